@@ -655,7 +655,7 @@ struct glusterfs_fs *glusterfs_get_fs(struct glexport_params params,
 	}
 
 	gl_fs->fs = fs;
-	gl_fs->volname = strdup(params.glvolname);
+	gl_fs->volname = gsh_strdup(params.glvolname);
 	gl_fs->destroy_mode = 0;
 	gl_fs->up_poll_usec = params.up_poll_usec;
 
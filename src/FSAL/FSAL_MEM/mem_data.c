@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file   FSAL_MEM/mem_data.c
+ *
+ * @brief Sparse file data
+ *
+ * The data of a regular file is kept in fixed size pages, indexed by their
+ * offset in an AVL tree.  Pages are only allocated when written to, or
+ * allocated explicitly, so ranges never written are holes that read as
+ * zeroes.  Every page is charged to the export of the file, which is
+ * limited with Max_Data_Size, or to half of the physical memory.
+ *
+ * Unless otherwise noted, callers must hold the data_lock of the file, for
+ * write if the pages are changed.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include "fsal.h"
+#include "mem_int.h"
+
+/**
+ * @brief A page of file data
+ */
+struct mem_page {
+	struct avltree_node node; /*< Entry in the file's pages tree */
+	uint64_t index; /*< Offset of the page / MEM_PAGE_SIZE */
+	char data[]; /*< MEM_PAGE_SIZE bytes of data */
+};
+
+static inline int mem_page_cmpf(const struct avltree_node *lhs,
+				const struct avltree_node *rhs)
+{
+	struct mem_page *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_page, node);
+	rk = avltree_container_of(rhs, struct mem_page, node);
+
+	if (lk->index < rk->index)
+		return -1;
+
+	if (lk->index == rk->index)
+		return 0;
+
+	return 1;
+}
+
+static struct mem_page *mem_page_lookup(struct mem_fsal_obj_handle *hdl,
+					uint64_t index)
+{
+	struct mem_page key;
+	struct avltree_node *node;
+
+	key.index = index;
+
+	node = avltree_lookup(&key.node, &hdl->mh_file.pages);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mem_page, node);
+}
+
+/**
+ * @brief Find the first page at or after an index
+ */
+static struct mem_page *mem_page_sup(struct mem_fsal_obj_handle *hdl,
+				     uint64_t index)
+{
+	struct mem_page key;
+	struct avltree_node *node;
+
+	key.index = index;
+
+	node = avltree_sup(&key.node, &hdl->mh_file.pages);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mem_page, node);
+}
+
+static struct mem_page *mem_page_next(struct mem_page *page)
+{
+	struct avltree_node *node = avltree_next(&page->node);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mem_page, node);
+}
+
+/**
+ * @brief Limit on the file data of an export
+ *
+ * @param[in] mfe	Export
+ *
+ * @return Max_Data_Size of the export, or the default limit if it is 0.
+ */
+uint64_t mem_data_limit(struct mem_fsal_export *mfe)
+{
+	uint64_t max = atomic_fetch_uint64_t(&mfe->max_data_size);
+
+	return max != 0 ? max : MEM.default_data_size;
+}
+
+/**
+ * @brief Charge pages to the export of a file
+ *
+ * @param[in] hdl	File the pages are for
+ * @param[in] count	Number of pages
+ *
+ * @return false if the export doesn't have room for them.
+ */
+static bool mem_page_charge(struct mem_fsal_obj_handle *hdl, uint64_t count)
+{
+	struct mem_fsal_export *mfe = hdl->mfo_exp;
+	uint64_t max = mem_data_limit(mfe);
+	uint64_t used;
+
+	if (count > max / MEM_PAGE_SIZE)
+		goto full;
+
+	used = atomic_add_uint64_t(&mfe->data_used, count * MEM_PAGE_SIZE);
+
+	if (used <= max)
+		return true;
+
+	atomic_sub_uint64_t(&mfe->data_used, count * MEM_PAGE_SIZE);
+
+full:
+	LogFullDebug(COMPONENT_FSAL,
+		     "%" PRIu64 " pages over export data limit %" PRIu64
+		     ", name=%s",
+		     count, max, hdl->m_name);
+	return false;
+}
+
+/**
+ * @brief Add a zeroed page already charged to the export
+ *
+ * @param[in] hdl	File the page is for
+ * @param[in] index	Index of the page
+ *
+ * @return The page.
+ */
+static struct mem_page *mem_page_insert(struct mem_fsal_obj_handle *hdl,
+					uint64_t index)
+{
+	struct mem_page *page;
+
+	page = gsh_calloc(1, sizeof(*page) + MEM_PAGE_SIZE);
+	page->index = index;
+
+	avltree_insert(&page->node, &hdl->mh_file.pages);
+	hdl->mh_file.npages++;
+	hdl->attrs.spaceused = hdl->mh_file.npages * MEM_PAGE_SIZE;
+
+	return page;
+}
+
+/**
+ * @brief Allocate a zeroed page, charging it to the export
+ *
+ * @param[in] hdl	File the page is for
+ * @param[in] index	Index of the page
+ *
+ * @return The page, or NULL if the export is out of space.
+ */
+static struct mem_page *mem_page_alloc(struct mem_fsal_obj_handle *hdl,
+				       uint64_t index)
+{
+	if (!mem_page_charge(hdl, 1))
+		return NULL;
+
+	return mem_page_insert(hdl, index);
+}
+
+static void mem_page_free(struct mem_fsal_obj_handle *hdl,
+			  struct mem_page *page)
+{
+	avltree_remove(&page->node, &hdl->mh_file.pages);
+	hdl->mh_file.npages--;
+	hdl->attrs.spaceused = hdl->mh_file.npages * MEM_PAGE_SIZE;
+
+	atomic_sub_uint64_t(&hdl->mfo_exp->data_used, MEM_PAGE_SIZE);
+	gsh_free(page);
+}
+
+/**
+ * @brief Initialize the data of a new regular file
+ *
+ * @param[in] hdl	File to initialize
+ */
+void mem_data_init(struct mem_fsal_obj_handle *hdl)
+{
+	PTHREAD_RWLOCK_init(&hdl->mh_file.data_lock, NULL);
+	avltree_init(&hdl->mh_file.pages, mem_page_cmpf, 0);
+	hdl->mh_file.npages = 0;
+}
+
+/**
+ * @brief Free all the data of a regular file being released
+ *
+ * The data_lock is destroyed, the caller must not hold it.
+ *
+ * @param[in] hdl	File being released
+ */
+void mem_data_free(struct mem_fsal_obj_handle *hdl)
+{
+	mem_data_truncate(hdl, 0);
+	PTHREAD_RWLOCK_destroy(&hdl->mh_file.data_lock);
+}
+
+/**
+ * @brief Read a range of a file, holes read as zeroes
+ *
+ * @param[in]  hdl	File to read
+ * @param[in]  offset	Offset to read at
+ * @param[out] buf	Buffer to read into
+ * @param[in]  len	Length to read
+ */
+void mem_data_read(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		   void *buf, size_t len)
+{
+	struct mem_page *page;
+	size_t in_page, count;
+
+	while (len > 0) {
+		in_page = offset % MEM_PAGE_SIZE;
+		count = MIN(len, MEM_PAGE_SIZE - in_page);
+
+		page = mem_page_lookup(hdl, offset / MEM_PAGE_SIZE);
+
+		if (page != NULL)
+			memcpy(buf, page->data + in_page, count);
+		else
+			memset(buf, 0, count);
+
+		buf += count;
+		offset += count;
+		len -= count;
+	}
+}
+
+/**
+ * @brief Write a range of a file, allocating pages as needed
+ *
+ * @param[in] hdl	File to write
+ * @param[in] offset	Offset to write at
+ * @param[in] buf	Data to write
+ * @param[in] len	Length to write
+ *
+ * @return The number of bytes written, less than len if the export ran out
+ *         of space.
+ */
+size_t mem_data_write(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		      const void *buf, size_t len)
+{
+	struct mem_page *page;
+	size_t in_page, count, written = 0;
+
+	while (written < len) {
+		in_page = offset % MEM_PAGE_SIZE;
+		count = MIN(len - written, MEM_PAGE_SIZE - in_page);
+
+		page = mem_page_lookup(hdl, offset / MEM_PAGE_SIZE);
+
+		if (page == NULL)
+			page = mem_page_alloc(hdl, offset / MEM_PAGE_SIZE);
+
+		if (page == NULL)
+			break;
+
+		memcpy(page->data + in_page, buf + written, count);
+
+		offset += count;
+		written += count;
+	}
+
+	return written;
+}
+
+/**
+ * @brief Allocate the pages backing a range of a file
+ *
+ * @param[in] hdl	File to allocate in
+ * @param[in] offset	Start of the range
+ * @param[in] len	Length of the range
+ *
+ * The pages the range is missing are charged to the export all at once,
+ * so a range that can't fit in the space left fails before any page is
+ * allocated, whatever its size.
+ *
+ * @return false if the export ran out of space, nothing was allocated.
+ */
+bool mem_data_allocate(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		       uint64_t len)
+{
+	struct mem_page *page;
+	uint64_t index, first, last, needed;
+
+	if (len == 0)
+		return true;
+
+	first = offset / MEM_PAGE_SIZE;
+	last = (offset + len - 1) / MEM_PAGE_SIZE;
+
+	/* The pages of the range the file doesn't have yet */
+	needed = last - first + 1;
+	for (page = mem_page_sup(hdl, first);
+	     page != NULL && page->index <= last; page = mem_page_next(page))
+		needed--;
+
+	if (needed == 0)
+		return true;
+
+	if (!mem_page_charge(hdl, needed))
+		return false;
+
+	for (index = first; needed != 0; index++) {
+		if (mem_page_lookup(hdl, index) != NULL)
+			continue;
+
+		(void)mem_page_insert(hdl, index);
+		needed--;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Punch a hole in a range of a file
+ *
+ * Pages entirely in the range are freed, the part of the range in other
+ * pages is zeroed.
+ *
+ * @param[in] hdl	File to deallocate in
+ * @param[in] offset	Start of the range
+ * @param[in] len	Length of the range
+ */
+void mem_data_deallocate(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+			 uint64_t len)
+{
+	struct mem_page *page, *next;
+	uint64_t end, start, stop;
+
+	if (len > UINT64_MAX - offset)
+		end = UINT64_MAX;
+	else
+		end = offset + len;
+
+	for (page = mem_page_sup(hdl, offset / MEM_PAGE_SIZE); page != NULL;
+	     page = next) {
+		start = page->index * MEM_PAGE_SIZE;
+
+		if (start >= end)
+			break;
+
+		next = mem_page_next(page);
+
+		if (offset <= start && end - start >= MEM_PAGE_SIZE) {
+			mem_page_free(hdl, page);
+			continue;
+		}
+
+		stop = MIN(end - start, MEM_PAGE_SIZE);
+
+		if (offset > start)
+			start = offset - start;
+		else
+			start = 0;
+
+		memset(page->data + start, 0, stop - start);
+	}
+}
+
+/**
+ * @brief Discard the data past a new end of file
+ *
+ * @param[in] hdl	File being truncated
+ * @param[in] size	New size of the file
+ */
+void mem_data_truncate(struct mem_fsal_obj_handle *hdl, uint64_t size)
+{
+	struct mem_page *page, *next;
+	size_t tail = size % MEM_PAGE_SIZE;
+
+	for (page = mem_page_sup(hdl, size / MEM_PAGE_SIZE + (tail != 0));
+	     page != NULL; page = next) {
+		next = mem_page_next(page);
+		mem_page_free(hdl, page);
+	}
+
+	/* A page straddling the end of file must not bring back old data
+	 * should the file grow again.
+	 */
+	if (tail != 0) {
+		page = mem_page_lookup(hdl, size / MEM_PAGE_SIZE);
+
+		if (page != NULL)
+			memset(page->data + tail, 0, MEM_PAGE_SIZE - tail);
+	}
+}
+
+/**
+ * @brief Find the next data or hole in a file
+ *
+ * @param[in] hdl	File to search
+ * @param[in] offset	Offset to search from
+ * @param[in] data	Search for data if true, for a hole otherwise
+ *
+ * @return Offset of the data or hole, UINT64_MAX if there is no more data.
+ *         The caller clamps the result to the size of the file.
+ */
+uint64_t mem_data_seek(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		       bool data)
+{
+	uint64_t index = offset / MEM_PAGE_SIZE;
+	struct mem_page *page;
+
+	if (data) {
+		page = mem_page_sup(hdl, index);
+
+		if (page == NULL)
+			return UINT64_MAX;
+
+		if (page->index == index)
+			return offset;
+
+		return page->index * MEM_PAGE_SIZE;
+	}
+
+	page = mem_page_lookup(hdl, index);
+
+	if (page == NULL)
+		return offset;
+
+	/* Skip the run of contiguous pages */
+	while (page != NULL && page->index == index) {
+		index++;
+		page = mem_page_next(page);
+	}
+
+	return index * MEM_PAGE_SIZE;
+}
@@ -94,9 +94,15 @@ static fsal_status_t mem_get_dynamic_info(struct fsal_export *exp_hdl,
 					  struct fsal_obj_handle *obj_hdl,
 					  fsal_dynamicfsinfo_t *infop)
 {
-	infop->total_bytes = 0;
-	infop->free_bytes = 0;
-	infop->avail_bytes = 0;
+	struct mem_fsal_export *myself =
+		container_of(exp_hdl, struct mem_fsal_export, export);
+	uint64_t max = mem_data_limit(myself);
+	uint64_t used = atomic_fetch_uint64_t(&myself->data_used);
+
+	/* Report the data limit as the size of the filesystem */
+	infop->total_bytes = max;
+	infop->free_bytes = max > used ? max - used : 0;
+	infop->avail_bytes = infop->free_bytes;
 	infop->total_files = 0;
 	infop->free_files = 0;
 	infop->avail_files = 0;
@@ -254,6 +260,8 @@ static struct config_item mem_export_params[] = {
 			mem_fsal_export, async_type),
 	CONF_ITEM_UI32("Async_Stall_Delay", 0, 1000, 0, mem_fsal_export,
 		       async_stall_delay),
+	CONF_ITEM_UI64("Max_Data_Size", 0, UINT64_MAX, 0, mem_fsal_export,
+		       max_data_size),
 	CONFIG_EOL
 };
 
@@ -384,6 +392,7 @@ fsal_status_t mem_update_export(struct fsal_module *fsal_hdl, void *parse_node,
 	atomic_store_uint32_t(&orig->async_stall_delay,
 			      myself.async_stall_delay);
 	atomic_store_uint32_t(&orig->async_type, myself.async_type);
+	atomic_store_uint64_t(&orig->max_data_size, myself.max_data_size);
 
 	LogEvent(COMPONENT_FSAL,
 		 "Updated FSAL_MEM aync parameters type=%s, delay=%" PRIu32
@@ -391,5 +400,10 @@ fsal_status_t mem_update_export(struct fsal_module *fsal_hdl, void *parse_node,
 		 str_async_type(myself.async_type), myself.async_delay,
 		 myself.async_stall_delay);
 
+	LogEvent(COMPONENT_FSAL,
+		 "Updated FSAL_MEM data limit %" PRIu64 ", %" PRIu64 " in use",
+		 myself.max_data_size,
+		 atomic_fetch_uint64_t(&orig->data_used));
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -120,6 +120,7 @@ static void mem_cleanup(struct mem_fsal_obj_handle *myself)
 		mem_clean_all_dirents(myself);
 		break;
 	case REGULAR_FILE:
+		mem_data_free(myself);
 		break;
 	case SYMBOLIC_LINK:
 		gsh_free(myself->mh_symlink.link_contents);
@@ -317,7 +318,7 @@ static void mem_insert_obj(struct mem_fsal_obj_handle *parent,
 	mem_int_get_ref(child);
 	dirent->dir = parent;
 	dirent->d_name = gsh_strdup(name);
-	/* Index is hash of the name */
+	/* Index is hash of the name, made unique on insertion */
 	dirent->d_index = CityHash64(name, strlen(name));
 
 	/* Link into child */
@@ -333,8 +334,20 @@ static void mem_insert_obj(struct mem_fsal_obj_handle *parent,
 
 	/* Name tree */
 	avltree_insert(&dirent->avl_n, &parent->mh_dir.avl_name);
-	/* Index tree */
-	avltree_insert(&dirent->avl_i, &parent->mh_dir.avl_index);
+	/* Index tree.  The index is the readdir cookie, so on a hash
+	 * collision probe for a free one, skipping the cookies reserved for
+	 * the start of the directory and the one used for its end.
+	 */
+	for (;;) {
+		if (dirent->d_index < 3 || dirent->d_index == UINT64_MAX)
+			dirent->d_index = 3;
+
+		if (avltree_insert(&dirent->avl_i,
+				   &parent->mh_dir.avl_index) == NULL)
+			break;
+
+		dirent->d_index++;
+	}
 	/* Update numkids */
 	numkids = atomic_inc_uint32_t(&parent->mh_dir.numkids);
 	LogFullDebug(COMPONENT_FSAL, "%s numkids %" PRIu32, parent->m_name,
@@ -704,20 +717,12 @@ static struct mem_fsal_obj_handle *_mem_alloc_handle(
 	struct fsal_attrlist *parent_post_attrs_out, const char *func, int line)
 {
 	struct mem_fsal_obj_handle *hdl;
-	size_t isize;
-
-	isize = sizeof(struct mem_fsal_obj_handle);
-	if (type == REGULAR_FILE) {
-		/* Regular files need space to read/write */
-		isize += MEM.inode_size;
-	}
 
-	hdl = gsh_calloc(1, isize);
+	hdl = gsh_calloc(1, sizeof(struct mem_fsal_obj_handle));
 
 	/* Establish tree details for this directory */
 	hdl->m_name = gsh_strdup(name);
 	hdl->obj_handle.fileid = atomic_postinc_uint64_t(&mem_inode_number);
-	hdl->datasize = MEM.inode_size;
 	glist_init(&hdl->dirents);
 	PTHREAD_RWLOCK_wrlock(&mfe->mfe_exp_lock);
 	glist_add_tail(&mfe->mfe_objs, &hdl->mfo_exp_entry);
@@ -773,13 +778,13 @@ static struct mem_fsal_obj_handle *_mem_alloc_handle(
 
 	switch (type) {
 	case REGULAR_FILE:
-		if ((attrs && attrs->valid_mask & ATTR_SIZE) != 0) {
+		/* Data is sparse, nothing is allocated until written */
+		mem_data_init(hdl);
+		if ((attrs && attrs->valid_mask & ATTR_SIZE) != 0)
 			hdl->attrs.filesize = attrs->filesize;
-			hdl->attrs.spaceused = attrs->filesize;
-		} else {
+		else
 			hdl->attrs.filesize = 0;
-			hdl->attrs.spaceused = 0;
-		}
+		hdl->attrs.spaceused = 0;
 		hdl->attrs.numlinks = 1;
 		break;
 	case BLOCK_FILE:
@@ -1264,7 +1269,22 @@ fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl, bool bypass,
 		return fsalstat(ERR_FSAL_INVAL, EINVAL);
 	}
 
-	mem_copy_attrs_mask(attrs_set, &myself->attrs);
+	if (obj_hdl->type != REGULAR_FILE) {
+		mem_copy_attrs_mask(attrs_set, &myself->attrs);
+	} else {
+		/* Size and space used follow the data pages */
+		PTHREAD_RWLOCK_wrlock(&myself->mh_file.data_lock);
+
+		if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_SIZE) &&
+		    attrs_set->filesize < myself->attrs.filesize)
+			mem_data_truncate(myself, attrs_set->filesize);
+
+		mem_copy_attrs_mask(attrs_set, &myself->attrs);
+		myself->attrs.spaceused =
+			myself->mh_file.npages * MEM_PAGE_SIZE;
+
+		PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+	}
 
 	GSH_AUTO_TRACEPOINT(
 		fsalmem, mem_setattrs, TRACE_DEBUG,
@@ -1617,8 +1637,12 @@ static fsal_status_t mem_open2_by_handle(struct fsal_obj_handle *obj_hdl,
 		bump_fd_lru(my_fd);
 	}
 
-	if (truncated)
-		myself->attrs.filesize = myself->attrs.spaceused = 0;
+	if (truncated) {
+		PTHREAD_RWLOCK_wrlock(&myself->mh_file.data_lock);
+		mem_data_truncate(myself, 0);
+		myself->attrs.filesize = 0;
+		PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+	}
 
 	/* Now check verifier for exclusive, but not for
 	 * FSAL_EXCLUSIVE_9P.
@@ -2009,6 +2033,8 @@ void mem_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
 
 	read_arg->io_amount = 0;
 
+	PTHREAD_RWLOCK_rdlock(&myself->mh_file.data_lock);
+
 	for (i = 0; i < read_arg->iov_count; i++) {
 		size_t bufsize;
 
@@ -2022,23 +2048,14 @@ void mem_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
 		if (offset + bufsize > myself->attrs.filesize) {
 			bufsize = myself->attrs.filesize - offset;
 		}
-		if (offset < myself->datasize) {
-			size_t readsize;
-
-			/* Data to read */
-			readsize = MIN(bufsize, myself->datasize - offset);
-			memcpy(read_arg->iov[i].iov_base, myself->data + offset,
-			       readsize);
-			if (readsize < bufsize)
-				memset(read_arg->iov[i].iov_base + readsize,
-				       'a', bufsize - readsize);
-		} else {
-			memset(read_arg->iov[i].iov_base, 'a', bufsize);
-		}
+		mem_data_read(myself, offset, read_arg->iov[i].iov_base,
+			      bufsize);
 		read_arg->io_amount += bufsize;
 		offset += bufsize;
 	}
 
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
 	GSH_AUTO_TRACEPOINT(
 		fsalmem, mem_read, TRACE_DEBUG,
 		"Read. Handle: {}, name: {}, state: {}, size: {}, spaceused: {}",
@@ -2167,24 +2184,28 @@ void mem_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
 		goto exit;
 	}
 
+	PTHREAD_RWLOCK_wrlock(&myself->mh_file.data_lock);
+
 	for (i = 0; i < write_arg->iov_count; i++) {
-		size_t bufsize;
+		size_t bufsize, written;
 
 		bufsize = write_arg->iov[i].iov_len;
-		if (offset + bufsize > myself->attrs.filesize) {
-			myself->attrs.filesize = myself->attrs.spaceused =
-				offset + bufsize;
-		}
-		if (offset < myself->datasize) {
-			size_t writesize;
+		written = mem_data_write(myself, offset,
+					 write_arg->iov[i].iov_base, bufsize);
+		if (offset + written > myself->attrs.filesize)
+			myself->attrs.filesize = offset + written;
+		write_arg->io_amount += written;
+		offset += written;
+
+		if (written < bufsize)
+			break;
+	}
 
-			/* Data to write */
-			writesize = MIN(bufsize, myself->datasize - offset);
-			memcpy(myself->data + offset,
-			       write_arg->iov[i].iov_base, writesize);
-		}
-		write_arg->io_amount += bufsize;
-		offset += bufsize;
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
+	if (write_arg->io_amount == 0 && i < write_arg->iov_count) {
+		/* The export is out of space, nothing could be written */
+		status = fsalstat(ERR_FSAL_NOSPC, ENOSPC);
 	}
 
 	GSH_AUTO_TRACEPOINT(
@@ -2202,7 +2223,7 @@ void mem_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
 	 */
 	myself->attrs.change = timespec_to_nsecs(&myself->attrs.mtime);
 
-	if (MEM.async_threads > 0 &&
+	if (MEM.async_threads > 0 && !FSAL_IS_ERROR(status) &&
 	    (async_type > MEM_RANDOM_OR_INLINE ||
 	     ((async_type == MEM_RANDOM_OR_INLINE) && ((random() % 1) == 1)))) {
 		struct mem_async_arg *async_arg;
@@ -2248,7 +2269,7 @@ void mem_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
 
 exit:
 
-	done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg, caller_arg);
+	done_cb(obj_hdl, status, write_arg, caller_arg);
 
 	destroy_fsal_fd(&async_arg->temp_fd);
 
@@ -2288,6 +2309,151 @@ fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Seek to data or hole
+ *
+ * @param[in]     obj_hdl   File on which to operate
+ * @param[in]     state     state_t to use for this operation
+ * @param[in,out] info      Information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t mem_seek2(struct fsal_obj_handle *obj_hdl, struct state_t *state,
+			struct io_info *info)
+{
+	struct mem_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	uint64_t offset = info->io_content.hole.di_offset;
+	uint64_t filesize, ret;
+	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
+
+	if (info->io_content.what != NFS4_CONTENT_DATA &&
+	    info->io_content.what != NFS4_CONTENT_HOLE)
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mh_file.data_lock);
+
+	filesize = myself->attrs.filesize;
+
+	/* RFC7862 15.11.3,
+	 * If the sa_offset is beyond the end of the file,
+	 * then SEEK MUST return NFS4ERR_NXIO. */
+	if (offset >= filesize) {
+		status = posix2fsal_status(ENXIO);
+		goto out;
+	}
+
+	ret = mem_data_seek(myself, offset,
+			    info->io_content.what == NFS4_CONTENT_DATA);
+
+	if (info->io_content.what == NFS4_CONTENT_DATA && ret >= filesize) {
+		/* No more data */
+		info->io_eof = TRUE;
+		goto out;
+	}
+
+	/* There is always a hole at the end of file */
+	ret = MIN(ret, filesize);
+
+	info->io_eof = (ret >= filesize);
+	info->io_content.hole.di_offset = ret;
+
+out:
+
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
+	return status;
+}
+
+/**
+ * @brief Reserve/Deallocate space in a region of a file
+ *
+ * @param[in] obj_hdl File to which bytes should be allocated
+ * @param[in] state   open stateid under which to do the allocation
+ * @param[in] offset  offset at which to begin the allocation
+ * @param[in] length  length of the data to be allocated
+ * @param[in] allocate Should space be allocated or deallocated?
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t mem_fallocate(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state, uint64_t offset,
+			    uint64_t length, bool allocate)
+{
+	struct mem_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	fsal_status_t status, status2;
+	struct fsal_fd temp_fd;
+	struct fsal_fd *out_fd;
+
+	if (allocate && (offset > MEM.fsal.fs_info.maxfilesize ||
+			 length > MEM.fsal.fs_info.maxfilesize - offset))
+		return fsalstat(ERR_FSAL_FBIG, EFBIG);
+
+	init_fsal_fd(&temp_fd, FSAL_FD_TEMP, op_ctx->fsal_export);
+
+	/* Indicate a desire to start io and get a usable file descritor */
+	status = fsal_start_io(&out_fd, obj_hdl, &myself->mh_file.fd, &temp_fd,
+			       state, FSAL_O_WRITE, false, NULL, false,
+			       &myself->mh_file.share);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "fsal_start_io failed returning %s",
+			     fsal_err_txt(status));
+		goto exit;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&myself->mh_file.data_lock);
+
+	if (!allocate) {
+		mem_data_deallocate(myself, offset, length);
+	} else if (mem_data_allocate(myself, offset, length)) {
+		if (offset + length > myself->attrs.filesize)
+			myself->attrs.filesize = offset + length;
+	} else {
+		status = fsalstat(ERR_FSAL_NOSPC, ENOSPC);
+	}
+
+	if (!FSAL_IS_ERROR(status)) {
+		/* Update change stats */
+		now(&myself->attrs.mtime);
+		myself->attrs.ctime = myself->attrs.mtime;
+		myself->attrs.change = timespec_to_nsecs(&myself->attrs.mtime);
+	}
+
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "%s %" PRIu64 "+%" PRIu64 " name=%s returned %s",
+		     allocate ? "allocate" : "deallocate", offset, length,
+		     myself->m_name, fsal_err_txt(status));
+
+	status2 = fsal_complete_io(obj_hdl, out_fd);
+
+	LogFullDebug(COMPONENT_FSAL, "fsal_complete_io returned %s",
+		     fsal_err_txt(status2));
+
+	if (state == NULL) {
+		/* We did I/O without a state so we need to release the temp
+		 * share reservation acquired.
+		 */
+
+		/* Release the share reservation now by updating the counters.
+		 */
+		update_share_counters_locked(obj_hdl, &myself->mh_file.share,
+					     FSAL_O_WRITE, FSAL_O_CLOSED);
+	}
+
+exit:
+
+	destroy_fsal_fd(&temp_fd);
+
+	return status;
+}
+
 /**
  * @brief Manage closing a file when a state is no longer needed.
  *
@@ -2512,6 +2678,8 @@ void mem_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->read2 = mem_read2;
 	ops->write2 = mem_write2;
 	ops->commit2 = mem_commit2;
+	ops->seek2 = mem_seek2;
+	ops->fallocate = mem_fallocate;
 	ops->close2 = mem_close2;
 	ops->close_func = mem_close_func;
 	ops->reopen_func = mem_reopen_func;
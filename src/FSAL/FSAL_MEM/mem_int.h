@@ -66,6 +66,10 @@ struct mem_fsal_export {
 	uint32_t async_stall_delay;
 	/** Type of async */
 	uint32_t async_type;
+	/** Config - limit on file data stored in this export, 0 for none */
+	uint64_t max_data_size;
+	/** Bytes of file data pages allocated in this export */
+	uint64_t data_used;
 };
 
 fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl, const char *path,
@@ -104,6 +108,12 @@ struct mem_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct fsal_fd fd;
+			/** Protects pages, npages and filesize */
+			pthread_rwlock_t data_lock;
+			/** Data pages, by index */
+			struct avltree pages;
+			/** Number of pages allocated */
+			uint64_t npages;
 		} mh_file;
 		struct {
 			object_file_type_t nodetype;
@@ -117,10 +127,8 @@ struct mem_fsal_obj_handle {
 	struct glist_head mfo_exp_entry; /**< Link into mfs_objs */
 	struct mem_fsal_export *mfo_exp; /**< Export owning object */
 	char *m_name; /**< Base name of obj, for debugging */
-	uint32_t datasize;
 	bool is_export;
 	uint32_t refcount; /**< We persist handles, so we need a refcount */
-	char data[0]; /* Allocated data */
 };
 
 /**
@@ -148,6 +156,27 @@ static inline bool mem_unopenable_type(object_file_type_t type)
 
 void mem_handle_ops_init(struct fsal_obj_ops *ops);
 
+/* File data, in sparse pages
+ */
+
+/** Size of a data page of a file */
+#define MEM_PAGE_SIZE (64 * 1024)
+
+uint64_t mem_data_limit(struct mem_fsal_export *mfe);
+void mem_data_init(struct mem_fsal_obj_handle *hdl);
+void mem_data_free(struct mem_fsal_obj_handle *hdl);
+void mem_data_read(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		   void *buf, size_t len);
+size_t mem_data_write(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		      const void *buf, size_t len);
+bool mem_data_allocate(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		       uint64_t len);
+void mem_data_deallocate(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+			 uint64_t len);
+void mem_data_truncate(struct mem_fsal_obj_handle *hdl, uint64_t size);
+uint64_t mem_data_seek(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+		       bool data);
+
 /* Internal MEM method linkage to export object
 */
 
@@ -202,7 +231,7 @@ struct mem_fsal_module {
 	struct fsal_obj_ops handle_ops;
 	/** List of MEM exports. TODO Locking when we care */
 	struct glist_head mem_exports;
-	/** Config - size of data in inode */
+	/** Config - size of data in inode, no longer used */
 	uint32_t inode_size;
 	/** Config - Interval for UP call thread */
 	uint32_t up_interval;
@@ -212,6 +241,9 @@ struct mem_fsal_module {
 	uint32_t async_threads;
 	/** Config - whether so use whence-is-name */
 	bool whence_is_name;
+	/** Limit on file data of exports without Max_Data_Size, half of
+	 *  the physical memory */
+	uint64_t default_data_size;
 };
 
 /* ASYNC testing */
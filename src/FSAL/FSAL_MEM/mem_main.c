@@ -34,6 +34,7 @@
 #include <pthread.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include "FSAL/fsal_init.h"
 #include "mem_int.h"
@@ -46,6 +47,9 @@
 /* defined the set of attributes supported with POSIX */
 #define MEM_SUPPORTED_ATTRIBUTES (ATTRS_POSIX)
 
+/* Default export data limit when the physical memory size is unknown */
+#define MEM_DEFAULT_DATA_SIZE (1024ULL * 1024 * 1024)
+
 static const char memname[] = "MEM";
 
 /* my module private storage */
@@ -183,6 +187,7 @@ static fsal_status_t mem_init_config(struct fsal_module *fsal_hdl,
 	struct mem_fsal_module *mem_me =
 		container_of(fsal_hdl, struct mem_fsal_module, fsal);
 	fsal_status_t status = { 0, 0 };
+	long pages, page_size;
 
 	LogDebug(COMPONENT_FSAL, "MEM module setup.");
 	LogFullDebug(COMPONENT_FSAL,
@@ -219,6 +224,20 @@ static fsal_status_t mem_init_config(struct fsal_module *fsal_hdl,
 	/* Set whence_is_name in fsinfo */
 	mem_me->fsal.fs_info.whence_is_name = mem_me->whence_is_name;
 
+	/* Keep exports without Max_Data_Size from exhausting memory */
+	pages = sysconf(_SC_PHYS_PAGES);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	if (pages > 0 && page_size > 0)
+		mem_me->default_data_size =
+			(uint64_t)pages * (uint64_t)page_size / 2;
+	else
+		mem_me->default_data_size = MEM_DEFAULT_DATA_SIZE;
+
+	LogInfo(COMPONENT_FSAL,
+		"Default export data limit %" PRIu64 " bytes",
+		mem_me->default_data_size);
+
 	display_fsinfo(&mem_me->fsal);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/ds.c
+ * @brief pNFS data server operations for FSAL_VFS
+ *
+ * DS handles are plain VFS handles of the backing filesystem, as handed out
+ * by a VFS flex files MDS (see mds.c).  The file is opened when the first
+ * READ or WRITE arrives, and the descriptor is kept for the lifetime of the
+ * handle.  Each READ or WRITE must carry a stateid signed by the MDS, of a
+ * layout the MDS still records as held on the file, that allows the I/O.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "../fsal_private.h"
+#include "nfs_convert.h"
+#include "vfs_methods.h"
+#include "nfs_exports.h"
+#include "pnfs_utils.h"
+
+/**
+ * @brief VFS private DS handle
+ */
+struct vfs_ds_handle {
+	struct fsal_ds_handle ds;
+	struct vfs_fsal_module *module; /*< Module holding the PNFS_Key */
+	struct fsal_filesystem *fs; /*< Filesystem of the handle */
+	vfs_file_handle_t fh; /*< The handle, as the MDS handed it out */
+	int fd; /*< Kernel file descriptor, -1 until opened */
+	int openflags; /*< O_RDONLY, O_WRONLY or O_RDWR */
+	stable_how4 stability_got; /*< Stability of the last write */
+};
+
+/**
+ * @brief Open the file for an I/O and check the stateid of the I/O
+ *
+ * @param[in] ds      The DS handle
+ * @param[in] stateid The stateid supplied with the I/O, NULL for a COMMIT
+ * @param[in] iomode  LAYOUTIOMODE4_READ or LAYOUTIOMODE4_RW
+ *
+ * @return An NFSv4.1 status code.
+ */
+static nfsstat4 vfs_ds_open(struct vfs_ds_handle *ds, const stateid4 *stateid,
+			    layoutiomode4 iomode)
+{
+	struct gsh_buffdesc fh_desc = { .addr = ds->fh.handle_data,
+					.len = ds->fh.handle_len };
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	int openflags = iomode == LAYOUTIOMODE4_RW ? O_WRONLY : O_RDONLY;
+	int fd;
+
+	if (ds->fd < 0 || (stateid != NULL && ds->openflags != O_RDWR &&
+			   ds->openflags != openflags)) {
+		/* Both read and written through this handle */
+		if (ds->fd >= 0)
+			openflags = O_RDWR;
+
+		fd = vfs_open_by_handle(ds->fs, &ds->fh, openflags,
+					&fsal_error);
+
+		if (fd < 0) {
+			LogDebug(COMPONENT_PNFS, "Could not open DS handle: %s",
+				 msg_fsal_err(fsal_error));
+			return nfs4_Errno_status(fsalstat(fsal_error, 0));
+		}
+
+		if (ds->fd >= 0)
+			close(ds->fd);
+
+		ds->fd = fd;
+		ds->openflags = openflags;
+	}
+
+	if (stateid == NULL)
+		return NFS4_OK;
+
+	/* The layouts held on the file are checked on every I/O, so that
+	 * the I/O stops as soon as its layout is returned or revoked.
+	 */
+	return vfs_pnfs_check_ds_stateid(ds->module, ds->fd, &fh_desc, stateid,
+					 iomode);
+}
+
+/**
+ * @brief Release a DS handle
+ *
+ * @param[in] ds_pub The object to release
+ */
+static void vfs_dsh_release(struct fsal_ds_handle *const ds_pub)
+{
+	struct vfs_ds_handle *ds = container_of(ds_pub, struct vfs_ds_handle,
+						ds);
+
+	if (ds->fd >= 0)
+		close(ds->fd);
+
+	gsh_free(ds);
+}
+
+/**
+ * @brief Read from a data-server handle.
+ *
+ * @param[in]  ds_pub           FSAL DS handle
+ * @param[in]  stateid          The stateid supplied with the READ operation,
+ *                              for validation
+ * @param[in]  offset           The offset at which to read
+ * @param[in]  requested_length Length of read requested (and size of buffer)
+ * @param[out] buffer           The buffer to which to store read data
+ * @param[out] supplied_length  Length of data read
+ * @param[out] end_of_file      True on end of file
+ *
+ * @return An NFSv4.1 status code.
+ */
+static nfsstat4 vfs_ds_read(struct fsal_ds_handle *const ds_pub,
+			    const stateid4 *stateid, const offset4 offset,
+			    const count4 requested_length, void *const buffer,
+			    count4 *const supplied_length,
+			    bool *const end_of_file)
+{
+	struct vfs_ds_handle *ds = container_of(ds_pub, struct vfs_ds_handle,
+						ds);
+	ssize_t nb_read;
+	nfsstat4 nfs_status;
+
+	nfs_status = vfs_ds_open(ds, stateid, LAYOUTIOMODE4_READ);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	nb_read = pread(ds->fd, buffer, requested_length, offset);
+
+	if (nb_read < 0) {
+		int retval = errno;
+
+		LogDebug(COMPONENT_PNFS, "DS read failed: %s",
+			 strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	*supplied_length = nb_read;
+	*end_of_file = nb_read < requested_length;
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Write to a data-server handle.
+ *
+ * @param[in]  ds_pub           FSAL DS handle
+ * @param[in]  stateid          The stateid supplied with the WRITE
+ *                              operation, for validation
+ * @param[in]  offset           The offset at which to write
+ * @param[in]  write_length     Length of write requested (and size of buffer)
+ * @param[in]  buffer           The buffer from which to write data
+ * @param[in]  stability_wanted Stability of write
+ * @param[out] written_length   Length of data written
+ * @param[out] writeverf        Write verifier
+ * @param[out] stability_got    Stability used for write (must be as
+ *                              or more stable than request)
+ *
+ * @return An NFSv4.1 status code.
+ */
+static nfsstat4 vfs_ds_write(struct fsal_ds_handle *const ds_pub,
+			     const stateid4 *stateid, const offset4 offset,
+			     const count4 write_length, const void *buffer,
+			     const stable_how4 stability_wanted,
+			     count4 *const written_length,
+			     verifier4 *const writeverf,
+			     stable_how4 *const stability_got)
+{
+	struct vfs_ds_handle *ds = container_of(ds_pub, struct vfs_ds_handle,
+						ds);
+	struct gsh_buffdesc verf_desc = { .addr = writeverf,
+					  .len = sizeof(verifier4) };
+	ssize_t nb_written;
+	nfsstat4 nfs_status;
+
+	nfs_status = vfs_ds_open(ds, stateid, LAYOUTIOMODE4_RW);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	nb_written = pwrite(ds->fd, buffer, write_length, offset);
+
+	if (nb_written < 0) {
+		int retval = errno;
+
+		LogDebug(COMPONENT_PNFS, "DS write failed: %s",
+			 strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	if (stability_wanted != UNSTABLE4 && fdatasync(ds->fd) < 0) {
+		int retval = errno;
+
+		LogDebug(COMPONENT_PNFS, "DS fdatasync failed: %s",
+			 strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	*written_length = nb_written;
+	*stability_got = stability_wanted;
+	ds->stability_got = stability_wanted;
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Commit a byte range to a DS handle.
+ *
+ * @param[in]  ds_pub    FSAL DS handle
+ * @param[in]  offset    Start of commit window
+ * @param[in]  count     Length of commit window
+ * @param[out] writeverf Write verifier
+ *
+ * @return An NFSv4.1 status code.
+ */
+static nfsstat4 vfs_ds_commit(struct fsal_ds_handle *const ds_pub,
+			      const offset4 offset, const count4 count,
+			      verifier4 *const writeverf)
+{
+	struct vfs_ds_handle *ds = container_of(ds_pub, struct vfs_ds_handle,
+						ds);
+	struct gsh_buffdesc verf_desc = { .addr = writeverf,
+					  .len = sizeof(verifier4) };
+	nfsstat4 nfs_status;
+
+	/* COMMIT carries no stateid, it only flushes what was already
+	 * written with one, so any descriptor will do.
+	 */
+	nfs_status = vfs_ds_open(ds, NULL, LAYOUTIOMODE4_READ);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	if (ds->stability_got != FILE_SYNC4 && fdatasync(ds->fd) < 0) {
+		int retval = errno;
+
+		LogDebug(COMPONENT_PNFS, "DS fdatasync failed: %s",
+			 strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Create a FSAL data server handle from a wire handle
+ *
+ * This is also where validation gets done, since PUTFH is the only
+ * operation that can return NFS4ERR_BADHANDLE.  The file is only opened
+ * once a READ or WRITE shows a stateid for it.
+ *
+ * @param[in]  pds      FSAL pNFS DS
+ * @param[in]  hdl_desc Buffer from which to create the handle
+ * @param[out] handle   FSAL DS handle
+ * @param[in]  flags    Handle flags
+ *
+ * @return NFSv4.1 error codes.
+ */
+static nfsstat4 vfs_make_ds_handle(struct fsal_pnfs_ds *const pds,
+				   const struct gsh_buffdesc *const hdl_desc,
+				   struct fsal_ds_handle **const handle,
+				   int flags)
+{
+	struct vfs_ds_handle *ds;
+	struct fsal_filesystem *fs;
+	fsal_status_t status;
+	bool dummy;
+
+	vfs_file_handle_t *fh = NULL;
+
+	vfs_alloc_handle(fh);
+
+	*handle = NULL;
+
+	status = vfs_check_handle(pds->mds_fsal_export,
+				  (struct gsh_buffdesc *)hdl_desc, &fs, fh,
+				  &dummy);
+
+	if (FSAL_IS_ERROR(status) || dummy)
+		return NFS4ERR_BADHANDLE;
+
+	ds = gsh_calloc(1, sizeof(struct vfs_ds_handle));
+	ds->module = container_of(pds->mds_fsal_export->fsal,
+				  struct vfs_fsal_module, module);
+	ds->fs = fs;
+	ds->fh = *fh;
+	ds->fd = -1;
+	ds->stability_got = UNSTABLE4;
+
+	*handle = &ds->ds;
+
+	return NFS4_OK;
+}
+
+void vfs_pnfs_ds_ops_init(struct fsal_pnfs_ds_ops *ops)
+{
+	memcpy(ops, &def_pnfs_ds_ops, sizeof(struct fsal_pnfs_ds_ops));
+	ops->make_ds_handle = vfs_make_ds_handle;
+	ops->dsh_release = vfs_dsh_release;
+	ops->dsh_read = vfs_ds_read;
+	ops->dsh_write = vfs_ds_write;
+	ops->dsh_commit = vfs_ds_commit;
+}
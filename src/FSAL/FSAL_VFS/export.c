@@ -78,6 +78,7 @@ static void release(struct fsal_export *exp_hdl)
 	}
 
 	vfs_sub_fini(myself);
+	vfs_pnfs_release(&myself->pnfs_param);
 
 	unclaim_all_export_maps(exp_hdl);
 
@@ -457,12 +458,20 @@ fsal_status_t vfs_create_export(struct fsal_module *fsal_hdl, void *parse_node,
 
 	myself->export.up_ops = up_ops;
 
+	retval = vfs_pnfs_init_export(myself);
+	if (retval != 0) {
+		fsal_status = posix2fsal_status(retval);
+		op_ctx->fsal_export = NULL;
+		goto err_cleanup;
+	}
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
 err_cleanup:
 	unclaim_all_export_maps(&myself->export);
 	fsal_detach_export(fsal_hdl, &myself->export.exports);
 err_free:
+	vfs_pnfs_release(&myself->pnfs_param);
 	free_export_ops(&myself->export);
 	gsh_free(myself); /* elvis has left the building */
 	return fsal_status;
@@ -534,6 +543,15 @@ fsal_status_t vfs_update_export(struct fsal_module *fsal_hdl, void *parse_node,
 		invalid = true;
 	}
 
+	if (orig->pnfs_param.nb_ds != myself.pnfs_param.nb_ds ||
+	    orig->pnfs_param.stripe_unit != myself.pnfs_param.stripe_unit ||
+	    orig->pnfs_param.mirror_count != myself.pnfs_param.mirror_count) {
+		LogCrit(COMPONENT_FSAL, "Can not change PNFS without restart.");
+		invalid = true;
+	}
+
+	vfs_pnfs_release(&myself.pnfs_param);
+
 	return invalid ? posix2fsal_status(EINVAL) :
 			 fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
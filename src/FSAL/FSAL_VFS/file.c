@@ -1289,6 +1289,8 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
 
 	read_arg->end_of_file = (nb_read == 0);
 
+	vfs_readahead(myself, my_fd->fd, read_arg->offset, nb_read);
+
 #if 0
 	/** @todo
 	 *
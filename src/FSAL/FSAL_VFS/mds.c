@@ -0,0 +1,1334 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/mds.c
+ * @brief Flex files pNFS metadata server for FSAL_VFS
+ *
+ * A VFS export configured with a PNFS block hands out loosely coupled
+ * flex files layouts whose data servers are other Ganesha instances
+ * exporting the same backing filesystem with PNFS_DS enabled.  The VFS
+ * handle of the file is used unchanged as the DS handle, so any DS can
+ * serve any byte of any file, and the MDS is free to stripe I/O across
+ * whichever data servers it likes.
+ *
+ * Since every data server reaches the same backing file, mirrors hold no
+ * extra copy of the data, they only give a client other paths to it.
+ * READ layouts are mirrored Mirror_Count times so that a client can read
+ * through another data server when one fails, while RW layouts always
+ * have a single mirror, as mirrored writes would only write the same
+ * bytes of the same file several times.
+ *
+ * The layouts granted on a file are recorded in an extended attribute of
+ * the file, which the data servers check the stateid of every I/O with,
+ * so that a client can no longer reach the file through a data server
+ * once its layout is returned or revoked.
+ *
+ * LAYOUTSTATS and LAYOUTERROR feed back into data server selection:
+ * new layouts prefer the data servers with the least reported traffic,
+ * and a client is not handed the data servers it reported errors on for
+ * a while.  Other clients may still reach those data servers, an error
+ * seen by one client is as likely to be about its own network path.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "os/xattr.h"
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "gsh_config.h"
+#include "nfs_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "vfs_methods.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "nfs_core.h"
+#include "pnfs_utils.h"
+
+/* Configuration */
+
+static struct config_item ds_params[] = {
+	CONF_MAND_IP_ADDR("DS_Addr", "127.0.0.1", vfs_pnfs_ds_parameter,
+			  ipaddr),
+	CONF_ITEM_UI16("DS_Port", 1, UINT16_MAX, NFS_PORT,
+		       vfs_pnfs_ds_parameter, ipport),
+	CONF_MAND_UI16("DS_Id", 1, UINT16_MAX, 1, vfs_pnfs_ds_parameter,
+		       id_servers),
+	CONFIG_EOL
+};
+
+/**
+ * @brief Allocate and free a Data_Server sub-block
+ *
+ * Each Data_Server block is parsed into its own structure and copied into
+ * the ds_array of the PNFS block on commit.
+ */
+static void *ds_init(void *link_mem, void *self_struct)
+{
+	assert(link_mem != NULL || self_struct != NULL);
+
+	if (link_mem == NULL)
+		return self_struct;
+	else if (self_struct == NULL)
+		return gsh_calloc(1, sizeof(struct vfs_pnfs_ds_parameter));
+
+	gsh_free(self_struct);
+	return NULL;
+}
+
+static int ds_commit(void *node, void *link_mem, void *self_struct,
+		     struct config_error_type *err_type)
+{
+	struct vfs_pnfs_ds_parameter *ds = self_struct;
+	struct vfs_pnfs_parameter *param =
+		container_of(link_mem, struct vfs_pnfs_parameter, ds_array);
+	int errcnt = 0;
+
+	if (ds->ipaddr.ss_family != AF_INET) {
+		LogCrit(COMPONENT_CONFIG,
+			"Flex files data servers must have an IPv4 DS_Addr");
+		err_type->invalid = true;
+		errcnt++;
+	} else if (param->nb_ds >= VFS_PNFS_MAX_DS) {
+		LogCrit(COMPONENT_CONFIG,
+			"Too many Data_Server blocks, at most %d are supported",
+			VFS_PNFS_MAX_DS);
+		err_type->invalid = true;
+		errcnt++;
+	} else {
+		param->ds_array[param->nb_ds] = *ds;
+		param->nb_ds++;
+	}
+
+	ds_init(link_mem, self_struct);
+	return errcnt;
+}
+
+/**
+ * @brief Validate the PNFS block of a VFS export
+ */
+int vfs_pnfs_commit(void *node, void *link_mem, void *self_struct,
+		    struct config_error_type *err_type)
+{
+	struct vfs_pnfs_parameter *param = self_struct;
+	uint32_t width;
+
+	if (param->nb_ds == 0) {
+		LogCrit(COMPONENT_CONFIG,
+			"PNFS block needs at least one Data_Server block");
+		err_type->invalid = true;
+		return 1;
+	}
+
+	width = param->stripe_width != 0 ? param->stripe_width
+					  : param->nb_ds / param->mirror_count;
+
+	if (width == 0 || width * param->mirror_count > param->nb_ds) {
+		LogCrit(COMPONENT_CONFIG,
+			"Stripe_Width %" PRIu32 " times Mirror_Count %" PRIu32
+			" needs more than the %" PRIu32
+			" configured data servers",
+			param->stripe_width, param->mirror_count,
+			param->nb_ds);
+		err_type->invalid = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+struct config_item vfs_pnfs_params[] = {
+	CONF_ITEM_UI32("Stripe_Unit", 4096, 64 * 1024 * 1024, 1024 * 1024,
+		       vfs_pnfs_parameter, stripe_unit),
+	CONF_ITEM_UI32("Stripe_Width", 0, VFS_PNFS_MAX_DS, 0,
+		       vfs_pnfs_parameter, stripe_width),
+	CONF_ITEM_UI32("Mirror_Count", 1, VFS_PNFS_MAX_DS, 1,
+		       vfs_pnfs_parameter, mirror_count),
+	CONF_ITEM_UI32("Stats_Collect_Hint", 0, 3600, 60, vfs_pnfs_parameter,
+		       stats_collect_hint),
+	CONF_ITEM_UI32("DS_Fail_Timeout", 0, 3600, 60, vfs_pnfs_parameter,
+		       ds_fail_timeout),
+	CONF_ITEM_STR("Synthetic_User", 1, 128, "65534", vfs_pnfs_parameter,
+		      ffds_user),
+	CONF_ITEM_STR("Synthetic_Group", 1, 128, "65534", vfs_pnfs_parameter,
+		      ffds_group),
+	CONF_ITEM_BLOCK_MULT("Data_Server", ds_params, ds_init, ds_commit,
+			     vfs_pnfs_parameter, ds_array),
+	CONFIG_EOL
+};
+
+/**
+ * @brief Release resources held by parsed PNFS parameters
+ *
+ * @param[in] param The parameters
+ */
+void vfs_pnfs_release(struct vfs_pnfs_parameter *param)
+{
+	gsh_free(param->ffds_user);
+	param->ffds_user = NULL;
+	gsh_free(param->ffds_group);
+	param->ffds_group = NULL;
+}
+
+/* Layouts held on a file */
+
+/**
+ * @brief Extended attribute of a file listing the layouts held on it
+ *
+ * The data servers share nothing with the MDS but the backing filesystem,
+ * so the MDS records the layouts it grants in an attribute of the file,
+ * out of reach of the clients, and the data servers check the stateid of
+ * each I/O against it.
+ */
+#define VFS_PNFS_LAYOUTS_XATTR "trusted.ganesha.pnfs_layouts"
+
+/** Layouts that may be held on a file at a time */
+#define VFS_PNFS_MAX_LAYOUTS 120
+
+/**
+ * @brief A layout held on a file, as recorded in the layouts attribute
+ *
+ * All the numbers are in network byte order.
+ */
+struct vfs_pnfs_layout_rec {
+	uint32_t token; /*< Names the layout in its DS stateids */
+	uint32_t iomode; /*< Iomode of the segments */
+	uint32_t seqid; /*< Layout seqid of the latest grant */
+	uint32_t segments; /*< Segments granted and not yet returned */
+	uint32_t epoch; /*< Server epoch of the MDS that granted it */
+	char other[OTHERSIZE]; /*< The layout stateid */
+};
+
+/**
+ * @brief The fsal_seg_data of a segment, naming its layout
+ */
+struct vfs_pnfs_layout_seg {
+	char other[OTHERSIZE]; /*< The layout stateid */
+	uint32_t iomode; /*< Iomode of the segment, in network byte order */
+};
+
+/**
+ * @brief Read the layouts held on a file
+ *
+ * @param[in]  fd    A descriptor of the file
+ * @param[out] recs  The layouts, VFS_PNFS_MAX_LAYOUTS of them at most
+ * @param[out] count Number of layouts
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_pnfs_read_layouts(int fd, struct vfs_pnfs_layout_rec *recs,
+				 uint32_t *count)
+{
+	ssize_t len;
+
+	len = fgetxattr(fd, VFS_PNFS_LAYOUTS_XATTR, recs,
+			VFS_PNFS_MAX_LAYOUTS * sizeof(*recs));
+
+	if (len < 0) {
+		*count = 0;
+		return errno == ENODATA ? 0 : errno;
+	}
+
+	if (len % sizeof(*recs) != 0) {
+		*count = 0;
+		return EINVAL;
+	}
+
+	*count = len / sizeof(*recs);
+	return 0;
+}
+
+/**
+ * @brief Record a granted or returned segment in the layouts of a file
+ *
+ * Layouts granted by an earlier instance of the MDS, which may have died
+ * before they were returned, are dropped on the way.
+ *
+ * @param[in]  myself  The file
+ * @param[in]  other   The layout stateid
+ * @param[in]  iomode  Iomode of the segment, in network byte order
+ * @param[in]  seqid   Layout seqid of a grant, 0 for a return
+ * @param[out] granted The layout after a grant, NULL for a return
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_pnfs_update_layouts(struct vfs_fsal_obj_handle *myself,
+				   const char *other, uint32_t iomode,
+				   uint32_t seqid,
+				   struct vfs_pnfs_layout_rec *granted)
+{
+	struct vfs_pnfs_layout_rec recs[VFS_PNFS_MAX_LAYOUTS];
+	struct vfs_pnfs_layout_rec *rec = NULL;
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	uint32_t epoch = htonl((uint32_t)nfs_ServerEpoch);
+	uint32_t count, kept, token = 0, i;
+	int fd, retval;
+
+	PTHREAD_RWLOCK_wrlock(&myself->obj_handle.obj_lock);
+
+	fd = vfs_fsal_open(myself, O_RDONLY, &fsal_error);
+
+	if (fd < 0) {
+		retval = -fd;
+		goto out;
+	}
+
+	retval = vfs_pnfs_read_layouts(fd, recs, &count);
+
+	if (retval != 0)
+		goto out;
+
+	for (i = 0, kept = 0; i < count; i++) {
+		if (recs[i].epoch != epoch)
+			continue;
+
+		recs[kept] = recs[i];
+
+		if (memcmp(recs[kept].other, other, OTHERSIZE) == 0 &&
+		    recs[kept].iomode == iomode)
+			rec = &recs[kept];
+
+		if (ntohl(recs[kept].token) > token)
+			token = ntohl(recs[kept].token);
+
+		kept++;
+	}
+
+	count = kept;
+
+	if (granted != NULL) {
+		if (rec == NULL) {
+			if (count == VFS_PNFS_MAX_LAYOUTS) {
+				retval = ENOSPC;
+				goto out;
+			}
+
+			/* A token is only reused once its layouts are gone,
+			 * and DS stateids are signed with the layout stateid
+			 * as well, so stale ones never match a new layout.
+			 */
+			rec = &recs[count++];
+			memset(rec, 0, sizeof(*rec));
+			rec->token = htonl(token + 1 != 0 ? token + 1 : 1);
+			rec->iomode = iomode;
+			rec->epoch = epoch;
+			memcpy(rec->other, other, OTHERSIZE);
+		}
+
+		rec->seqid = htonl(seqid);
+		rec->segments = htonl(ntohl(rec->segments) + 1);
+		*granted = *rec;
+	} else if (rec != NULL) {
+		rec->segments = htonl(ntohl(rec->segments) - 1);
+
+		if (rec->segments == 0) {
+			*rec = recs[count - 1];
+			count--;
+		}
+	}
+
+	if (count != 0)
+		retval = fsetxattr(fd, VFS_PNFS_LAYOUTS_XATTR, recs,
+				   count * sizeof(*recs), 0);
+	else
+		retval = fremovexattr(fd, VFS_PNFS_LAYOUTS_XATTR);
+
+	if (retval < 0) {
+		retval = errno;
+
+		if (retval == ENODATA)
+			retval = 0;
+	}
+
+out:
+
+	if (fd >= 0)
+		close(fd);
+
+	PTHREAD_RWLOCK_unlock(&myself->obj_handle.obj_lock);
+
+	return retval;
+}
+
+/* Data server stateids */
+
+#define SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3)      \
+	do {                           \
+		v0 += v1;              \
+		v1 = SIP_ROTL(v1, 13); \
+		v1 ^= v0;              \
+		v0 = SIP_ROTL(v0, 32); \
+		v2 += v3;              \
+		v3 = SIP_ROTL(v3, 16); \
+		v3 ^= v2;              \
+		v0 += v3;              \
+		v3 = SIP_ROTL(v3, 21); \
+		v3 ^= v0;              \
+		v2 += v1;              \
+		v1 = SIP_ROTL(v1, 17); \
+		v1 ^= v2;              \
+		v2 = SIP_ROTL(v2, 32); \
+	} while (0)
+
+/**
+ * @brief SipHash-2-4 of a buffer
+ *
+ * A keyed hash that can't be forged without the key, used to sign the
+ * stateids the MDS hands out for its data servers.
+ *
+ * @param[in] key The 128 bit key
+ * @param[in] in  The buffer
+ * @param[in] len Length of the buffer
+ *
+ * @return The hash.
+ */
+static uint64_t vfs_pnfs_siphash(const uint64_t key[2], const uint8_t *in,
+				 size_t len)
+{
+	uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+	uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+	uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+	uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+	uint64_t m = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		m |= (uint64_t)in[i] << (8 * (i % 8));
+
+		if (i % 8 == 7) {
+			v3 ^= m;
+			SIP_ROUND(v0, v1, v2, v3);
+			SIP_ROUND(v0, v1, v2, v3);
+			v0 ^= m;
+			m = 0;
+		}
+	}
+
+	m |= (uint64_t)len << 56;
+	v3 ^= m;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	v0 ^= m;
+
+	v2 ^= 0xff;
+	for (i = 0; i < 4; i++)
+		SIP_ROUND(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief Sign a DS stateid
+ *
+ * @param[in] module The VFS module, holding the key
+ * @param[in] ds_fh  The DS handle
+ * @param[in] rec    The layout of the stateid
+ * @param[in] seqid  Layout seqid of the grant
+ *
+ * @return The signature.
+ */
+static uint64_t vfs_pnfs_ds_sign(struct vfs_fsal_module *module,
+				 const struct gsh_buffdesc *ds_fh,
+				 const struct vfs_pnfs_layout_rec *rec,
+				 uint32_t seqid)
+{
+	uint8_t buf[3 * sizeof(uint32_t) + OTHERSIZE + VFS_HANDLE_LEN];
+	uint32_t seqid_be = htonl(seqid);
+	size_t len = ds_fh->len;
+	uint8_t *p = buf;
+
+	if (len > VFS_HANDLE_LEN)
+		len = VFS_HANDLE_LEN;
+
+	memcpy(p, &rec->token, sizeof(rec->token));
+	p += sizeof(rec->token);
+	memcpy(p, &rec->iomode, sizeof(rec->iomode));
+	p += sizeof(rec->iomode);
+	memcpy(p, &seqid_be, sizeof(seqid_be));
+	p += sizeof(seqid_be);
+	memcpy(p, rec->other, OTHERSIZE);
+	p += OTHERSIZE;
+	memcpy(p, ds_fh->addr, len);
+	p += len;
+
+	return vfs_pnfs_siphash(module->pnfs_sipkey, buf, p - buf);
+}
+
+/**
+ * @brief Build the stateid a client presents to the data servers
+ *
+ * The stateid carries the token of the layout in the layouts of the file
+ * and the layout seqid of the grant, with a signature of both, the DS
+ * handle, the iomode and the layout stateid made with the PNFS_Key shared
+ * by the MDS and its data servers.  Only a client that was granted a
+ * layout can then do I/O through a data server, only reads with a READ
+ * layout, and only until the layout is returned or revoked.
+ *
+ * @param[in]  module  The VFS module
+ * @param[in]  ds_fh   The DS handle
+ * @param[in]  rec     The layout
+ * @param[in]  seqid   Layout seqid of the grant
+ * @param[out] stateid The stateid
+ */
+static void vfs_pnfs_ds_stateid(struct vfs_fsal_module *module,
+				const struct gsh_buffdesc *ds_fh,
+				const struct vfs_pnfs_layout_rec *rec,
+				uint32_t seqid, stateid4 *stateid)
+{
+	uint64_t sign = htobe64(vfs_pnfs_ds_sign(module, ds_fh, rec, seqid));
+
+	stateid->seqid = seqid;
+	memcpy(stateid->other, &rec->token, sizeof(rec->token));
+	memcpy(stateid->other + sizeof(rec->token), &sign, sizeof(sign));
+}
+
+/**
+ * @brief Check the stateid of a data server READ or WRITE
+ *
+ * The layout of the stateid must still be held on the file, and the
+ * stateid must come from one of its grants.
+ *
+ * @param[in] module  The VFS module
+ * @param[in] fd      A descriptor of the file
+ * @param[in] ds_fh   The DS handle
+ * @param[in] stateid The stateid supplied with the operation
+ * @param[in] iomode  LAYOUTIOMODE4_READ for a read, LAYOUTIOMODE4_RW for a
+ *		      write
+ *
+ * @return NFS4_OK, NFS4ERR_BAD_STATEID or NFS4ERR_OPENMODE.
+ */
+nfsstat4 vfs_pnfs_check_ds_stateid(struct vfs_fsal_module *module, int fd,
+				   const struct gsh_buffdesc *ds_fh,
+				   const stateid4 *stateid,
+				   layoutiomode4 iomode)
+{
+	struct vfs_pnfs_layout_rec recs[VFS_PNFS_MAX_LAYOUTS];
+	struct vfs_pnfs_layout_rec *rec = NULL;
+	uint32_t token, count, i;
+	uint64_t sign;
+	int retval;
+
+	memcpy(&token, stateid->other, sizeof(token));
+	memcpy(&sign, stateid->other + sizeof(token), sizeof(sign));
+
+	retval = vfs_pnfs_read_layouts(fd, recs, &count);
+
+	if (retval != 0) {
+		LogDebug(COMPONENT_PNFS, "Could not read the layouts: %s",
+			 strerror(retval));
+		return NFS4ERR_BAD_STATEID;
+	}
+
+	for (i = 0; rec == NULL && i < count; i++) {
+		if (recs[i].token == token)
+			rec = &recs[i];
+	}
+
+	if (rec == NULL) {
+		LogDebug(COMPONENT_PNFS,
+			 "DS stateid of a layout not held on the file");
+		return NFS4ERR_BAD_STATEID;
+	}
+
+	if (stateid->seqid == 0 || stateid->seqid > ntohl(rec->seqid) ||
+	    be64toh(sign) !=
+		    vfs_pnfs_ds_sign(module, ds_fh, rec, stateid->seqid)) {
+		LogDebug(COMPONENT_PNFS, "DS stateid was not made by our MDS");
+		return NFS4ERR_BAD_STATEID;
+	}
+
+	if (iomode == LAYOUTIOMODE4_RW &&
+	    ntohl(rec->iomode) != LAYOUTIOMODE4_RW) {
+		LogDebug(COMPONENT_PNFS, "DS write with a READ layout");
+		return NFS4ERR_OPENMODE;
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Derive the DS stateid key from PNFS_Key
+ *
+ * @param[in] module The VFS module
+ */
+static void vfs_pnfs_set_key(struct vfs_fsal_module *module)
+{
+	const uint64_t zero[2] = { 0, 0 };
+	size_t len = strlen(module->pnfs_key);
+
+	module->pnfs_sipkey[0] = vfs_pnfs_siphash(
+		zero, (const uint8_t *)module->pnfs_key, len);
+	module->pnfs_sipkey[1] = vfs_pnfs_siphash(
+		module->pnfs_sipkey, (const uint8_t *)module->pnfs_key, len);
+}
+
+/**
+ * @brief Set up pNFS roles for a new export
+ *
+ * Registers the export as a Data Server if the module has PNFS_DS enabled,
+ * and enables flex files layouts if the module has PNFS_MDS enabled and the
+ * export has at least one data server configured.
+ *
+ * @param[in] myself The export
+ *
+ * @return 0 or an errno.
+ */
+int vfs_pnfs_init_export(struct vfs_fsal_export *myself)
+{
+	struct fsal_export *exp_hdl = &myself->export;
+	struct fsal_module *fsal_hdl = exp_hdl->fsal;
+	struct vfs_fsal_module *module =
+		container_of(fsal_hdl, struct vfs_fsal_module, module);
+	fsal_status_t status;
+
+	myself->pnfs_ds_enabled =
+		exp_hdl->exp_ops.fs_supports(exp_hdl, fso_pnfs_ds_supported);
+
+	myself->pnfs_mds_enabled =
+		exp_hdl->exp_ops.fs_supports(exp_hdl, fso_pnfs_mds_supported) &&
+		myself->pnfs_param.nb_ds != 0;
+
+	if (myself->pnfs_ds_enabled || myself->pnfs_mds_enabled) {
+		if (module->pnfs_key == NULL) {
+			LogCrit(COMPONENT_CONFIG,
+				"PNFS_MDS and PNFS_DS need a PNFS_Key shared by the MDS and its data servers");
+			return EINVAL;
+		}
+
+		vfs_pnfs_set_key(module);
+	}
+
+	if (myself->pnfs_ds_enabled) {
+		struct fsal_pnfs_ds *pds = NULL;
+
+		status = fsal_hdl->m_ops.create_fsal_pnfs_ds(fsal_hdl, NULL,
+							     &pds);
+
+		if (FSAL_IS_ERROR(status))
+			return EINVAL;
+
+		/* special case: server_id matches export_id */
+		pds->id_servers = op_ctx->ctx_export->export_id;
+		pds->mds_export = op_ctx->ctx_export;
+		pds->mds_fsal_export = exp_hdl;
+
+		if (!pnfs_ds_insert(pds)) {
+			LogCrit(COMPONENT_CONFIG,
+				"Server id %d already in use.",
+				pds->id_servers);
+
+			/* Return the ref taken by create_fsal_pnfs_ds */
+			pnfs_ds_put(pds);
+			return EEXIST;
+		}
+
+		LogInfo(COMPONENT_FSAL, "pnfs ds was enabled for [%s]",
+			CTX_FULLPATH(op_ctx));
+	}
+
+	if (myself->pnfs_mds_enabled) {
+		LogInfo(COMPONENT_FSAL,
+			"pnfs flex files mds was enabled for [%s] with %" PRIu32
+			" data servers",
+			CTX_FULLPATH(op_ctx), myself->pnfs_param.nb_ds);
+		vfs_export_ops_pnfs(&exp_hdl->exp_ops);
+	}
+
+	return 0;
+}
+
+/* Export operations */
+
+/**
+ * @brief Get layout types supported by export
+ *
+ * @param[in]  exp_hdl Public export handle
+ * @param[out] count   Number of layout types in array
+ * @param[out] types   Static array of layout types
+ */
+static void vfs_fs_layouttypes(struct fsal_export *exp_hdl, int32_t *count,
+			       const layouttype4 **types)
+{
+	static const layouttype4 supported_layout_type = LAYOUT4_FLEX_FILES;
+
+	*types = &supported_layout_type;
+	*count = 1;
+}
+
+/**
+ * @brief Get layout block size for export
+ *
+ * @param[in] exp_hdl Public export handle
+ *
+ * @return The configured stripe unit.
+ */
+static uint32_t vfs_fs_layout_blocksize(struct fsal_export *exp_hdl)
+{
+	return EXPORT_VFS_FROM_FSAL(exp_hdl)->pnfs_param.stripe_unit;
+}
+
+/**
+ * @brief Maximum number of segments we will use
+ *
+ * @param[in] exp_hdl Public export handle
+ *
+ * @return 1
+ */
+static uint32_t vfs_fs_maximum_segments(struct fsal_export *exp_hdl)
+{
+	return 1;
+}
+
+/**
+ * @brief Size of the buffer needed for a loc_body
+ *
+ * Each ff_data_server4 holds a deviceid, a stateid, one DS handle and the
+ * synthetic owner strings.
+ *
+ * @param[in] exp_hdl Public export handle
+ *
+ * @return Size of the buffer needed for a loc_body
+ */
+static size_t vfs_fs_loc_body_size(struct fsal_export *exp_hdl)
+{
+	return 0x40 + VFS_PNFS_MAX_DS * (NFS4_FHSIZE + 0x140);
+}
+
+void vfs_export_ops_pnfs(struct export_ops *ops)
+{
+	ops->fs_layouttypes = vfs_fs_layouttypes;
+	ops->fs_layout_blocksize = vfs_fs_layout_blocksize;
+	ops->fs_maximum_segments = vfs_fs_maximum_segments;
+	ops->fs_loc_body_size = vfs_fs_loc_body_size;
+}
+
+/* Module operations */
+
+/**
+ * @brief Size of the buffer needed for a ds_addr
+ *
+ * One multipath address and one version entry.
+ *
+ * @param[in] fsal_hdl FSAL module
+ *
+ * @return Size of the buffer needed for a ds_addr
+ */
+size_t vfs_fs_da_addr_size(struct fsal_module *fsal_hdl)
+{
+	return 0x100;
+}
+
+/**
+ * @brief Find the VFS export that owns a deviceid
+ *
+ * The high part of a VFS deviceid is the export id of the MDS export, the
+ * low part is the index of the data server in that export's ds_array.
+ *
+ * @param[in] fsal_hdl FSAL module
+ * @param[in] export_id Export id from the deviceid
+ *
+ * @return The export or NULL.  Must be called with fsm_lock held.
+ */
+static struct vfs_fsal_export *vfs_pnfs_find_export(struct fsal_module *fsal_hdl,
+						    uint16_t export_id)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &fsal_hdl->exports) {
+		struct fsal_export *exp_hdl =
+			glist_entry(glist, struct fsal_export, exports);
+
+		if (exp_hdl->export_id == export_id)
+			return EXPORT_VFS_FROM_FSAL(exp_hdl);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Describe a flex files data server
+ *
+ * @param[in]  fsal_hdl     FSAL module
+ * @param[out] da_addr_body Stream we write the result to
+ * @param[in]  type         Type of layout that gave the device
+ * @param[in]  deviceid     The device to look up
+ *
+ * @return Valid error codes in RFC 5661, p. 365.
+ */
+nfsstat4 vfs_getdeviceinfo(struct fsal_module *fsal_hdl, XDR *da_addr_body,
+			   const layouttype4 type,
+			   const struct pnfs_deviceid *deviceid)
+{
+	struct vfs_fsal_export *myself;
+	struct sockaddr_in *sin;
+	fsal_multipath_member_t host;
+	nfsstat4 nfs_status;
+
+	if (type != LAYOUT4_FLEX_FILES) {
+		LogCrit(COMPONENT_PNFS, "Unsupported layout type: %x", type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	PTHREAD_RWLOCK_rdlock(&fsal_hdl->fsm_lock);
+
+	myself = vfs_pnfs_find_export(fsal_hdl, deviceid->device_id2);
+
+	if (myself == NULL || !myself->pnfs_mds_enabled ||
+	    deviceid->device_id4 >= myself->pnfs_param.nb_ds) {
+		PTHREAD_RWLOCK_unlock(&fsal_hdl->fsm_lock);
+		LogDebug(COMPONENT_PNFS, "No device %u/%u/%u",
+			 deviceid->device_id1, deviceid->device_id2,
+			 deviceid->device_id4);
+		return NFS4ERR_NOENT;
+	}
+
+	sin = (struct sockaddr_in *)&myself->pnfs_param
+		      .ds_array[deviceid->device_id4].ipaddr;
+
+	host.proto = IPPROTO_TCP;
+	host.addr = ntohl(sin->sin_addr.s_addr);
+	host.port = myself->pnfs_param.ds_array[deviceid->device_id4].ipport;
+
+	PTHREAD_RWLOCK_unlock(&fsal_hdl->fsm_lock);
+
+	LogDebug(COMPONENT_PNFS, "advertises DS %u addr=%u.%u.%u.%u port=%u",
+		 deviceid->device_id4, (host.addr & 0xFF000000) >> 24,
+		 (host.addr & 0x00FF0000) >> 16, (host.addr & 0x0000FF00) >> 8,
+		 host.addr & 0x000000FF, host.port);
+
+	/* Loosely coupled NFSv4.1 data server */
+	nfs_status = FSAL_encode_ff_device_versions4(
+		da_addr_body, 1, 1, &host, NFS_V4, 1,
+		fsal_hdl->fs_info.maxread, fsal_hdl->fs_info.maxwrite, false);
+
+	return nfs_status;
+}
+
+/* Data server selection */
+
+/**
+ * @brief Protects the failures of the data servers of all the exports
+ */
+static pthread_mutex_t vfs_pnfs_failures_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Whether a client reported an error on a data server recently
+ *
+ * @note The failures lock must be held.
+ *
+ * @param[in] ds       The data server
+ * @param[in] clientid The client
+ * @param[in] now      The current time
+ *
+ * @return true if the data server must not be handed to the client.
+ */
+static bool vfs_pnfs_ds_failed(const struct vfs_pnfs_ds_parameter *ds,
+			       uint64_t clientid, time_t now)
+{
+	int i;
+
+	for (i = 0; i < VFS_PNFS_DS_FAILURES; i++) {
+		if (ds->failures[i].clientid == clientid &&
+		    ds->failures[i].until > now)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Pick the data servers for a new layout
+ *
+ * Data servers that the client reported an error on within the last
+ * DS_Fail_Timeout seconds are skipped.  The remaining ones are ordered by
+ * the traffic clients reported through LAYOUTSTATS, so that new layouts go
+ * to the least loaded data servers.
+ *
+ * @param[in]  param    PNFS parameters of the export
+ * @param[in]  clientid The client the layout is for, NULL if unknown
+ * @param[in]  mirrors  Number of mirrors of the layout
+ * @param[out] chosen   Indexes into ds_array
+ * @param[out] width    Data servers per mirror
+ *
+ * @return Number of data servers chosen (width times mirrors), or 0 if not
+ *         enough data servers are healthy.
+ */
+static uint32_t vfs_pnfs_select_ds(struct vfs_pnfs_parameter *param,
+				   const uint64_t *clientid, uint32_t mirrors,
+				   uint32_t *chosen, uint32_t *width)
+{
+	uint64_t load[VFS_PNFS_MAX_DS];
+	uint32_t healthy = 0;
+	uint32_t i, j;
+	time_t now = time(NULL);
+
+	PTHREAD_MUTEX_lock(&vfs_pnfs_failures_lock);
+
+	for (i = 0; i < param->nb_ds; i++) {
+		struct vfs_pnfs_ds_parameter *ds = &param->ds_array[i];
+		uint64_t bytes;
+
+		if (clientid != NULL && vfs_pnfs_ds_failed(ds, *clientid, now))
+			continue;
+
+		bytes = atomic_fetch_uint64_t(&ds->io_bytes);
+
+		/* Insertion sort by reported load, the table is tiny */
+		for (j = healthy; j > 0 && load[j - 1] > bytes; j--) {
+			load[j] = load[j - 1];
+			chosen[j] = chosen[j - 1];
+		}
+
+		load[j] = bytes;
+		chosen[j] = i;
+		healthy++;
+	}
+
+	PTHREAD_MUTEX_unlock(&vfs_pnfs_failures_lock);
+
+	*width = param->stripe_width != 0 ? param->stripe_width
+					   : param->nb_ds / param->mirror_count;
+
+	/* Narrow the stripe rather than fail if some DSs are down */
+	if (*width * mirrors > healthy)
+		*width = healthy / mirrors;
+
+	return *width * mirrors;
+}
+
+/* Handle operations */
+
+/**
+ * @brief Grant a flex files layout segment.
+ *
+ * Always grants a whole file layout, with one segment, striped over width
+ * data servers, and mirrored mirror_count times if it is a READ layout.
+ *
+ * @param[in]     obj_hdl  Public object handle
+ * @param[out]    loc_body An XDR stream to which the FSAL must encode
+ *                         the layout specific portion of the granted
+ *                         layout segment.
+ * @param[in]     arg      Input arguments of the function
+ * @param[in,out] res      In/out and output arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, pp. 366-7.
+ */
+static nfsstat4 vfs_layoutget(struct fsal_obj_handle *obj_hdl, XDR *loc_body,
+			      const struct fsal_layoutget_arg *arg,
+			      struct fsal_layoutget_res *res)
+{
+	struct vfs_fsal_obj_handle *myself = OBJ_VFS_FROM_FSAL(obj_hdl);
+	struct vfs_fsal_export *myexport =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export);
+	struct vfs_pnfs_parameter *param = &myexport->pnfs_param;
+	struct vfs_fsal_module *module =
+		container_of(obj_hdl->fsal, struct vfs_fsal_module, module);
+	uint32_t chosen[VFS_PNFS_MAX_DS];
+	uint32_t width, count, mirrors, mirror, stripe;
+	struct gsh_buffdesc ds_desc;
+	struct vfs_pnfs_layout_seg *seg;
+	struct vfs_pnfs_layout_rec rec;
+	stateid4 ds_stateid;
+	fsal_status_t status;
+	nfsstat4 nfs_status;
+	int retval;
+	fattr4_owner ffds_user;
+	fattr4_owner_group ffds_group;
+	ff_flags4 flags = FF_FLAGS_NO_LAYOUTCOMMIT;
+	uint64_t stripe_unit = param->stripe_unit;
+
+	if (!myexport->pnfs_mds_enabled)
+		return NFS4ERR_LAYOUTUNAVAILABLE;
+
+	if (arg->type != LAYOUT4_FLEX_FILES) {
+		LogCrit(COMPONENT_PNFS, "Unsupported layout type: %x",
+			arg->type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	if (res->segment.io_mode != LAYOUTIOMODE4_READ &&
+	    res->segment.io_mode != LAYOUTIOMODE4_RW)
+		return NFS4ERR_BADIOMODE;
+
+	/* The data servers trust the layout, so check the caller may do
+	 * the I/O the layout allows here.
+	 */
+	status = obj_hdl->obj_ops->test_access(
+		obj_hdl,
+		res->segment.io_mode == LAYOUTIOMODE4_RW ? FSAL_WRITE_ACCESS :
+							  FSAL_READ_ACCESS,
+		NULL, NULL, false);
+
+	if (FSAL_IS_ERROR(status))
+		return nfs4_Errno_status(status);
+
+	/* Mirrors of a RW layout would write the same backing file */
+	mirrors = res->segment.io_mode == LAYOUTIOMODE4_READ ?
+			  param->mirror_count :
+			  1;
+
+	count = vfs_pnfs_select_ds(param, op_ctx->clientid, mirrors, chosen,
+				   &width);
+
+	if (count == 0) {
+		LogDebug(COMPONENT_PNFS,
+			 "Not enough healthy data servers for a layout");
+		return NFS4ERR_LAYOUTTRYLATER;
+	}
+
+	/* We grant only one segment, and we want it back when the file is
+	 * closed.
+	 */
+	res->return_on_close = true;
+	res->last_segment = true;
+	res->segment.offset = 0;
+	res->segment.length = NFS4_UINT64_MAX;
+
+	ds_desc.addr = myself->handle->handle_data;
+	ds_desc.len = myself->handle->handle_len;
+
+	seg = gsh_malloc(sizeof(*seg));
+	memcpy(seg->other, arg->stateid.other, OTHERSIZE);
+	seg->iomode = htonl(res->segment.io_mode);
+
+	retval = vfs_pnfs_update_layouts(myself, seg->other, seg->iomode,
+					 arg->stateid.seqid, &rec);
+
+	if (retval != 0) {
+		LogDebug(COMPONENT_PNFS, "Could not record the layout: %s",
+			 strerror(retval));
+		gsh_free(seg);
+
+		if (retval == ENOSPC)
+			return NFS4ERR_LAYOUTTRYLATER;
+		else if (retval == ENOTSUP)
+			return NFS4ERR_LAYOUTUNAVAILABLE;
+
+		return nfs4_Errno_status(posix2fsal_status(retval));
+	}
+
+	vfs_pnfs_ds_stateid(module, &ds_desc, &rec, arg->stateid.seqid,
+			    &ds_stateid);
+
+	ffds_user.utf8string_val = param->ffds_user;
+	ffds_user.utf8string_len = strlen(param->ffds_user);
+	ffds_group.utf8string_val = param->ffds_group;
+	ffds_group.utf8string_len = strlen(param->ffds_group);
+
+	if (!xdr_length4(loc_body, &stripe_unit) ||
+	    !xdr_uint32_t(loc_body, &mirrors)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_layout4 header.");
+		nfs_status = NFS4ERR_SERVERFAULT;
+		goto out;
+	}
+
+	for (mirror = 0; mirror < mirrors; mirror++) {
+		if (!xdr_uint32_t(loc_body, &width)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding ffm_data_servers_len.");
+			nfs_status = NFS4ERR_SERVERFAULT;
+			goto out;
+		}
+
+		for (stripe = 0; stripe < width; stripe++) {
+			struct pnfs_deviceid deviceid =
+				DEVICE_ID_INIT_ZERO(FSAL_ID_VFS);
+			uint32_t idx = chosen[mirror * width + stripe];
+
+			deviceid.device_id2 = op_ctx->ctx_export->export_id;
+			deviceid.device_id4 = idx;
+
+			nfs_status = FSAL_encode_data_server(
+				loc_body, &deviceid, 1,
+				&param->ds_array[idx].id_servers, &ds_desc, 0,
+				&ds_stateid, ffds_user, ffds_group);
+
+			if (nfs_status != NFS4_OK)
+				goto out;
+		}
+	}
+
+	if (!xdr_ff_flags(loc_body, &flags) ||
+	    !xdr_uint32_t(loc_body, &param->stats_collect_hint)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_layout4 trailer.");
+		nfs_status = NFS4ERR_SERVERFAULT;
+		goto out;
+	}
+
+	LogDebug(COMPONENT_PNFS,
+		 "Granted flex files layout width %" PRIu32 " mirrors %" PRIu32,
+		 width, mirrors);
+
+	res->fsal_seg_data = seg;
+	return NFS4_OK;
+
+out:
+
+	(void)vfs_pnfs_update_layouts(myself, seg->other, seg->iomode, 0,
+				      NULL);
+	gsh_free(seg);
+
+	return nfs_status;
+}
+
+/**
+ * @brief Potentially return one layout segment
+ *
+ * The segment is dropped from the layouts of the file when it is disposed
+ * of, so that the DS stateids of its layout stop working once the layout
+ * has no segment of its iomode left, whether the client returned it or
+ * the layout was revoked.
+ *
+ * @param[in] obj_hdl  Public object handle
+ * @param[in] lrf_body ff_layoutreturn4, ignored
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, p. 367.
+ */
+static nfsstat4 vfs_layoutreturn(struct fsal_obj_handle *obj_hdl,
+				 XDR *lrf_body,
+				 const struct fsal_layoutreturn_arg *arg)
+{
+	struct vfs_pnfs_layout_seg *seg = arg->fsal_seg_data;
+	int retval;
+
+	if (arg->lo_type != LAYOUT4_FLEX_FILES) {
+		LogDebug(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->lo_type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	if (!arg->dispose || seg == NULL)
+		return NFS4_OK;
+
+	retval = vfs_pnfs_update_layouts(OBJ_VFS_FROM_FSAL(obj_hdl),
+					 seg->other, seg->iomode, 0, NULL);
+
+	/* The file may be gone, the layout is returned either way */
+	if (retval != 0)
+		LogDebug(COMPONENT_PNFS, "Could not drop the layout: %s",
+			 strerror(retval));
+
+	gsh_free(seg);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Commit a segment of a layout
+ *
+ * The data servers write straight into the backing filesystem, so size and
+ * times are already correct and there is nothing left to do.
+ *
+ * @param[in]     obj_hdl  Public object handle
+ * @param[in]     lou_body Layout specific arguments, ignored
+ * @param[in]     arg      Input arguments of the function
+ * @param[in,out] res      In/out and output arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, p. 366.
+ */
+static nfsstat4 vfs_layoutcommit(struct fsal_obj_handle *obj_hdl,
+				 XDR *lou_body,
+				 const struct fsal_layoutcommit_arg *arg,
+				 struct fsal_layoutcommit_res *res)
+{
+	if (arg->type != LAYOUT4_FLEX_FILES) {
+		LogCrit(COMPONENT_PNFS, "Unsupported layout type: %x",
+			arg->type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	res->size_supplied = false;
+	res->commit_done = true;
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Find a data server by its universal address
+ *
+ * @param[in] param PNFS parameters of the export
+ * @param[in] uaddr Universal address as reported by the client
+ *
+ * @return The data server or NULL.
+ */
+static struct vfs_pnfs_ds_parameter *
+vfs_pnfs_ds_by_uaddr(struct vfs_pnfs_parameter *param, const char *uaddr)
+{
+	uint32_t i;
+
+	for (i = 0; i < param->nb_ds; i++) {
+		struct vfs_pnfs_ds_parameter *ds = &param->ds_array[i];
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ds->ipaddr;
+		uint32_t addr = ntohl(sin->sin_addr.s_addr);
+		char buf[24];
+
+		(void)snprintf(buf, sizeof(buf), "%u.%u.%u.%u.%u.%u",
+			       (addr & 0xFF000000) >> 24,
+			       (addr & 0x00FF0000) >> 16,
+			       (addr & 0x0000FF00) >> 8, addr & 0x000000FF,
+			       (ds->ipport & 0xFF00) >> 8, ds->ipport & 0x00FF);
+
+		if (strcmp(buf, uaddr) == 0)
+			return ds;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Account client reported traffic to a data server
+ *
+ * The flex files lou_body names the data server the statistics are for,
+ * charge the completed bytes to it so layout selection can balance load.
+ *
+ * @param[in] obj_hdl  Public object handle
+ * @param[in] lou_body ff_layoutupdate4
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK
+ */
+static nfsstat4 vfs_layoutstats(struct fsal_obj_handle *obj_hdl,
+				XDR *lou_body,
+				const struct fsal_layoutstats_arg *arg)
+{
+	struct vfs_fsal_export *myexport =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export);
+	struct vfs_pnfs_ds_parameter *ds;
+	ff_layoutupdate4 update;
+
+	if (!myexport->pnfs_mds_enabled || arg->type != LAYOUT4_FLEX_FILES)
+		return NFS4_OK;
+
+	memset(&update, 0, sizeof(update));
+
+	if (!xdr_ff_layoutupdate4(lou_body, &update)) {
+		LogDebug(COMPONENT_PNFS, "Could not decode ff_layoutupdate4");
+		xdr_free((xdrproc_t)xdr_ff_layoutupdate4, &update);
+		return NFS4_OK;
+	}
+
+	if (update.ffl_addr.r_addr != NULL) {
+		ds = vfs_pnfs_ds_by_uaddr(&myexport->pnfs_param,
+					  update.ffl_addr.r_addr);
+
+		if (ds != NULL) {
+			(void)atomic_add_uint64_t(
+				&ds->io_bytes,
+				update.ffl_read.ffil_bytes_completed +
+					update.ffl_write.ffil_bytes_completed);
+		}
+	}
+
+	xdr_free((xdrproc_t)xdr_ff_layoutupdate4, &update);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Take a data server out of rotation for a client after its error
+ *
+ * The client keeps its failure slot of the data server if it has one,
+ * else takes a free or expired slot, or the slot of the client whose
+ * failure expires first if all the slots are in use.
+ *
+ * @param[in] obj_hdl Public object handle
+ * @param[in] arg     Input arguments of the function
+ *
+ * @return NFS4_OK
+ */
+static nfsstat4 vfs_layouterror(struct fsal_obj_handle *obj_hdl,
+				const struct fsal_layouterror_arg *arg)
+{
+	struct vfs_fsal_export *myexport =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export);
+	struct vfs_pnfs_parameter *param = &myexport->pnfs_param;
+	struct vfs_pnfs_ds_parameter *ds;
+	struct vfs_pnfs_ds_failure *failure;
+	time_t now = time(NULL);
+	int i;
+
+	if (!myexport->pnfs_mds_enabled || op_ctx->clientid == NULL ||
+	    arg->deviceid.fsal_id != FSAL_ID_VFS ||
+	    arg->deviceid.device_id2 != op_ctx->ctx_export->export_id ||
+	    arg->deviceid.device_id4 >= param->nb_ds)
+		return NFS4_OK;
+
+	ds = &param->ds_array[arg->deviceid.device_id4];
+
+	LogEvent(COMPONENT_PNFS,
+		 "Data server %" PRIu16 " reported %s for %s by client %"
+		 PRIx64 ", avoiding it for that client for %" PRIu32
+		 " seconds",
+		 ds->id_servers, nfsstat4_to_str(arg->status),
+		 nfsop4_to_str(arg->opnum), *op_ctx->clientid,
+		 param->ds_fail_timeout);
+
+	PTHREAD_MUTEX_lock(&vfs_pnfs_failures_lock);
+
+	failure = NULL;
+
+	for (i = 0; failure == NULL && i < VFS_PNFS_DS_FAILURES; i++) {
+		if (ds->failures[i].clientid == *op_ctx->clientid)
+			failure = &ds->failures[i];
+	}
+
+	for (i = 0; failure == NULL && i < VFS_PNFS_DS_FAILURES; i++) {
+		if (ds->failures[i].until <= now)
+			failure = &ds->failures[i];
+	}
+
+	if (failure == NULL) {
+		failure = &ds->failures[0];
+
+		for (i = 1; i < VFS_PNFS_DS_FAILURES; i++) {
+			if (ds->failures[i].until < failure->until)
+				failure = &ds->failures[i];
+		}
+	}
+
+	failure->clientid = *op_ctx->clientid;
+	failure->until = now + param->ds_fail_timeout;
+
+	PTHREAD_MUTEX_unlock(&vfs_pnfs_failures_lock);
+
+	return NFS4_OK;
+}
+
+void vfs_handle_ops_pnfs(struct fsal_obj_ops *ops)
+{
+	ops->layoutget = vfs_layoutget;
+	ops->layoutreturn = vfs_layoutreturn;
+	ops->layoutcommit = vfs_layoutcommit;
+	ops->layoutstats = vfs_layoutstats;
+	ops->layouterror = vfs_layouterror;
+}
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/readahead.c
+ * @brief Sequential stream detection and readahead for FSAL_VFS
+ *
+ * Clients spreading a sequential read over several connections send
+ * READs slightly out of order, which defeats the readahead heuristics of
+ * the kernel, so each read is tracked against a few streams per file.
+ * A read within a readahead window of the frontier of a stream belongs to
+ * it, whatever its order, and once a stream has seen a few reads the
+ * range ahead of it is advised with POSIX_FADV_WILLNEED.  Optionally,
+ * pages far enough behind a stream are dropped with POSIX_FADV_DONTNEED
+ * so that streaming large files does not evict the rest of the page
+ * cache.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include "fsal.h"
+#include "vfs_methods.h"
+#include "FSAL/fsal_commonlib.h"
+
+/**
+ * @brief Number of concurrent streams tracked per file
+ */
+#define VFS_RA_STREAMS 4
+
+/**
+ * @brief Reads a stream must see before readahead is issued for it
+ */
+#define VFS_RA_MIN_READS 2
+
+/**
+ * @brief A sequential stream of reads of a file
+ */
+struct vfs_ra_stream {
+	uint64_t end; /*< Highest end offset read */
+	uint64_t ra_end; /*< Readahead was issued up to here */
+	uint64_t dropped; /*< Pages were dropped up to here */
+	uint64_t used; /*< Last use, for replacement */
+	uint32_t reads; /*< Number of reads of the stream */
+};
+
+/**
+ * @brief Read streams of a file
+ */
+struct vfs_readahead {
+	pthread_mutex_t lock; /*< Protects everything below */
+	uint64_t clock; /*< Incremented on each read */
+	struct vfs_ra_stream streams[VFS_RA_STREAMS];
+};
+
+static struct vfs_readahead *vfs_readahead_get(struct vfs_fsal_obj_handle *hdl)
+{
+	struct vfs_readahead *ra;
+
+	ra = atomic_fetch_voidptr((void **)&hdl->u.file.ra);
+
+	if (ra != NULL)
+		return ra;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+
+	ra = hdl->u.file.ra;
+
+	if (ra == NULL) {
+		ra = gsh_calloc(1, sizeof(*ra));
+		PTHREAD_MUTEX_init(&ra->lock, NULL);
+		atomic_store_voidptr((void **)&hdl->u.file.ra, ra);
+	}
+
+	PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+
+	return ra;
+}
+
+/**
+ * @brief Find the stream a read belongs to, or replace the least recently
+ *        used one
+ *
+ * @param[in] ra     Read streams of the file
+ * @param[in] offset Offset of the read
+ * @param[in] end    End of the read
+ * @param[in] window How far from the frontier of a stream a read may be
+ *
+ * @return The stream, with reads == 0 if it is a new one.
+ */
+static struct vfs_ra_stream *vfs_ra_match(struct vfs_readahead *ra,
+					  uint64_t offset, uint64_t end,
+					  uint64_t window)
+{
+	struct vfs_ra_stream *stream, *best = NULL, *lru = &ra->streams[0];
+	uint64_t distance, best_distance = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < VFS_RA_STREAMS; i++) {
+		stream = &ra->streams[i];
+
+		if (stream->used < lru->used)
+			lru = stream;
+
+		if (stream->reads == 0)
+			continue;
+
+		/* Reordered reads land a little behind the frontier, the
+		 * next ones a little ahead of it.
+		 */
+		if (offset > stream->end)
+			distance = offset - stream->end;
+		else if (end < stream->end)
+			distance = stream->end - end;
+		else
+			distance = 0;
+
+		if (distance <= window && distance < best_distance) {
+			best = stream;
+			best_distance = distance;
+		}
+	}
+
+	if (best != NULL)
+		return best;
+
+	memset(lru, 0, sizeof(*lru));
+	lru->end = end;
+	lru->ra_end = end;
+	lru->dropped = offset;
+
+	return lru;
+}
+
+/**
+ * @brief Account a read, and advise the kernel about the stream it belongs to
+ *
+ * @param[in] myself File read
+ * @param[in] fd     File descriptor the read was done on
+ * @param[in] offset Offset of the read
+ * @param[in] len    Amount actually read
+ */
+void vfs_readahead(struct vfs_fsal_obj_handle *myself, int fd,
+		   uint64_t offset, size_t len)
+{
+	struct vfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct vfs_fsal_export,
+			     export);
+	uint64_t ra_size = export->readahead_size;
+	uint64_t end = offset + len;
+	uint64_t window, ahead = 0, ahead_len = 0, behind = 0, behind_len = 0;
+	struct vfs_readahead *ra;
+	struct vfs_ra_stream *stream;
+	const char *result = NULL;
+
+	if (ra_size == 0 || len == 0)
+		return;
+
+	/* A read of a stream may be reordered by up to the readahead size,
+	 * or by a few reads for small readahead sizes.
+	 */
+	window = MAX(ra_size, 8 * (uint64_t)len);
+
+	ra = vfs_readahead_get(myself);
+
+	PTHREAD_MUTEX_lock(&ra->lock);
+
+	stream = vfs_ra_match(ra, offset, end, window);
+	stream->used = ++ra->clock;
+
+	if (stream->reads >= VFS_RA_MIN_READS)
+		result = end <= stream->ra_end ? "hit" : "miss";
+
+	stream->reads++;
+
+	if (end > stream->end)
+		stream->end = end;
+
+	if (stream->reads >= VFS_RA_MIN_READS &&
+	    stream->end + ra_size / 2 > stream->ra_end) {
+		/* Less than half the readahead is left, issue the rest */
+		ahead = MAX(stream->ra_end, stream->end);
+		ahead_len = stream->end + ra_size - ahead;
+		stream->ra_end = stream->end + ra_size;
+	}
+
+	if (export->drop_behind && stream->reads >= VFS_RA_MIN_READS &&
+	    stream->end > stream->dropped + 2 * window) {
+		/* Keep a window behind the frontier for reordered reads */
+		behind = stream->dropped;
+		behind_len = stream->end - window - behind;
+		stream->dropped += behind_len;
+	}
+
+	PTHREAD_MUTEX_unlock(&ra->lock);
+
+	if (ahead_len != 0)
+		(void)posix_fadvise(fd, ahead, ahead_len,
+				    POSIX_FADV_WILLNEED);
+
+	if (behind_len != 0)
+		(void)posix_fadvise(fd, behind, behind_len,
+				    POSIX_FADV_DONTNEED);
+
+	if (result != NULL || ahead_len != 0) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "read %" PRIu64 "+%zu %s, readahead %" PRIu64
+			     "+%" PRIu64 ", drop %" PRIu64 "+%" PRIu64,
+			     offset, len, result ? result : "new", ahead,
+			     ahead_len, behind, behind_len);
+
+		fsal_metrics__readahead(result, ahead_len,
+					op_ctx->ctx_export->export_id);
+	}
+}
+
+/**
+ * @brief Free the read streams of a file
+ *
+ * @param[in] myself File being released
+ */
+void vfs_readahead_free(struct vfs_fsal_obj_handle *myself)
+{
+	struct vfs_readahead *ra = myself->u.file.ra;
+
+	if (ra == NULL)
+		return;
+
+	PTHREAD_MUTEX_destroy(&ra->lock);
+	gsh_free(ra);
+	myself->u.file.ra = NULL;
+}
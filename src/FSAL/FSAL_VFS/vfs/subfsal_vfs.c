@@ -55,6 +55,11 @@ static struct config_item export_params[] = {
 			fsid_type),
 	CONF_ITEM_BOOL("async_hsm_restore", true, vfs_fsal_export,
 		       async_hsm_restore),
+	CONF_ITEM_UI64("readahead_size", 0, 1024 * 1024 * 1024,
+		       0, vfs_fsal_export, readahead_size),
+	CONF_ITEM_BOOL("drop_behind", false, vfs_fsal_export, drop_behind),
+	CONF_ITEM_BLOCK("PNFS", vfs_pnfs_params, noop_conf_init,
+			vfs_pnfs_commit, vfs_fsal_export, pnfs_param),
 	CONFIG_EOL
 };
 
@@ -47,6 +47,54 @@ struct vfs_fsal_module {
 	struct fsal_module module;
 	struct fsal_obj_ops handle_ops;
 	bool only_one_user;
+	char *pnfs_key; /*< Secret shared by the pNFS MDS and its DSs */
+	uint64_t pnfs_sipkey[2]; /*< Key for DS stateids, from pnfs_key */
+};
+
+/*
+ * VFS flex files pNFS parameters
+ */
+
+/** Maximum number of data servers a VFS MDS export may stripe over */
+#define VFS_PNFS_MAX_DS 16
+
+/** Clients whose errors on a data server are remembered at a time */
+#define VFS_PNFS_DS_FAILURES 32
+
+/**
+ * @brief A client that reported an error on a data server
+ */
+struct vfs_pnfs_ds_failure {
+	uint64_t clientid; /*< The client that reported the error */
+	time_t until; /*< Do not hand the DS to the client before this time */
+};
+
+/**
+ * @brief A Ganesha data server used by a VFS flex files MDS export
+ *
+ * The data server must export the same backing filesystem, so that VFS
+ * handles handed out by the MDS resolve to the same files there.
+ */
+struct vfs_pnfs_ds_parameter {
+	sockaddr_t ipaddr; /*< Address of the data server */
+	uint16_t ipport; /*< Port of the data server */
+	uint16_t id_servers; /*< Export_Id of the DS export on that server */
+	/* Run-time state, maintained from LAYOUTSTATS and LAYOUTERROR */
+	uint64_t io_bytes; /*< Bytes reported through LAYOUTSTATS */
+	/** Clients to not hand the DS to, protected by the failures lock */
+	struct vfs_pnfs_ds_failure failures[VFS_PNFS_DS_FAILURES];
+};
+
+struct vfs_pnfs_parameter {
+	uint32_t stripe_unit; /*< Bytes per stripe */
+	uint32_t stripe_width; /*< Data servers per mirror, 0 for all */
+	uint32_t mirror_count; /*< Mirrors of READ layouts */
+	uint32_t stats_collect_hint; /*< LAYOUTSTATS interval in seconds */
+	uint32_t ds_fail_timeout; /*< Seconds to avoid a DS after error */
+	char *ffds_user; /*< Synthetic user for DS access */
+	char *ffds_group; /*< Synthetic group for DS access */
+	uint32_t nb_ds; /*< Number of configured data servers */
+	struct vfs_pnfs_ds_parameter ds_array[VFS_PNFS_MAX_DS];
 };
 
 /*
@@ -56,6 +104,12 @@ struct vfs_fsal_export {
 	struct fsal_export export;
 	int fsid_type;
 	bool async_hsm_restore;
+	bool pnfs_ds_enabled;
+	bool pnfs_mds_enabled;
+	struct vfs_pnfs_parameter pnfs_param;
+	uint64_t readahead_size; /*< Readahead ahead of sequential streams,
+				     0 to disable */
+	bool drop_behind; /*< Drop pages behind sequential streams */
 };
 
 #define EXPORT_VFS_FROM_FSAL(fsal) \
@@ -161,6 +215,8 @@ struct vfs_state_fd {
  * this, we save the args that were used to mknod or lookup the socket.
  */
 
+struct vfs_readahead;
+
 struct vfs_fsal_obj_handle {
 	struct fsal_obj_handle obj_handle;
 	fsal_dev_t dev;
@@ -174,6 +230,8 @@ struct vfs_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			struct vfs_readahead *ra; /*< Read streams, allocated
+						      on first read */
 		} file;
 		struct {
 			unsigned char *link_content;
@@ -395,4 +453,29 @@ fsal_status_t find_fd(struct fsal_fd **out_fd, struct fsal_obj_handle *obj_hdl,
 		      struct fsal_fd *tmp_fd, struct state_t *state,
 		      fsal_openflags_t openflags, bool bypass);
 
+/* Sequential stream detection and readahead */
+void vfs_readahead(struct vfs_fsal_obj_handle *myself, int fd,
+		   uint64_t offset, size_t len);
+void vfs_readahead_free(struct vfs_fsal_obj_handle *myself);
+
+/* pNFS flex files MDS and DS */
+extern struct config_item vfs_pnfs_params[];
+
+int vfs_pnfs_commit(void *node, void *link_mem, void *self_struct,
+		    struct config_error_type *err_type);
+
+void vfs_pnfs_release(struct vfs_pnfs_parameter *param);
+int vfs_pnfs_init_export(struct vfs_fsal_export *myself);
+void vfs_export_ops_pnfs(struct export_ops *ops);
+void vfs_handle_ops_pnfs(struct fsal_obj_ops *ops);
+void vfs_pnfs_ds_ops_init(struct fsal_pnfs_ds_ops *ops);
+nfsstat4 vfs_pnfs_check_ds_stateid(struct vfs_fsal_module *module, int fd,
+				   const struct gsh_buffdesc *ds_fh,
+				   const stateid4 *stateid,
+				   layoutiomode4 iomode);
+nfsstat4 vfs_getdeviceinfo(struct fsal_module *fsal_hdl, XDR *da_addr_body,
+			   const layouttype4 type,
+			   const struct pnfs_deviceid *deviceid);
+size_t vfs_fs_da_addr_size(struct fsal_module *fsal_hdl);
+
 #endif /* VFS_METHODS_H */
@@ -100,6 +100,12 @@ static struct config_item xfs_params[] = {
 	CONF_ITEM_BOOL("auth_xdev_export", false, vfs_fsal_module,
 		       module.fs_info.auth_exportpath_xdev),
 	CONF_ITEM_BOOL("only_one_user", false, vfs_fsal_module, only_one_user),
+	CONF_ITEM_BOOL("PNFS_MDS", false, vfs_fsal_module,
+		       module.fs_info.pnfs_mds),
+	CONF_ITEM_BOOL("PNFS_DS", false, vfs_fsal_module,
+		       module.fs_info.pnfs_ds),
+	CONF_ITEM_STR("PNFS_Key", 16, 256, NULL, vfs_fsal_module,
+		      pnfs_key),
 	CONFIG_EOL
 };
 
@@ -209,9 +215,13 @@ MODULE_INIT void xfs_init(void)
 	myself->m_ops.create_export = vfs_create_export;
 	myself->m_ops.update_export = vfs_update_export;
 	myself->m_ops.init_config = init_config;
+	myself->m_ops.getdeviceinfo = vfs_getdeviceinfo;
+	myself->m_ops.fs_da_addr_size = vfs_fs_da_addr_size;
+	myself->m_ops.fsal_pnfs_ds_ops = vfs_pnfs_ds_ops_init;
 
 	/* Initialize the fsal_obj_handle ops for FSAL XFS */
 	vfs_handle_ops_init(&XFS.handle_ops);
+	vfs_handle_ops_pnfs(&XFS.handle_ops);
 }
 
 MODULE_FINI void xfs_unload(void)
@@ -36,8 +36,15 @@
 
 /* Export */
 
-static struct config_item export_params[] = { CONF_ITEM_NOOP("name"),
-					      CONFIG_EOL };
+static struct config_item export_params[] = {
+	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_UI64("readahead_size", 0, 1024 * 1024 * 1024,
+		       0, vfs_fsal_export, readahead_size),
+	CONF_ITEM_BOOL("drop_behind", false, vfs_fsal_export, drop_behind),
+	CONF_ITEM_BLOCK("PNFS", vfs_pnfs_params, noop_conf_init,
+			vfs_pnfs_commit, vfs_fsal_export, pnfs_param),
+	CONFIG_EOL
+};
 
 static struct config_block export_param_block = {
 	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.xfs-export%d",
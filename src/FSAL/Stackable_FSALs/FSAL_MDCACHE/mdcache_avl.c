@@ -63,6 +63,258 @@ void mdcache_avl_init(mdcache_entry_t *entry)
 		     0 /* flags */);
 	avltree_init(&entry->fsobj.fsdir.avl.sorted, avl_dirent_sorted_cmpf,
 		     0 /* flags */);
+	entry->fsobj.fsdir.avl.filter = NULL;
+}
+
+static inline uint64_t avl_dirent_hash(const char *name, size_t namelen)
+{
+#if AVL_HASH_MURMUR3
+	uint32_t hk[4];
+	uint64_t namehash;
+
+	MurmurHash3_x64_128(name, namelen, 67, hk);
+	memcpy(&namehash, hk, 8);
+	return namehash;
+#else
+	return CityHash64WithSeed(name, namelen, 67);
+#endif
+}
+
+/**
+ * @brief Counting Bloom filter of the names of a directory
+ *
+ * Counters are 4 bits, a counter that reaches 15 is never decremented
+ * again.  Since an overcounted name only costs a lookup in the FSAL, names
+ * are counted whenever they are inserted in the names tree, and only
+ * uncounted when they are removed from the directory.
+ *
+ * A name whose dirent was reaped with its chunk is counted again when it
+ * is read back, so how full the filter is is measured by the counters in
+ * use rather than by the names counted: a name already counted does not
+ * put any new counter to use.
+ */
+struct mdcache_name_filter {
+	uint32_t mask; /*< Number of counters - 1 */
+	uint32_t used; /*< Counters that are not 0 */
+	uint32_t max_used; /*< Past this many counters used, drop the filter */
+	uint8_t counters[]; /*< Two counters per byte */
+};
+
+/** Counters per name in the filter, and probes per name. */
+#define AVL_FILTER_RATIO 8
+#define AVL_FILTER_PROBES 4
+#define AVL_FILTER_SATURATED 15
+
+/** Share of the counters in use when the filter holds one name per
+ *  AVL_FILTER_RATIO counters, 1 - e^(-AVL_FILTER_PROBES/AVL_FILTER_RATIO)
+ *  is about 2/5.
+ */
+#define AVL_FILTER_MAX_USED(counters) ((counters) / 5 * 2)
+
+static inline uint32_t avl_filter_probe(struct mdcache_name_filter *filter,
+					uint64_t namehash, int i)
+{
+	/* Double hashing with the two halves of the name hash */
+	return ((uint32_t)namehash + i * ((uint32_t)(namehash >> 32) | 1)) &
+	       filter->mask;
+}
+
+static inline uint8_t avl_filter_get(struct mdcache_name_filter *filter,
+				     uint32_t idx)
+{
+	return (filter->counters[idx / 2] >> ((idx & 1) * 4)) & 0xf;
+}
+
+static inline void avl_filter_set(struct mdcache_name_filter *filter,
+				  uint32_t idx, uint8_t val)
+{
+	int shift = (idx & 1) * 4;
+
+	filter->counters[idx / 2] =
+		(filter->counters[idx / 2] & ~(0xf << shift)) | (val << shift);
+}
+
+static void avl_filter_add(mdcache_entry_t *entry, uint64_t namehash)
+{
+	struct mdcache_name_filter *filter = entry->fsobj.fsdir.avl.filter;
+	uint32_t idx;
+	uint8_t val;
+	int i;
+
+	if (filter == NULL)
+		return;
+
+	for (i = 0; i < AVL_FILTER_PROBES; i++) {
+		idx = avl_filter_probe(filter, namehash, i);
+		val = avl_filter_get(filter, idx);
+
+		if (val == 0)
+			filter->used++;
+
+		if (val < AVL_FILTER_SATURATED)
+			avl_filter_set(filter, idx, val + 1);
+	}
+
+	if (filter->used > filter->max_used) {
+		/* Too full to be useful anymore */
+		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_MDCACHE,
+				"Dropping full name filter of %p", entry);
+		mdcache_avl_filter_free(entry);
+	}
+}
+
+static void avl_filter_remove(mdcache_entry_t *entry, uint64_t namehash)
+{
+	struct mdcache_name_filter *filter = entry->fsobj.fsdir.avl.filter;
+	uint32_t idx;
+	uint8_t val;
+	int i;
+
+	if (filter == NULL)
+		return;
+
+	for (i = 0; i < AVL_FILTER_PROBES; i++) {
+		idx = avl_filter_probe(filter, namehash, i);
+		val = avl_filter_get(filter, idx);
+
+		if (val == 0) {
+			/* The name was never counted, something is off, don't
+			 * trust the filter anymore.
+			 */
+			LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_MDCACHE,
+				    "Name filter of %p is inconsistent",
+				    entry);
+			mdcache_avl_filter_free(entry);
+			return;
+		}
+	}
+
+	for (i = 0; i < AVL_FILTER_PROBES; i++) {
+		idx = avl_filter_probe(filter, namehash, i);
+		val = avl_filter_get(filter, idx);
+
+		/* Two probes may share a counter */
+		if (val == 0 || val == AVL_FILTER_SATURATED)
+			continue;
+
+		if (val == 1)
+			filter->used--;
+
+		avl_filter_set(filter, idx, val - 1);
+	}
+}
+
+/**
+ * @brief Build the negative lookup filter of a directory
+ *
+ * The names tree must hold every name of the directory, that is the
+ * directory has just been found to be fully populated.  Nothing is done if
+ * the directory already has a filter, which is kept up to date.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry  The directory
+ */
+void mdcache_avl_filter_build(mdcache_entry_t *entry)
+{
+	struct mdcache_name_filter *filter;
+	struct avltree_node *node;
+	mdcache_dir_entry_t *dirent;
+	uint64_t size = avltree_size(&entry->fsobj.fsdir.avl.t);
+	uint32_t capacity, counters = 64;
+
+#ifdef DEBUG_MDCACHE
+	assert(entry->content_lock.__data.__cur_writer);
+#endif
+
+	if (entry->fsobj.fsdir.avl.filter != NULL ||
+	    mdcache_param.dir.avl_filter_max == 0 ||
+	    size > mdcache_param.dir.avl_filter_max)
+		return;
+
+	/* Leave room for the directory to double before the filter is
+	 * dropped, at a false positive rate of about 2.5% when full.
+	 */
+	capacity = size < 16 ? 32 : 2 * size;
+	while (counters < capacity * AVL_FILTER_RATIO)
+		counters <<= 1;
+
+	filter = gsh_calloc(1, sizeof(*filter) + counters / 2);
+	filter->mask = counters - 1;
+	filter->max_used = AVL_FILTER_MAX_USED(counters);
+	entry->fsobj.fsdir.avl.filter = filter;
+
+	for (node = avltree_first(&entry->fsobj.fsdir.avl.t); node != NULL;
+	     node = avltree_next(node)) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_name);
+		avl_filter_add(entry, dirent->namehash);
+	}
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_MDCACHE,
+			"Built name filter of %p for %" PRIu64
+			" names with %" PRIu32 " counters",
+			entry, size, counters);
+}
+
+/**
+ * @brief Free the negative lookup filter of a directory
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry  The directory
+ */
+void mdcache_avl_filter_free(mdcache_entry_t *entry)
+{
+	gsh_free(entry->fsobj.fsdir.avl.filter);
+	entry->fsobj.fsdir.avl.filter = NULL;
+}
+
+/**
+ * @brief Check a name against the negative lookup filter of a directory
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in] entry  The directory
+ * @param[in] name   The name looked up
+ *
+ * @retval true if the name is certainly not in the directory.
+ * @retval false if it may be, or the directory has no filter.
+ */
+bool mdcache_avl_filter_excludes(mdcache_entry_t *entry, const char *name)
+{
+	struct mdcache_name_filter *filter = entry->fsobj.fsdir.avl.filter;
+	uint64_t namehash;
+	int i;
+
+	if (filter == NULL)
+		return false;
+
+	namehash = avl_dirent_hash(name, strlen(name));
+
+	for (i = 0; i < AVL_FILTER_PROBES; i++) {
+		if (avl_filter_get(filter,
+				   avl_filter_probe(filter, namehash, i)) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Uncount a name removed from a directory
+ *
+ * Only names still in the names tree are known to have been counted.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry   The directory
+ * @param[in] dirent  The dirent of the name
+ */
+void mdcache_avl_filter_remove(mdcache_entry_t *entry,
+			       mdcache_dir_entry_t *dirent)
+{
+	avl_filter_remove(entry, dirent->namehash);
 }
 
 static inline struct avltree_node *
@@ -304,9 +556,6 @@ int mdcache_avl_insert_ck(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 int mdcache_avl_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 {
 	mdcache_dir_entry_t *v = *dirent, *v2;
-#if AVL_HASH_MURMUR3
-	uint32_t hk[4];
-#endif
 	struct avltree_node *node;
 	int code;
 
@@ -317,12 +566,12 @@ int mdcache_avl_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 #endif
 
 	/* compute hash */
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(v->name, strlen(v->name), 67, hk);
-	memcpy(&v->namehash, hk, 8);
-#else
-	v->namehash = CityHash64WithSeed(v->name, strlen(v->name), 67);
-#endif
+	v->namehash = avl_dirent_hash(v->name, strlen(v->name));
+
+	/* Count the name whether or not it makes it into the tree, the
+	 * filter must never miss a name of the directory.
+	 */
+	avl_filter_add(entry, v->namehash);
 
 again:
 
@@ -549,23 +798,14 @@ mdcache_dir_entry_t *mdcache_avl_lookup(mdcache_entry_t *entry,
 	struct avltree_node *node;
 	mdcache_dir_entry_t *v2;
 	mdcache_dir_entry_t v;
-#if AVL_HASH_MURMUR3
-	uint32_t hashbuff[4];
-#endif
-	size_t namelen = strlen(name);
 
 	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_MDCACHE, "Lookup %s",
 			name);
 
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(name, namelen, 67, hashbuff);
-	/* This seems to be correct.  The avltree_lookup function looks
-	   as hk.k, but does no namecmp on its own, so there's no need to
-	   allocate space for or copy the name in the key. */
-	memcpy(&v.namehash, hashbuff, 8);
-#else
-	v.namehash = CityHash64WithSeed(name, namelen, 67);
-#endif
+	/* The name is not copied into the key, avl_dirent_name_cmpf only
+	 * needs a pointer to it.
+	 */
+	v.namehash = avl_dirent_hash(name, strlen(name));
 	v.name = name;
 
 	node = avltree_lookup(&v.node_name, &entry->fsobj.fsdir.avl.t);
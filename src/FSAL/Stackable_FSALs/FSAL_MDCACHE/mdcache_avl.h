@@ -47,6 +47,12 @@
  * Heuristic methods are used to detect worst-case scenarios and fall
  * back to tractable (e.g., lookup) algorithms.
  *
+ * Once a directory has been fully populated, a counting Bloom filter of
+ * the hashes of its names is kept along with the trees.  It outlives the
+ * dirents reaped with their chunks, so lookups of names that certainly do
+ * not exist can still be answered without calling the FSAL.  The filter
+ * is dropped whenever the dirent cache is invalidated.
+ *
  */
 
 #ifndef MDCACHE_AVL_H
@@ -126,6 +132,12 @@ mdcache_dir_entry_t *mdcache_avl_lookup(mdcache_entry_t *entry,
 					const char *name);
 void mdcache_avl_clean_trees(mdcache_entry_t *parent);
 
+void mdcache_avl_filter_build(mdcache_entry_t *entry);
+void mdcache_avl_filter_free(mdcache_entry_t *entry);
+bool mdcache_avl_filter_excludes(mdcache_entry_t *entry, const char *name);
+void mdcache_avl_filter_remove(mdcache_entry_t *entry,
+			       mdcache_dir_entry_t *dirent);
+
 void unchunk_dirent(mdcache_dir_entry_t *dirent);
 #endif /* MDCACHE_AVL_H */
 
@@ -35,6 +35,7 @@
 
 #include "mdcache_int.h"
 #include "mdcache_lru.h"
+#include "mdcache_avl.h"
 
 /**
  * @brief Get the sub-FSAL handle from an MDCACHE handle
@@ -56,4 +57,44 @@ struct fsal_obj_handle *mdcdb_get_sub_handle(struct fsal_obj_handle *obj_hdl)
 	return entry->sub_handle;
 }
 
+/**
+ * @brief Drop the dirent chunks of a directory
+ *
+ * This does what the chunk reaper does to a directory whose chunks are
+ * all reclaimed, the dirents go but the negative lookup filter stays.
+ *
+ * @param[in] dir_hdl	MDCACHE handle of the directory
+ */
+void mdcdb_reap_dir_chunks(struct fsal_obj_handle *dir_hdl)
+{
+	mdcache_entry_t *entry =
+		container_of(dir_hdl, mdcache_entry_t, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+	mdcache_clean_dirent_chunks(entry);
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+}
+
+/**
+ * @brief Check a name against the negative lookup filter of a directory
+ *
+ * @param[in] dir_hdl	MDCACHE handle of the directory
+ * @param[in] name	Name to check
+ * @return true if the filter rules the name out, false if it may exist or
+ * the directory has no filter
+ */
+bool mdcdb_name_filter_excludes(struct fsal_obj_handle *dir_hdl,
+				const char *name)
+{
+	mdcache_entry_t *entry =
+		container_of(dir_hdl, mdcache_entry_t, obj_handle);
+	bool excludes;
+
+	PTHREAD_RWLOCK_rdlock(&entry->content_lock);
+	excludes = mdcache_avl_filter_excludes(entry, name);
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+
+	return excludes;
+}
+
 #endif /* MDCACHE_DEBUG_H */
@@ -322,6 +322,7 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 
 	PTHREAD_MUTEX_destroy(&exp->mdc_exp_lock);
 	PTHREAD_MUTEX_destroy(&exp->dirent_map.dm_mtx);
+	mdc_quota_put(exp->quota);
 
 	gsh_free(exp); /* elvis has left the building */
 }
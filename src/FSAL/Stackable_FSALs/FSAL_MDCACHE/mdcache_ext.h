@@ -39,6 +39,15 @@
  * @{
  */
 
+/**
+ * @brief Replacement policies for cache entries
+ */
+
+enum mdcache_lru_policy {
+	MDCACHE_LRU_POLICY_LRU, /*< Promote on reference, demote with age */
+	MDCACHE_LRU_POLICY_2Q, /*< Scan resistant 2Q with a ghost list */
+};
+
 /**
  * @brief Structure to hold MDCACHE parameters
  */
@@ -66,6 +75,10 @@ struct mdcache_parameter {
 		uint32_t avl_detached_mult;
 		/** Computed max detached dirents */
 		uint32_t avl_detached_max;
+		/** Largest directory, in names, given a negative lookup
+		 *  filter, 0 disables the filters.
+		 */
+		uint32_t avl_filter_max;
 	} dir;
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
@@ -75,12 +88,29 @@ struct mdcache_parameter {
 	    the high water mark. Set it to 0 does not attempt to release
 	    entries. Defaults to 100, settable by Entries_Release_Size. */
 	uint32_t entries_release_size;
+	/** Replacement policy for cache entries.  Defaults to LRU,
+	    settable with LRU_Policy. */
+	uint32_t lru_policy;
+	/** With the 2Q policy, the percentage of Entries_HWMark kept for
+	    entries referenced only once before entries referenced again
+	    are reclaimed.  Defaults to 25, settable with
+	    LRU_Probation_Percent. */
+	uint32_t lru_probation_percent;
+	/** With the 2Q policy, the number of recently evicted entries
+	    remembered, as a percentage of Entries_HWMark.  Defaults to 50,
+	    settable with LRU_Ghost_Percent. */
+	uint32_t lru_ghost_percent;
 	/** High water mark for chunks.  Defaults to 100000,
 	    settable by Chunks_HWMark. */
 	uint32_t chunks_hwmark;
 	/** Low water mark for chunks.  Defaults to 10000,
 	    settable by Chunks_HWMark. */
 	uint32_t chunks_lwmark;
+	/** Bytes allocated by MDCACHE above which the reaper releases
+	    entries, 0 for no limit.  Only enforced when built with
+	    USE_MEM_ACCOUNTING.  Defaults to 0, settable with
+	    Memory_Limit. */
+	uint64_t memory_limit;
 	/** Base interval in seconds between runs of the LRU cleaner
 	    thread. Defaults to 90, settable with LRU_Run_Interval. */
 	uint32_t lru_run_interval;
@@ -144,6 +174,10 @@ struct mdcache_parameter {
 	    can significantly improve performance saving the need to update
 	    attributes on many read/write operations. */
 	bool use_cached_owner_on_owner_override;
+	/** Number of encoded NFSv4 attribute replies memoized on each
+	    entry.  Defaults to 0 (disabled), settable with
+	    Fattr_Cache_Slots. */
+	uint32_t fattr_cache_slots;
 };
 
 extern struct mdcache_parameter mdcache_param;
@@ -197,6 +197,7 @@ mdc_open2_by_name(mdcache_entry_t *mdc_parent, struct state_t *state,
 		/* Invalidate the attributes since we just truncated. */
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 	}
 
 	if (attrs_out) {
@@ -400,6 +401,7 @@ mdcache_open2(struct fsal_obj_handle *obj_hdl, struct state_t *state,
 			 */
 			atomic_clear_uint32_t_bits(&mdc_parent->mde_flags,
 						   MDCACHE_TRUST_ATTRS);
+			mdc_listing_changed(mdc_parent);
 		}
 
 		LogFullDebug(COMPONENT_MDCACHE, "Open2 of object succeeded.");
@@ -507,6 +509,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	if (truncated && !FSAL_IS_ERROR(status)) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 	}
 
 	return status;
@@ -540,10 +543,15 @@ static void mdc_read_super_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 	mdcache_lru_ref(entry, LRU_ACTIVE_REF);
 	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
 
-	if (!FSAL_IS_ERROR(ret))
+	if (!FSAL_IS_ERROR(ret)) {
 		mdc_set_time_current(&entry->attrs.atime);
-	else if (ret.major == ERR_FSAL_STALE)
+		/* atime was updated in place, don't serve encodings of the
+		 * attributes made before.
+		 */
+		atomic_inc_uint32_t(&entry->fattr_generation);
+	} else if (ret.major == ERR_FSAL_STALE) {
 		mdcache_kill_entry(entry);
+	}
 	mdcache_lru_unref(entry, LRU_ACTIVE_REF);
 	gsh_free(arg);
 }
@@ -629,6 +637,7 @@ static void mdc_write_super_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 		atomic_inc_uint32_t(&entry->attr_generation);
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 	}
 
 	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
@@ -755,11 +764,13 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 	subcall(status = entry->sub_handle->obj_ops->commit2(entry->sub_handle,
 							     offset, len));
 
-	if (status.major == ERR_FSAL_STALE)
+	if (status.major == ERR_FSAL_STALE) {
 		mdcache_kill_entry(entry);
-	else
+	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
+	}
 
 	return status;
 }
@@ -856,11 +867,13 @@ fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 	subcall(status = entry->sub_handle->obj_ops->fallocate(
 			entry->sub_handle, state, offset, length, allocate););
 
-	if (status.major == ERR_FSAL_STALE)
+	if (status.major == ERR_FSAL_STALE) {
 		mdcache_kill_entry(entry);
-	else
+	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
+	}
 
 	return status;
 }
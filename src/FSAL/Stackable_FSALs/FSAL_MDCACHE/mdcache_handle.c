@@ -114,6 +114,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		 */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(parent);
 	}
 
 	if (mdcache_param.dir.avl_chunk != 0) {
@@ -521,6 +522,7 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 
 	/* Invalidate attributes, so refresh will be forced */
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+	mdc_listing_changed(entry);
 
 	if (FSAL_IS_SUCCESS(status) && !invalidate) {
 		/* Refresh destination directory attributes without
@@ -698,17 +700,21 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 		/* Mark target file attributes as invalid */
 		atomic_clear_uint32_t_bits(&mdc_lookup_dst->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(mdc_lookup_dst);
 	}
 
 	/* Mark renamed file attributes as invalid */
 	atomic_clear_uint32_t_bits(&mdc_obj->mde_flags, MDCACHE_TRUST_ATTRS);
+	mdc_listing_changed(mdc_obj);
 
 	/* Mark directory attributes as invalid */
 	atomic_clear_uint32_t_bits(&mdc_olddir->mde_flags, MDCACHE_TRUST_ATTRS);
+	mdc_listing_changed(mdc_olddir);
 
 	if (olddir_hdl != newdir_hdl) {
 		atomic_clear_uint32_t_bits(&mdc_newdir->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(mdc_newdir);
 	}
 
 	/* NOTE: Below we mostly don't check if the directory is not
@@ -923,6 +929,7 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	    original_generation) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 	}
 
 out:
@@ -1119,6 +1126,7 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 			(long long)change, (long long)entry->attrs.change);
 		entry->attrs.change = change + 1;
 	}
+	mdc_listing_changed(entry);
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 out:
 	if (kill_entry)
@@ -1183,8 +1191,10 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		/* Invalidate attributes of parent and entry */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(parent);
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 
 		if (entry->obj_handle.type == DIRECTORY) {
 			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
@@ -1355,9 +1365,60 @@ static nfsstat4 mdcache_layoutcommit(struct fsal_obj_handle *obj_hdl,
 	subcall(status = entry->sub_handle->obj_ops->layoutcommit(
 			entry->sub_handle, lou_body, arg, res));
 
-	if (status == NFS4_OK)
+	if (status == NFS4_OK) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Report layout statistics
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl  The file the statistics apply to
+ * @param[in] lou_body An XDR stream containing the layout type-specific
+ *                     portion of the LAYOUTSTATS arguments.
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 63.
+ */
+static nfsstat4 mdcache_layoutstats(struct fsal_obj_handle *obj_hdl,
+				    XDR *lou_body,
+				    const struct fsal_layoutstats_arg *arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	nfsstat4 status;
+
+	subcall(status = entry->sub_handle->obj_ops->layoutstats(
+			entry->sub_handle, lou_body, arg));
+
+	return status;
+}
+
+/**
+ * @brief Report a layout device error
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl  The file the error applies to
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 61.
+ */
+static nfsstat4 mdcache_layouterror(struct fsal_obj_handle *obj_hdl,
+				    const struct fsal_layouterror_arg *arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	nfsstat4 status;
+
+	subcall(status = entry->sub_handle->obj_ops->layouterror(
+			entry->sub_handle, arg));
 
 	return status;
 }
@@ -1430,6 +1491,175 @@ static fsal_status_t mdcache_merge(struct fsal_obj_handle *orig_hdl,
 	return status;
 }
 
+/**
+ * @brief Get a validator for cached listings of a directory
+ *
+ * Dirent changes show up in the change attribute of the directory, which
+ * must be trusted.  Attribute changes of the entries handed out by
+ * mdcache_readdir_chunked() bump the readdir epoch of their filesystem, see
+ * mdc_listing_changed().
+ *
+ * @param[in]  dir_hdl Directory to validate
+ * @param[out] change  Change attribute of the directory
+ * @param[out] epoch   Epoch covering the attributes of its entries
+ *
+ * @return true if the listing of the directory may be cached.
+ */
+static bool mdcache_readdir_validator(struct fsal_obj_handle *dir_hdl,
+				      uint64_t *change, uint64_t *epoch)
+{
+	mdcache_entry_t *entry =
+		container_of(dir_hdl, mdcache_entry_t, obj_handle);
+	bool valid;
+
+	/* Entries are only flagged when dirents are cached */
+	if (dir_hdl->type != DIRECTORY || mdcache_param.dir.avl_chunk == 0)
+		return false;
+
+	/* Read the epoch first, any later change invalidates the listing */
+	*epoch = atomic_fetch_uint64_t(mdc_readdir_epoch(entry));
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	valid = mdcache_is_attrs_valid(entry, ATTR_CHANGE) &&
+		test_mde_flags(entry, MDCACHE_TRUST_CONTENT);
+
+	if (valid)
+		*change = entry->attrs.change;
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	return valid;
+}
+
+/**
+ * @brief Look up encoded attributes memoized on an entry
+ *
+ * @param[in]  obj_hdl    Object to look up
+ * @param[in]  mask       Attributes the encoding depends on
+ * @param[in]  key        Opaque key of the encoding
+ * @param[out] fattr      Copy of the encoding, to be freed by the caller
+ * @param[out] generation Generation of the attributes
+ *
+ * @return true if an encoding was copied to @a fattr.
+ */
+static bool mdcache_fattr_cache_get(struct fsal_obj_handle *obj_hdl,
+				    attrmask_t mask,
+				    const struct gsh_buffdesc *key,
+				    struct gsh_buffdesc *fattr,
+				    uint64_t *generation)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_fattr *slot;
+	bool hit = false;
+	uint32_t i;
+
+	*generation = 0;
+
+	if (mdcache_param.fattr_cache_slots == 0 ||
+	    op_ctx->export_perms.expire_time_attr == 0)
+		return false;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	/* Taken before the caller fetches the attributes it will encode */
+	*generation = mdc_fattr_generation(entry);
+
+	if (entry->fattrs == NULL || !mdcache_is_attrs_valid(entry, mask))
+		goto out;
+
+	for (i = 0; i < mdcache_param.fattr_cache_slots; i++) {
+		slot = entry->fattrs[i];
+
+		if (slot == NULL)
+			break;
+
+		if (slot->generation != *generation ||
+		    slot->key_len != key->len ||
+		    memcmp(slot->key, key->addr, key->len) != 0)
+			continue;
+
+		fattr->addr = gsh_malloc(slot->fattr.len);
+		fattr->len = slot->fattr.len;
+		memcpy(fattr->addr, slot->fattr.addr, slot->fattr.len);
+		hit = true;
+		break;
+	}
+
+out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	return hit;
+}
+
+/**
+ * @brief Memoize encoded attributes on an entry
+ *
+ * The encoding replaces the one with the same key, or else the least
+ * recently memoized one.
+ *
+ * @param[in] obj_hdl    Object the attributes were encoded from
+ * @param[in] key        Opaque key of the encoding
+ * @param[in] fattr      The encoding, ownership passes to MDCACHE
+ * @param[in] generation Generation returned by mdcache_fattr_cache_get()
+ */
+static void mdcache_fattr_cache_put(struct fsal_obj_handle *obj_hdl,
+				    const struct gsh_buffdesc *key,
+				    struct gsh_buffdesc *fattr,
+				    uint64_t generation)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	uint32_t slots = mdcache_param.fattr_cache_slots;
+	struct mdc_fattr *slot;
+	uint32_t i;
+
+	if (slots == 0) {
+		gsh_free(fattr->addr);
+		return;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (mdc_fattr_generation(entry) != generation) {
+		/* The attributes changed while they were being encoded */
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		gsh_free(fattr->addr);
+		return;
+	}
+
+	if (entry->fattrs == NULL)
+		entry->fattrs = gsh_calloc(slots, sizeof(*entry->fattrs));
+
+	for (i = 0; i < slots - 1; i++) {
+		slot = entry->fattrs[i];
+
+		if (slot == NULL || (slot->key_len == key->len &&
+				     memcmp(slot->key, key->addr, key->len) == 0))
+			break;
+	}
+
+	slot = entry->fattrs[i];
+
+	if (slot != NULL) {
+		gsh_free(slot->fattr.addr);
+		gsh_free(slot);
+	}
+
+	memmove(&entry->fattrs[1], &entry->fattrs[0],
+		i * sizeof(*entry->fattrs));
+
+	slot = gsh_malloc(sizeof(*slot) + key->len);
+	slot->generation = generation;
+	slot->fattr = *fattr;
+	slot->key_len = key->len;
+	memcpy(slot->key, key->addr, key->len);
+	entry->fattrs[0] = slot;
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
 static bool mdcache_is_referral(struct fsal_obj_handle *obj_hdl,
 				struct fsal_attrlist *unused, bool cache_attrs)
 {
@@ -1539,6 +1769,11 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->layoutget = mdcache_layoutget;
 	ops->layoutreturn = mdcache_layoutreturn;
 	ops->layoutcommit = mdcache_layoutcommit;
+	ops->layoutstats = mdcache_layoutstats;
+	ops->layouterror = mdcache_layouterror;
+	ops->readdir_validator = mdcache_readdir_validator;
+	ops->fattr_cache_get = mdcache_fattr_cache_get;
+	ops->fattr_cache_put = mdcache_fattr_cache_put;
 
 	/* Multi-FD */
 	ops->open2 = mdcache_open2;
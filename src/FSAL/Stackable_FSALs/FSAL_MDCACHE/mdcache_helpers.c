@@ -62,6 +62,11 @@
 #define mdc_chunk_first_dirent(c) \
 	glist_first_entry(&(c)->dirents, mdcache_dir_entry_t, chunk_list)
 
+/**
+ * @brief Readdir epochs, see mdc_readdir_epoch()
+ */
+uint64_t mdc_readdir_epochs[MDC_READDIR_EPOCHS];
+
 /**
  * @brief Drop refs for state chunks
  *
@@ -173,7 +178,7 @@ static mdcache_entry_t *mdcache_alloc_handle(struct mdcache_fsal_export *export,
 	mdcache_entry_t *result;
 	fsal_status_t status;
 
-	result = mdcache_lru_get(sub_handle, flags);
+	result = mdcache_lru_get(sub_handle, export->quota, flags);
 
 	/* mdcache_lru_get never returns NULL */
 	assert(result);
@@ -625,11 +630,17 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 	/* Clean the active and deleted trees */
 	mdcache_avl_clean_trees(entry);
 
+	/* The filter can not be trusted anymore either */
+	mdcache_avl_filter_free(entry);
+
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_DIR_POPULATED);
 
 	atomic_set_uint32_t_bits(&entry->mde_flags,
 				 MDCACHE_TRUST_CONTENT |
 					 MDCACHE_TRUST_DIR_CHUNKS);
+
+	/* Cookies handed out in cached listings may not be valid anymore */
+	mdc_readdir_epoch_bump(entry);
 }
 
 /**
@@ -1182,6 +1193,17 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent, const char *name,
 			 * valid, it can serve negative lookups. */
 			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
+		if (op_ctx_export_has_option(
+			    EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) &&
+		    mdcache_avl_filter_excludes(mdc_parent, name)) {
+			/* Some dirents were reaped since the directory was
+			 * populated, but the name filter still knows all the
+			 * names. */
+			LogFullDebugAlt(COMPONENT_NFS_READDIR,
+					COMPONENT_MDCACHE,
+					"Name filter excludes %s", name);
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		}
 	}
 	return fsalstat(ERR_FSAL_STALE, 0);
 }
@@ -1595,8 +1617,10 @@ void mdcache_dirent_remove(mdcache_entry_t *parent, const char *name)
 
 		dirent = mdcache_avl_lookup(parent, name);
 
-		if (dirent != NULL)
+		if (dirent != NULL) {
+			mdcache_avl_filter_remove(parent, dirent);
 			avl_dirent_set_deleted(parent, dirent);
+		}
 	}
 }
 
@@ -3031,6 +3055,7 @@ again:
 				 */
 				atomic_set_uint32_t_bits(&directory->mde_flags,
 							 MDCACHE_DIR_POPULATED);
+				mdcache_avl_filter_build(directory);
 			}
 
 			PTHREAD_RWLOCK_unlock(&directory->content_lock);
@@ -3050,6 +3075,7 @@ again:
 			 */
 			atomic_set_uint32_t_bits(&directory->mde_flags,
 						 MDCACHE_DIR_POPULATED);
+			mdcache_avl_filter_build(directory);
 		} else {
 			/* Since we just populated a chunk and have not
 			 * determined that we read the entire directory, make
@@ -3270,6 +3296,14 @@ again:
 			continue;
 		}
 
+		/* Any change to the attributes from now on must invalidate
+		 * cached listings returning them, so flag the entry before
+		 * fetching them.
+		 */
+		if (!test_mde_flags(entry, MDCACHE_LISTED))
+			atomic_set_uint32_t_bits(&entry->mde_flags,
+						 MDCACHE_LISTED);
+
 		/* Ensure the attribute cache is valid.  The simplest way to do
 		 * this is to call getattrs().  We need a copy anyway, to ensure
 		 * thread safety.
@@ -3335,6 +3369,12 @@ again:
 				 */
 				atomic_set_uint32_t_bits(&directory->mde_flags,
 							 MDCACHE_DIR_POPULATED);
+
+				/* Building the filter needs the write lock,
+				 * a later pass will do if we don't have it.
+				 */
+				if (has_write)
+					mdcache_avl_filter_build(directory);
 			}
 
 			if (has_write) {
@@ -3448,6 +3488,39 @@ void _mdcache_kill_entry(mdcache_entry_t *entry, char *file, int line,
 	}
 }
 
+static inline bool mdc_timespec_differ(const struct timespec *a,
+				       const struct timespec *b)
+{
+	return a->tv_sec != b->tv_sec || a->tv_nsec != b->tv_nsec;
+}
+
+/**
+ * @brief Check whether refreshed attributes differ from the cached ones
+ *
+ * Only the attributes that end up in READDIR replies are compared.
+ *
+ * @param[in] cached Cached attributes
+ * @param[in] fresh  Refreshed attributes
+ *
+ * @return true if any of them changed.
+ */
+
+static bool mdc_listed_attrs_differ(const struct fsal_attrlist *cached,
+				    const struct fsal_attrlist *fresh)
+{
+	return cached->change != fresh->change ||
+	       cached->filesize != fresh->filesize ||
+	       cached->spaceused != fresh->spaceused ||
+	       cached->mode != fresh->mode ||
+	       cached->numlinks != fresh->numlinks ||
+	       cached->owner != fresh->owner || cached->group != fresh->group ||
+	       cached->rawdev.major != fresh->rawdev.major ||
+	       cached->rawdev.minor != fresh->rawdev.minor ||
+	       mdc_timespec_differ(&cached->atime, &fresh->atime) ||
+	       mdc_timespec_differ(&cached->mtime, &fresh->mtime) ||
+	       mdc_timespec_differ(&cached->ctime, &fresh->ctime);
+}
+
 /**
  * @brief Update the cached attributes
  *
@@ -3461,6 +3534,9 @@ void _mdcache_kill_entry(mdcache_entry_t *entry, char *file, int line,
  */
 void mdc_update_attr_cache(mdcache_entry_t *entry, struct fsal_attrlist *attrs)
 {
+	if (mdc_listed_attrs_differ(&entry->attrs, attrs))
+		mdc_listing_changed(entry);
+
 	if (entry->attrs.acl != NULL) {
 		/* We used to have an ACL... */
 		if (attrs->acl != NULL) {
@@ -3543,4 +3619,30 @@ void mdc_update_attr_cache(mdcache_entry_t *entry, struct fsal_attrlist *attrs)
 	mdc_fixup_md(entry, &entry->attrs);
 }
 
+/**
+ * @brief Drop the encoded attributes memoized on an entry
+ *
+ * @note The caller must hold the attribute lock for WRITE
+ *
+ * @param[in] entry	Entry whose attributes are being updated
+ */
+void mdc_fattr_drop(mdcache_entry_t *entry)
+{
+	uint32_t i;
+
+	atomic_inc_uint32_t(&entry->fattr_generation);
+
+	if (entry->fattrs == NULL)
+		return;
+
+	for (i = 0; i < mdcache_param.fattr_cache_slots; i++) {
+		if (entry->fattrs[i] == NULL)
+			break;
+
+		gsh_free(entry->fattrs[i]->fattr.addr);
+		gsh_free(entry->fattrs[i]);
+		entry->fattrs[i] = NULL;
+	}
+}
+
 /** @} */
@@ -42,6 +42,7 @@
 #include "fsal_convert.h"
 #include "display.h"
 #include "common_utils.h"
+#include "req_recorder.h"
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
@@ -98,6 +99,8 @@ struct mdcache_fsal_export {
 	mdc_dirmap_t dirent_map;
 	/** Thread for dirmap processing */
 	struct fridgethr *dirmap_fridge;
+	/** Cache entries and chunks charged to this export */
+	struct mdc_quota *quota;
 };
 
 /**
@@ -160,6 +163,8 @@ enum lru_q_id {
 				   * last active reference (never cleared).
 				   */
 #define LRU_SENTINEL_HELD 0x00000008 /* true if sentinel reference is held */
+#define LRU_PROTECTED 0x00000010 /* 2Q: entry goes to L1 when inactive */
+#define LRU_REREFERENCED 0x00000020 /* Entry was referenced from L1 or L2 */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q; /*< Link in the physical deque
@@ -228,6 +233,20 @@ struct entry_export_map {
 #define MDCACHE_TRUST_SEC_LABEL FSAL_UP_INVALIDATE_SEC_LABEL
 /** The entry has been removed, but not unhashed due to state */
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
+/** The entry was handed out by readdir since its attributes last changed */
+static const uint32_t MDCACHE_LISTED = 0x1000;
+
+/**
+ * @brief Encoded attributes memoized on an entry
+ *
+ * See mdcache_fattr_cache_get() and mdcache_fattr_cache_put().
+ */
+struct mdc_fattr {
+	uint64_t generation; /*< mdc_fattr_generation() when encoded */
+	struct gsh_buffdesc fattr; /*< The encoding */
+	size_t key_len; /*< Length of key */
+	char key[]; /*< Opaque key of the encoding */
+};
 
 /**
  * @brief Represents a cached inode
@@ -237,7 +256,8 @@ static const uint32_t MDCACHE_UNREACHABLE = 0x100;
  * is also the anchor for state held on a file.
  *
  * Regarding the locking discipline:
- * (1) attr_lock protects the attrs field, the export_list, and attr_time
+ * (1) attr_lock protects the attrs field, the export_list, attr_time and
+ *     the fattrs array
  *
  * (2) content_lock must be held for WRITE when modifying the AVL tree
  *     of a directory or any dirent contained therein.  It must be
@@ -282,6 +302,11 @@ struct mdcache_fsal_obj_handle {
 	struct fsal_attrlist attrs;
 	/** Attribute generation, increased for every write */
 	uint32_t attr_generation;
+	/** Generation of the memoized encoded attributes, increased whenever
+	    the cached attributes are refreshed or updated in place */
+	uint32_t fattr_generation;
+	/** Memoized encoded attributes, most recent first */
+	struct mdc_fattr **fattrs;
 	/** FH hash linkage */
 	struct {
 		struct avltree_node node_k; /*< AVL node in tree */
@@ -305,6 +330,8 @@ struct mdcache_fsal_obj_handle {
 	 *  no mapped export.
 	 */
 	int32_t first_export_id;
+	/** Quota of the export this entry was created for */
+	struct mdc_quota *quota;
 	/** Lock on type-specific cached content.  See locking
 	    discipline for details. */
 	pthread_rwlock_t content_lock;
@@ -356,6 +383,10 @@ struct mdcache_fsal_obj_handle {
 				struct avltree sorted;
 				/** Heuristic. Expect 0. */
 				uint32_t collisions;
+				/** Negative lookup filter of all the names,
+				 *  NULL if not known.
+				 */
+				struct mdcache_name_filter *filter;
 			} avl;
 		} fsdir; /**< DIRECTORY data */
 	} fsobj;
@@ -378,6 +409,8 @@ struct dir_chunk {
 	fsal_cookie_t next_ck;
 	/** Number of entries in chunk */
 	int num_entries;
+	/** Quota this chunk is charged to, that of its parent */
+	struct mdc_quota *quota;
 };
 
 /**
@@ -513,6 +546,7 @@ fsal_status_t mdcache_readdir_uncached(mdcache_entry_t *directory,
 				       fsal_readdir_cb cb, attrmask_t attrmask,
 				       bool *eod_met);
 void mdcache_clean_dirent_chunk(struct dir_chunk *chunk);
+void mdcache_clean_dirent_chunks(mdcache_entry_t *entry);
 void place_new_dirent(mdcache_entry_t *parent_dir,
 		      mdcache_dir_entry_t *new_dir_entry);
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
@@ -525,6 +559,21 @@ fsal_status_t mdc_get_parent(struct mdcache_fsal_export *exp,
 			     struct gsh_buffdesc *parent_out);
 
 void mdc_update_attr_cache(mdcache_entry_t *entry, struct fsal_attrlist *attrs);
+void mdc_fattr_drop(mdcache_entry_t *entry);
+
+/**
+ * @brief Get the generation of the cached attributes of an entry
+ *
+ * Encoded attributes memoized on the entry are only used while this is
+ * unchanged.
+ */
+
+static inline uint64_t mdc_fattr_generation(mdcache_entry_t *entry)
+{
+	return ((uint64_t)atomic_fetch_uint32_t(&entry->fattr_generation)
+		<< 32) |
+	       atomic_fetch_uint32_t(&entry->attr_generation);
+}
 
 static inline void mdcache_free_fh(struct gsh_buffdesc *fh_desc);
 
@@ -577,12 +626,60 @@ extern struct config_block mdcache_param_blk;
 			op_ctx->fsal_export = &(myexp)->mfe_exp;           \
 	} while (0)
 
+/**
+ * @brief Start timing a sub-FSAL call for the flight recorder
+ *
+ * Only the outermost of nested calls is timed.  The state lock time of the
+ * request is paused until the call is done.
+ *
+ * @param[out] start	Start of the call, only set if recorded
+ *
+ * @return The record of the request, NULL if it is not recorded.
+ */
+static inline struct req_record *req_record_fsal_start(uint64_t *start)
+{
+	struct req_record *record = op_ctx->req_record;
+
+	if (record == NULL)
+		return NULL;
+
+	*start = req_cycles();
+
+	if (record->fsal_depth++ == 0 && record->sal_depth != 0)
+		record->sal_cycles += *start - record->sal_start;
+
+	return record;
+}
+
+static inline void req_record_fsal_done(struct req_record *record,
+					uint64_t start)
+{
+	uint64_t end;
+
+	if (record == NULL)
+		return;
+
+	end = req_cycles();
+	record->fsal_calls++;
+
+	if (--record->fsal_depth != 0)
+		return;
+
+	record->fsal_cycles += end - start;
+
+	if (record->sal_depth != 0)
+		record->sal_start = end;
+}
+
 /* Call a sub-FSAL function using it's export */
-#define subcall_raw(myexp, call)                                   \
-	do {                                                       \
-		op_ctx->fsal_export = (myexp)->mfe_exp.sub_export; \
-		call;                                              \
-		op_ctx->fsal_export = &(myexp)->mfe_exp;           \
+#define subcall_raw(myexp, call)                                            \
+	do {                                                                \
+		uint64_t __start = 0;                                       \
+		struct req_record *__rec = req_record_fsal_start(&__start); \
+		op_ctx->fsal_export = (myexp)->mfe_exp.sub_export;          \
+		call;                                                       \
+		op_ctx->fsal_export = &(myexp)->mfe_exp;                    \
+		req_record_fsal_done(__rec, __start);                       \
 	} while (0)
 
 /* Call a sub-FSAL function using it's export */
@@ -729,6 +826,60 @@ static inline void mdcache_free_fh(struct gsh_buffdesc *fh_desc)
 	fh_desc->addr = NULL;
 }
 
+/**
+ * @brief Number of readdir epochs, should be prime.
+ */
+#define MDC_READDIR_EPOCHS 61
+
+extern uint64_t mdc_readdir_epochs[MDC_READDIR_EPOCHS];
+
+/**
+ * @brief Get the readdir epoch covering an entry
+ *
+ * Epochs are shared by all the entries of a filesystem (and of any other
+ * filesystem hashing to the same slot).  They are part of the validator
+ * handed out by mdcache_readdir_validator().
+ */
+
+static inline uint64_t *mdc_readdir_epoch(mdcache_entry_t *entry)
+{
+	const fsal_fsid_t *fsid = &entry->obj_handle.fsid;
+
+	return &mdc_readdir_epochs[(fsid->major ^ fsid->minor) %
+				   MDC_READDIR_EPOCHS];
+}
+
+/**
+ * @brief Invalidate every cached listing covering an entry
+ *
+ * @param[in] entry The entry whose listing or attributes changed
+ */
+
+static inline void mdc_readdir_epoch_bump(mdcache_entry_t *entry)
+{
+	atomic_inc_uint64_t(mdc_readdir_epoch(entry));
+}
+
+/**
+ * @brief Note that the attributes of an entry may have changed
+ *
+ * Cached listings returning the entry must not be used anymore.  The epoch
+ * is only bumped for entries that were handed out by readdir, so that
+ * writes to files that were never listed do not touch a shared counter.
+ *
+ * @param[in] entry The entry whose attributes changed
+ */
+
+static inline void mdc_listing_changed(mdcache_entry_t *entry)
+{
+	if (!(atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_LISTED))
+		return;
+
+	if (atomic_postclear_uint32_t_bits(&entry->mde_flags, MDCACHE_LISTED) &
+	    MDCACHE_LISTED)
+		mdc_readdir_epoch_bump(entry);
+}
+
 /**
  * @brief Update entry metadata from its attributes
  *
@@ -748,6 +899,8 @@ static inline void mdc_fixup_md(mdcache_entry_t *entry,
 {
 	uint32_t flags = 0;
 
+	mdc_fattr_drop(entry);
+
 	/* As long as the ACL was requested, and we get here, we assume no
 	 * failure to fetch ACL (differentiated from no ACL to fetch), and
 	 * thus we only look at the fact that ACL was requested to determine
@@ -771,6 +924,7 @@ static inline void mdc_fixup_md(mdcache_entry_t *entry,
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ACL |
 						   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 		return;
 	}
 
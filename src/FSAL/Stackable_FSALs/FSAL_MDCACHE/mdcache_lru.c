@@ -60,6 +60,8 @@
 #include "sal_functions.h"
 #include "nfs_exports.h"
 #include "sys_resource.h"
+#include "monitoring.h"
+#include "mem_accounting.h"
 
 #include "gsh_lttng/gsh_lttng.h"
 #if defined(USE_LTTNG) && !defined(LTTNG_PARSING)
@@ -91,6 +93,16 @@
  * under the MDCACHE hash table latch.  Likewise, entries must first be
  * made unreachable to the MDCACHE hash table, then independently reach
  * a refcnt of 0, before they may be disposed or recycled.
+ *
+ * With LRU_Policy = twoq, the same lanes implement 2Q [Johnson and Shasha
+ * 1994] instead.  L2 is the probation queue (A1in): new entries go there,
+ * and stay there when referenced again, so a scan of a tree only ever
+ * recycles probation entries.  L1 is the protected queue (Am), for entries
+ * that were referenced again after having been evicted from probation.
+ * Such entries are recognized with a ghost list (A1out) of the keys of
+ * entries recently evicted from probation.  Both queues are kept in LRU
+ * order, and the reaper demotes the LRU end of L1 to probation when L1
+ * outgrows its share of the cache.
  */
 
 struct lru_state lru_state;
@@ -204,6 +216,130 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
 	(LRU_ENTRY_L1_OR_L2(e) && ((n) == LRU_SENTINEL_REFCOUNT + 1) && \
 	 ((e)->fh_hk.inavl))
 
+#define LRU_2Q() (lru_state.policy == MDCACHE_LRU_POLICY_2Q)
+
+/**
+ * The ghost list of the 2Q policy, remembering the keys of the entries
+ * recently evicted from probation.
+ *
+ * Only the key hashes are needed, so the list is kept as two generations of
+ * a Bloom filter.  Keys are added to the current generation, and once it
+ * holds size keys the other one is cleared and becomes current.  A key is a
+ * ghost while either generation has it, so between size and twice that many
+ * keys are remembered.  A false positive merely protects an entry early.
+ */
+
+struct lru_ghost {
+	pthread_mutex_t mtx;
+	uint64_t *gen[2]; /*< Bits of each generation */
+	uint64_t mask; /*< Bits per generation - 1 */
+	uint64_t size; /*< Keys per generation */
+	uint64_t count; /*< Keys added to the current generation */
+	uint32_t cur; /*< Current generation */
+};
+
+static struct lru_ghost lru_ghost;
+
+/**
+ * @brief Compute the two bits of a key in a ghost generation
+ */
+static inline void lru_ghost_bits(uint64_t hk, uint64_t *b1, uint64_t *b2)
+{
+	*b1 = hk & lru_ghost.mask;
+	*b2 = ((hk >> 32) ^ (hk * 0x9e3779b97f4a7c15ULL)) & lru_ghost.mask;
+}
+
+#define GHOST_TEST(g, b) ((g)[(b) / 64] & (1ULL << ((b) % 64)))
+#define GHOST_SET(g, b) ((g)[(b) / 64] |= (1ULL << ((b) % 64)))
+
+/**
+ * @brief Remember the key of an entry evicted from probation
+ *
+ * @param[in] hk  Hash of the key of the entry
+ */
+static void lru_ghost_add(uint64_t hk)
+{
+	uint64_t b1, b2;
+	uint64_t *g;
+
+	PTHREAD_MUTEX_lock(&lru_ghost.mtx);
+
+	if (lru_ghost.gen[0] == NULL) {
+		PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+		return;
+	}
+
+	if (lru_ghost.count >= lru_ghost.size) {
+		/* Forget the older generation */
+		lru_ghost.cur ^= 1;
+		lru_ghost.count = 0;
+		memset(lru_ghost.gen[lru_ghost.cur], 0,
+		       (lru_ghost.mask + 1) / 8);
+	}
+
+	lru_ghost_bits(hk, &b1, &b2);
+	g = lru_ghost.gen[lru_ghost.cur];
+	GHOST_SET(g, b1);
+	GHOST_SET(g, b2);
+	lru_ghost.count++;
+
+	PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+}
+
+/**
+ * @brief Check whether a new entry was recently evicted from probation
+ *
+ * @param[in] hk  Hash of the key of the entry
+ *
+ * @return true if the key is on the ghost list.
+ */
+static bool lru_ghost_test(uint64_t hk)
+{
+	uint64_t b1, b2;
+	bool found = false;
+	int i;
+
+	PTHREAD_MUTEX_lock(&lru_ghost.mtx);
+
+	if (lru_ghost.gen[0] != NULL) {
+		lru_ghost_bits(hk, &b1, &b2);
+
+		for (i = 0; i < 2 && !found; i++)
+			found = GHOST_TEST(lru_ghost.gen[i], b1) &&
+				GHOST_TEST(lru_ghost.gen[i], b2);
+	}
+
+	PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+
+	return found;
+}
+
+/**
+ * @brief Size the ghost list for a number of keys per generation
+ *
+ * About 8 bits per key keep false positives below 5%.
+ */
+static void lru_ghost_resize(uint64_t size)
+{
+	uint64_t bits = 64;
+
+	while (bits < size * 8)
+		bits <<= 1;
+
+	PTHREAD_MUTEX_lock(&lru_ghost.mtx);
+
+	gsh_free(lru_ghost.gen[0]);
+	gsh_free(lru_ghost.gen[1]);
+	lru_ghost.gen[0] = gsh_calloc(bits / 64, sizeof(uint64_t));
+	lru_ghost.gen[1] = gsh_calloc(bits / 64, sizeof(uint64_t));
+	lru_ghost.mask = bits - 1;
+	lru_ghost.size = size;
+	lru_ghost.count = 0;
+	lru_ghost.cur = 0;
+
+	PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+}
+
 /**
  * @brief Initialize a single base queue.
  *
@@ -384,6 +520,24 @@ static inline void lru_insert(mdcache_lru_t *lru, struct lru_q *q)
 	++(q->size);
 }
 
+/**
+ * @brief Insert an entry at the MRU end of L1 or L2
+ *
+ * The 2Q policy keeps its queues in order, so that reaping from the head
+ * takes the least recently used entry.
+ *
+ * @note The caller MUST hold the lane lock.
+ *
+ * @param[in] lru    The LRU entry to insert
+ * @param[in] q      The queue to insert on
+ */
+static inline void lru_insert_mru(mdcache_lru_t *lru, struct lru_q *q)
+{
+	lru->qid = q->id;
+	glist_add_tail(&q->q, &lru->q);
+	++(q->size);
+}
+
 /**
  * @brief Insert a chunk into the specified queue and lane with locking
  *
@@ -427,6 +581,7 @@ static inline void make_active_lru(mdcache_entry_t *entry)
 		LRU_DQ(lru, q);
 		q = &qlane->ACTIVE;
 		lru_insert(lru, q);
+		atomic_set_uint32_t_bits(&lru->flags, LRU_REREFERENCED);
 		break;
 	case LRU_ENTRY_L2:
 		q = lru_queue_of(entry);
@@ -434,6 +589,7 @@ static inline void make_active_lru(mdcache_entry_t *entry)
 		LRU_DQ(lru, q);
 		q = &qlane->ACTIVE;
 		lru_insert(lru, q);
+		atomic_set_uint32_t_bits(&lru->flags, LRU_REREFERENCED);
 		break;
 	case LRU_ENTRY_ACTIVE:
 		q = lru_queue_of(entry);
@@ -473,6 +629,20 @@ static inline void make_inactive_lru(mdcache_entry_t *entry)
 		q = lru_queue_of(entry);
 		LRU_DQ(&entry->lru, q);
 
+		if (LRU_2Q()) {
+			/* Entries stay on probation until they come back
+			 * from the ghost list.
+			 */
+			if (atomic_fetch_uint32_t(&entry->lru.flags) &
+			    LRU_PROTECTED)
+				q = &qlane->L1;
+			else
+				q = &qlane->L2;
+
+			lru_insert_mru(&entry->lru, q);
+			break;
+		}
+
 		if (atomic_fetch_uint32_t(&entry->lru.flags) &
 		    LRU_EVER_PROMOTED) {
 			/* If entry was ever promoted, insert into L1. */
@@ -493,6 +663,365 @@ static inline void make_inactive_lru(mdcache_entry_t *entry)
 	} /* switch qid */
 }
 
+/**
+ * Entries or chunks examined per lane looking for one of a given export.
+ */
+#define LRU_QUOTA_SCAN 32
+
+/** Quotas of all exports, protected by mdc_quota_mtx */
+static struct glist_head mdc_quota_list;
+static pthread_mutex_t mdc_quota_mtx;
+
+/** Quotas of the list with an entry or chunk soft limit, changed under
+ *  mdc_quota_mtx so that allocations skip the list while they are 0.
+ */
+static uint32_t mdc_quota_entries_soft;
+static uint32_t mdc_quota_chunks_soft;
+
+/**
+ * @brief Change a soft limit of a quota, keeping count of the soft limits
+ *
+ * @note mdc_quota_mtx MUST be held
+ *
+ * @param[in] quota  Quota to change
+ * @param[in] soft   Soft limit of the quota to change
+ * @param[in] count  Count of the quotas with that soft limit
+ * @param[in] value  New limit, 0 for none
+ */
+static void mdc_quota_set_soft(struct mdc_quota *quota, uint32_t *soft,
+			       uint32_t *count, uint32_t value)
+{
+	uint32_t old = atomic_fetch_uint32_t(soft);
+
+	atomic_store_uint32_t(soft, value);
+
+	/* Quotas of released exports are not counted anymore */
+	if (glist_null(&quota->q_list) || (old == 0) == (value == 0))
+		return;
+
+	if (value != 0)
+		(void)atomic_inc_uint32_t(count);
+	else
+		(void)atomic_dec_uint32_t(count);
+}
+
+/**
+ * @brief Create the quota of an export
+ *
+ * @param[in] export  Export being created, its limits are copied
+ *
+ * @return The quota, with a reference for the export.
+ */
+struct mdc_quota *mdc_quota_new(struct gsh_export *export)
+{
+	struct mdc_quota *quota = gsh_calloc(1, sizeof(*quota));
+
+	quota->refcnt = 1;
+	quota->export_id = export->export_id;
+	quota->entries_hard =
+		atomic_fetch_uint32_t(&export->cache_entries_hard);
+	quota->chunks_hard = atomic_fetch_uint32_t(&export->cache_chunks_hard);
+
+	PTHREAD_MUTEX_lock(&mdc_quota_mtx);
+	glist_add_tail(&mdc_quota_list, &quota->q_list);
+	mdc_quota_set_soft(quota, &quota->entries_soft, &mdc_quota_entries_soft,
+			   atomic_fetch_uint32_t(&export->cache_entries_soft));
+	mdc_quota_set_soft(quota, &quota->chunks_soft, &mdc_quota_chunks_soft,
+			   atomic_fetch_uint32_t(&export->cache_chunks_soft));
+	PTHREAD_MUTEX_unlock(&mdc_quota_mtx);
+
+	return quota;
+}
+
+static inline void mdc_quota_ref(struct mdc_quota *quota)
+{
+	(void)atomic_inc_int32_t(&quota->refcnt);
+}
+
+static inline void mdc_quota_unref(struct mdc_quota *quota)
+{
+	if (atomic_dec_int32_t(&quota->refcnt) == 0)
+		gsh_free(quota);
+}
+
+/**
+ * @brief Drop the reference of the export to its quota
+ *
+ * The quota is no longer reported nor enforced, objects still charged to it
+ * keep it around until they are released.
+ *
+ * @param[in] quota  Quota of the export being released, may be NULL
+ */
+void mdc_quota_put(struct mdc_quota *quota)
+{
+	if (quota == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&mdc_quota_mtx);
+	mdc_quota_set_soft(quota, &quota->entries_soft, &mdc_quota_entries_soft,
+			   0);
+	mdc_quota_set_soft(quota, &quota->chunks_soft, &mdc_quota_chunks_soft,
+			   0);
+	glist_del(&quota->q_list);
+	PTHREAD_MUTEX_unlock(&mdc_quota_mtx);
+
+	mdc_quota_unref(quota);
+}
+
+/**
+ * @brief Call a function for the quota of each export
+ *
+ * @note The callback is called with the quota list locked.
+ *
+ * @param[in] cb   Function to call
+ * @param[in] arg  Argument passed to the function
+ */
+void mdc_quota_foreach(void (*cb)(struct mdc_quota *quota, void *arg),
+		       void *arg)
+{
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&mdc_quota_mtx);
+
+	glist_for_each(glist, &mdc_quota_list)
+	{
+		cb(glist_entry(glist, struct mdc_quota, q_list), arg);
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_quota_mtx);
+}
+
+/**
+ * @brief Refresh the limits of a quota from the export of the operation
+ *
+ * Limits may be changed by an export update, the copies are refreshed
+ * whenever an object is charged on behalf of the export.
+ *
+ * @param[in] quota  Quota about to be charged
+ */
+static void mdc_quota_refresh(struct mdc_quota *quota)
+{
+	struct gsh_export *export;
+	uint32_t entries_soft, chunks_soft;
+
+	if (op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	export = op_ctx->ctx_export;
+
+	if (export->export_id != quota->export_id)
+		return;
+
+	atomic_store_uint32_t(
+		&quota->entries_hard,
+		atomic_fetch_uint32_t(&export->cache_entries_hard));
+	atomic_store_uint32_t(
+		&quota->chunks_hard,
+		atomic_fetch_uint32_t(&export->cache_chunks_hard));
+
+	entries_soft = atomic_fetch_uint32_t(&export->cache_entries_soft);
+	chunks_soft = atomic_fetch_uint32_t(&export->cache_chunks_soft);
+
+	if (entries_soft == atomic_fetch_uint32_t(&quota->entries_soft) &&
+	    chunks_soft == atomic_fetch_uint32_t(&quota->chunks_soft))
+		return;
+
+	PTHREAD_MUTEX_lock(&mdc_quota_mtx);
+	mdc_quota_set_soft(quota, &quota->entries_soft, &mdc_quota_entries_soft,
+			   entries_soft);
+	mdc_quota_set_soft(quota, &quota->chunks_soft, &mdc_quota_chunks_soft,
+			   chunks_soft);
+	PTHREAD_MUTEX_unlock(&mdc_quota_mtx);
+}
+
+/**
+ * @brief Find the export most over its soft limit
+ *
+ * Without any soft limit, which is the default, the list is not walked.
+ *
+ * @param[in] chunks  Look at chunks rather than entries
+ *
+ * @return The quota, with a reference the caller must drop, or NULL if no
+ *         export is over its soft limit.
+ */
+static struct mdc_quota *mdc_quota_most_over(bool chunks)
+{
+	struct glist_head *glist;
+	struct mdc_quota *quota, *worst = NULL;
+	uint64_t used, soft, excess, worst_excess = 0;
+
+	if (atomic_fetch_uint32_t(chunks ? &mdc_quota_chunks_soft
+					 : &mdc_quota_entries_soft) == 0)
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&mdc_quota_mtx);
+
+	glist_for_each(glist, &mdc_quota_list)
+	{
+		quota = glist_entry(glist, struct mdc_quota, q_list);
+
+		if (chunks) {
+			used = atomic_fetch_uint64_t(&quota->chunks);
+			soft = atomic_fetch_uint32_t(&quota->chunks_soft);
+		} else {
+			used = atomic_fetch_uint64_t(&quota->entries);
+			soft = atomic_fetch_uint32_t(&quota->entries_soft);
+		}
+
+		if (soft == 0 || used <= soft)
+			continue;
+
+		excess = used - soft;
+
+		if (excess > worst_excess) {
+			worst = quota;
+			worst_excess = excess;
+		}
+	}
+
+	if (worst != NULL)
+		mdc_quota_ref(worst);
+
+	PTHREAD_MUTEX_unlock(&mdc_quota_mtx);
+
+	return worst;
+}
+
+/**
+ * @brief Account an object reclaimed to enforce a quota
+ *
+ * @param[in] quota   Quota of the object
+ * @param[in] chunks  The object is a chunk rather than an entry
+ */
+static void mdc_quota_count_reclaim(struct mdc_quota *quota, bool chunks)
+{
+	if (chunks) {
+		(void)atomic_inc_uint64_t(&quota->chunks_reclaimed);
+		monitoring__dynamic_mdcache_export_reclaim(quota->export_id,
+							   "chunks");
+	} else {
+		(void)atomic_inc_uint64_t(&quota->entries_reclaimed);
+		monitoring__dynamic_mdcache_export_reclaim(quota->export_id,
+							   "entries");
+	}
+}
+
+static inline void mdc_quota_charge_entry(mdcache_entry_t *entry,
+					  struct mdc_quota *quota)
+{
+	atomic_store_voidptr((void **)&entry->quota, quota);
+
+	if (quota == NULL)
+		return;
+
+	mdc_quota_ref(quota);
+	(void)atomic_inc_uint64_t(&quota->entries);
+}
+
+static inline void mdc_quota_uncharge_entry(mdcache_entry_t *entry)
+{
+	struct mdc_quota *quota = entry->quota;
+
+	if (quota == NULL)
+		return;
+
+	atomic_store_voidptr((void **)&entry->quota, NULL);
+	(void)atomic_dec_uint64_t(&quota->entries);
+	mdc_quota_unref(quota);
+}
+
+static inline void mdc_quota_charge_chunk(struct dir_chunk *chunk,
+					  struct mdc_quota *quota)
+{
+	chunk->quota = quota;
+
+	if (quota == NULL)
+		return;
+
+	mdc_quota_ref(quota);
+	(void)atomic_inc_uint64_t(&quota->chunks);
+}
+
+static inline void mdc_quota_uncharge_chunk(struct dir_chunk *chunk)
+{
+	struct mdc_quota *quota = chunk->quota;
+
+	if (quota == NULL)
+		return;
+
+	chunk->quota = NULL;
+	(void)atomic_dec_uint64_t(&quota->chunks);
+	mdc_quota_unref(quota);
+}
+
+/**
+ * @brief Find the first entry of a queue charged to a quota
+ *
+ * @note The caller must hold the lane lock
+ *
+ * @param[in] lq     Queue to look in
+ * @param[in] quota  Quota to look for, NULL for any entry
+ *
+ * @return The entry closest to the LRU end, within LRU_QUOTA_SCAN of it.
+ */
+static inline mdcache_lru_t *lru_first_of(struct lru_q *lq,
+					  struct mdc_quota *quota)
+{
+	struct glist_head *glist;
+	mdcache_entry_t *entry;
+	int scanned = 0;
+
+	if (quota == NULL)
+		return glist_first_entry(&lq->q, mdcache_lru_t, q);
+
+	glist_for_each(glist, &lq->q)
+	{
+		if (++scanned > LRU_QUOTA_SCAN)
+			break;
+
+		entry = container_of(glist, mdcache_entry_t, lru.q);
+
+		if (atomic_fetch_voidptr((void **)&entry->quota) == quota)
+			return &entry->lru;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find the first chunk of a queue charged to a quota
+ *
+ * @note The caller must hold the lane lock
+ *
+ * @param[in] lq     Queue to look in
+ * @param[in] quota  Quota to look for, NULL for any chunk
+ *
+ * @return The chunk closest to the LRU end, within LRU_QUOTA_SCAN of it.
+ */
+static inline mdcache_lru_t *chunk_lru_first_of(struct lru_q *lq,
+						struct mdc_quota *quota)
+{
+	struct glist_head *glist;
+	struct dir_chunk *chunk;
+	int scanned = 0;
+
+	if (quota == NULL)
+		return glist_first_entry(&lq->q, mdcache_lru_t, q);
+
+	glist_for_each(glist, &lq->q)
+	{
+		if (++scanned > LRU_QUOTA_SCAN)
+			break;
+
+		chunk = container_of(glist, struct dir_chunk, chunk_lru.q);
+
+		if (chunk->quota == quota)
+			return &chunk->chunk_lru;
+	}
+
+	return NULL;
+}
+
 /**
  * @brief Clean an entry for recycling.
  *
@@ -628,8 +1157,15 @@ static inline void mdcache_lru_clean(mdcache_entry_t *entry)
 	/* Done with the attrs */
 	fsal_release_attrs(&entry->attrs);
 
+	if (entry->fattrs != NULL) {
+		mdc_fattr_drop(entry);
+		gsh_free(entry->fattrs);
+		entry->fattrs = NULL;
+	}
+
 	/* Clean out the export mapping before deconstruction */
 	mdc_clean_entry(entry);
+	mdc_quota_uncharge_entry(entry);
 
 	/* Clean our handle */
 	fsal_obj_handle_fini(&entry->obj_handle, true);
@@ -647,6 +1183,36 @@ static inline void mdcache_lru_clean(mdcache_entry_t *entry)
 		PTHREAD_SPIN_destroy(&entry->fsobj.fsdir.fsd_spin);
 }
 
+/**
+ * @brief Account an entry reaped from L1 or L2
+ *
+ * With the 2Q policy, entries reaped from probation become ghosts.
+ *
+ * @param[in] qid    Queue the entry was reaped from
+ * @param[in] hk     Hash of the key of the entry
+ * @param[in] flags  LRU flags of the entry
+ */
+static void lru_count_eviction(enum lru_q_id qid, uint64_t hk, uint32_t flags)
+{
+	if (qid == LRU_ENTRY_L1) {
+		(void)atomic_inc_uint64_t(&lru_state.protected_evictions);
+		monitoring__dynamic_mdcache_lru_event("protected_eviction");
+		return;
+	}
+
+	(void)atomic_inc_uint64_t(&lru_state.probation_evictions);
+	monitoring__dynamic_mdcache_lru_event("probation_eviction");
+
+	if (!(flags & LRU_REREFERENCED)) {
+		/* Only ever used once, as by a scan */
+		(void)atomic_inc_uint64_t(&lru_state.scan_evictions);
+		monitoring__dynamic_mdcache_lru_event("scan_eviction");
+	}
+
+	if (LRU_2Q())
+		lru_ghost_add(hk);
+}
+
 /**
  * @brief Try to pull an entry off the queue
  *
@@ -660,14 +1226,17 @@ static inline void mdcache_lru_clean(mdcache_entry_t *entry)
  *
  * @note The caller @a MUST @a NOT hold the lane lock
  *
- * @param[in] qid  Queue to reap
+ * @param[in] qid   Queue to reap
+ * @param[in] keep  Skip lanes whose queue holds no more entries than this
+ * @param[in] quota Only reap entries charged to this quota, if not NULL
  * @return Available entry if found, NULL otherwisem the reference held on
  * the object is a LRU_TEMP_REF.
  */
 
 static uint32_t reap_lane;
 
-static inline mdcache_lru_t *lru_reap_impl(enum lru_q_id qid)
+static inline mdcache_lru_t *lru_reap_impl(enum lru_q_id qid, uint64_t keep,
+					   struct mdc_quota *quota)
 {
 	uint32_t lane;
 	struct lru_q_lane *qlane;
@@ -676,6 +1245,8 @@ static inline mdcache_lru_t *lru_reap_impl(enum lru_q_id qid)
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
 	cih_latch_t latch;
+	uint64_t hk;
+	uint32_t flags;
 	int ix;
 
 	lane = LRU_NEXT(reap_lane);
@@ -684,8 +1255,8 @@ static inline mdcache_lru_t *lru_reap_impl(enum lru_q_id qid)
 		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
 
 		QLOCK(qlane);
-		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
-		if (!lru) {
+		lru = lru_first_of(lq, quota);
+		if (!lru || lq->size <= keep) {
 			QUNLOCK(qlane);
 			continue;
 		}
@@ -733,8 +1304,11 @@ static inline mdcache_lru_t *lru_reap_impl(enum lru_q_id qid)
 
 			LRU_DQ(lru, q);
 			entry->lru.qid = LRU_ENTRY_NONE;
+			hk = entry->fh_hk.key.hk;
+			flags = atomic_fetch_uint32_t(&entry->lru.flags);
 			QUNLOCK(qlane);
 			cih_remove_latched(entry, &latch, CIH_REMOVE_UNLOCK);
+			lru_count_eviction(qid, hk, flags);
 			/* Note, we're not releasing our ref here.
 			 * cih_remove_latched() called
 			 * mdcache_lru_unref(), which released the
@@ -757,18 +1331,95 @@ out:
 	return lru;
 }
 
-static inline mdcache_lru_t *lru_try_reap_entry(uint32_t flags)
+static inline mdcache_lru_t *lru_reap_entry(void)
 {
 	mdcache_lru_t *lru;
 
+	if (LRU_2Q()) {
+		/* Reap probation while it holds more than its share */
+		lru = lru_reap_impl(LRU_ENTRY_L2, lru_state.probation_max,
+				    NULL);
+		if (!lru)
+			lru = lru_reap_impl(LRU_ENTRY_L1, 0, NULL);
+		if (!lru)
+			lru = lru_reap_impl(LRU_ENTRY_L2, 0, NULL);
+
+		return lru;
+	}
+
+	/* XXX dang why not start with the cleanup list? */
+	lru = lru_reap_impl(LRU_ENTRY_L2, 0, NULL);
+	if (!lru)
+		lru = lru_reap_impl(LRU_ENTRY_L1, 0, NULL);
+
+	return lru;
+}
+
+static inline mdcache_lru_t *lru_try_reap_entry(uint32_t flags)
+{
 	if (atomic_fetch_uint64_t(&lru_state.entries_used) <
 	    lru_state.entries_hiwat)
 		return NULL;
 
-	/* XXX dang why not start with the cleanup list? */
-	lru = lru_reap_impl(LRU_ENTRY_L2);
+	return lru_reap_entry();
+}
+
+/**
+ * @brief Try to reap an entry to enforce the export quotas
+ *
+ * An export at its hard limit replaces one of its own entries, whatever the
+ * state of the cache.  Otherwise, when the cache is above its high water
+ * mark, an entry of the export most over its soft limit is reaped.
+ *
+ * @param[in] quota  Quota the new entry will be charged to, may be NULL
+ *
+ * @return Reaped entry, or NULL to fall back to lru_try_reap_entry.
+ */
+static mdcache_lru_t *lru_try_reap_quota_entry(struct mdc_quota *quota)
+{
+	mdcache_lru_t *lru = NULL;
+	struct mdc_quota *victim;
+	uint32_t hard;
+
+	if (quota != NULL) {
+		hard = atomic_fetch_uint32_t(&quota->entries_hard);
+
+		if (hard != 0 &&
+		    atomic_fetch_uint64_t(&quota->entries) >= hard) {
+			lru = lru_reap_impl(LRU_ENTRY_L2, 0, quota);
+			if (!lru)
+				lru = lru_reap_impl(LRU_ENTRY_L1, 0, quota);
+
+			if (lru) {
+				mdc_quota_count_reclaim(quota, false);
+				return lru;
+			}
+
+			LogFullDebug(COMPONENT_MDCACHE_LRU,
+				     "Export %" PRIu16
+				     " at its entry hard limit %" PRIu32
+				     " with no reclaimable entry",
+				     quota->export_id, hard);
+		}
+	}
+
+	if (atomic_fetch_uint64_t(&lru_state.entries_used) <
+	    lru_state.entries_hiwat)
+		return NULL;
+
+	victim = mdc_quota_most_over(false);
+
+	if (victim == NULL)
+		return NULL;
+
+	lru = lru_reap_impl(LRU_ENTRY_L2, 0, victim);
 	if (!lru)
-		lru = lru_reap_impl(LRU_ENTRY_L1);
+		lru = lru_reap_impl(LRU_ENTRY_L1, 0, victim);
+
+	if (lru)
+		mdc_quota_count_reclaim(victim, false);
+
+	mdc_quota_unref(victim);
 
 	return lru;
 }
@@ -791,6 +1442,7 @@ static inline mdcache_lru_t *lru_try_reap_entry(uint32_t flags)
  *
  * @param[in] qid        Queue to reap
  * @param[in] parent     The directory we desire a chunk for
+ * @param[in] quota      Only reap chunks charged to this quota, if not NULL
  *
  * @return Available chunk if found, NULL otherwise
  */
@@ -798,7 +1450,8 @@ static inline mdcache_lru_t *lru_try_reap_entry(uint32_t flags)
 static uint32_t chunk_reap_lane;
 
 static inline mdcache_lru_t *lru_reap_chunk_impl(enum lru_q_id qid,
-						 mdcache_entry_t *parent)
+						 mdcache_entry_t *parent,
+						 struct mdc_quota *quota)
 {
 	uint32_t lane;
 	struct lru_q_lane *qlane;
@@ -817,7 +1470,7 @@ static inline mdcache_lru_t *lru_reap_chunk_impl(enum lru_q_id qid,
 		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
 
 		QLOCK(qlane);
-		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
+		lru = chunk_lru_first_of(lq, quota);
 
 		if (!lru) {
 			QUNLOCK(qlane);
@@ -873,6 +1526,7 @@ static inline mdcache_lru_t *lru_reap_chunk_impl(enum lru_q_id qid,
 			 * lock.
 			 */
 			mdcache_clean_dirent_chunk(chunk);
+			mdc_quota_uncharge_chunk(chunk);
 			atomic_clear_uint32_t_bits(&entry->mde_flags,
 						   MDCACHE_DIR_POPULATED);
 
@@ -898,6 +1552,66 @@ static inline mdcache_lru_t *lru_reap_chunk_impl(enum lru_q_id qid,
 	return NULL;
 }
 
+/**
+ * @brief Try to reap a chunk to enforce the export quotas
+ *
+ * This is the counterpart of lru_try_reap_quota_entry for chunks.
+ *
+ * @param[in] parent  The directory we desire a chunk for
+ * @param[in] quota   Quota the new chunk will be charged to, may be NULL
+ *
+ * @return Reaped chunk, or NULL to fall back to reaping any chunk.
+ */
+static mdcache_lru_t *lru_try_reap_quota_chunk(mdcache_entry_t *parent,
+					       struct mdc_quota *quota)
+{
+	mdcache_lru_t *lru = NULL;
+	struct mdc_quota *victim;
+	uint32_t hard;
+
+	if (quota != NULL) {
+		hard = atomic_fetch_uint32_t(&quota->chunks_hard);
+
+		if (hard != 0 &&
+		    atomic_fetch_uint64_t(&quota->chunks) >= hard) {
+			lru = lru_reap_chunk_impl(LRU_ENTRY_L2, parent, quota);
+			if (!lru)
+				lru = lru_reap_chunk_impl(LRU_ENTRY_L1, parent,
+							  quota);
+
+			if (lru) {
+				mdc_quota_count_reclaim(quota, true);
+				return lru;
+			}
+
+			LogFullDebug(COMPONENT_MDCACHE_LRU,
+				     "Export %" PRIu16
+				     " at its chunk hard limit %" PRIu32
+				     " with no reclaimable chunk",
+				     quota->export_id, hard);
+		}
+	}
+
+	if (lru_state.chunks_used < lru_state.chunks_hiwat)
+		return NULL;
+
+	victim = mdc_quota_most_over(true);
+
+	if (victim == NULL)
+		return NULL;
+
+	lru = lru_reap_chunk_impl(LRU_ENTRY_L2, parent, victim);
+	if (!lru)
+		lru = lru_reap_chunk_impl(LRU_ENTRY_L1, parent, victim);
+
+	if (lru)
+		mdc_quota_count_reclaim(victim, true);
+
+	mdc_quota_unref(victim);
+
+	return lru;
+}
+
 /**
  * @brief Re-use or allocate a chunk
  *
@@ -924,10 +1638,16 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 	if (prev_chunk)
 		mdcache_lru_ref_chunk(prev_chunk);
 
-	if (lru_state.chunks_used >= lru_state.chunks_hiwat) {
-		lru = lru_reap_chunk_impl(LRU_ENTRY_L2, parent);
+	/* Chunks are charged to the export of their directory */
+	if (parent->quota != NULL)
+		mdc_quota_refresh(parent->quota);
+
+	lru = lru_try_reap_quota_chunk(parent, parent->quota);
+
+	if (!lru && lru_state.chunks_used >= lru_state.chunks_hiwat) {
+		lru = lru_reap_chunk_impl(LRU_ENTRY_L2, parent, NULL);
 		if (!lru)
-			lru = lru_reap_chunk_impl(LRU_ENTRY_L1, parent);
+			lru = lru_reap_chunk_impl(LRU_ENTRY_L1, parent, NULL);
 	}
 
 	if (lru) {
@@ -947,6 +1667,7 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 
 	/* Set the chunk's parent and insert */
 	chunk->parent = parent;
+	mdc_quota_charge_chunk(chunk, parent->quota);
 	glist_add_tail(&chunk->parent->fsobj.fsdir.chunks, &chunk->chunks);
 	if (prev_chunk) {
 		chunk->reload_ck = glist_last_entry(&prev_chunk->dirents,
@@ -1077,6 +1798,38 @@ void mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
 	cih_hash_release(&latch);
 }
 
+/**
+ * @brief Demote the LRU end of the protected queue of a lane
+ *
+ * With the 2Q policy, L1 may only hold its share of the cache, the rest of
+ * its entries go back on probation.
+ *
+ * @param[in]     qlane         The lane to process
+ *
+ * @returns the number of entries demoted
+ */
+
+static inline int lru_run_lane_2q(struct lru_q_lane *qlane)
+{
+	size_t workdone = 0;
+	mdcache_lru_t *lru;
+
+	QLOCK(qlane);
+
+	while (qlane->L1.size > lru_state.protected_max &&
+	       workdone < lru_state.per_lane_work) {
+		lru = glist_first_entry(&qlane->L1.q, mdcache_lru_t, q);
+		LRU_DQ(lru, &qlane->L1);
+		atomic_clear_uint32_t_bits(&lru->flags, LRU_PROTECTED);
+		lru_insert_mru(lru, &qlane->L2);
+		++workdone;
+	}
+
+	QUNLOCK(qlane);
+
+	return workdone;
+}
+
 /**
  * @brief Function that executes in the lru thread to process one lane
  *
@@ -1100,6 +1853,9 @@ static inline int lru_run_lane(int lane)
 	LogDebug(COMPONENT_MDCACHE_LRU, "Reaping up to %d entries from lane %d",
 		 lru_state.per_lane_work, lane);
 
+	if (LRU_2Q())
+		return lru_run_lane_2q(qlane);
+
 	/* ACTIVE */
 	QLOCK(qlane);
 
@@ -1152,6 +1908,22 @@ static inline int lru_run_lane(int lane)
 	return workdone;
 }
 
+/**
+ * @brief Report the cache usage of an export
+ *
+ * @param[in] quota  Quota of the export
+ * @param[in] arg    Unused
+ */
+static void lru_report_quota(struct mdc_quota *quota, void *arg)
+{
+	monitoring__dynamic_mdcache_export_usage(
+		quota->export_id, "entries",
+		atomic_fetch_uint64_t(&quota->entries));
+	monitoring__dynamic_mdcache_export_usage(
+		quota->export_id, "chunks",
+		atomic_fetch_uint64_t(&quota->chunks));
+}
+
 /**
  * @brief Function that executes in the lru thread
  *
@@ -1298,6 +2070,15 @@ static void lru_run(struct fridgethr_context *ctx)
 		 ((uint64_t)threadwait));
 	LogFullDebug(COMPONENT_MDCACHE_LRU, "totalwork=%d lanes=%d", totalwork,
 		     LRU_N_Q_LANES);
+	LogDebug(COMPONENT_MDCACHE_LRU,
+		 "Evictions: probation %" PRIu64 " (scan %" PRIu64
+		 "), protected %" PRIu64 ", ghost hits %" PRIu64,
+		 atomic_fetch_uint64_t(&lru_state.probation_evictions),
+		 atomic_fetch_uint64_t(&lru_state.scan_evictions),
+		 atomic_fetch_uint64_t(&lru_state.protected_evictions),
+		 atomic_fetch_uint64_t(&lru_state.ghost_hits));
+
+	mdc_quota_foreach(lru_report_quota, NULL);
 }
 
 /**
@@ -1446,10 +2227,10 @@ static void chunk_lru_run(struct fridgethr_context *ctx)
 		mdcache_lru_t *lru = NULL;
 		struct dir_chunk *chunk;
 
-		lru = lru_reap_chunk_impl(LRU_ENTRY_L2, NULL);
+		lru = lru_reap_chunk_impl(LRU_ENTRY_L2, NULL, NULL);
 
 		if (lru == NULL)
-			lru = lru_reap_chunk_impl(LRU_ENTRY_L1, NULL);
+			lru = lru_reap_chunk_impl(LRU_ENTRY_L1, NULL, NULL);
 
 		if (lru == NULL) {
 			/* No more progress possible. */
@@ -1541,6 +2322,38 @@ size_t mdcache_lru_release_entries(int32_t want_release)
 	return released;
 }
 
+/**
+ * @brief Release entries while MDCACHE is over its memory limit
+ *
+ * Called by the reaper, see gsh_mem_check().  Unlike
+ * mdcache_lru_release_entries(), entries are reaped whatever the high water
+ * mark, enough to free the excess if they only held their own size.
+ *
+ * @param[in] excess	Bytes allocated over Memory_Limit
+ */
+static void mdcache_lru_reclaim_memory(uint64_t excess)
+{
+	uint64_t want = excess / sizeof(mdcache_entry_t) + 1;
+	uint64_t released = 0;
+	mdcache_lru_t *lru;
+	mdcache_entry_t *entry;
+
+	EXPORT_ADMIN_LOCK();
+
+	while (released < want && (lru = lru_reap_entry()) != NULL) {
+		entry = container_of(lru, mdcache_entry_t, lru);
+		mdcache_lru_unref(entry, LRU_TEMP_REF);
+		++released;
+	}
+
+	EXPORT_ADMIN_UNLOCK();
+
+	LogDebug(COMPONENT_MDCACHE_LRU,
+		 "Released %" PRIu64 " of %" PRIu64
+		 " entries wanted to get under Memory_Limit",
+		 released, want);
+}
+
 /* Public functions */
 
 void init_fds_limit(void)
@@ -1591,8 +2404,12 @@ fsal_status_t mdcache_lru_pkginit(void)
 		lru_state.per_lane_work = mdcache_param.reaper_work_per_lane;
 	}
 
-	/* Set high watermark for cache entries. */
-	lru_state.entries_hiwat = mdcache_param.entries_hwmark;
+	/* Set high watermark for cache entries and the replacement policy. */
+	PTHREAD_MUTEX_init(&lru_ghost.mtx, NULL);
+	glist_init(&mdc_quota_list);
+	PTHREAD_MUTEX_init(&mdc_quota_mtx, NULL);
+	mdcache_lru_set_policy(mdcache_param.lru_policy,
+			       mdcache_param.entries_hwmark);
 	lru_state.entries_used = 0;
 
 	/* set lru release entries size */
@@ -1603,6 +2420,9 @@ fsal_status_t mdcache_lru_pkginit(void)
 	lru_state.chunks_lowat = mdcache_param.chunks_lwmark;
 	lru_state.chunks_used = 0;
 
+	gsh_mem_set_limit(COMPONENT_MDCACHE, mdcache_param.memory_limit,
+			  mdcache_lru_reclaim_memory);
+
 	/* init queue complex */
 	lru_init_queues();
 
@@ -1676,9 +2496,48 @@ fsal_status_t mdcache_lru_pkgshutdown(void)
 
 	lru_destroy_queues();
 
+	gsh_free(lru_ghost.gen[0]);
+	gsh_free(lru_ghost.gen[1]);
+	lru_ghost.gen[0] = lru_ghost.gen[1] = NULL;
+	PTHREAD_MUTEX_destroy(&lru_ghost.mtx);
+	PTHREAD_MUTEX_destroy(&mdc_quota_mtx);
+
 	return status;
 }
 
+/**
+ * @brief Set the replacement policy and size of the entry cache
+ *
+ * Entries already cached keep their queue, so besides initialization this
+ * is only meant for comparing policies on a quiet cache.
+ *
+ * @param[in] policy         Replacement policy
+ * @param[in] entries_hiwat  High water mark for cache entries
+ */
+void mdcache_lru_set_policy(enum mdcache_lru_policy policy,
+			    uint64_t entries_hiwat)
+{
+	uint64_t lane_entries = entries_hiwat / LRU_N_Q_LANES + 1;
+
+	lru_state.entries_hiwat = entries_hiwat;
+	lru_state.probation_max =
+		lane_entries * mdcache_param.lru_probation_percent / 100;
+	lru_state.protected_max = lane_entries - lru_state.probation_max;
+
+	if (policy == MDCACHE_LRU_POLICY_2Q) {
+		/* Each of the two ghost generations holds half the keys */
+		lru_ghost_resize(entries_hiwat *
+					 mdcache_param.lru_ghost_percent / 200 +
+				 1);
+	}
+
+	lru_state.policy = policy;
+
+	LogInfo(COMPONENT_MDCACHE_LRU,
+		"Entry cache of %" PRIu64 " entries, %s policy", entries_hiwat,
+		policy == MDCACHE_LRU_POLICY_2Q ? "2Q" : "LRU");
+}
+
 static inline void init_rw_locks(mdcache_entry_t *entry)
 {
 	/* Initialize the entry locks */
@@ -1712,20 +2571,26 @@ mdcache_entry_t *alloc_cache_entry(void)
  * sufficiently constructed.
  *
  * @param[in] sub_handle  The underlying FSAL's fsal_obj_handle
+ * @param[in] quota       Quota of the export the entry is created for
  * @param[in] flags       The flags for the caller's initial reference, MUST
  *                        include LRU_ACTIVE_REF
  *
  * @return a usable entry or NULL if unexport is in progress.
  */
 mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle,
-				 uint32_t flags)
+				 struct mdc_quota *quota, uint32_t flags)
 {
 	mdcache_lru_t *lru;
 	mdcache_entry_t *nentry = NULL;
 
 	assert(flags & LRU_ACTIVE_REF);
 
-	lru = lru_try_reap_entry(LRU_TEMP_REF);
+	if (quota != NULL)
+		mdc_quota_refresh(quota);
+
+	lru = lru_try_reap_quota_entry(quota);
+	if (!lru)
+		lru = lru_try_reap_entry(LRU_TEMP_REF);
 	if (lru) {
 		/* we uniquely hold entry with a temp ref that we will
 		 * discard (with no negative consequence) below when we remake
@@ -1752,6 +2617,7 @@ mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle,
 	nentry->lru.lane = lru_lane_of(nentry);
 	nentry->lru.flags = LRU_SENTINEL_HELD;
 	nentry->sub_handle = sub_handle;
+	mdc_quota_charge_entry(nentry, quota);
 
 	if (flags & LRU_PROMOTE) {
 		/* If entry is ever promoted, remember that. */
@@ -1775,6 +2641,13 @@ void mdcache_lru_insert_active(mdcache_entry_t *entry)
 	mdcache_lru_t *lru = &entry->lru;
 	struct lru_q_lane *qlane = &LRU[lru->lane];
 
+	if (LRU_2Q() && lru_ghost_test(entry->fh_hk.key.hk)) {
+		/* Evicted from probation not long ago, protect it */
+		atomic_set_uint32_t_bits(&lru->flags, LRU_PROTECTED);
+		(void)atomic_inc_uint64_t(&lru_state.ghost_hits);
+		monitoring__dynamic_mdcache_lru_event("ghost_hit");
+	}
+
 	QLOCK(qlane);
 
 	/* Enqueue. */
@@ -1986,6 +2859,7 @@ static void lru_clean_chunk(struct dir_chunk *chunk)
 
 	/* Then do the actual cleaning work. */
 	mdcache_clean_dirent_chunk(chunk);
+	mdc_quota_uncharge_chunk(chunk);
 }
 
 void _mdcache_lru_ref_chunk(struct dir_chunk *chunk, const char *func, int line)
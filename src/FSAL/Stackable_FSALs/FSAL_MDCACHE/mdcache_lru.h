@@ -74,10 +74,44 @@ struct lru_state {
 	uint64_t chunks_used;
 	uint32_t per_lane_work;
 	time_t prev_time; /* previous time the gc thread was run. */
+	uint32_t policy; /* enum mdcache_lru_policy */
+	uint64_t probation_max; /* 2Q: L2 entries per lane reaped first */
+	uint64_t protected_max; /* 2Q: L1 entries per lane before demotion */
+	uint64_t ghost_hits; /* new entries found on the ghost list */
+	uint64_t probation_evictions; /* entries reaped from L2 */
+	uint64_t scan_evictions; /* of those, never referenced again */
+	uint64_t protected_evictions; /* entries reaped from L1 */
 };
 
 extern struct lru_state lru_state;
 
+/**
+ * @brief Cache usage and limits of an export
+ *
+ * Each entry is charged to the export it was created for, and each dirent
+ * chunk to the export of its directory.  When the export has a hard limit
+ * and is at it, a new object replaces one of its own.  When the cache is
+ * above its high water mark, objects of the export most over its soft limit
+ * are reclaimed first, so an export may use idle capacity beyond its soft
+ * limit until others need it.
+ *
+ * The quota is referenced by its export and by every object charged to it,
+ * so it outlives an export whose entries are still cached.
+ */
+struct mdc_quota {
+	struct glist_head q_list; /*< Link in the list of quotas */
+	int32_t refcnt; /*< Export reference plus one per charged object */
+	uint16_t export_id; /*< Export the quota is for */
+	uint64_t entries; /*< Entries charged */
+	uint64_t chunks; /*< Dirent chunks charged */
+	uint32_t entries_soft; /*< Copies of the export limits, 0 for none */
+	uint32_t entries_hard;
+	uint32_t chunks_soft;
+	uint32_t chunks_hard;
+	uint64_t entries_reclaimed; /*< Entries reclaimed to enforce limits */
+	uint64_t chunks_reclaimed; /*< Chunks reclaimed to enforce limits */
+};
+
 /** Cache entries pool */
 extern pool_t *mdcache_entry_pool;
 
@@ -104,9 +138,11 @@ extern pool_t *mdcache_entry_pool;
 
 fsal_status_t mdcache_lru_pkginit(void);
 fsal_status_t mdcache_lru_pkgshutdown(void);
+void mdcache_lru_set_policy(enum mdcache_lru_policy policy,
+			    uint64_t entries_hiwat);
 
 mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle,
-				 uint32_t flags);
+				 struct mdc_quota *quota, uint32_t flags);
 void mdcache_lru_insert_active(mdcache_entry_t *entry);
 
 #define mdcache_lru_ref(e, f) _mdcache_lru_ref(e, f, __func__, __LINE__)
@@ -169,5 +205,10 @@ void mdc_lru_map_dirent(mdcache_dir_entry_t *dirent);
 fsal_cookie_t *mdc_lru_unmap_dirent(uint64_t ck);
 fsal_status_t dirmap_lru_init(struct mdcache_fsal_export *exp);
 void dirmap_lru_stop(struct mdcache_fsal_export *exp);
+
+struct mdc_quota *mdc_quota_new(struct gsh_export *export);
+void mdc_quota_put(struct mdc_quota *quota);
+void mdc_quota_foreach(void (*cb)(struct mdc_quota *quota, void *arg),
+		       void *arg);
 #endif /* MDCACHE_LRU_H */
 /** @} */
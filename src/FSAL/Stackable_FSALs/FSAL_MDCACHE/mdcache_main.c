@@ -144,6 +144,7 @@ void mdcache_export_uninit(void)
 			   &op_ctx->fsal_export->exports);
 	free_export_ops(op_ctx->fsal_export);
 	up_ready_destroy(&exp->up_ops);
+	mdc_quota_put(exp->quota);
 
 	gsh_free(exp);
 
@@ -222,6 +223,8 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 		return status;
 	}
 
+	myself->quota = mdc_quota_new(op_ctx->ctx_export);
+
 	/* Set up op_ctx */
 	op_ctx->fsal_export = &myself->mfe_exp;
 	op_ctx->fsal_module = &MDCACHE.module;
@@ -412,7 +415,8 @@ void mdcache_utilization(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
 	char *type;
-	uint64_t entries_used, chunks_used;
+	uint64_t entries_used, chunks_used, ghost_hits, scan_evictions;
+	uint64_t probation_evictions, protected_evictions;
 	uint32_t fd_limit, fd_state;
 	size_t open_fds;
 
@@ -424,6 +428,12 @@ void mdcache_utilization(DBusMessageIter *iter)
 	chunks_used = atomic_fetch_uint64_t(&lru_state.chunks_used);
 	fd_state = atomic_fetch_uint32_t(&fd_lru_state.fd_state);
 	fd_limit = atomic_fetch_uint32_t(&fd_lru_state.fds_system_imposed);
+	ghost_hits = atomic_fetch_uint64_t(&lru_state.ghost_hits);
+	scan_evictions = atomic_fetch_uint64_t(&lru_state.scan_evictions);
+	probation_evictions =
+		atomic_fetch_uint64_t(&lru_state.probation_evictions);
+	protected_evictions =
+		atomic_fetch_uint64_t(&lru_state.protected_evictions);
 
 	type = " FSAL opened FD count : ";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
@@ -463,7 +473,80 @@ void mdcache_utilization(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				       &chunks_used);
 
+	type = " LRU policy : ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	if (lru_state.policy == MDCACHE_LRU_POLICY_2Q)
+		type = " 2Q ";
+	else
+		type = " LRU ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+
+	type = " Probation evictions : ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &probation_evictions);
+
+	type = " Scan evictions : ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &scan_evictions);
+
+	type = " Protected evictions : ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &protected_evictions);
+
+	type = " Ghost hits : ";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &ghost_hits);
+
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
+
+static void mdcache_dbus_export_quota(struct mdc_quota *quota, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+	uint64_t entries, entries_reclaimed, chunks, chunks_reclaimed;
+
+	entries = atomic_fetch_uint64_t(&quota->entries);
+	entries_reclaimed = atomic_fetch_uint64_t(&quota->entries_reclaimed);
+	chunks = atomic_fetch_uint64_t(&quota->chunks);
+	chunks_reclaimed = atomic_fetch_uint64_t(&quota->chunks_reclaimed);
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+				       &quota->export_id);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entries);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &quota->entries_soft);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &quota->entries_hard);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entries_reclaimed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &chunks);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &quota->chunks_soft);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &quota->chunks_hard);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &chunks_reclaimed);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/* per export cache usage and quotas */
+void mdcache_dbus_export_usage(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(qtuuttuut)",
+					 &array_iter);
+	mdc_quota_foreach(mdcache_dbus_export_quota, &array_iter);
+	dbus_message_iter_close_container(iter, &array_iter);
+}
 #endif /* USE_DBUS */
 /** @} */
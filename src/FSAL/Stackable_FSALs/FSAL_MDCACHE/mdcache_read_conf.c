@@ -54,6 +54,12 @@
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("lru", MDCACHE_LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("twoq", MDCACHE_LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7, mdcache_parameter, nparts),
 	CONF_ITEM_UI32("Cache_Size", 1, UINT32_MAX, 32633, mdcache_parameter,
@@ -64,14 +70,24 @@ static struct config_item mdcache_params[] = {
 		       dir.avl_chunk),
 	CONF_ITEM_UI32("Detached_Mult", 1, UINT32_MAX, 1, mdcache_parameter,
 		       dir.avl_detached_mult),
+	CONF_ITEM_UI32("Dir_Filter_Max", 0, UINT32_MAX, 100000,
+		       mdcache_parameter, dir.avl_filter_max),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
 	CONF_ITEM_UI32("Entries_Release_Size", 0, UINT32_MAX, 100,
 		       mdcache_parameter, entries_release_size),
+	CONF_ITEM_TOKEN("LRU_Policy", MDCACHE_LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
+	CONF_ITEM_UI32("LRU_Probation_Percent", 1, 90, 25, mdcache_parameter,
+		       lru_probation_percent),
+	CONF_ITEM_UI32("LRU_Ghost_Percent", 1, 200, 50, mdcache_parameter,
+		       lru_ghost_percent),
 	CONF_ITEM_UI32("Chunks_HWMark", 1, UINT32_MAX, 1000, mdcache_parameter,
 		       chunks_hwmark),
 	CONF_ITEM_UI32("Chunks_LWMark", 1, UINT32_MAX, 1000, mdcache_parameter,
 		       chunks_lwmark),
+	CONF_ITEM_UI64("Memory_Limit", 0, UINT64_MAX, 0, mdcache_parameter,
+		       memory_limit),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90, mdcache_parameter,
 		       lru_run_interval),
 	CONF_ITEM_BOOL("Cache_FDs", true, mdcache_parameter, Cache_FDs),
@@ -98,6 +114,8 @@ static struct config_item mdcache_params[] = {
 		      mdcache_parameter, files_delegatable_percent),
 	CONF_ITEM_BOOL("Use_Cached_Owner_On_Owner_Override", true,
 		       mdcache_parameter, use_cached_owner_on_owner_override),
+	CONF_ITEM_UI32("Fattr_Cache_Slots", 0, 16, 0, mdcache_parameter,
+		       fattr_cache_slots),
 	CONFIG_EOL
 };
 
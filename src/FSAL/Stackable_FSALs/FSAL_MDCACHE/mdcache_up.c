@@ -75,6 +75,9 @@ static fsal_status_t mdc_up_invalidate(const struct fsal_up_vector *vec,
 	atomic_clear_uint32_t_bits(&entry->mde_flags,
 				   flags & FSAL_UP_INVALIDATE_CACHE);
 
+	if (flags & FSAL_UP_INVALIDATE_ATTRS)
+		mdc_listing_changed(entry);
+
 	if (flags & FSAL_UP_INVALIDATE_CLOSE)
 		status = fsal_close(&entry->obj_handle);
 
@@ -244,6 +247,7 @@ static fsal_status_t mdc_up_update(const struct fsal_up_vector *vec,
 					   MDCACHE_TRUST_ATTRS |
 						   MDCACHE_TRUST_CONTENT |
 						   MDCACHE_DIR_POPULATED);
+		mdc_listing_changed(entry);
 
 		status = fsal_close(&entry->obj_handle);
 
@@ -392,6 +396,7 @@ static fsal_status_t mdc_up_update(const struct fsal_up_vector *vec,
 
 	if (mutatis_mutandis) {
 		mdc_fixup_md(entry, attr);
+		mdc_listing_changed(entry);
 		entry->attrs.valid_mask |= mask_set;
 		/* If directory can not trust content anymore. */
 		if (entry->obj_handle.type == DIRECTORY) {
@@ -407,6 +412,7 @@ static fsal_status_t mdc_up_update(const struct fsal_up_vector *vec,
 	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_listing_changed(entry);
 		status = fsalstat(ERR_FSAL_INVAL, 0);
 	}
 
@@ -40,25 +40,53 @@
 #include "nfs_core.h"
 #include <sys/stat.h>
 #include "FSAL/access_check.h"
+#include "nfs4_acls.h"
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <grp.h>
 #include <sys/types.h>
 #include <os/subr.h>
+#include "monitoring.h"
 
 static bool fsal_check_ace_owner(uid_t uid, struct user_cred *creds)
 {
 	return (creds->caller_uid == uid);
 }
 
-static bool fsal_check_ace_group(gid_t gid, struct user_cred *creds)
+/* Callers with more alternate groups than this get them sorted for ACL
+ * evaluation, and looked up by binary search.
+ */
+#define FSAL_ACL_SORT_GROUPS 16
+
+static int fsal_gid_cmp(const void *a, const void *b)
+{
+	gid_t gid_a = *(const gid_t *)a;
+	gid_t gid_b = *(const gid_t *)b;
+
+	return (gid_a > gid_b) - (gid_a < gid_b);
+}
+
+/**
+ * @brief Check group membership of the caller
+ *
+ * @param[in] gid    Group to check
+ * @param[in] creds  Caller credentials
+ * @param[in] groups Sorted copy of the alternate groups, or NULL
+ */
+
+static bool fsal_check_ace_group(gid_t gid, struct user_cred *creds,
+				 const gid_t *groups)
 {
 	int i;
 
 	if (creds->caller_gid == gid)
 		return true;
 
+	if (groups != NULL)
+		return bsearch(&gid, groups, creds->caller_glen, sizeof(gid_t),
+			       fsal_gid_cmp) != NULL;
+
 	for (i = 0; i < creds->caller_glen; i++) {
 		if (creds->caller_garray[i] == gid)
 			return true;
@@ -68,7 +96,8 @@ static bool fsal_check_ace_group(gid_t gid, struct user_cred *creds)
 }
 
 static bool fsal_check_ace_matches(fsal_ace_t *pace, struct user_cred *creds,
-				   bool is_owner, bool is_group)
+				   const gid_t *groups, bool is_owner,
+				   bool is_group)
 {
 	bool result = false;
 	char *cause = "";
@@ -98,7 +127,7 @@ static bool fsal_check_ace_matches(fsal_ace_t *pace, struct user_cred *creds,
 			break;
 		}
 	else if (IS_FSAL_ACE_GROUP_ID(*pace)) {
-		if (fsal_check_ace_group(pace->who.gid, creds)) {
+		if (fsal_check_ace_group(pace->who.gid, creds, groups)) {
 			result = true;
 			cause = "group";
 		}
@@ -117,7 +146,8 @@ static bool fsal_check_ace_matches(fsal_ace_t *pace, struct user_cred *creds,
 }
 
 static bool fsal_check_ace_applicable(fsal_ace_t *pace, struct user_cred *creds,
-				      bool is_dir, bool is_owner, bool is_group,
+				      const gid_t *groups, bool is_dir,
+				      bool is_owner, bool is_group,
 				      bool is_root)
 {
 	bool is_applicable = false;
@@ -148,8 +178,8 @@ static bool fsal_check_ace_applicable(fsal_ace_t *pace, struct user_cred *creds,
 	}
 
 	/* The user should match who value. */
-	is_applicable = is_root ||
-			fsal_check_ace_matches(pace, creds, is_owner, is_group);
+	is_applicable = is_root || fsal_check_ace_matches(pace, creds, groups,
+							 is_owner, is_group);
 	if (is_applicable)
 		LogFullDebug(COMPONENT_NFS_V4_ACL, "Applicable, flag=0X%x",
 			     pace->flag);
@@ -435,125 +465,34 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
 }
 
 /**
- * @brief Check access using v4 ACL list
+ * @brief Walk the ACEs of an ACL
  *
- * @param[in] creds
- * @param[in] v4mask
- * @param[in] allowed
- * @param[in] denied
- * @param[in] p_object_attributes
+ * @param[in]  creds          Caller credentials
+ * @param[in]  groups         Sorted copy of the alternate groups, or NULL
+ * @param[in]  v4mask         Requested access
+ * @param[in]  missing_access Requested access not granted yet
+ * @param[out] allowed        Allowed access, or NULL
+ * @param[out] denied         Denied access, or NULL
+ * @param[in]  pacl           The ACL
+ * @param[in]  is_dir         Object is a directory
+ * @param[in]  is_owner       Caller owns the object
+ * @param[in]  is_group       Caller is in the group of the object
+ * @param[in]  is_root        Caller is superuser
  *
- * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS or ERR_FSAL_PERM
  */
 
 static fsal_status_t
-fsal_check_access_acl(struct user_cred *creds, fsal_aceperm_t v4mask,
-		      fsal_accessflags_t *allowed, fsal_accessflags_t *denied,
-		      struct fsal_attrlist *p_object_attributes)
+fsal_check_acl_aces(struct user_cred *creds, const gid_t *groups,
+		    fsal_aceperm_t v4mask, fsal_aceperm_t missing_access,
+		    fsal_accessflags_t *allowed, fsal_accessflags_t *denied,
+		    fsal_acl_t *pacl, bool is_dir, bool is_owner,
+		    bool is_group, bool is_root)
 {
-	fsal_aceperm_t missing_access;
 	fsal_aceperm_t tperm;
-	uid_t uid;
-	gid_t gid;
-	fsal_acl_t *pacl = NULL;
 	fsal_ace_t *pace = NULL;
 	int ace_number = 0;
-	bool is_dir = false;
-	bool is_owner = false;
-	bool is_group = false;
-	bool is_root = false;
-
-	if (allowed != NULL)
-		*allowed = 0;
-
-	if (denied != NULL)
-		*denied = 0;
-
-	if (!p_object_attributes->acl) {
-		/* Means that FSAL_ACE4_REQ_FLAG was set, but no ACLs */
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "Allow ACE required, but no ACLs");
-		return fsalstat(ERR_FSAL_NO_ACE, 0);
-	}
-
-	/* unsatisfied flags */
-	missing_access = v4mask &
-			 ~(FSAL_ACE4_PERM_CONTINUE | FSAL_ACE4_REQ_FLAG);
-	if (!missing_access) {
-		LogFullDebug(COMPONENT_NFS_V4_ACL, "Nothing was requested");
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-	}
-
-	/* Get file ownership information. */
-	uid = p_object_attributes->owner;
-	gid = p_object_attributes->group;
-	pacl = p_object_attributes->acl;
-	is_dir = (p_object_attributes->type == DIRECTORY);
-	is_root = op_ctx->fsal_export->exp_ops.is_superuser(op_ctx->fsal_export,
-							    creds);
-
-	if (is_root) {
-		if (is_dir) {
-			if (allowed != NULL)
-				*allowed = v4mask;
-
-			/* On a directory, allow root anything. */
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met root privileges on directory");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-
-		/* Otherwise, allow root anything but execute. */
-		missing_access &= FSAL_ACE_PERM_EXECUTE;
-
-		if (allowed != NULL)
-			*allowed = v4mask & ~FSAL_ACE_PERM_EXECUTE;
-
-		if (!missing_access) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met root privileges");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
-
-	LogFullDebug(COMPONENT_NFS_V4_ACL,
-		     "file acl=%p, file uid=%u, file gid=%u, ", pacl, uid, gid);
-
-	if (isFullDebug(COMPONENT_NFS_V4_ACL)) {
-		char str[LOG_BUFF_LEN] = "\0";
-		struct display_buffer dspbuf = { sizeof(str), str, str };
-
-		(void)display_fsal_v4mask(&dspbuf, v4mask,
-					  p_object_attributes->type ==
-						  DIRECTORY);
 
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "user uid=%u, user gid= %u, v4mask=%s",
-			     creds->caller_uid, creds->caller_gid, str);
-	}
-
-	is_owner = fsal_check_ace_owner(uid, creds);
-	is_group = fsal_check_ace_group(gid, creds);
-
-	/* Always grant READ_ACL, WRITE_ACL and READ_ATTR, WRITE_ATTR
-	 * to the file owner. */
-	if (is_owner) {
-		if (allowed != NULL)
-			*allowed |= v4mask & (FSAL_ACE_PERM_WRITE_ACL |
-					      FSAL_ACE_PERM_READ_ACL |
-					      FSAL_ACE_PERM_WRITE_ATTR |
-					      FSAL_ACE_PERM_READ_ATTR);
-
-		missing_access &=
-			~(FSAL_ACE_PERM_WRITE_ACL | FSAL_ACE_PERM_READ_ACL);
-		missing_access &=
-			~(FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_READ_ATTR);
-		if (!missing_access) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met owner privileges");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
 	/** @todo Even if user is admin, audit/alarm checks should be done. */
 
 	for (pace = pacl->aces; pace < pacl->aces + pacl->naces; pace++) {
@@ -574,8 +513,8 @@ fsal_check_access_acl(struct user_cred *creds, fsal_aceperm_t v4mask,
 		LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
 
 		/* Check if this ACE is applicable. */
-		if (fsal_check_ace_applicable(pace, creds, is_dir, is_owner,
-					      is_group, is_root)) {
+		if (fsal_check_ace_applicable(pace, creds, groups, is_dir,
+					      is_owner, is_group, is_root)) {
 			if (IS_FSAL_ACE_ALLOW(*pace)) {
 				/* Do not set bits which are already denied */
 				if (denied)
@@ -680,6 +619,181 @@ fsal_check_access_acl(struct user_cred *creds, fsal_aceperm_t v4mask,
 	}
 }
 
+/**
+ * @brief Check access using v4 ACL list
+ *
+ * @param[in] creds
+ * @param[in] v4mask
+ * @param[in] allowed
+ * @param[in] denied
+ * @param[in] p_object_attributes
+ *
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
+ */
+
+static fsal_status_t
+fsal_check_access_acl(struct user_cred *creds, fsal_aceperm_t v4mask,
+		      fsal_accessflags_t *allowed, fsal_accessflags_t *denied,
+		      struct fsal_attrlist *p_object_attributes)
+{
+	fsal_aceperm_t missing_access;
+	uid_t uid;
+	gid_t gid;
+	fsal_acl_t *pacl = NULL;
+	struct fsal_acl_decision decision;
+	gid_t *groups = NULL;
+	fsal_status_t status;
+	bool is_dir = false;
+	bool is_owner = false;
+	bool is_group = false;
+	bool is_root = false;
+	bool memoize;
+
+	if (allowed != NULL)
+		*allowed = 0;
+
+	if (denied != NULL)
+		*denied = 0;
+
+	if (!p_object_attributes->acl) {
+		/* Means that FSAL_ACE4_REQ_FLAG was set, but no ACLs */
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "Allow ACE required, but no ACLs");
+		return fsalstat(ERR_FSAL_NO_ACE, 0);
+	}
+
+	/* unsatisfied flags */
+	missing_access = v4mask &
+			 ~(FSAL_ACE4_PERM_CONTINUE | FSAL_ACE4_REQ_FLAG);
+	if (!missing_access) {
+		LogFullDebug(COMPONENT_NFS_V4_ACL, "Nothing was requested");
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	/* Get file ownership information. */
+	uid = p_object_attributes->owner;
+	gid = p_object_attributes->group;
+	pacl = p_object_attributes->acl;
+	is_dir = (p_object_attributes->type == DIRECTORY);
+	is_root = op_ctx->fsal_export->exp_ops.is_superuser(op_ctx->fsal_export,
+							    creds);
+
+	if (is_root) {
+		if (is_dir) {
+			if (allowed != NULL)
+				*allowed = v4mask;
+
+			/* On a directory, allow root anything. */
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met root privileges on directory");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
+		/* Otherwise, allow root anything but execute. */
+		missing_access &= FSAL_ACE_PERM_EXECUTE;
+
+		if (allowed != NULL)
+			*allowed = v4mask & ~FSAL_ACE_PERM_EXECUTE;
+
+		if (!missing_access) {
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met root privileges");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4_ACL,
+		     "file acl=%p, file uid=%u, file gid=%u, ", pacl, uid, gid);
+
+	if (isFullDebug(COMPONENT_NFS_V4_ACL)) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = { sizeof(str), str, str };
+
+		(void)display_fsal_v4mask(&dspbuf, v4mask,
+					  p_object_attributes->type ==
+						  DIRECTORY);
+
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "user uid=%u, user gid= %u, v4mask=%s",
+			     creds->caller_uid, creds->caller_gid, str);
+	}
+
+	is_owner = fsal_check_ace_owner(uid, creds);
+	is_group = fsal_check_ace_group(gid, creds, NULL);
+
+	/* Always grant READ_ACL, WRITE_ACL and READ_ATTR, WRITE_ATTR
+	 * to the file owner. */
+	if (is_owner) {
+		if (allowed != NULL)
+			*allowed |= v4mask & (FSAL_ACE_PERM_WRITE_ACL |
+					      FSAL_ACE_PERM_READ_ACL |
+					      FSAL_ACE_PERM_WRITE_ATTR |
+					      FSAL_ACE_PERM_READ_ATTR);
+
+		missing_access &=
+			~(FSAL_ACE_PERM_WRITE_ACL | FSAL_ACE_PERM_READ_ACL);
+		missing_access &=
+			~(FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_READ_ATTR);
+		if (!missing_access) {
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met owner privileges");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
+	/* Walk the ACEs, unless this caller was already evaluated
+	 * against this ACL.  Callers with many groups are not memoized.
+	 */
+	memoize = creds->caller_glen <= FSAL_ACL_DECISION_GROUPS;
+	decision.acl_id = pacl->id;
+	decision.caller_uid = creds->caller_uid;
+	decision.caller_gid = creds->caller_gid;
+	decision.caller_glen = creds->caller_glen;
+	if (memoize)
+		memcpy(decision.caller_garray, creds->caller_garray,
+		       creds->caller_glen * sizeof(gid_t));
+	decision.owner = uid;
+	decision.group = gid;
+	decision.v4mask = v4mask;
+	decision.flags = (is_dir ? FSAL_ACL_DECISION_DIR : 0) |
+			 (is_root ? FSAL_ACL_DECISION_ROOT : 0) |
+			 (allowed != NULL ? FSAL_ACL_DECISION_ALLOWED : 0) |
+			 (denied != NULL ? FSAL_ACL_DECISION_DENIED : 0);
+
+	if (memoize && nfs4_acl_decision_get(&decision)) {
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "cached decision %s allowed 0x%X denied 0x%X",
+			     msg_fsal_err(decision.major), decision.allowed,
+			     decision.denied);
+		if (allowed != NULL)
+			*allowed = decision.allowed;
+		if (denied != NULL)
+			*denied = decision.denied;
+		return fsalstat(decision.major, 0);
+	}
+
+	if (creds->caller_glen > FSAL_ACL_SORT_GROUPS) {
+		groups = gsh_malloc(creds->caller_glen * sizeof(gid_t));
+		memcpy(groups, creds->caller_garray,
+		       creds->caller_glen * sizeof(gid_t));
+		qsort(groups, creds->caller_glen, sizeof(gid_t), fsal_gid_cmp);
+	}
+
+	status = fsal_check_acl_aces(creds, groups, v4mask, missing_access,
+				     allowed, denied, pacl, is_dir, is_owner,
+				     is_group, is_root);
+
+	gsh_free(groups);
+
+	decision.major = status.major;
+	decision.allowed = allowed != NULL ? *allowed : 0;
+	decision.denied = denied != NULL ? *denied : 0;
+	if (memoize)
+		nfs4_acl_decision_set(&decision);
+
+	return status;
+}
+
 /**
  * @brief Check access using mode bits only
  *
@@ -862,21 +976,126 @@ int ganesha_ngroups;
 gid_t *ganesha_groups;
 
 #if GSH_CAN_HOST_LOCAL_FS
-void fsal_set_credentials(const struct user_cred *creds)
+/* Longest group list remembered per thread, longer ones are always set */
+#define FSAL_CREDS_TRACKED_GROUPS 64
+
+/**
+ * @brief Credentials currently installed on a thread
+ *
+ * Credentials are set with per-thread syscalls, so each thread knows
+ * what it has installed, and skips the syscalls that would not change
+ * anything.
+ */
+
+struct fsal_thread_creds {
+	bool uid_valid;
+	bool gid_valid;
+	bool groups_valid;
+	uid_t uid;
+	gid_t gid;
+	unsigned int ngroups;
+	gid_t groups[FSAL_CREDS_TRACKED_GROUPS];
+};
+
+static __thread struct fsal_thread_creds thread_creds;
+
+/* Credential syscalls issued, and skipped */
+static counter_metric_handle_t creds_syscalls_issued;
+static counter_metric_handle_t creds_syscalls_elided;
+
+static bool fsal_thread_groups_match(unsigned int ngroups,
+				     const gid_t *groups)
 {
-	if (set_threadgroups(creds->caller_glen, creds->caller_garray) != 0)
+	return thread_creds.groups_valid && thread_creds.ngroups == ngroups &&
+	       memcmp(thread_creds.groups, groups,
+		      ngroups * sizeof(gid_t)) == 0;
+}
+
+static void fsal_thread_set_groups(unsigned int ngroups, const gid_t *groups)
+{
+	if (fsal_thread_groups_match(ngroups, groups)) {
+		monitoring__counter_inc(creds_syscalls_elided, 1);
+		return;
+	}
+
+	if (set_threadgroups(ngroups, groups) != 0)
 		LogFatal(COMPONENT_FSAL, "set_threadgroups() returned %s (%d)",
 			 strerror(errno), errno);
-	setgroup(creds->caller_gid);
-	setuser(creds->caller_uid);
+
+	monitoring__counter_inc(creds_syscalls_issued, 1);
+
+	thread_creds.groups_valid = ngroups <= FSAL_CREDS_TRACKED_GROUPS;
+	if (thread_creds.groups_valid) {
+		thread_creds.ngroups = ngroups;
+		memcpy(thread_creds.groups, groups, ngroups * sizeof(gid_t));
+	}
 }
 
+static void fsal_thread_set_gid(gid_t gid)
+{
+	if (thread_creds.gid_valid && thread_creds.gid == gid) {
+		monitoring__counter_inc(creds_syscalls_elided, 1);
+		return;
+	}
+
+	setgroup(gid);
+	monitoring__counter_inc(creds_syscalls_issued, 1);
+
+	thread_creds.gid_valid = true;
+	thread_creds.gid = gid;
+}
+
+static void fsal_thread_set_uid(uid_t uid)
+{
+	if (thread_creds.uid_valid && thread_creds.uid == uid) {
+		monitoring__counter_inc(creds_syscalls_elided, 1);
+		return;
+	}
+
+	setuser(uid);
+	monitoring__counter_inc(creds_syscalls_issued, 1);
+
+	thread_creds.uid_valid = true;
+	thread_creds.uid = uid;
+}
+
+void fsal_set_credentials(const struct user_cred *creds)
+{
+	fsal_thread_set_groups(creds->caller_glen, creds->caller_garray);
+	fsal_thread_set_gid(creds->caller_gid);
+	fsal_thread_set_uid(creds->caller_uid);
+}
+
+/**
+ * @brief Switch the thread back to Ganesha's credentials
+ *
+ * Ganesha's groups are always put back, even when running as root: work
+ * done as Ganesha may still be checked against its groups, by a backend
+ * squashing root for instance.  Only the calls that change nothing are
+ * skipped.
+ */
 void fsal_restore_ganesha_credentials(void)
 {
-	setuser(ganesha_uid);
-	setgroup(ganesha_gid);
-	if (set_threadgroups(ganesha_ngroups, ganesha_groups) != 0)
-		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+	fsal_thread_set_uid(ganesha_uid);
+	fsal_thread_set_gid(ganesha_gid);
+	fsal_thread_set_groups(ganesha_ngroups, ganesha_groups);
+}
+
+static void fsal_register_credentials_metrics(void)
+{
+	const metric_label_t issued[] = { METRIC_LABEL("result", "issued") };
+	const metric_label_t elided[] = { METRIC_LABEL("result", "elided") };
+
+	creds_syscalls_issued = monitoring__register_counter(
+		"fsal__credential_syscalls_total",
+		METRIC_METADATA("Credential switching syscalls",
+				METRIC_UNIT_NONE),
+		issued, ARRAY_SIZE(issued));
+	creds_syscalls_elided = monitoring__register_counter(
+		"fsal__credential_syscalls_total",
+		METRIC_METADATA("Credential switching syscalls",
+				METRIC_UNIT_NONE),
+		elided, ARRAY_SIZE(elided));
 }
 #endif /* GSH_CAN_HOST_LOCAL_FS */
 
@@ -898,6 +1117,10 @@ void fsal_save_ganesha_credentials(void)
 	ganesha_uid = getuser();
 	ganesha_gid = getgroup();
 
+#if GSH_CAN_HOST_LOCAL_FS
+	fsal_register_credentials_metrics();
+#endif /* GSH_CAN_HOST_LOCAL_FS */
+
 	ganesha_ngroups = getgroups(0, NULL);
 	if (ganesha_ngroups > 0) {
 		ganesha_groups = gsh_malloc(ganesha_ngroups * sizeof(gid_t));
@@ -357,15 +357,17 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
  * @param[in]  fhs       Array if buffer descriptors holding opaque DS
  *                       handles
  * @param[in] ffds_efficiency MDS evaluation of mirror's effectiveness
+ * @param[in] ffds_stateid Stateid to use with the DS, NULL for the
+ *                         anonymous stateid
  * @param[in] ffds_user Synthetic uid to be used for RPC call to DS
  * @param[in] ffds_group Synthetic gid to be used for RPC call to DS
  * @return NFS status codes.
  */
-static nfsstat4 FSAL_encode_data_server(
+nfsstat4 FSAL_encode_data_server(
 	XDR *xdrs, const struct pnfs_deviceid *deviceid, const uint32_t num_fhs,
 	const uint16_t *ds_ids, const struct gsh_buffdesc *fhs,
-	const uint32_t ffds_efficiency, const fattr4_owner ffds_user,
-	const fattr4_owner_group ffds_group)
+	const uint32_t ffds_efficiency, const stateid4 *ffds_stateid,
+	const fattr4_owner ffds_user, const fattr4_owner_group ffds_group)
 {
 	nfsstat4 nfs_status = 0;
 	size_t i = 0;
@@ -383,15 +385,18 @@ static nfsstat4 FSAL_encode_data_server(
 	}
 
 	/* Encode ffds_stateid
-	 * For now, we assume only loosely coupled setup.
+	 * Without one from the FSAL, we assume a loosely coupled setup.
 	 * Hence set stateid to anonymous.
 	*/
-	stateid4 ffds_stateid;
+	stateid4 anon_stateid;
 
-	ffds_stateid.seqid = 0;
-	memset(&ffds_stateid.other, '\0', sizeof(ffds_stateid.other));
+	if (ffds_stateid == NULL) {
+		anon_stateid.seqid = 0;
+		memset(&anon_stateid.other, '\0', sizeof(anon_stateid.other));
+		ffds_stateid = &anon_stateid;
+	}
 
-	if (!xdr_stateid4(xdrs, &ffds_stateid)) {
+	if (!xdr_stateid4(xdrs, (stateid4 *)ffds_stateid)) {
 		LogMajor(COMPONENT_PNFS, "Failed encoding ffds_stateid.");
 		return NFS4ERR_SERVERFAULT;
 	}
@@ -502,7 +507,9 @@ nfsstat4 FSAL_encode_flex_file_layout(
 		for (j = 0; j < stripes; j++) {
 			nfs_status = FSAL_encode_data_server(
 				xdrs, deviceid, num_fhs, ds_ids, fhs,
-				ffds_efficiency, ffds_user, ffds_group);
+				ffds_efficiency, NULL, ffds_user, ffds_group);
+			if (nfs_status != NFS4_OK)
+				return nfs_status;
 		}
 	}
 
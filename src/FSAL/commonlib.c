@@ -71,6 +71,7 @@
 #include "pnfs_utils.h"
 #include "atomic_utils.h"
 #include "sys_resource.h"
+#include "monitoring.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -3108,6 +3109,22 @@ bool fsal_common_is_referral(struct fsal_obj_handle *obj_hdl,
 	return true;
 }
 
+/**
+ * @brief Count a read of a detected sequential stream
+ *
+ * FSAL modules don't link with the monitoring library, they report their
+ * readahead through here.
+ *
+ * @param[in] result    "hit" or "miss", NULL for the first read of a stream
+ * @param[in] bytes     Bytes of readahead issued
+ * @param[in] export_id Export of the file
+ */
+void fsal_metrics__readahead(const char *result, uint64_t bytes,
+			     uint16_t export_id)
+{
+	monitoring__dynamic_fsal_readahead(result, bytes, export_id);
+}
+
 struct gsh_refstr *no_export;
 
 void init_ctx_refstr(void)
@@ -1239,6 +1239,84 @@ static nfsstat4 layoutcommit(struct fsal_obj_handle *obj_hdl, XDR *lou_body,
 	return NFS4ERR_NOTSUPP;
 }
 
+/**
+ * @brief Ignore layout statistics
+ *
+ * @param[in] obj_hdl  The file the statistics apply to
+ * @param[in] lou_body Layout type-specific portion of the arguments
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK
+ */
+static nfsstat4 layoutstats(struct fsal_obj_handle *obj_hdl, XDR *lou_body,
+			    const struct fsal_layoutstats_arg *arg)
+{
+	return NFS4_OK;
+}
+
+/**
+ * @brief Ignore a layout device error
+ *
+ * @param[in] obj_hdl  The file the error applies to
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK
+ */
+static nfsstat4 layouterror(struct fsal_obj_handle *obj_hdl,
+			    const struct fsal_layouterror_arg *arg)
+{
+	return NFS4_OK;
+}
+
+/**
+ * @brief Listings can not be validated by default
+ *
+ * @param[in]  dir_hdl Directory to validate
+ * @param[out] change  Change attribute of the directory
+ * @param[out] epoch   Epoch covering the attributes of its entries
+ *
+ * @return false
+ */
+static bool readdir_validator(struct fsal_obj_handle *dir_hdl,
+			      uint64_t *change, uint64_t *epoch)
+{
+	return false;
+}
+
+/**
+ * @brief Encoded attributes are not memoized by default
+ *
+ * @param[in]  obj_hdl    Object to look up
+ * @param[in]  mask       Attributes the encoding depends on
+ * @param[in]  key        Opaque key of the encoding
+ * @param[out] fattr      Copy of the encoding
+ * @param[out] generation Generation of the attributes
+ *
+ * @return false
+ */
+static bool fattr_cache_get(struct fsal_obj_handle *obj_hdl, attrmask_t mask,
+			    const struct gsh_buffdesc *key,
+			    struct gsh_buffdesc *fattr, uint64_t *generation)
+{
+	*generation = 0;
+	return false;
+}
+
+/**
+ * @brief Drop encoded attributes
+ *
+ * @param[in] obj_hdl    Object the attributes were encoded from
+ * @param[in] key        Opaque key of the encoding
+ * @param[in] fattr      The encoding
+ * @param[in] generation Generation returned by fattr_cache_get()
+ */
+static void fattr_cache_put(struct fsal_obj_handle *obj_hdl,
+			    const struct gsh_buffdesc *key,
+			    struct gsh_buffdesc *fattr, uint64_t generation)
+{
+	gsh_free(fattr->addr);
+}
+
 /* open2
  * default case not supported
  */
@@ -1488,6 +1566,11 @@ struct fsal_obj_ops def_handle_ops = {
 	.setattr2 = setattr2,
 	.close2 = close2,
 	.is_referral = is_referral,
+	.layoutstats = layoutstats,
+	.layouterror = layouterror,
+	.readdir_validator = readdir_validator,
+	.fattr_cache_get = fattr_cache_get,
+	.fattr_cache_put = fattr_cache_put,
 };
 
 /* fsal_pnfs_ds common methods */
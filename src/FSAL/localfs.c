@@ -30,6 +30,7 @@
 #include "FSAL/fsal_localfs.h"
 #ifdef LINUX
 #include <sys/sysmacros.h> /* for major(3), minor(3) */
+#include <poll.h>
 #endif
 #include <fcntl.h>
 #if __FreeBSD__
@@ -177,6 +178,32 @@ static struct glist_head posix_file_systems = { &posix_file_systems,
 static bool fs_initialized;
 static struct avltree avl_fsid;
 static struct avltree avl_dev;
+static struct avltree avl_path;
+
+/* Each scan of the mount table has a new generation, file systems it did
+ * not see are gone.
+ */
+static uint64_t mnt_generation;
+
+#ifdef LINUX
+/* Polled for changes to the mount table */
+static int mountinfo_fd = -1;
+#endif
+
+/**
+ * @brief A path the mount table was scanned for
+ *
+ * While the mount table doesn't change, the file systems of paths at or
+ * under a scanned path are all known.
+ */
+struct scanned_path {
+	struct avltree_node node_k;
+	size_t pathlen;
+	char *path;
+};
+
+/* Scanned paths, by path */
+static struct avltree scanned_paths;
 
 static inline int fsal_fs_cmpf_fsid(const struct avltree_node *lhs,
 				    const struct avltree_node *rhs)
@@ -239,6 +266,34 @@ avltree_inline_dev_lookup(const struct avltree_node *key)
 		return NULL;
 }
 
+static inline int fsal_fs_cmpf_path(const struct avltree_node *lhs,
+				    const struct avltree_node *rhs)
+{
+	struct fsal_filesystem *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct fsal_filesystem, avl_path);
+	rk = avltree_container_of(rhs, struct fsal_filesystem, avl_path);
+
+	return strcmp(lk->path, rk->path);
+}
+
+static inline struct fsal_filesystem *lookup_path_locked(const char *path)
+{
+	struct fsal_filesystem key;
+	struct avltree_node *node;
+
+	key.path = (char *)path;
+
+	node = avltree_inline_lookup(&key.avl_path, &avl_path,
+				     fsal_fs_cmpf_path);
+
+	if (node != NULL)
+		return avltree_container_of(node, struct fsal_filesystem,
+					    avl_path);
+	else
+		return NULL;
+}
+
 static void remove_fs(struct fsal_filesystem *fs)
 {
 	if (fs->in_fsid_avl)
@@ -247,6 +302,9 @@ static void remove_fs(struct fsal_filesystem *fs)
 	if (fs->in_dev_avl)
 		avltree_remove(&fs->avl_dev, &avl_dev);
 
+	if (fs->in_path_avl)
+		avltree_remove(&fs->avl_path, &avl_path);
+
 	glist_del(&fs->siblings);
 	glist_del(&fs->filesystems);
 }
@@ -259,6 +317,39 @@ static void free_fs(struct fsal_filesystem *fs)
 	gsh_free(fs);
 }
 
+/**
+ * @brief Remove an unclaimed file system that is no longer mounted
+ *
+ * Unlike release_posix_file_system(), its children are kept, they are left
+ * without a parent for posix_find_parent() to attach them again.
+ *
+ * @note Must hold fs_lock for write
+ *
+ * @param[in] fs	the file system to remove
+ */
+static void remove_stale_fs(struct fsal_filesystem *fs)
+{
+	struct glist_head *glist, *glistn;
+	struct fsal_filesystem *child_fs;
+
+	glist_for_each_safe(glist, glistn, &fs->children)
+	{
+		child_fs = glist_entry(glist, struct fsal_filesystem, siblings);
+		glist_del(&child_fs->siblings);
+		child_fs->parent = NULL;
+	}
+
+	LogFilesystem("REMOVE STALE", "", fs);
+
+	LogInfo(COMPONENT_FSAL,
+		"Removed unmounted filesystem %p %s dev=%" PRIu64 ".%" PRIu64
+		" type=%s",
+		fs, fs->path, fs->dev.major, fs->dev.minor, fs->type);
+
+	remove_fs(fs);
+	free_fs(fs);
+}
+
 int re_index_fs_fsid(struct fsal_filesystem *fs, enum fsid_type fsid_type,
 		     struct fsal_fsid__ *fsid)
 {
@@ -633,6 +724,7 @@ static void posix_create_file_system(struct mntent *mnt, struct stat *mnt_stat)
 	fs->path = gsh_strdup(mnt->mnt_dir);
 	fs->device = gsh_strdup(mnt->mnt_fsname);
 	fs->type = gsh_strdup(mnt->mnt_type);
+	fs->mnt_id = -1;
 	glist_init(&fs->exports);
 
 	if (!posix_get_fsid(fs, mnt_stat)) {
@@ -672,6 +764,9 @@ static void posix_create_file_system(struct mntent *mnt, struct stat *mnt_stat)
 			fs->type = NULL;
 		}
 
+		/* The file system is still mounted */
+		fs1->generation = mnt_generation;
+
 		free_fs(fs);
 		return;
 	}
@@ -707,6 +802,9 @@ static void posix_create_file_system(struct mntent *mnt, struct stat *mnt_stat)
 			fs->type = NULL;
 		}
 
+		/* The file system is still mounted */
+		fs1->generation = mnt_generation;
+
 		remove_fs(fs);
 		free_fs(fs);
 		return;
@@ -714,6 +812,40 @@ static void posix_create_file_system(struct mntent *mnt, struct stat *mnt_stat)
 
 	fs->in_dev_avl = true;
 
+	node = avltree_insert(&fs->avl_path, &avl_path);
+
+	if (node != NULL) {
+		/* Another file system is known at this path */
+		struct fsal_filesystem *fs1;
+
+		fs1 = avltree_container_of(node, struct fsal_filesystem,
+					   avl_path);
+
+		if (fs1->generation == mnt_generation || fs1->unclaim != NULL) {
+			/* It is still mounted, or claimed and can't be
+			 * removed before it is unexported.
+			 */
+			LogDebug(COMPONENT_FSAL,
+				 "Skipped %s dev=%" PRIu64 ".%" PRIu64
+				 " type=%s, %s dev=%" PRIu64 ".%" PRIu64
+				 " is still known there",
+				 fs->path, fs->dev.major, fs->dev.minor,
+				 fs->type, fs1->path, fs1->dev.major,
+				 fs1->dev.minor);
+
+			remove_fs(fs);
+			free_fs(fs);
+			return;
+		}
+
+		/* Something else was mounted in place of it */
+		remove_stale_fs(fs1);
+		(void)avltree_insert(&fs->avl_path, &avl_path);
+	}
+
+	fs->in_path_avl = true;
+	fs->generation = mnt_generation;
+
 	glist_add_tail(&posix_file_systems, &fs->filesystems);
 	glist_init(&fs->children);
 
@@ -729,11 +861,42 @@ static void posix_create_file_system(struct mntent *mnt, struct stat *mnt_stat)
 		posix_create_fs_btrfs_subvols(fs);
 }
 
+static inline bool is_path_child(const char *possible_path,
+				 int possible_pathlen, const char *compare_path,
+				 int compare_pathlen)
+{
+	/* For a possible_path to represent a child of compare_path:
+	 * possible_pathlen MUST be longer (otherwise it can't be a child
+	 * the portion of possible_path up to compare_pathlen must be the same
+	 * AND the portion of possible_path that compares MUST end with a '/'
+	 *
+	 * Thus /short is NOT a child of /short/longer
+	 * and /some/path is NOT a child of /some/other/path
+	 * and /some/path2 is NOT a child of /some/path
+	 *
+	 * Since the '/' check is simple, check it before comparing strings
+	 */
+	return possible_pathlen > compare_pathlen &&
+	       possible_path[compare_pathlen] == '/' &&
+	       strncmp(possible_path, compare_path, compare_pathlen) == 0;
+}
+
+/**
+ * @brief Attach a file system to the closest file system above it
+ *
+ * The path is walked up a component at a time through the path index.
+ * Children of the parent that are below this file system become its
+ * children, they were attached before it was mounted.
+ *
+ * @note Must hold fs_lock for write
+ *
+ * @param[in] this	the file system to attach
+ */
 static void posix_find_parent(struct fsal_filesystem *this)
 {
-	struct glist_head *glist;
-	struct fsal_filesystem *fs;
-	int plen = 0;
+	struct glist_head *glist, *glistn;
+	struct fsal_filesystem *fs = NULL;
+	char *path, *slash;
 
 	/* Check if it already has parent */
 	if (this->parent != NULL)
@@ -743,39 +906,47 @@ static void posix_find_parent(struct fsal_filesystem *this)
 	if (this->pathlen == 1 && this->path[0] == '/')
 		return;
 
-	glist_for_each(glist, &posix_file_systems)
-	{
-		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
+	path = gsh_strdup(this->path);
 
-		/* If this path is longer than this path, then it
-		 * can't be a parent, or if it's shorter than the
-		 * current match;
-		 */
-		if (fs->pathlen >= this->pathlen || fs->pathlen < plen)
-			continue;
-
-		/* Check for sub-string match */
-		if (strncmp(fs->path, this->path, fs->pathlen) != 0)
-			continue;
-
-		/* Differentiate between /fs1 and /fs10 for parent of
-		 * /fs10/fs2, however, if fs->path is "/", we need to
-		 * special case.
-		 */
-		if (fs->pathlen != 1 && this->path[fs->pathlen] != '/')
-			continue;
+	while (fs == NULL && (slash = strrchr(path, '/')) != NULL) {
+		if (slash == path) {
+			/* Last try is "/" */
+			path[1] = '\0';
+			fs = lookup_path_locked(path);
+			break;
+		}
 
-		this->parent = fs;
-		plen = fs->pathlen;
+		*slash = '\0';
+		fs = lookup_path_locked(path);
 	}
 
-	if (this->parent == NULL) {
+	gsh_free(path);
+
+	if (fs == NULL) {
 		LogInfo(COMPONENT_FSAL, "Unattached file system %s",
 			this->path);
 		return;
 	}
 
+	glist_for_each_safe(glist, glistn, &fs->children)
+	{
+		struct fsal_filesystem *child_fs;
+
+		child_fs = glist_entry(glist, struct fsal_filesystem, siblings);
+
+		if (!is_path_child(child_fs->path, child_fs->pathlen,
+				   this->path, this->pathlen))
+			continue;
+
+		glist_del(&child_fs->siblings);
+		child_fs->parent = this;
+		glist_add_tail(&this->children, &child_fs->siblings);
+		LogInfo(COMPONENT_FSAL, "File system %s is a child of %s",
+			child_fs->path, this->path);
+	}
+
 	/* Add to parent's list of children */
+	this->parent = fs;
 	glist_add_tail(&this->parent->children, &this->siblings);
 	LogInfo(COMPONENT_FSAL, "File system %s is a child of %s", this->path,
 		this->parent->path);
@@ -814,6 +985,326 @@ static bool path_is_subset(const char *path, const char *of)
 	return true;
 }
 
+/**
+ * @brief Check if the mount table changed since it was last checked
+ *
+ * The kernel flags /proc/self/mountinfo with POLLPRI when anything is
+ * mounted or unmounted, and clears the flag once polled.
+ *
+ * @return true if it changed, or if changes can't be tracked.
+ */
+static bool mount_table_changed(void)
+{
+#ifdef LINUX
+	struct pollfd pfd;
+
+	if (mountinfo_fd < 0) {
+		mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY);
+
+		if (mountinfo_fd < 0) {
+			LogDebug(COMPONENT_FSAL,
+				 "Can't track mount table changes, open of /proc/self/mountinfo failed with %s",
+				 strerror(errno));
+			return true;
+		}
+
+		/* Nothing was scanned with the mount table as it is now */
+		return true;
+	}
+
+	pfd.fd = mountinfo_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) < 0)
+		return true;
+
+	return (pfd.revents & (POLLPRI | POLLERR)) != 0;
+#else
+	return true;
+#endif
+}
+
+static inline int scanned_path_cmpf(const struct avltree_node *lhs,
+				    const struct avltree_node *rhs)
+{
+	struct scanned_path *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct scanned_path, node_k);
+	rk = avltree_container_of(rhs, struct scanned_path, node_k);
+
+	rc = memcmp(lk->path, rk->path, MIN(lk->pathlen, rk->pathlen));
+
+	if (rc != 0)
+		return rc;
+
+	return (lk->pathlen > rk->pathlen) - (lk->pathlen < rk->pathlen);
+}
+
+static void clear_scanned_paths(void)
+{
+	struct avltree_node *node;
+	struct scanned_path *scanned;
+
+	while ((node = avltree_first(&scanned_paths)) != NULL) {
+		scanned = avltree_container_of(node, struct scanned_path,
+					       node_k);
+		avltree_remove(node, &scanned_paths);
+		gsh_free(scanned->path);
+		gsh_free(scanned);
+	}
+}
+
+static inline bool scanned_path_lookup(const char *path, size_t pathlen)
+{
+	struct scanned_path key;
+
+	key.path = (char *)path;
+	key.pathlen = pathlen;
+
+	return avltree_inline_lookup(&key.node_k, &scanned_paths,
+				     scanned_path_cmpf) != NULL;
+}
+
+/**
+ * @brief Check if a path is at or under a path the mount table was scanned
+ *        for
+ *
+ * A scan for a path finds the file systems above and below it, which
+ * includes those of any path under it.  The path and each of its parents
+ * are looked up, rather than compared with every scanned path.
+ */
+static bool path_is_scanned(const char *path)
+{
+	size_t pathlen = strlen(path);
+	size_t len;
+
+	if (scanned_path_lookup("/", 1) || scanned_path_lookup(path, pathlen))
+		return true;
+
+	for (len = 1; len < pathlen; len++) {
+		if (path[len] == '/' && scanned_path_lookup(path, len))
+			return true;
+	}
+
+	return false;
+}
+
+static void add_scanned_path(const char *path)
+{
+	struct scanned_path *scanned;
+
+	scanned = gsh_malloc(sizeof(*scanned));
+	scanned->pathlen = strlen(path);
+	scanned->path = gsh_strdup(path);
+
+	if (avltree_insert(&scanned->node_k, &scanned_paths) != NULL) {
+		/* Already scanned */
+		gsh_free(scanned->path);
+		gsh_free(scanned);
+	}
+}
+
+/**
+ * @brief A mount of /proc/self/mountinfo
+ */
+struct mount_info {
+	char *path; /*< Mount point */
+	int id; /*< Mount id, a new mount gets a new one */
+	fsal_dev_t dev; /*< Device of the mount */
+	size_t order; /*< Position in mountinfo, later mounts are on top */
+};
+
+struct mount_infos {
+	struct mount_info *mounts; /*< Sorted by path, one per path */
+	size_t count;
+};
+
+static int mount_info_cmpf(const void *a, const void *b)
+{
+	const struct mount_info *ma = a, *mb = b;
+	int rc = strcmp(ma->path, mb->path);
+
+	if (rc != 0)
+		return rc;
+
+	return ma->order < mb->order ? -1 : ma->order > mb->order;
+}
+
+/**
+ * @brief Decode the octal escapes of a mountinfo field in place
+ */
+static void mount_info_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s != '\0') {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = (s[1] - '0') << 6 | (s[2] - '0') << 3 |
+			       (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+
+	*d = '\0';
+}
+
+/**
+ * @brief Read the id and device of the mounts
+ *
+ * The mount table only gives the device name of a mount, which is kept by
+ * a remount of another device, or of another subvolume, over the same
+ * path.  The mount id is not.
+ *
+ * @param[out] infos	The mounts, empty if they can't be read
+ */
+static void mount_infos_load(struct mount_infos *infos)
+{
+#ifdef LINUX
+	FILE *fp;
+	struct mount_info *info;
+	char *line = NULL, *path;
+	size_t linesz = 0, alloc = 0, i, n;
+	unsigned int major, minor;
+	int id;
+#endif
+
+	infos->mounts = NULL;
+	infos->count = 0;
+
+#ifdef LINUX
+	fp = fopen("/proc/self/mountinfo", "r");
+
+	if (fp == NULL) {
+		LogDebug(COMPONENT_FSAL,
+			 "Can't identify mounts, open of /proc/self/mountinfo failed with %s",
+			 strerror(errno));
+		return;
+	}
+
+	while (getline(&line, &linesz, fp) > 0) {
+		if (sscanf(line, "%d %*d %u:%u %*s %ms", &id, &major, &minor,
+			   &path) != 4)
+			continue;
+
+		if (infos->count == alloc) {
+			alloc = alloc == 0 ? 64 : alloc * 2;
+			infos->mounts = gsh_realloc(
+				infos->mounts, alloc * sizeof(*infos->mounts));
+		}
+
+		mount_info_unescape(path);
+
+		info = &infos->mounts[infos->count];
+		info->path = gsh_strdup(path);
+		info->id = id;
+		info->dev.major = major;
+		info->dev.minor = minor;
+		info->order = infos->count++;
+
+		free(path);
+	}
+
+	free(line);
+	fclose(fp);
+
+	if (infos->count == 0)
+		return;
+
+	/* Keep the mount on top of each path */
+	qsort(infos->mounts, infos->count, sizeof(*infos->mounts),
+	      mount_info_cmpf);
+
+	for (i = 1, n = 0; i < infos->count; i++) {
+		if (strcmp(infos->mounts[n].path, infos->mounts[i].path) == 0)
+			gsh_free(infos->mounts[n].path);
+		else
+			n++;
+
+		infos->mounts[n] = infos->mounts[i];
+	}
+
+	infos->count = n + 1;
+#endif
+}
+
+static void mount_infos_free(struct mount_infos *infos)
+{
+	size_t i;
+
+	for (i = 0; i < infos->count; i++)
+		gsh_free(infos->mounts[i].path);
+
+	gsh_free(infos->mounts);
+}
+
+static struct mount_info *mount_info_find(struct mount_infos *infos,
+					  const char *path)
+{
+	size_t lo = 0, hi = infos->count, mid;
+	int rc;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		rc = strcmp(path, infos->mounts[mid].path);
+
+		if (rc == 0)
+			return &infos->mounts[mid];
+
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Keep the known subvolumes of a btrfs file system still mounted
+ *
+ * Subvolumes are not in the mount table.
+ */
+static void posix_keep_btrfs_subvols(struct fsal_filesystem *fs)
+{
+	struct glist_head *glist;
+	struct fsal_filesystem *child;
+
+	glist_for_each(glist, &fs->children)
+	{
+		child = glist_entry(glist, struct fsal_filesystem, siblings);
+
+		if (strcmp(child->type, "btrfs_sv") == 0) {
+			child->generation = mnt_generation;
+			posix_keep_btrfs_subvols(child);
+		}
+	}
+}
+
+/**
+ * @brief Bring the file systems above and below a path up to date with the
+ *        mount table
+ *
+ * Nothing is done while the mount table is unchanged since a scan for the
+ * path, or a path above it.  Otherwise, mounts already known with the same
+ * mount id and device in /proc/self/mountinfo are kept without going to
+ * the file system, the others are looked at again, new ones are added and
+ * those no longer mounted are removed unless they are claimed.  Only the
+ * file systems that were added, or lost their parent, are attached to the
+ * tree.
+ *
+ * btrfs subvolumes are not in the mount table, they are only enumerated
+ * for a btrfs file system that is new, or when the path is on a device no
+ * known file system is on, possibly a new subvolume.
+ *
+ * @param[in] path	the path to scan for
+ *
+ * @return 0 or an errno.
+ */
 int populate_posix_file_systems(const char *path)
 {
 	FILE *fp;
@@ -821,7 +1312,11 @@ int populate_posix_file_systems(const char *path)
 	struct stat st;
 	int retval = 0;
 	struct glist_head *glist, *glistn;
-	struct fsal_filesystem *fs, *fsn;
+	struct fsal_filesystem *fs;
+	struct mount_infos infos;
+	struct mount_info *info;
+	fsal_dev_t dev;
+	bool path_known;
 
 	PTHREAD_RWLOCK_wrlock(&fs_lock);
 
@@ -829,70 +1324,27 @@ int populate_posix_file_systems(const char *path)
 		LogDebug(COMPONENT_FSAL, "Initializing posix file systems");
 		avltree_init(&avl_fsid, fsal_fs_cmpf_fsid, 0);
 		avltree_init(&avl_dev, fsal_fs_cmpf_dev, 0);
+		avltree_init(&avl_path, fsal_fs_cmpf_path, 0);
+		avltree_init(&scanned_paths, scanned_path_cmpf, 0);
 		fs_initialized = true;
 	}
 
-	/* We are about to rescan mtab, remove unclaimed file systems.
-	 * release_posix_file_system will actually do the depth first
-	 * search for unclaimed file systems.
-	 */
-
-	glist = posix_file_systems.next;
-
-	/* Scan the list for the first top level file system that is not
-	 * claimed.
-	 *
-	 * NOTE: the following two loops are similar to glist_for_each_safe but
-	 *       instead of just taking the next list entry, we take the next
-	 *       list entry that is a top level file system. This way even if
-	 *       the glist->next was a descendant file system that was going to
-	 *       be released, before we release a file system or it's
-	 *       descendants, we look for the next top level file system, since
-	 *       it's a top level file system it WILL NOT be released when we
-	 *       release fs or it's descendants.
+	/* The path may be on a btrfs subvolume not known yet, even under a
+	 * scanned path since subvolumes are not in the mount table.
 	 */
-	while (glist != &posix_file_systems) {
-		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
-
-		if (fs->parent == NULL) {
-			/* Top level file system done */
-			break;
-		}
-
-		glist = glist->next;
+	if (stat(path, &st) == 0) {
+		dev = posix2fsal_devt(st.st_dev);
+		path_known = lookup_dev_locked(&dev) != NULL;
+	} else {
+		path_known = false;
 	}
 
-	/* Now, while we still have a top level file system to process
-	 */
-	while (glist != &posix_file_systems) {
-		/* First, find the NEXT top level file system. */
-		glistn = glist->next;
-
-		while (glistn != &posix_file_systems) {
-			fsn = glist_entry(glistn, struct fsal_filesystem,
-					  filesystems);
-			if (fsn->parent == NULL) {
-				/* Top level file system done */
-				break;
-			}
-
-			glistn = glistn->next;
-		}
-
-		/* Now glistn/fsn is either the next top level file
-		 * system or glistn is &posix_file_systems.
-		 *
-		 * fs is the file system to try releasing on, try to
-		 * release this file system or it's descendants.
-		 */
-
-		(void)release_posix_file_system(fs, UNCLAIM_SKIP);
-
-		/* Now ready to start processing the next top level
-		 * file system that is not claimed.
-		 */
-		glist = glistn;
-		fs = fsn;
+	if (mount_table_changed())
+		clear_scanned_paths();
+	else if (path_known && path_is_scanned(path)) {
+		LogDebug(COMPONENT_FSAL,
+			 "Mount table unchanged since %s was scanned", path);
+		goto out;
 	}
 
 	/* start looking for the mount point */
@@ -905,6 +1357,10 @@ int populate_posix_file_systems(const char *path)
 		goto out;
 	}
 
+	mnt_generation++;
+
+	mount_infos_load(&infos);
+
 #ifdef USE_BLKID
 	if (blkid_get_cache(&cache, NULL) != 0)
 		LogInfo(COMPONENT_FSAL, "blkid_get_cache failed");
@@ -953,13 +1409,45 @@ int populate_posix_file_systems(const char *path)
 			continue;
 		}
 
+		fs = lookup_path_locked(mnt->mnt_dir);
+		info = mount_info_find(&infos, mnt->mnt_dir);
+
+		if (fs != NULL && info != NULL && fs->mnt_id == info->id &&
+		    fs->mnt_dev.major == info->dev.major &&
+		    fs->mnt_dev.minor == info->dev.minor &&
+		    strcmp(fs->type, mnt->mnt_type) == 0) {
+			/* Same mount, no need to look at it again. */
+			fs->generation = mnt_generation;
+
+			if (strcasecmp(mnt->mnt_type, "btrfs") != 0)
+				continue;
+
+			if (path_known)
+				posix_keep_btrfs_subvols(fs);
+			else
+				posix_create_fs_btrfs_subvols(fs);
+
+			continue;
+		}
+
 		if (stat(mnt->mnt_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
 			continue;
 		}
 
 		posix_create_file_system(mnt, &st);
+
+		/* Remember the mount the file system at the path is */
+		fs = lookup_path_locked(mnt->mnt_dir);
+
+		if (fs != NULL && info != NULL &&
+		    fs->generation == mnt_generation) {
+			fs->mnt_id = info->id;
+			fs->mnt_dev = info->dev;
+		}
 	}
 
+	mount_infos_free(&infos);
+
 #ifdef USE_BLKID
 	if (cache) {
 		blkid_put_cache(cache);
@@ -969,9 +1457,35 @@ int populate_posix_file_systems(const char *path)
 
 	endmntent(fp);
 
-	/* build tree of POSIX file systems */
-	glist_for_each(glist, &posix_file_systems) posix_find_parent(
-		glist_entry(glist, struct fsal_filesystem, filesystems));
+	/* Remove the file systems the scan should have seen and did not */
+	glist_for_each_safe(glist, glistn, &posix_file_systems)
+	{
+		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
+
+		if (fs->generation == mnt_generation ||
+		    !path_is_subset(path, fs->path))
+			continue;
+
+		if (fs->unclaim != NULL) {
+			LogDebug(COMPONENT_FSAL,
+				 "Filesystem %s is no longer mounted but still claimed",
+				 fs->path);
+			continue;
+		}
+
+		remove_stale_fs(fs);
+	}
+
+	/* Attach the new and orphaned file systems to the tree */
+	glist_for_each(glist, &posix_file_systems)
+	{
+		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
+
+		if (fs->parent == NULL)
+			posix_find_parent(fs);
+	}
+
+	add_scanned_path(path);
 
 out:
 	PTHREAD_RWLOCK_unlock(&fs_lock);
@@ -1148,6 +1662,15 @@ void release_posix_file_systems(void)
 		(void)release_posix_file_system(fs, UNCLAIM_WARN);
 	}
 
+	clear_scanned_paths();
+
+#ifdef LINUX
+	if (mountinfo_fd >= 0) {
+		close(mountinfo_fd);
+		mountinfo_fd = -1;
+	}
+#endif
+
 	PTHREAD_RWLOCK_unlock(&fs_lock);
 }
 
@@ -1342,26 +1865,6 @@ void unclaim_all_export_maps(struct fsal_export *exp)
 #define HAS_NON_CHILD_CLAIMS(this) \
 	(this->claims[CLAIM_ROOT] != 0 || this->claims[CLAIM_SUBTREE] != 0)
 
-static inline bool is_path_child(const char *possible_path,
-				 int possible_pathlen, const char *compare_path,
-				 int compare_pathlen)
-{
-	/* For a possible_path to represent a child of compare_path:
-	 * possible_pathlen MUST be longer (otherwise it can't be a child
-	 * the portion of possible_path up to compare_pathlen must be the same
-	 * AND the portion of possible_path that compares MUST end with a '/'
-	 *
-	 * Thus /short is NOT a child of /short/longer
-	 * and /some/path is NOT a child of /some/other/path
-	 * and /some/path2 is NOT a child of /some/path
-	 *
-	 * Since the '/' check is simple, check it before comparing strings
-	 */
-	return possible_pathlen > compare_pathlen &&
-	       possible_path[compare_pathlen] == '/' &&
-	       strncmp(possible_path, compare_path, compare_pathlen) == 0;
-}
-
 static inline bool is_filesystem_child(struct fsal_filesystem *fs,
 				       const char *path, int pathlen)
 {
@@ -1841,23 +2344,15 @@ int claim_posix_filesystems(const char *path, struct fsal_module *fsal,
 			    struct stat *statbuf)
 {
 	int retval = 0;
-	struct fsal_filesystem *fs, *root = NULL;
-	struct glist_head *glist;
+	struct fsal_filesystem *root;
 	struct fsal_dev__ dev;
 
 	PTHREAD_RWLOCK_wrlock(&fs_lock);
 
 	dev = posix2fsal_devt(statbuf->st_dev);
 
-	/* Scan POSIX file systems to find export root fs */
-	glist_for_each(glist, &posix_file_systems)
-	{
-		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
-		if (fs->dev.major == dev.major && fs->dev.minor == dev.minor) {
-			root = fs;
-			break;
-		}
-	}
+	/* Find the export root fs */
+	root = lookup_dev_locked(&dev);
 
 	/* Check if we found a filesystem */
 	if (root == NULL) {
@@ -1942,9 +2437,10 @@ static struct gsh_dbus_method cachemgr_show_fs = {
 		  END_ARG_LIST }
 };
 
-static struct gsh_dbus_method *cachemgr_methods[] = { &cachemgr_show_fs,
-						      &cachemgr_show_idmapper,
-						      NULL };
+static struct gsh_dbus_method *cachemgr_methods[] = {
+	&cachemgr_show_fs, &cachemgr_show_idmapper,
+	&cachemgr_show_idmapper_shards, NULL
+};
 
 static struct gsh_dbus_interface cachemgr_table = {
 	.name = "org.ganesha.nfsd.cachemgr",
@@ -38,6 +38,10 @@
 #include "nfs_file_handle.h"
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
+#include "nfs_readdir_cache.h"
+#include "nfs4_fattr_cache.h"
+#include "req_recorder.h"
+#include "lock_profile.h"
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "config_parsing.h"
@@ -818,6 +822,11 @@ int init_server_pkgs(void)
 	}
 	LogInfo(COMPONENT_INIT, "IP/name cache successfully initialized");
 
+	readdir_cache_init();
+	fattr_cache_init();
+	req_recorder_init();
+	lock_profile_init();
+
 	LogEvent(COMPONENT_INIT, "Initializing ID Mapper.");
 	if (!idmapper_init()) {
 		LogCrit(COMPONENT_INIT, "Failed initializing ID Mapper.");
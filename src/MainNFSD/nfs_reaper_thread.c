@@ -42,6 +42,7 @@
 #include "nfs_core.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "mem_accounting.h"
 
 #define REAPER_DELAY 10
 
@@ -326,6 +327,11 @@ static void reaper_run(struct fridgethr_context *ctx)
 
 	rst->count += reap_expired_open_owners();
 
+	/* Before trimming, so that memory released by components over
+	 * their limit may be returned to the system.
+	 */
+	gsh_mem_check();
+
 #ifndef __APPLE__
 	if (nfs_param.core_param.malloc_trim)
 		reap_malloc_frag();
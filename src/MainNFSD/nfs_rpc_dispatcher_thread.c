@@ -61,6 +61,7 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
+#include "req_recorder.h"
 #include "nfs_file_handle.h"
 #include "xprt_handler.h"
 #include "connection_manager.h"
@@ -1602,6 +1603,8 @@ static struct svc_req *alloc_nfs_request(SVCXPRT *xprt, XDR *xdrs)
 
 	TAILQ_INIT_ENTRY(reqdata, dupes);
 
+	req_record_mark(reqdata, REQ_MARK_RECEIVED);
+
 	return &reqdata->svc;
 }
 
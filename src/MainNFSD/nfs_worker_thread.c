@@ -60,6 +60,7 @@
 #include "client_mgr.h"
 #include "export_mgr.h"
 #include "server_stats.h"
+#include "req_recorder.h"
 #include "uid2grp.h"
 
 #include "gsh_lttng/gsh_lttng.h"
@@ -695,6 +696,7 @@ enum nfs_req_result complete_request(nfs_request_t *reqdata,
 		 * normally cached that has been dropped.
 		 */
 		nfs_dupreq_delete(reqdata, rc);
+		req_record_done(reqdata, rc);
 		return rc;
 	}
 
@@ -725,6 +727,8 @@ enum nfs_req_result complete_request(nfs_request_t *reqdata,
 	LogFullDebug(COMPONENT_DISPATCH, "After svc_sendreply on socket %d",
 		     xprt->xp_fd);
 
+	req_record_done(reqdata, rc);
+
 	/* Finish any request not already deleted */
 	nfs_dupreq_finish(reqdata, rc);
 	return rc;
@@ -732,6 +736,8 @@ enum nfs_req_result complete_request(nfs_request_t *reqdata,
 
 void complete_request_instrumentation(nfs_request_t *reqdata)
 {
+	req_record_mark(reqdata, REQ_MARK_SERVICE);
+
 	GSH_AUTO_TRACEPOINT(nfs_rpc, op_end, TRACE_INFO, "Op end. request: {}",
 			    reqdata);
 }
@@ -824,6 +830,8 @@ static enum xprt_stat nfs_rpc_process_request(nfs_request_t *reqdata,
 	if (retry)
 		goto retry_after_drc_suspend;
 
+	req_record_mark(reqdata, REQ_MARK_PROCESS);
+
 	GSH_AUTO_TRACEPOINT(nfs_rpc, start, TRACE_INFO,
 			    "Rpc start. request: {}", reqdata);
 
@@ -996,6 +1004,7 @@ static enum xprt_stat nfs_rpc_process_request(nfs_request_t *reqdata,
 	 * server boot time.  This gets high precision with simple 64 bit math.
 	 */
 	now(&op_ctx->start_time);
+	req_record_start(reqdata);
 
 	/* Initialized user_credentials */
 	init_credentials();
@@ -1035,6 +1044,7 @@ static enum xprt_stat nfs_rpc_process_request(nfs_request_t *reqdata,
 	/* If req is uncacheable, or if req is v41+, nfs_dupreq_start will do
 	 * nothing but allocate a result object and mark the request (ie, the
 	 * path is short, lockless, and does no hash/search). */
+	req_record_mark(reqdata, REQ_MARK_DUPREQ);
 	dpq_status = nfs_dupreq_start(reqdata);
 
 	if (dpq_status == DUPREQ_SUCCESS) {
@@ -1088,6 +1098,7 @@ retry_after_drc_suspend:
 	/* If we come here on a retry after drc suspend, then we already did
 	 * the stuff above.
 	 */
+	req_record_mark(reqdata, REQ_MARK_EXECUTE);
 
 	/* We need the port below. */
 	port = get_port(op_ctx->caller_addr);
@@ -1466,6 +1477,8 @@ retry_after_drc_suspend:
 
 null_op:
 
+		req_record_mark(reqdata, REQ_MARK_DISPATCH);
+
 		GSH_AUTO_TRACEPOINT(
 			nfs_rpc, op_start, TRACE_INFO,
 			"Op start. request: {}, func: {}, export_id: {}",
@@ -45,6 +45,7 @@
 #include "nfs_convert.h"
 #include "nfs_file_handle.h"
 #include "nfs_proto_tools.h"
+#include "nfs_readdir_cache.h"
 #include <assert.h>
 
 fsal_errors_t nfs3_readdirplus_callback(void *opaque,
@@ -70,6 +71,7 @@ struct nfs3_readdirplus_cb_data {
 	uint32_t max_count; /*< Maximum number of entries allowed. */
 	nfsstat3 error; /*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
+	bool uncacheable; /*< The entries depend on the caller */
 };
 
 static nfsstat3 nfs_readdir_dot_entry(struct fsal_obj_handle *obj,
@@ -128,6 +130,10 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	struct fsal_attrlist attrs_dir, attrs_parent;
 	bool use_cookie_verifier =
 		op_ctx_export_has_option(EXPORT_OPTION_USE_COOKIE_VERIFIER);
+	struct readdir_cache_ctx cache_ctx;
+	struct readdir_reply *reply = NULL;
+	uint8_t *head = NULL;
+	u_int head_len = 0;
 	READDIRPLUS3resfail *resfail =
 		&res->res_readdirplus3.READDIRPLUS3res_u.resfail;
 	READDIRPLUS3resok *resok =
@@ -145,6 +151,7 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	resfail->dir_attributes.attributes_follow = FALSE;
 
 	memset(&tracker, 0, sizeof(tracker));
+	memset(&cache_ctx, 0, sizeof(cache_ctx));
 
 	if (op_ctx_export_has_option(EXPORT_OPTION_NO_READDIR_PLUS)) {
 		res->res_readdirplus3.status = NFS3ERR_NOTSUPP;
@@ -304,6 +311,55 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
+	if (nfs_param.core_param.readdir_cache_size != 0 &&
+	    !op_ctx->is_rdma_buff_used) {
+		/* "." and ".." are always encoded afresh, only the entries
+		 * following them are cached.
+		 */
+		head_len = xdr_getpos(&tracker.xdr);
+
+		cache_ctx.key.cookie = fsal_cookie;
+		cache_ctx.key.mem_avail = tracker.mem_avail - head_len;
+		cache_ctx.key.max_count = tracker.max_count - tracker.count;
+		cache_ctx.key.export_id = op_ctx->ctx_export->export_id;
+		cache_ctx.key.vers = NFS_V3;
+
+		reply = readdir_cache_get(dir_obj, &cache_ctx);
+	}
+
+	if (reply != NULL) {
+		if (head_len != 0) {
+			head = tracker.entries;
+			tracker.entries = NULL;
+		}
+
+		resok->reply.uio = readdir_reply_uio(reply, head, head_len);
+		resok->reply.entries = NULL;
+		head = NULL;
+		goto out_reply;
+	}
+
+	if (cache_ctx.cacheable) {
+		/* Encode the entries in a buffer of their own, that can be
+		 * shared with the cache.
+		 */
+		xdr_destroy(&tracker.xdr);
+
+		if (head_len != 0) {
+			head = tracker.entries;
+			tracker.entries = NULL;
+		}
+
+		tracker.mem_avail -= head_len;
+		tracker.max_count -= tracker.count;
+		tracker.count = 0;
+		if (tracker.entries == NULL)
+			tracker.entries = gsh_malloc(tracker.mem_avail);
+
+		xdrmem_create(&tracker.xdr, (char *)tracker.entries,
+			      tracker.mem_avail, XDR_ENCODE);
+	}
+
 	LogDebug(COMPONENT_NFS_READDIR,
 		 "Readdirplus3 -> Call to fsal_readdir, cookie=%" PRIu64,
 		 fsal_cookie);
@@ -366,6 +422,30 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		pos_end = xdr_getpos(&tracker.xdr);
 
+		if (cache_ctx.cacheable && num_entries != 0 &&
+		    !tracker.uncacheable) {
+			/* Share the entries buffer with the cache */
+			reply = readdir_cache_put(&cache_ctx, tracker.entries,
+						  pos_end);
+			tracker.entries = NULL;
+			resok->reply.uio =
+				readdir_reply_uio(reply, head, head_len);
+			resok->reply.entries = NULL;
+			head = NULL;
+			goto out_reply;
+		}
+
+		if (head != NULL) {
+			/* Not cached after all, put the entries back after
+			 * "." and "..", there is room for them.
+			 */
+			memcpy(head + head_len, tracker.entries, pos_end);
+			gsh_free(tracker.entries);
+			tracker.entries = head;
+			head = NULL;
+			pos_end += head_len;
+		}
+
 		/* Get an xdr_uio and fill it in */
 		uio = gsh_calloc(1, sizeof(struct xdr_uio) +
 					    sizeof(struct xdr_uio));
@@ -384,6 +464,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		resok->reply.entries = NULL;
 	}
 
+out_reply:
+
 	nfs_SetPostOpAttr(dir_obj, &resok->dir_attributes, &attrs_dir);
 
 	memcpy(resok->cookieverf, cookie_verifier, sizeof(cookieverf3));
@@ -417,6 +499,8 @@ out:
 	if (!op_ctx->is_rdma_buff_used)
 		gsh_free(tracker.entries);
 
+	gsh_free(head);
+
 	return rc;
 } /* nfs3_readdirplus */
 
@@ -486,6 +570,7 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	} else {
 		ep3.name_handle.handle_follows = false;
 		ep3.name_attributes.attributes_follow = false;
+		tracker->uncacheable = true;
 	}
 
 	/* Encode the entry into the xdrmem buffer and then assure there is
@@ -41,6 +41,7 @@
 #include "nfs_proto_functions.h"
 #include "nfs_proto_tools.h"
 #include "server_stats.h"
+#include "req_recorder.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
 #include "pnfs_utils.h"
@@ -737,6 +738,8 @@ enum nfs_req_result complete_op(compound_data_t *data, nfsstat4 *status,
 out:
 
 	server_stats_nfsv4_op_done(data->opcode, &data->op_start_time, *status);
+	req_record_op(data->opcode, data->opname, &data->op_start_time,
+		      *status);
 
 	return result;
 }
@@ -1135,6 +1138,202 @@ uint32_t get_nfs4_opcodes(compound_data_t *data, nfs_opnum4 *opcodes,
 	return data->argarray_len;
 }
 
+/**
+ * @brief Size of the chunks compound scoped allocations are carved from
+ *
+ * Large enough for the compound data, the tag, the current and saved
+ * filehandles and the private data of a few operations.
+ */
+#define COMPOUND_CHUNK_SIZE 8192
+
+/**
+ * @brief Number of spare chunks kept by each thread
+ */
+#define COMPOUND_CHUNK_SPARES 4
+
+/**
+ * @brief A chunk of a compound arena
+ */
+struct compound_chunk {
+	struct compound_chunk *next; /*< Older chunk of the arena, or next
+					 spare chunk */
+	size_t size; /*< Usable size of data */
+	char data[] __attribute__((aligned(16)));
+};
+
+/**
+ * @brief Spare chunks of the calling thread
+ */
+struct compound_spares {
+	struct compound_chunk *head;
+	unsigned int count;
+};
+
+static pthread_key_t compound_spares_key;
+static pthread_once_t compound_spares_once = PTHREAD_ONCE_INIT;
+
+static void compound_spares_free(void *arg)
+{
+	struct compound_spares *spares = arg;
+	struct compound_chunk *chunk;
+
+	while (spares->head != NULL) {
+		chunk = spares->head;
+		spares->head = chunk->next;
+		gsh_free(chunk);
+	}
+
+	gsh_free(spares);
+}
+
+static void compound_spares_init(void)
+{
+	int rc = pthread_key_create(&compound_spares_key,
+				    compound_spares_free);
+
+	if (rc != 0)
+		LogFatal(COMPONENT_NFS_V4,
+			 "Could not create compound arena key: %d", rc);
+}
+
+static struct compound_spares *compound_spares_get(void)
+{
+	struct compound_spares *spares;
+
+	(void)pthread_once(&compound_spares_once, compound_spares_init);
+
+	spares = pthread_getspecific(compound_spares_key);
+
+	if (spares == NULL) {
+		spares = gsh_calloc(1, sizeof(*spares));
+		(void)pthread_setspecific(compound_spares_key, spares);
+	}
+
+	return spares;
+}
+
+/**
+ * @brief Get a chunk, reusing a spare one of this thread if possible
+ */
+static struct compound_chunk *compound_chunk_get(size_t size)
+{
+	struct compound_spares *spares;
+	struct compound_chunk *chunk;
+
+	if (size <= COMPOUND_CHUNK_SIZE) {
+		spares = compound_spares_get();
+
+		if (spares->head != NULL) {
+			chunk = spares->head;
+			spares->head = chunk->next;
+			spares->count--;
+			return chunk;
+		}
+
+		size = COMPOUND_CHUNK_SIZE;
+	}
+
+	chunk = gsh_malloc(sizeof(*chunk) + size);
+	chunk->size = size;
+
+	return chunk;
+}
+
+/**
+ * @brief Release a chunk, keeping it as a spare of this thread if possible
+ *
+ * The chunk may have been obtained on another thread, if the compound was
+ * suspended and resumed.
+ */
+static void compound_chunk_put(struct compound_chunk *chunk)
+{
+	struct compound_spares *spares;
+
+	if (chunk->size == COMPOUND_CHUNK_SIZE) {
+		spares = compound_spares_get();
+
+		if (spares->count < COMPOUND_CHUNK_SPARES) {
+			chunk->next = spares->head;
+			spares->head = chunk;
+			spares->count++;
+			return;
+		}
+	}
+
+	gsh_free(chunk);
+}
+
+static inline size_t compound_align(size_t size)
+{
+	return (size + 15) & ~(size_t)15;
+}
+
+/**
+ * @brief Allocate compound data and the arena it lives in
+ *
+ * The compound data is released with compound_data_Free().
+ */
+compound_data_t *compound_data_alloc(void)
+{
+	struct compound_chunk *chunk = compound_chunk_get(0);
+	compound_data_t *data = (compound_data_t *)chunk->data;
+
+	memset(data, 0, sizeof(*data));
+	chunk->next = NULL;
+	data->arena = chunk;
+	data->arena_used = compound_align(sizeof(*data));
+
+	return data;
+}
+
+/**
+ * @brief Allocate zeroed memory for the duration of a compound
+ *
+ * The memory is released all at once by compound_data_Free(), it must not
+ * be freed, and anything that must outlive the compound must be copied
+ * to memory obtained from gsh_malloc().  A compound only ever runs on one
+ * thread at a time, so no locking is needed.
+ *
+ * @param[in] data Compound data
+ * @param[in] size Number of bytes to allocate
+ *
+ * @return Pointer to a block of memory, aligned for any type.
+ */
+void *compound_alloc(compound_data_t *data, size_t size)
+{
+	struct compound_chunk *chunk = data->arena;
+	void *p;
+
+	size = compound_align(size);
+
+	if (chunk == NULL || data->arena_used + size > chunk->size) {
+		chunk = compound_chunk_get(size);
+		chunk->next = data->arena;
+		data->arena = chunk;
+		data->arena_used = 0;
+	}
+
+	p = chunk->data + data->arena_used;
+	data->arena_used += size;
+
+	return memset(p, 0, size);
+}
+
+/**
+ * @brief Allocate a filehandle buffer for the duration of a compound
+ *
+ * Used for the current and saved filehandles in place of
+ * nfs4_AllocateFH().
+ *
+ * @param[in]  data Compound data
+ * @param[out] fh   Filehandle to allocate
+ */
+void compound_alloc_fh(compound_data_t *data, nfs_fh4 *fh)
+{
+	fh->nfs_fh4_len = NFS4_FHSIZE;
+	fh->nfs_fh4_val = compound_alloc(data, NFS4_FHSIZE);
+}
+
 /**
  * @brief The NFS PROC4 COMPOUND
  *
@@ -1214,7 +1413,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 #endif
 	/* Initialisation of the compound request internal's data */
-	data = gsh_calloc(1, sizeof(*data));
+	data = compound_data_alloc();
 
 	data->req = req;
 	data->argarray_len = argarray_len;
@@ -1230,6 +1429,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	copy_tag(&res_compound4->tag, &arg->arg_compound4.tag);
 
 	if (res_compound4->tag.utf8string_len > 0) {
+		char *tagname;
+
 		/* Check if the tag is a valid utf8 string (., .., and / ok) */
 		if (nfs4_utf8string_scan(&res_compound4->tag,
 					 UTF8_SCAN_STRICT) != 0) {
@@ -1252,13 +1453,14 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 
 		/* Make a copy of the tagname */
-		data->tagname =
-			gsh_malloc(res_compound4->tag.utf8string_len + 1);
-		memcpy(data->tagname, res_compound4->tag.utf8string_val,
+		tagname = compound_alloc(data,
+					 res_compound4->tag.utf8string_len + 1);
+		memcpy(tagname, res_compound4->tag.utf8string_val,
 		       res_compound4->tag.utf8string_len + 1);
+		data->tagname = tagname;
 	} else {
 		/* No tag */
-		data->tagname = gsh_strdup("NO TAG");
+		data->tagname = "NO TAG";
 	}
 
 	/* Managing the operation list */
@@ -1493,6 +1695,8 @@ void nfs4_Compound_Free(nfs_res_t *res)
  */
 void compound_data_Free(compound_data_t *data)
 {
+	struct compound_chunk *chunk;
+
 	if (data == NULL)
 		return;
 
@@ -1506,8 +1710,6 @@ void compound_data_Free(compound_data_t *data)
 	set_current_entry(data, NULL);
 	set_saved_entry(data, NULL);
 
-	gsh_free(data->tagname);
-
 	if (data->session) {
 		if (data->slotid != UINT32_MAX) {
 			nfs41_session_slot_t *slot;
@@ -1533,13 +1735,18 @@ void compound_data_Free(compound_data_t *data)
 		data->saved_pnfs_ds = NULL;
 	}
 
-	if (data->currentFH.nfs_fh4_val != NULL)
-		gsh_free(data->currentFH.nfs_fh4_val);
+	/* Release the arena, data itself lives in the oldest chunk. The
+	 * current and saved filehandles and the tag name were allocated
+	 * from it.
+	 */
+	chunk = data->arena;
 
-	if (data->savedFH.nfs_fh4_val != NULL)
-		gsh_free(data->savedFH.nfs_fh4_val);
+	while (chunk != NULL) {
+		struct compound_chunk *next = chunk->next;
 
-	gsh_free(data);
+		compound_chunk_put(chunk);
+		chunk = next;
+	}
 } /* compound_data_Free */
 
 /**
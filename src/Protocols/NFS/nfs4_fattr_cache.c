@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs4_fattr_cache.c
+ * @brief   Memoization of encoded NFSv4 attributes
+ *
+ * Clients ask for the same few sets of attributes over and over again, and
+ * encoding them (including mapping owner and group to names) costs far more
+ * than copying the result.  The encoding of the attributes of an object is
+ * handed to its FSAL (MDCACHE) through the fattr_cache_put method, keyed by
+ * the requested attributes, the export and the minor version, and copied
+ * back by the fattr_cache_get method as long as the attributes it was built
+ * from are unchanged.
+ *
+ * The memoized blob holds the attribute values followed by the bitmap of
+ * the attributes actually encoded, so that the values can be handed to the
+ * reply without another copy.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_proto_tools.h"
+#include "nfs4_fattr_cache.h"
+#include "monitoring.h"
+
+/**
+ * @brief Number of attribute masks with their own statistics
+ *
+ * Masks seen after that many are accounted together.
+ */
+
+#define FATTR_CACHE_MASKS 16
+
+/**
+ * @brief Hits and misses for a mask
+ */
+
+struct fattr_cache_stats {
+	uint32_t map[BITMAP4_MAPLEN]; /*< The mask */
+	char label[32]; /*< The mask in hex, for the metric label */
+	counter_metric_handle_t hits;
+	counter_metric_handle_t misses;
+};
+
+static struct fattr_cache_stats fattr_cache_masks[FATTR_CACHE_MASKS];
+static struct fattr_cache_stats fattr_cache_other = { .label = "other" };
+static uint32_t fattr_cache_nmasks; /*< Published entries of the table */
+static pthread_mutex_t fattr_cache_lock; /*< Serializes table updates */
+
+static void fattr_cache_register(struct fattr_cache_stats *stats)
+{
+	const metric_label_t hit[] = { METRIC_LABEL("mask", stats->label),
+				       METRIC_LABEL("result", "hit") };
+	const metric_label_t miss[] = { METRIC_LABEL("mask", stats->label),
+					METRIC_LABEL("result", "miss") };
+
+	stats->hits = monitoring__register_counter(
+		"nfs__fattr_cache_total",
+		METRIC_METADATA("Encoded attribute cache lookups",
+				METRIC_UNIT_NONE),
+		hit, ARRAY_SIZE(hit));
+	stats->misses = monitoring__register_counter(
+		"nfs__fattr_cache_total",
+		METRIC_METADATA("Encoded attribute cache lookups",
+				METRIC_UNIT_NONE),
+		miss, ARRAY_SIZE(miss));
+}
+
+static struct fattr_cache_stats *
+fattr_cache_stats_lookup(const uint32_t *map, uint32_t nmasks)
+{
+	uint32_t i;
+
+	for (i = 0; i < nmasks; i++) {
+		if (memcmp(fattr_cache_masks[i].map, map,
+			   sizeof(fattr_cache_masks[i].map)) == 0)
+			return &fattr_cache_masks[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Get the statistics of a mask, adding it to the table if needed
+ *
+ * Entries are only appended to the table, and are filled in before the
+ * count is increased, so the table can be searched without the lock.
+ */
+
+static struct fattr_cache_stats *fattr_cache_stats_get(const uint32_t *map)
+{
+	struct fattr_cache_stats *stats;
+	uint32_t nmasks = atomic_fetch_uint32_t(&fattr_cache_nmasks);
+
+	stats = fattr_cache_stats_lookup(map, nmasks);
+
+	if (stats != NULL || nmasks == FATTR_CACHE_MASKS)
+		return stats != NULL ? stats : &fattr_cache_other;
+
+	PTHREAD_MUTEX_lock(&fattr_cache_lock);
+
+	nmasks = atomic_fetch_uint32_t(&fattr_cache_nmasks);
+	stats = fattr_cache_stats_lookup(map, nmasks);
+
+	if (stats == NULL && nmasks < FATTR_CACHE_MASKS) {
+		stats = &fattr_cache_masks[nmasks];
+		memcpy(stats->map, map, sizeof(stats->map));
+		(void)snprintf(stats->label, sizeof(stats->label), "%x,%x,%x",
+			       map[0], map[1], map[2]);
+		fattr_cache_register(stats);
+		atomic_inc_uint32_t(&fattr_cache_nmasks);
+	}
+
+	PTHREAD_MUTEX_unlock(&fattr_cache_lock);
+
+	return stats != NULL ? stats : &fattr_cache_other;
+}
+
+/**
+ * @brief Look up the encoded attributes of the current object
+ *
+ * If no encoding is memoized, ctx is left ready for fattr_cache_put(),
+ * which should be called once the attributes have been fetched and
+ * encoded.  The caller is still responsible for checking that the
+ * attributes may be read.
+ *
+ * @param[in]     data   NFSv4 compound request's data
+ * @param[in]     Bitmap Bitmap of attributes being requested
+ * @param[in]     mask   The attributes being requested
+ * @param[out]    ctx    Lookup state
+ * @param[out]    Fattr  NFSv4 Fattr buffer, filled in on a hit
+ *
+ * @return true if Fattr was filled in.
+ */
+
+bool fattr_cache_get(compound_data_t *data, struct bitmap4 *Bitmap,
+		     attrmask_t mask, struct fattr_cache_ctx *ctx,
+		     fattr4 *Fattr)
+{
+	struct fsal_obj_handle *obj = data->current_obj;
+	struct gsh_buffdesc key = { .addr = &ctx->key,
+				    .len = sizeof(ctx->key) };
+	struct fattr_cache_stats *stats;
+	struct gsh_buffdesc blob;
+	u_int len;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	if (Bitmap->bitmap4_len > BITMAP4_MAPLEN ||
+	    !nfs4_Fattr_Cacheable(Bitmap))
+		return false;
+
+	memcpy(ctx->key.map, Bitmap->map,
+	       Bitmap->bitmap4_len * sizeof(ctx->key.map[0]));
+	ctx->key.export_id = op_ctx->ctx_export->export_id;
+	ctx->key.minorversion = data->minorversion;
+
+	if (!obj->obj_ops->fattr_cache_get(obj, mask, &key, &blob,
+					   &ctx->generation)) {
+		if (ctx->generation != 0) {
+			stats = fattr_cache_stats_get(ctx->key.map);
+			monitoring__counter_inc(stats->misses, 1);
+		}
+		return false;
+	}
+
+	stats = fattr_cache_stats_get(ctx->key.map);
+	monitoring__counter_inc(stats->hits, 1);
+
+	len = blob.len - sizeof(Fattr->attrmask);
+
+	memcpy(&Fattr->attrmask, (char *)blob.addr + len,
+	       sizeof(Fattr->attrmask));
+	Fattr->attr_vals.attrlist4_val = blob.addr;
+	Fattr->attr_vals.attrlist4_len = len;
+
+	return true;
+}
+
+/**
+ * @brief Memoize the encoded attributes of the current object
+ *
+ * @param[in] data  NFSv4 compound request's data
+ * @param[in] ctx   State left by fattr_cache_get()
+ * @param[in] Fattr The encoded attributes
+ */
+
+void fattr_cache_put(compound_data_t *data, struct fattr_cache_ctx *ctx,
+		     const fattr4 *Fattr)
+{
+	struct fsal_obj_handle *obj = data->current_obj;
+	struct gsh_buffdesc key = { .addr = &ctx->key,
+				    .len = sizeof(ctx->key) };
+	u_int len = Fattr->attr_vals.attrlist4_len;
+	struct gsh_buffdesc blob;
+
+	if (ctx->generation == 0 || len == 0)
+		return;
+
+	blob.len = len + sizeof(Fattr->attrmask);
+	blob.addr = gsh_malloc(blob.len);
+	memcpy(blob.addr, Fattr->attr_vals.attrlist4_val, len);
+	memcpy((char *)blob.addr + len, &Fattr->attrmask,
+	       sizeof(Fattr->attrmask));
+
+	obj->obj_ops->fattr_cache_put(obj, &key, &blob, ctx->generation);
+}
+
+/**
+ * @brief Initialize the statistics of the encoded attribute cache
+ */
+
+void fattr_cache_init(void)
+{
+	PTHREAD_MUTEX_init(&fattr_cache_lock, NULL);
+	fattr_cache_register(&fattr_cache_other);
+}
@@ -44,6 +44,7 @@
 #include "nfs_proto_tools.h"
 #include "nfs_file_handle.h"
 #include "nfs_convert.h"
+#include "nfs4_fattr_cache.h"
 #include "sal_functions.h"
 
 #include "gsh_lttng/gsh_lttng.h"
@@ -77,6 +78,7 @@ enum nfs_req_result nfs4_op_getattr(struct nfs_argop4 *op,
 		&res_GETATTR4->GETATTR4res_u.resok4.obj_attributes;
 	nfs_client_id_t *deleg_client = NULL;
 	struct fsal_obj_handle *obj = data->current_obj;
+	struct fattr_cache_ctx fattr_ctx;
 
 	GSH_AUTO_TRACEPOINT(nfs4, op_getattr_start, TRACE_INFO,
 			    "GETATTR arg: len={} map={}",
@@ -155,6 +157,17 @@ enum nfs_req_result nfs4_op_getattr(struct nfs_argop4 *op,
 		STATELOCK_unlock(obj);
 	}
 
+	if (fattr_cache_get(data, &arg_GETATTR4->attr_request, mask,
+			    &fattr_ctx, obj_attributes)) {
+		/* Only encodings of objects that are not referrals are
+		 * memoized, and they are dropped if the mode changes.
+		 */
+		res_GETATTR4->status = file_To_Fattr_Access(
+			data, &arg_GETATTR4->attr_request);
+		fsal_release_attrs(&attrs);
+		goto reply;
+	}
+
 	res_GETATTR4->status = file_To_Fattr(data, mask, &attrs, obj_attributes,
 					     &arg_GETATTR4->attr_request);
 
@@ -196,9 +209,13 @@ enum nfs_req_result nfs4_op_getattr(struct nfs_argop4 *op,
 		}
 	}
 
+	if (res_GETATTR4->status == NFS4_OK && !current_obj_is_referral)
+		fattr_cache_put(data, &fattr_ctx, obj_attributes);
+
 	/* Done with the attrs */
 	fsal_release_attrs(&attrs);
 
+reply:
 	if (res_GETATTR4->status == NFS4_OK) {
 		/* Fill in and check response size and make sure it fits. */
 		data->op_resp_size =
@@ -409,6 +409,12 @@ enum nfs_req_result nfs4_op_layoutget(struct nfs_argop4 *op,
 	arg.export_id = op_ctx->ctx_export->export_id;
 	arg.maxcount = arg_LAYOUTGET4->loga_maxcount;
 
+	/* The seqid update_stateid will give the layout state */
+	arg.stateid.seqid = layout_state->state_seqid + 1;
+	if (arg.stateid.seqid == 0)
+		arg.stateid.seqid = 1;
+	memcpy(arg.stateid.other, layout_state->stateid_other, OTHERSIZE);
+
 	/* Guaranteed on the first call */
 	res.context = NULL;
 
@@ -526,6 +532,8 @@ enum nfs_req_result nfs4_op_layouterror(struct nfs_argop4 *op,
 	/* Convenience alias for response */
 	LAYOUTERROR4res *const res_LAYOUTERROR4 =
 		&resp->nfs_resop4_u.oplayouterror;
+	/* Input arguments of FSAL_layouterror */
+	struct fsal_layouterror_arg arg;
 
 	LogEvent(COMPONENT_PNFS,
 		 "LAYOUTERROR OP %d status %d offset: %" PRIu64
@@ -534,11 +542,28 @@ enum nfs_req_result nfs4_op_layouterror(struct nfs_argop4 *op,
 		 arg_LAYOUTERROR4->lea_errors.de_status,
 		 arg_LAYOUTERROR4->lea_offset, arg_LAYOUTERROR4->lea_length);
 
-	/** @todo: what else do we want to do with this error ???  */
+	res_LAYOUTERROR4->ler_status =
+		nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+
+	if (res_LAYOUTERROR4->ler_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.offset = arg_LAYOUTERROR4->lea_offset;
+	arg.length = arg_LAYOUTERROR4->lea_length;
+	memcpy(&arg.deviceid, arg_LAYOUTERROR4->lea_errors.de_deviceid,
+	       sizeof(arg.deviceid));
+	arg.status = arg_LAYOUTERROR4->lea_errors.de_status;
+	arg.opnum = arg_LAYOUTERROR4->lea_errors.de_opnum;
 
-	res_LAYOUTERROR4->ler_status = NFS4_OK;
+	/* Let the FSAL decide whether to steer layouts away from the
+	 * failing device.
+	 */
+	res_LAYOUTERROR4->ler_status =
+		data->current_obj->obj_ops->layouterror(data->current_obj,
+							&arg);
 
-	return NFS_REQ_OK;
+	return nfsstat4_to_nfs_req_result(res_LAYOUTERROR4->ler_status);
 }
 
 void nfs4_op_layouterror_Free(nfs_resop4 *res)
@@ -555,12 +580,16 @@ enum nfs_req_result nfs4_op_layoutstats(struct nfs_argop4 *op,
 	/* Convenience alias for response */
 	LAYOUTSTATS4res *const res_LAYOUTSTATS4 =
 		&resp->nfs_resop4_u.oplayoutstats;
+	/* Input arguments of FSAL_layoutstats */
+	struct fsal_layoutstats_arg arg;
+	/* XDR stream holding the lou_body opaque */
+	XDR lou_body;
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_offset, arg_LAYOUTSTATS4->lsa_length);
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS read count %u bytes %" PRIu64
 		 " write count %u bytes %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_read.ii_count,
@@ -568,11 +597,31 @@ enum nfs_req_result nfs4_op_layoutstats(struct nfs_argop4 *op,
 		 arg_LAYOUTSTATS4->lsa_write.ii_count,
 		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
-	/** @todo: what else do we want to do with the stats ???  */
+	res_LAYOUTSTATS4->lsr_status =
+		nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+
+	if (res_LAYOUTSTATS4->lsr_status != NFS4_OK)
+		return NFS_REQ_ERROR;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.type = arg_LAYOUTSTATS4->lsa_layoutupdate.lou_type;
+	arg.offset = arg_LAYOUTSTATS4->lsa_offset;
+	arg.length = arg_LAYOUTSTATS4->lsa_length;
+	arg.read = arg_LAYOUTSTATS4->lsa_read;
+	arg.write = arg_LAYOUTSTATS4->lsa_write;
+
+	xdrmem_create(&lou_body,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_val,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_len,
+		      XDR_DECODE);
+
+	res_LAYOUTSTATS4->lsr_status =
+		data->current_obj->obj_ops->layoutstats(data->current_obj,
+							&lou_body, &arg);
 
-	res_LAYOUTSTATS4->lsr_status = NFS4_OK;
+	xdr_destroy(&lou_body);
 
-	return NFS_REQ_OK;
+	return nfsstat4_to_nfs_req_result(res_LAYOUTSTATS4->lsr_status);
 }
 
 void nfs4_op_layoutstats_Free(nfs_resop4 *res)
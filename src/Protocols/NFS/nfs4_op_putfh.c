@@ -268,7 +268,7 @@ enum nfs_req_result nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* If no currentFH were set, allocate one */
 	if (data->currentFH.nfs_fh4_val == NULL)
-		nfs4_AllocateFH(&data->currentFH);
+		compound_alloc_fh(data, &data->currentFH);
 
 	/* Copy the filehandle from the arg structure */
 	data->currentFH.nfs_fh4_len = arg_PUTFH4->object.nfs_fh4_len;
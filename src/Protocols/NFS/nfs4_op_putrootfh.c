@@ -138,8 +138,10 @@ enum nfs_req_result nfs4_op_putrootfh(struct nfs_argop4 *op,
 	file_obj->obj_ops->put_ref(file_obj);
 
 	/* Convert it to a file handle */
-	if (!nfs4_FSALToFhandle(data->currentFH.nfs_fh4_val == NULL,
-				&data->currentFH, data->current_obj,
+	if (data->currentFH.nfs_fh4_val == NULL)
+		compound_alloc_fh(data, &data->currentFH);
+
+	if (!nfs4_FSALToFhandle(false, &data->currentFH, data->current_obj,
 				op_ctx->ctx_export)) {
 		LogCrit(COMPONENT_EXPORT,
 			"Could not get handle for Pseudo Root");
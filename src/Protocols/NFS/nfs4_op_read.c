@@ -281,7 +281,6 @@ enum nfs_req_result nfs4_op_read_resume(struct nfs_argop4 *op,
 		 * might as well be prepared here. Our caller is already
 		 * prepared for such a scenario.
 		 */
-		gsh_free(data->op_data);
 		data->op_data = NULL;
 	}
 
@@ -337,7 +336,6 @@ enum nfs_req_result nfs4_op_read_plus_resume(struct nfs_argop4 *op,
 		 * might as well be prepared here. Our caller is already
 		 * prepared for such a scenario.
 		 */
-		gsh_free(read_data);
 		data->op_data = NULL;
 	}
 
@@ -772,8 +770,8 @@ static enum nfs_req_result nfs4_read(struct nfs_argop4 *op,
 	resok->data.last_iov_buf_size = 0;
 	resok->data.release = read4_io_data_release;
 
-	/* Set up args, allocate from heap, iov_len will be 1 */
-	read_data = gsh_calloc(1, sizeof(*read_data));
+	/* Set up args, allocate from the compound, iov_len will be 1 */
+	read_data = compound_alloc(data, sizeof(*read_data));
 	LogFullDebug(COMPONENT_NFS_V4, "Allocated read_data %p", read_data);
 	read_arg = &read_data->read_arg;
 	read_arg->info = info;
@@ -889,7 +887,6 @@ enum nfs_req_result nfs4_op_read(struct nfs_argop4 *op, compound_data_t *data,
 		 * might as well be prepared here. Our caller is already
 		 * prepared for such a scenario.
 		 */
-		gsh_free(data->op_data);
 		data->op_data = NULL;
 	}
 
@@ -985,7 +982,6 @@ enum nfs_req_result nfs4_op_read_plus(struct nfs_argop4 *op,
 		 * might as well be prepared here. Our caller is already
 		 * prepared for such a scenario.
 		 */
-		gsh_free(data->op_data);
 		data->op_data = NULL;
 	}
 
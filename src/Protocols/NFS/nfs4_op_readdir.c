@@ -35,6 +35,7 @@
 #include "nfs_file_handle.h"
 #include "nfs_convert.h"
 #include "export_mgr.h"
+#include "nfs_readdir_cache.h"
 
 #include "gsh_lttng/gsh_lttng.h"
 #if defined(USE_LTTNG) && !defined(LTTNG_PARSING)
@@ -55,6 +56,7 @@ struct nfs4_readdir_cb_data {
 	int count; /*< Number of entries accumulated so far. */
 	uint32_t max_count; /*< Maximum number of entries allowed. */
 	bool has_entries; /*< Track if at least one entry fit  */
+	bool uncacheable; /*< The entries depend on the caller */
 	nfsstat4 error; /*< Set to a value other than NFS4_OK if the
 				   callback function finds a fatal error. */
 	struct bitmap4 *req_attr; /*< The requested attributes */
@@ -143,6 +145,7 @@ fsal_errors_t nfs4_readdir_callback(void *opaque, struct fsal_obj_handle *obj,
 		/* Restore the export. */
 		LogDebug(COMPONENT_NFS_READDIR,
 			 "Cleanup after problem with junction processing.");
+		tracker->uncacheable = true;
 		restore_data(tracker);
 		return ERR_FSAL_NO_ERROR;
 	}
@@ -164,6 +167,9 @@ fsal_errors_t nfs4_readdir_callback(void *opaque, struct fsal_obj_handle *obj,
 		if (obj->state_hdl->dir.junction_export == NULL)
 			goto not_junction;
 
+		/* What is returned for a junction depends on the client */
+		tracker->uncacheable = true;
+
 		/* This is a junction. Code used to not recognize this
 		 * which resulted in readdir giving different attributes
 		 * (including FH, FSid, etc...) to clients from a
@@ -439,6 +445,8 @@ not_junction:
 skip:
 
 	if (args.rdattr_error != NFS4_OK) {
+		tracker->uncacheable = true;
+
 		if (!attribute_is_set(tracker->req_attr, FATTR4_RDATTR_ERROR) &&
 		    !attribute_is_set(tracker->req_attr, FATTR4_FS_LOCATIONS)) {
 			tracker->error = args.rdattr_error;
@@ -470,6 +478,7 @@ skip:
 server_fault:
 
 	tracker->error = NFS4ERR_SERVERFAULT;
+	tracker->uncacheable = true;
 
 failure:
 
@@ -540,6 +549,10 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	attrmask_t attrmask;
 	bool use_cookie_verifier =
 		op_ctx_export_has_option(EXPORT_OPTION_USE_COOKIE_VERIFIER);
+	bool use_cache = nfs_param.core_param.readdir_cache_size != 0 &&
+			 nfs4_Fattr_Cacheable(&arg_READDIR4->attr_request);
+	struct readdir_cache_ctx cache_ctx;
+	struct readdir_reply *reply = NULL;
 
 	GSH_AUTO_TRACEPOINT(
 		nfs4, op_readir_start, TRACE_INFO,
@@ -553,6 +566,7 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	res_READDIR4->status = nfs4_sanity_check_FH(data, DIRECTORY, false);
 
 	memset(&tracker, 0, sizeof(tracker));
+	memset(&cache_ctx, 0, sizeof(cache_ctx));
 
 	if (res_READDIR4->status != NFS4_OK)
 		goto out;
@@ -633,8 +647,11 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 	 * returned to the client This value is the change attribute of the
 	 * directory. If verifier is unused (as in many NFS Servers) then
 	 * only a set of zeros is returned (trivial value)
+	 *
+	 * The cache of encoded replies also needs up to date directory
+	 * attributes to validate them.
 	 */
-	if (use_cookie_verifier) {
+	if (use_cookie_verifier || use_cache) {
 		struct fsal_attrlist attrs;
 
 		fsal_prepare_attrs(&attrs, ATTR_CHANGE);
@@ -649,8 +666,10 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 			goto out;
 		}
 
-		memcpy(cookie_verifier, &attrs.change,
-		       MIN(sizeof(cookie_verifier), sizeof(attrs.change)));
+		if (use_cookie_verifier)
+			memcpy(cookie_verifier, &attrs.change,
+			       MIN(sizeof(cookie_verifier),
+				   sizeof(attrs.change)));
 
 		/* Done with the attrs */
 		fsal_release_attrs(&attrs);
@@ -676,6 +695,31 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 		}
 	}
 
+	if (use_cache) {
+		cache_ctx.key.cookie = cookie;
+		cache_ctx.key.mem_avail = maxcount - READDIR_RESOK_BASE_SIZE;
+		cache_ctx.key.max_count = dircount;
+		memcpy(cache_ctx.key.attrs, arg_READDIR4->attr_request.map,
+		       MIN(arg_READDIR4->attr_request.bitmap4_len,
+			   BITMAP4_MAPLEN) * sizeof(uint32_t));
+		cache_ctx.key.export_id = op_ctx->ctx_export->export_id;
+		cache_ctx.key.vers = NFS_V4;
+		cache_ctx.key.minorversion = data->minorversion;
+
+		reply = readdir_cache_get(dir_obj, &cache_ctx);
+	}
+
+	if (reply != NULL) {
+		/* The cached body includes the end of list and eof */
+		data->op_resp_size =
+			readdir_reply_length(reply) + READDIR_RESOK_BASE_SIZE;
+		resok->reply.uio = readdir_reply_uio(reply, NULL, 0);
+		memcpy(resok->cookieverf, cookie_verifier, NFS4_VERIFIER_SIZE);
+		resok->reply.entries = NULL;
+		res_READDIR4->status = NFS4_OK;
+		goto out;
+	}
+
 	/* Prepare to read the entries */
 	tracker.mem_avail = maxcount - READDIR_RESOK_BASE_SIZE;
 	tracker.max_count = dircount;
@@ -762,17 +806,25 @@ enum nfs_req_result nfs4_op_readdir(struct nfs_argop4 *op,
 
 		pos_end = xdr_getpos(&tracker.xdr);
 
-		/* Get an xdr_uio and fill it in */
-		uio = gsh_calloc(1, sizeof(struct xdr_uio) +
-					    sizeof(struct xdr_uio));
-		uio->uio_release = xdr_dirlist4_uio_release;
-		uio->uio_count = 1;
-		uio->uio_vio[0].vio_base = tracker.entries;
-		uio->uio_vio[0].vio_head = tracker.entries;
-		uio->uio_vio[0].vio_tail = tracker.entries + pos_end;
-		uio->uio_vio[0].vio_wrap = tracker.entries + pos_end;
-		uio->uio_vio[0].vio_length = pos_end;
-		uio->uio_vio[0].vio_type = VIO_DATA;
+		if (cache_ctx.cacheable && !tracker.uncacheable &&
+		    !op_ctx->is_rdma_buff_used) {
+			/* Share the entries buffer with the cache */
+			reply = readdir_cache_put(&cache_ctx, tracker.entries,
+						  pos_end);
+			uio = readdir_reply_uio(reply, NULL, 0);
+		} else {
+			/* Get an xdr_uio and fill it in */
+			uio = gsh_calloc(1, sizeof(struct xdr_uio) +
+						    sizeof(struct xdr_uio));
+			uio->uio_release = xdr_dirlist4_uio_release;
+			uio->uio_count = 1;
+			uio->uio_vio[0].vio_base = tracker.entries;
+			uio->uio_vio[0].vio_head = tracker.entries;
+			uio->uio_vio[0].vio_tail = tracker.entries + pos_end;
+			uio->uio_vio[0].vio_wrap = tracker.entries + pos_end;
+			uio->uio_vio[0].vio_length = pos_end;
+			uio->uio_vio[0].vio_type = VIO_DATA;
+		}
 
 		/* Take over entries buffer */
 		tracker.entries = NULL;
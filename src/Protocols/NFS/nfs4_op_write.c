@@ -184,7 +184,6 @@ enum nfs_req_result nfs4_op_write_resume(struct nfs_argop4 *op,
 		 * so we might as well be prepared here. Our caller is already
 		 * prepared for such a scenario.
 		 */
-		gsh_free(data->op_data);
 		data->op_data = NULL;
 	}
 
@@ -475,8 +474,8 @@ enum nfs_req_result nfs4_op_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	/* Set up args, allocate from heap, iov_len will be 1 */
-	write_data = gsh_calloc(1, sizeof(*write_data));
+	/* Set up args, allocate from the compound, iov_len will be 1 */
+	write_data = compound_alloc(data, sizeof(*write_data));
 	LogFullDebug(COMPONENT_NFS_V4, "Allocated write_data %p", write_data);
 	write_arg = &write_data->write_arg;
 	write_arg->info = NULL;
@@ -553,7 +552,6 @@ out:
 			 * might go async so we might as well be prepared here.
 			 * Our caller is already prepared for such a scenario.
 			 */
-			gsh_free(data->op_data);
 			data->op_data = NULL;
 		}
 
@@ -3390,40 +3390,47 @@ void get_mounted_on_fileid(compound_data_t *data, uint64_t *mounted_on_fileid)
 }
 
 /**
- * @brief Fill NFSv4 Fattr from a file
+ * @brief Check whether encoded attributes may be reused
  *
- * This function fills an NFSv4 Fattr from a file represented by
- * data->currentFH and data->current-obj.
+ * The encoding of most attributes only depends on the object, the export
+ * and the minor version.  Space attributes are fetched from the filesystem
+ * while encoding, reading the ACL depends on the caller, and ACL and
+ * fs_locations may be large.
  *
- * Memory for bitmap_val and attr_val is dynamically allocated, the caller is
- * responsible for freeing it.
+ * @param[in] Bitmap Bitmap of attributes being requested
  *
- * @param[in]     data          NFSv4 compoud request's data
- * @param[in]     request_mask  The original request attribute mask
- * @param[in/out] attr          fsal_attrlist to fill in and mask to request
- * @param[out]    Fattr         NFSv4 Fattr buffer
- * @param[in]     Bitmap        Bitmap of attributes being requested
+ * @return true if an encoding of these attributes may be cached.
+ */
+
+bool nfs4_Fattr_Cacheable(struct bitmap4 *Bitmap)
+{
+	return !attribute_is_set(Bitmap, FATTR4_ACL) &&
+	       !attribute_is_set(Bitmap, FATTR4_FS_LOCATIONS) &&
+	       !attribute_is_set(Bitmap, FATTR4_FILES_AVAIL) &&
+	       !attribute_is_set(Bitmap, FATTR4_FILES_FREE) &&
+	       !attribute_is_set(Bitmap, FATTR4_FILES_TOTAL) &&
+	       !attribute_is_set(Bitmap, FATTR4_SPACE_AVAIL) &&
+	       !attribute_is_set(Bitmap, FATTR4_SPACE_FREE) &&
+	       !attribute_is_set(Bitmap, FATTR4_SPACE_TOTAL);
+}
+
+/**
+ * @brief Check the caller may read the attributes of a file
+ *
+ * @param[in] data   NFSv4 compoud request's data
+ * @param[in] Bitmap Bitmap of attributes being requested
  *
  * @retval NFSv4 status
  */
 
-nfsstat4 file_To_Fattr(compound_data_t *data, attrmask_t request_mask,
-		       struct fsal_attrlist *attr, fattr4 *Fattr,
-		       struct bitmap4 *Bitmap)
+nfsstat4 file_To_Fattr_Access(compound_data_t *data, struct bitmap4 *Bitmap)
 {
 	fsal_status_t status;
-	struct xdr_attrs_args args = {
-		.attrs = attr,
-		.data = data,
-		.hdl4 = &data->currentFH,
-	};
 
 	/* Permission check only if ACL is asked for.
 	 * NOTE: We intentionally do NOT check ACE4_READ_ATTR.
 	 */
 	if (attribute_is_set(Bitmap, FATTR4_ACL)) {
-		fsal_status_t status;
-
 		LogDebug(COMPONENT_NFS_V4_ACL,
 			 "Permission check for ACL for obj %p",
 			 data->current_obj);
@@ -3463,6 +3470,43 @@ nfsstat4 file_To_Fattr(compound_data_t *data, attrmask_t request_mask,
 #endif /* ENABLE_RFC_ACL */
 	}
 
+	return NFS4_OK;
+}
+
+/**
+ * @brief Fill NFSv4 Fattr from a file
+ *
+ * This function fills an NFSv4 Fattr from a file represented by
+ * data->currentFH and data->current-obj.
+ *
+ * Memory for bitmap_val and attr_val is dynamically allocated, the caller is
+ * responsible for freeing it.
+ *
+ * @param[in]     data          NFSv4 compoud request's data
+ * @param[in]     request_mask  The original request attribute mask
+ * @param[in/out] attr          fsal_attrlist to fill in and mask to request
+ * @param[out]    Fattr         NFSv4 Fattr buffer
+ * @param[in]     Bitmap        Bitmap of attributes being requested
+ *
+ * @retval NFSv4 status
+ */
+
+nfsstat4 file_To_Fattr(compound_data_t *data, attrmask_t request_mask,
+		       struct fsal_attrlist *attr, fattr4 *Fattr,
+		       struct bitmap4 *Bitmap)
+{
+	fsal_status_t status;
+	nfsstat4 nfs_status;
+	struct xdr_attrs_args args = {
+		.attrs = attr,
+		.data = data,
+		.hdl4 = &data->currentFH,
+	};
+
+	nfs_status = file_To_Fattr_Access(data, Bitmap);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
 	if (attribute_is_set(Bitmap, FATTR4_MOUNTED_ON_FILEID)) {
 		get_mounted_on_fileid(data, &args.mounted_on_fileid);
 	}
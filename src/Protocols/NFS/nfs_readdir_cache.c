@@ -0,0 +1,450 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs_readdir_cache.c
+ * @brief   Cache of encoded READDIR and READDIRPLUS replies
+ *
+ * Many clients listing the same directory get the very same reply, which
+ * costs a walk of the directory and the XDR encoding of every entry each
+ * time.  Encoded entries are kept here, keyed by the directory handle and
+ * the request parameters, and are handed to the transport by reference.
+ *
+ * A cached reply is only served while the validator of the directory (see
+ * the readdir_validator FSAL method) is unchanged, and never longer than
+ * the attribute expiration time of the export.  Only replies that do not
+ * depend on the credentials of the caller beyond the permission checks of
+ * fsal_readdir() are inserted, the callers are responsible for that.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "gsh_list.h"
+#include "common_utils.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_readdir_cache.h"
+#include "city.h"
+#include "monitoring.h"
+
+/**
+ * @brief Number of partitions of the cache, should be prime.
+ */
+
+#define READDIR_CACHE_PARTITIONS 17
+
+/**
+ * @brief An encoded listing
+ */
+
+struct readdir_reply {
+	struct glist_head hash_node; /*< Node in the bucket list */
+	struct glist_head lru_node; /*< Node in the partition LRU */
+	struct readdir_cache_key key; /*< Request parameters */
+	uint64_t hash; /*< Hash of key and fh */
+	uint64_t change; /*< Directory validator */
+	uint64_t epoch; /*< Directory validator */
+	time_t expires; /*< Time after which the reply is stale, or 0 */
+	int32_t refcnt; /*< Cache plus replies in flight */
+	u_int len; /*< Length of body */
+	uint8_t *body; /*< Encoded entries */
+	size_t fh_len; /*< Length of fh */
+	char fh[]; /*< Handle key of the directory */
+};
+
+/**
+ * @brief A partition of the cache
+ */
+
+struct readdir_cache_partition {
+	pthread_mutex_t lock; /*< Protects the lists and count */
+	struct glist_head lru; /*< Most recently used first */
+	struct glist_head *buckets; /*< Hash buckets */
+	uint32_t count; /*< Number of cached replies */
+};
+
+static struct readdir_cache_partition *readdir_cache;
+static uint32_t readdir_cache_buckets;
+static uint32_t readdir_cache_max;
+
+static counter_metric_handle_t readdir_cache_hits;
+static counter_metric_handle_t readdir_cache_misses;
+
+static inline struct readdir_cache_partition *
+readdir_cache_partition(uint64_t hash)
+{
+	return &readdir_cache[hash % READDIR_CACHE_PARTITIONS];
+}
+
+static inline struct glist_head *
+readdir_cache_bucket(struct readdir_cache_partition *part, uint64_t hash)
+{
+	return &part->buckets[(hash / READDIR_CACHE_PARTITIONS) %
+			      readdir_cache_buckets];
+}
+
+/**
+ * @brief Drop a reference on a reply
+ *
+ * @param[in] reply The reply
+ */
+
+void readdir_reply_put(struct readdir_reply *reply)
+{
+	if (atomic_dec_int32_t(&reply->refcnt) != 0)
+		return;
+
+	gsh_free(reply->body);
+	gsh_free(reply);
+}
+
+/**
+ * @brief Get the length of the encoded entries of a reply
+ *
+ * @param[in] reply The reply
+ *
+ * @return The length of the body.
+ */
+
+u_int readdir_reply_length(const struct readdir_reply *reply)
+{
+	return reply->len;
+}
+
+/**
+ * @brief Remove a reply from its partition
+ *
+ * @note The caller must hold the partition lock.
+ */
+
+static void readdir_cache_remove(struct readdir_cache_partition *part,
+				 struct readdir_reply *reply)
+{
+	glist_del(&reply->hash_node);
+	glist_del(&reply->lru_node);
+	part->count--;
+	readdir_reply_put(reply);
+}
+
+static struct readdir_reply *
+readdir_cache_lookup(struct readdir_cache_partition *part,
+		     const struct readdir_cache_ctx *ctx)
+{
+	struct glist_head *glist;
+	struct readdir_reply *reply;
+
+	glist_for_each(glist, readdir_cache_bucket(part, ctx->hash)) {
+		reply = glist_entry(glist, struct readdir_reply, hash_node);
+
+		if (reply->hash == ctx->hash && reply->fh_len == ctx->fh.len &&
+		    memcmp(&reply->key, &ctx->key, sizeof(reply->key)) == 0 &&
+		    memcmp(reply->fh, ctx->fh.addr, ctx->fh.len) == 0)
+			return reply;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Check the caller may list the directory and see attributes
+ *
+ * Cached replies only hold entries with attributes, so the caller must pass
+ * both permission checks done by fsal_readdir().
+ */
+
+static bool readdir_cache_access(struct fsal_obj_handle *dir)
+{
+	fsal_accessflags_t access_mask =
+		(FSAL_MODE_MASK_SET(FSAL_R_OK) | FSAL_MODE_MASK_SET(FSAL_X_OK) |
+		 FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR) |
+		 FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_EXECUTE));
+
+	return !FSAL_IS_ERROR(fsal_access(dir, access_mask));
+}
+
+/**
+ * @brief Look up an encoded listing
+ *
+ * The caller fills in ctx->key.  If no usable reply is cached, ctx is left
+ * ready for readdir_cache_put(), which may only be called if
+ * ctx->cacheable is set.
+ *
+ * @param[in]     dir The directory, a reference must be held
+ * @param[in,out] ctx Lookup state
+ *
+ * @return A referenced reply, or NULL.
+ */
+
+struct readdir_reply *readdir_cache_get(struct fsal_obj_handle *dir,
+					struct readdir_cache_ctx *ctx)
+{
+	struct readdir_cache_partition *part;
+	struct readdir_reply *reply;
+	time_t now = time(NULL);
+
+	ctx->cacheable = false;
+
+	if (readdir_cache == NULL ||
+	    op_ctx->export_perms.expire_time_attr == 0 ||
+	    !dir->obj_ops->readdir_validator(dir, &ctx->change, &ctx->epoch))
+		return NULL;
+
+	dir->obj_ops->handle_to_key(dir, &ctx->fh);
+
+	ctx->hash = CityHash64WithSeed(
+		ctx->fh.addr, ctx->fh.len,
+		CityHash64((char *)&ctx->key, sizeof(ctx->key)));
+	ctx->cacheable = true;
+
+	part = readdir_cache_partition(ctx->hash);
+
+	PTHREAD_MUTEX_lock(&part->lock);
+
+	reply = readdir_cache_lookup(part, ctx);
+
+	if (reply != NULL &&
+	    (reply->change != ctx->change || reply->epoch != ctx->epoch ||
+	     (reply->expires != 0 && now > reply->expires))) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Dropping stale reply for cookie %" PRIu64,
+			     ctx->key.cookie);
+		readdir_cache_remove(part, reply);
+		reply = NULL;
+	}
+
+	if (reply != NULL) {
+		atomic_inc_int32_t(&reply->refcnt);
+		glist_del(&reply->lru_node);
+		glist_add(&part->lru, &reply->lru_node);
+	}
+
+	PTHREAD_MUTEX_unlock(&part->lock);
+
+	if (reply != NULL && !readdir_cache_access(dir)) {
+		/* Let fsal_readdir() build the reply for this caller */
+		readdir_reply_put(reply);
+		reply = NULL;
+	}
+
+	if (reply == NULL) {
+		monitoring__counter_inc(readdir_cache_misses, 1);
+		return NULL;
+	}
+
+	monitoring__counter_inc(readdir_cache_hits, 1);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Serving cached reply for cookie %" PRIu64 " len %u",
+		     ctx->key.cookie, reply->len);
+
+	return reply;
+}
+
+/**
+ * @brief Insert an encoded listing
+ *
+ * @param[in] ctx  Lookup state from readdir_cache_get()
+ * @param[in] body Encoded entries, ownership is taken
+ * @param[in] len  Length of body
+ *
+ * @return The reply, referenced for the caller.
+ */
+
+struct readdir_reply *readdir_cache_put(struct readdir_cache_ctx *ctx,
+					uint8_t *body, u_int len)
+{
+	struct readdir_cache_partition *part;
+	struct readdir_reply *reply, *old;
+	int32_t expire = op_ctx->export_perms.expire_time_attr;
+
+	reply = gsh_malloc(sizeof(struct readdir_reply) + ctx->fh.len);
+	reply->key = ctx->key;
+	reply->hash = ctx->hash;
+	reply->change = ctx->change;
+	reply->epoch = ctx->epoch;
+	reply->expires = expire > 0 ? time(NULL) + expire : 0;
+	reply->refcnt = 2;
+	reply->len = len;
+	reply->body = body;
+	reply->fh_len = ctx->fh.len;
+	memcpy(reply->fh, ctx->fh.addr, ctx->fh.len);
+
+	part = readdir_cache_partition(ctx->hash);
+
+	PTHREAD_MUTEX_lock(&part->lock);
+
+	old = readdir_cache_lookup(part, ctx);
+
+	if (old != NULL)
+		readdir_cache_remove(part, old);
+
+	glist_add(readdir_cache_bucket(part, ctx->hash), &reply->hash_node);
+	glist_add(&part->lru, &reply->lru_node);
+	part->count++;
+
+	while (part->count > readdir_cache_max) {
+		old = glist_last_entry(&part->lru, struct readdir_reply,
+				       lru_node);
+		readdir_cache_remove(part, old);
+	}
+
+	PTHREAD_MUTEX_unlock(&part->lock);
+
+	return reply;
+}
+
+static void readdir_reply_uio_release(struct xdr_uio *uio, u_int flags)
+{
+	struct readdir_reply *reply = uio->uio_u2;
+	int ix;
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Releasing %p, references %" PRIi32 ", count %d", uio,
+		     uio->uio_references, (int)uio->uio_count);
+
+	if (!(--uio->uio_references)) {
+		for (ix = 0; ix < uio->uio_count; ix++) {
+			if (uio->uio_vio[ix].vio_base != reply->body)
+				gsh_free(uio->uio_vio[ix].vio_base);
+		}
+		readdir_reply_put(reply);
+		gsh_free(uio);
+	}
+}
+
+static void readdir_vio_fill(struct xdr_vio *vio, uint8_t *base, u_int len)
+{
+	vio->vio_base = base;
+	vio->vio_head = base;
+	vio->vio_tail = base + len;
+	vio->vio_wrap = base + len;
+	vio->vio_length = len;
+	vio->vio_type = VIO_DATA;
+}
+
+/**
+ * @brief Hand a reply over to the transport
+ *
+ * @param[in] reply    The reply, the reference of the caller is consumed
+ * @param[in] head     Optional entries to send before the cached ones,
+ *                     ownership is taken
+ * @param[in] head_len Length of head
+ *
+ * @return An xdr_uio to be used as the dirlist of the reply.
+ */
+
+struct xdr_uio *readdir_reply_uio(struct readdir_reply *reply, uint8_t *head,
+				  u_int head_len)
+{
+	u_int count = head != NULL ? 2 : 1;
+	struct xdr_uio *uio;
+
+	uio = gsh_calloc(1, sizeof(struct xdr_uio) +
+				    count * sizeof(struct xdr_vio));
+	uio->uio_release = readdir_reply_uio_release;
+	uio->uio_u2 = reply;
+	uio->uio_count = count;
+
+	if (head != NULL)
+		readdir_vio_fill(&uio->uio_vio[0], head, head_len);
+
+	readdir_vio_fill(&uio->uio_vio[count - 1], reply->body, reply->len);
+
+	return uio;
+}
+
+static void readdir_cache_cleanup(void)
+{
+	struct readdir_cache_partition *part;
+	struct readdir_reply *reply;
+	int i;
+
+	if (readdir_cache == NULL)
+		return;
+
+	for (i = 0; i < READDIR_CACHE_PARTITIONS; i++) {
+		part = &readdir_cache[i];
+
+		PTHREAD_MUTEX_lock(&part->lock);
+		while ((reply = glist_first_entry(&part->lru,
+						  struct readdir_reply,
+						  lru_node)) != NULL)
+			readdir_cache_remove(part, reply);
+		PTHREAD_MUTEX_unlock(&part->lock);
+	}
+}
+
+static struct cleanup_list_element readdir_cache_cleanup_element = {
+	.clean = readdir_cache_cleanup,
+};
+
+/**
+ * @brief Initialize the encoded READDIR reply cache
+ */
+
+void readdir_cache_init(void)
+{
+	uint32_t size = nfs_param.core_param.readdir_cache_size;
+	const metric_label_t hit[] = { METRIC_LABEL("result", "hit") };
+	const metric_label_t miss[] = { METRIC_LABEL("result", "miss") };
+	uint32_t i, j;
+
+	if (size == 0) {
+		LogInfo(COMPONENT_NFS_READDIR, "READDIR reply cache disabled");
+		return;
+	}
+
+	readdir_cache_max = size / READDIR_CACHE_PARTITIONS + 1;
+	readdir_cache_buckets = readdir_cache_max;
+	readdir_cache = gsh_calloc(READDIR_CACHE_PARTITIONS,
+				   sizeof(struct readdir_cache_partition));
+
+	for (i = 0; i < READDIR_CACHE_PARTITIONS; i++) {
+		struct readdir_cache_partition *part = &readdir_cache[i];
+
+		PTHREAD_MUTEX_init(&part->lock, NULL);
+		glist_init(&part->lru);
+		part->buckets = gsh_malloc(readdir_cache_buckets *
+					   sizeof(struct glist_head));
+		for (j = 0; j < readdir_cache_buckets; j++)
+			glist_init(&part->buckets[j]);
+	}
+
+	readdir_cache_hits = monitoring__register_counter(
+		"nfs__readdir_cache_total",
+		METRIC_METADATA("READDIR reply cache lookups",
+				METRIC_UNIT_NONE),
+		hit, ARRAY_SIZE(hit));
+	readdir_cache_misses = monitoring__register_counter(
+		"nfs__readdir_cache_total",
+		METRIC_METADATA("READDIR reply cache lookups",
+				METRIC_UNIT_NONE),
+		miss, ARRAY_SIZE(miss));
+
+	RegisterCleanup(&readdir_cache_cleanup_element);
+
+	LogInfo(COMPONENT_NFS_READDIR,
+		"READDIR reply cache of %" PRIu32 " replies initialized", size);
+}
@@ -785,6 +785,8 @@ const char *recovery_backend_str(enum recovery_backend recovery_backend)
 		return "rados_ng";
 	case RECOVERY_BACKEND_RADOS_CLUSTER:
 		return "rados_cluster";
+	case RECOVERY_BACKEND_FS_JOURNAL:
+		return "fs_journal";
 	}
 
 	return "Unknown recovery backend";
@@ -809,6 +811,9 @@ int nfs4_recovery_init(void)
 	case RECOVERY_BACKEND_FS_NG:
 		fs_ng_backend_init(&recovery_backend);
 		break;
+	case RECOVERY_BACKEND_FS_JOURNAL:
+		fs_journal_backend_init(&recovery_backend);
+		break;
 #ifdef USE_RADOS_RECOV
 	case RECOVERY_BACKEND_RADOS_KV:
 		rados.kv_init(&recovery_backend);
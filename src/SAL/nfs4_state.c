@@ -158,7 +158,9 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 
 	mutex_init = true;
 
-	/* Add the stateid.other, this will increment cid_stateid_counter */
+	/* Add the stateid.other, this will reserve a slot of the stateid
+	 * table, or increment cid_stateid_counter if it is full.
+	 */
 	nfs4_BuildStateId_Other(clientid, pnew_state->stateid_other);
 
 	/* Set the type and data for this state */
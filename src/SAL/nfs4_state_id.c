@@ -62,6 +62,7 @@
 #include "sal_functions.h"
 #include "nfs_proto_tools.h"
 #include "city.h"
+#include <urcu-bp.h>
 
 /**
  * @brief Hash table for stateids.
@@ -78,6 +79,77 @@ char all_zero[OTHERSIZE];
  * @brief All-zeroes stateid4.other
  */
 char all_ones[OTHERSIZE];
+
+/**
+ * @brief Stateids resolved through the slot table
+ *
+ * The 32 bits that follow the clientid in the other of a stateid either
+ * hold a counter of the client, for states that are kept in ht_state_id,
+ * or, with STATEID_SLOT_FLAG set, the index of a slot of the table that
+ * points to the state along with the generation of the slot.  The table
+ * is made of chunks that are allocated as needed and never freed, so
+ * that a stateid is resolved with an array lookup under rcu_read_lock()
+ * and without any lock.  The generation of a slot is bumped each time
+ * the slot is released, and freed slots are reused in the order they
+ * were released, so that a stale stateid does not match a later state.
+ * A slot is retired rather than reused once its generation would wrap,
+ * since a stateid of its first generation could then match again; with
+ * 2^19 slots of 2^12 generations that is after 2^31 states.  States that
+ * have been in a slot are freed after a grace period.
+ *
+ * Once all the slots are in use or retired, states fall back to
+ * ht_state_id.
+ */
+
+#define STATEID_SLOT_FLAG 0x80000000
+#define STATEID_SLOT_BITS 19
+#define STATEID_SLOT_MASK ((1U << STATEID_SLOT_BITS) - 1)
+#define STATEID_GEN_MASK (~STATEID_SLOT_FLAG >> STATEID_SLOT_BITS)
+#define STATEID_CHUNK_BITS 12
+#define STATEID_CHUNK_SLOTS (1U << STATEID_CHUNK_BITS)
+#define STATEID_CHUNKS (1U << (STATEID_SLOT_BITS - STATEID_CHUNK_BITS))
+#define STATEID_NO_SLOT UINT32_MAX
+
+struct stateid_slot {
+	struct state_t *state; /*< The state, RCU protected */
+	uint32_t gen; /*< Generation of the slot */
+	uint32_t next_free; /*< Next free slot, STATEID_NO_SLOT if last */
+};
+
+/**
+ * @brief A state waiting for a grace period to be freed
+ */
+
+struct stateid_rcu_free {
+	struct rcu_head rcu_head;
+	struct state_t *state;
+};
+
+static struct stateid_slot *stateid_chunks[STATEID_CHUNKS];
+static uint32_t stateid_nchunks;
+static uint32_t stateid_free_head = STATEID_NO_SLOT;
+static uint32_t stateid_free_tail = STATEID_NO_SLOT;
+static uint32_t stateid_retired;
+static pthread_mutex_t stateid_slot_mutex;
+
+static inline uint32_t stateid_other_word(const char *other)
+{
+	uint32_t word;
+
+	memcpy(&word, other + sizeof(clientid4), sizeof(word));
+	return word;
+}
+
+static inline bool stateid_other_in_slot(const char *other)
+{
+	return (stateid_other_word(other) & STATEID_SLOT_FLAG) != 0;
+}
+
+static inline struct stateid_slot *stateid_slot_of(uint32_t index)
+{
+	return &stateid_chunks[index >> STATEID_CHUNK_BITS]
+			      [index & (STATEID_CHUNK_SLOTS - 1)];
+}
 #define seqid_all_one 0xFFFFFFFF
 
 /**
@@ -91,7 +163,7 @@ char all_ones[OTHERSIZE];
 int display_stateid_other(struct display_buffer *dspbuf, char *other)
 {
 	uint64_t clientid = *((uint64_t *)other);
-	uint32_t count = *((uint32_t *)(other + sizeof(uint64_t)));
+	uint32_t count = stateid_other_word(other);
 	int b_left = display_cat(dspbuf, "OTHER=");
 
 	if (b_left <= 0)
@@ -112,6 +184,14 @@ int display_stateid_other(struct display_buffer *dspbuf, char *other)
 	if (b_left <= 0)
 		return b_left;
 
+	if (count & STATEID_SLOT_FLAG)
+		return display_printf(dspbuf,
+				      "} StateIdSlot=%" PRIu32 " Gen=%" PRIu32
+				      "}",
+				      count & STATEID_SLOT_MASK,
+				      (count >> STATEID_SLOT_BITS) &
+					      STATEID_GEN_MASK);
+
 	return display_printf(dspbuf, "} StateIdCounter=0x%08" PRIx32 "}",
 			      count);
 }
@@ -454,20 +534,132 @@ int nfs4_Init_state_id(void)
 		return -1;
 	}
 
+	PTHREAD_MUTEX_init(&stateid_slot_mutex, NULL);
+
 	return 0;
 }
 
+/**
+ * @brief Reserve a slot of the stateid table
+ *
+ * A chunk of slots is added to the table when none is free.
+ *
+ * @return The slot index and generation to put in a stateid other, or 0
+ *	   if the table is full.
+ */
+static uint32_t stateid_slot_reserve(void)
+{
+	struct stateid_slot *chunk, *slot;
+	uint32_t index, i;
+
+	PTHREAD_MUTEX_lock(&stateid_slot_mutex);
+
+	if (stateid_free_head == STATEID_NO_SLOT) {
+		if (stateid_nchunks == STATEID_CHUNKS) {
+			PTHREAD_MUTEX_unlock(&stateid_slot_mutex);
+			return 0;
+		}
+
+		chunk = gsh_calloc(STATEID_CHUNK_SLOTS, sizeof(*chunk));
+		index = stateid_nchunks << STATEID_CHUNK_BITS;
+
+		for (i = 0; i < STATEID_CHUNK_SLOTS - 1; i++)
+			chunk[i].next_free = index + i + 1;
+
+		chunk[i].next_free = STATEID_NO_SLOT;
+
+		rcu_assign_pointer(stateid_chunks[stateid_nchunks], chunk);
+		stateid_nchunks++;
+
+		stateid_free_head = index;
+		stateid_free_tail = index + i;
+	}
+
+	index = stateid_free_head;
+	slot = stateid_slot_of(index);
+
+	stateid_free_head = slot->next_free;
+	if (stateid_free_head == STATEID_NO_SLOT)
+		stateid_free_tail = STATEID_NO_SLOT;
+
+	slot->next_free = STATEID_NO_SLOT;
+
+	PTHREAD_MUTEX_unlock(&stateid_slot_mutex);
+
+	return STATEID_SLOT_FLAG | (slot->gen << STATEID_SLOT_BITS) | index;
+}
+
+/**
+ * @brief Release the slot of a stateid other
+ *
+ * @param[in] other The other of the stateid
+ * @param[in] state The state expected in the slot, NULL if the state was
+ *		    never put in it.
+ *
+ * @retval true if the slot was released.
+ * @retval false if the slot does not hold the state.
+ */
+static bool stateid_slot_release(const char *other, struct state_t *state)
+{
+	uint32_t word = stateid_other_word(other);
+	uint32_t index = word & STATEID_SLOT_MASK;
+	struct stateid_slot *slot;
+
+	PTHREAD_MUTEX_lock(&stateid_slot_mutex);
+
+	slot = stateid_slot_of(index);
+
+	if (slot->state != state ||
+	    slot->gen != ((word >> STATEID_SLOT_BITS) & STATEID_GEN_MASK)) {
+		PTHREAD_MUTEX_unlock(&stateid_slot_mutex);
+		return false;
+	}
+
+	rcu_assign_pointer(slot->state, NULL);
+	atomic_store_uint32_t(&slot->gen,
+			      (slot->gen + 1) & STATEID_GEN_MASK);
+
+	if (slot->gen == 0) {
+		/* All the generations of the slot were used, keep it empty
+		 * so that none of its stateids matches again.
+		 */
+		if (stateid_retired++ == 0)
+			LogInfo(COMPONENT_STATE,
+				"Retiring stateid slots that used all their generations");
+
+		PTHREAD_MUTEX_unlock(&stateid_slot_mutex);
+		return true;
+	}
+
+	if (stateid_free_tail == STATEID_NO_SLOT)
+		stateid_free_head = index;
+	else
+		stateid_slot_of(stateid_free_tail)->next_free = index;
+
+	stateid_free_tail = index;
+
+	PTHREAD_MUTEX_unlock(&stateid_slot_mutex);
+
+	return true;
+}
+
 /**
  * @brief Build the 12 byte "other" portion of a stateid
  *
- * It is built from the ServerEpoch and a 64 bit global counter.
+ * It is built from the clientid and a slot of the stateid table, or a
+ * counter of the client if the table is full.  The slot must then be
+ * filled by nfs4_State_Set().
  *
  * @param[in] other stateid.other object (a char[OTHERSIZE] string)
  */
 void nfs4_BuildStateId_Other(nfs_client_id_t *clientid, char *other)
 {
-	uint32_t my_stateid =
-		atomic_inc_uint32_t(&clientid->cid_stateid_counter);
+	uint32_t my_stateid = stateid_slot_reserve();
+
+	if (my_stateid == 0)
+		my_stateid = atomic_inc_uint32_t(
+				     &clientid->cid_stateid_counter) &
+			     ~STATEID_SLOT_FLAG;
 
 	/* The first part of the other is the 64 bit clientid, which
 	 * consists of the epoch in the high order 32 bits followed by
@@ -479,6 +671,15 @@ void nfs4_BuildStateId_Other(nfs_client_id_t *clientid, char *other)
 	       sizeof(my_stateid));
 }
 
+static void stateid_free_deferred(struct rcu_head *head)
+{
+	struct stateid_rcu_free *deferred =
+		container_of(head, struct stateid_rcu_free, rcu_head);
+
+	free_state(deferred->state);
+	gsh_free(deferred);
+}
+
 /**
  * @brief Relinquish a reference on a state_t
  *
@@ -511,7 +712,18 @@ void dec_nfs4_state_ref(struct state_t *state)
 
 	PTHREAD_MUTEX_destroy(&state->state_mutex);
 
-	free_state(state);
+	if (stateid_other_in_slot(state->stateid_other)) {
+		/* A lookup may still be looking at the state it found in
+		 * the slot, free it after a grace period.
+		 */
+		struct stateid_rcu_free *deferred =
+			gsh_malloc(sizeof(*deferred));
+
+		deferred->state = state;
+		call_rcu(&deferred->rcu_head, stateid_free_deferred);
+	} else {
+		free_state(state);
+	}
 
 	if (str_valid)
 		LogFullDebug(COMPONENT_STATE, "Deleted %s", str);
@@ -531,6 +743,8 @@ state_status_t nfs4_State_Set(state_t *state)
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
 	hash_error_t err;
+	bool in_slot = stateid_other_in_slot(state->stateid_other);
+	struct stateid_slot *slot;
 
 	buffkey.addr = state->stateid_other;
 	buffkey.len = OTHERSIZE;
@@ -538,23 +752,26 @@ state_status_t nfs4_State_Set(state_t *state)
 	buffval.addr = state;
 	buffval.len = sizeof(state_t);
 
-	err = hashtable_test_and_set(ht_state_id, &buffkey, &buffval,
-				     HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
-
-	switch (err) {
-	case HASHTABLE_SUCCESS:
-		break;
-	default:
-		LogCrit(COMPONENT_STATE,
-			"ht_state_id hashtable_test_and_set failed %s for key %p",
-			hash_table_err_to_str(err), buffkey.addr);
-		return STATE_ENTRY_EXISTS; /* likely reason */
+	if (!in_slot) {
+		err = hashtable_test_and_set(
+			ht_state_id, &buffkey, &buffval,
+			HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+
+		switch (err) {
+		case HASHTABLE_SUCCESS:
+			break;
+		default:
+			LogCrit(COMPONENT_STATE,
+				"ht_state_id hashtable_test_and_set failed %s for key %p",
+				hash_table_err_to_str(err), buffkey.addr);
+			return STATE_ENTRY_EXISTS; /* likely reason */
+		}
 	}
 
 	/* If stateid is a LOCK or SHARE state, we also index by entry/owner */
 	if (state->state_type != STATE_TYPE_LOCK &&
 	    state->state_type != STATE_TYPE_SHARE)
-		return STATE_SUCCESS;
+		goto publish;
 
 	buffkey.addr = state;
 	buffkey.len = sizeof(state_t);
@@ -567,7 +784,7 @@ state_status_t nfs4_State_Set(state_t *state)
 
 	switch (err) {
 	case HASHTABLE_SUCCESS:
-		return STATE_SUCCESS;
+		break;
 
 	case HASHTABLE_ERROR_KEY_ALREADY_EXISTS: /* buggy client? */
 	default: /* error case */
@@ -594,6 +811,11 @@ state_status_t nfs4_State_Set(state_t *state)
 			}
 		}
 
+		if (in_slot) {
+			(void)stateid_slot_release(state->stateid_other, NULL);
+			return STATE_ENTRY_EXISTS; /* likely reason */
+		}
+
 		buffkey.addr = state->stateid_other;
 		buffkey.len = OTHERSIZE;
 		err = HashTable_Del(ht_state_id, &buffkey, NULL, NULL);
@@ -604,6 +826,70 @@ state_status_t nfs4_State_Set(state_t *state)
 		}
 		return STATE_ENTRY_EXISTS; /* likely reason */
 	}
+
+publish:
+	/* The state is only made visible in its slot once it can't fail,
+	 * the failure paths free it right away.
+	 */
+	if (in_slot) {
+		slot = stateid_slot_of(stateid_other_word(state->stateid_other) &
+				       STATEID_SLOT_MASK);
+		rcu_assign_pointer(slot->state, state);
+	}
+
+	return STATE_SUCCESS;
+}
+
+/**
+ * @brief Get the state of a stateid from its slot
+ *
+ * @param[in] other stateid4.other
+ *
+ * @returns The found state_t or NULL if not found.
+ */
+static struct state_t *stateid_slot_get(const char *other)
+{
+	uint32_t word = stateid_other_word(other);
+	uint32_t index = word & STATEID_SLOT_MASK;
+	struct stateid_slot *chunk;
+	struct state_t *state = NULL;
+	int32_t refcount = 0;
+
+	rcu_read_lock();
+
+	chunk = rcu_dereference(stateid_chunks[index >> STATEID_CHUNK_BITS]);
+	if (chunk == NULL)
+		goto out;
+
+	chunk += index & (STATEID_CHUNK_SLOTS - 1);
+
+	if (atomic_fetch_uint32_t(&chunk->gen) !=
+	    ((word >> STATEID_SLOT_BITS) & STATEID_GEN_MASK))
+		goto out;
+
+	state = rcu_dereference(chunk->state);
+
+	/* The slot may have been reused since the generation was checked,
+	 * and the state may be on its way to be freed.
+	 */
+	if (state != NULL &&
+	    (memcmp(state->stateid_other, other, OTHERSIZE) != 0 ||
+	     (refcount = atomic_inc_unless_0_int32_t(&state->state_refcount)) ==
+		     0))
+		state = NULL;
+
+out:
+	rcu_read_unlock();
+
+	if (state != NULL)
+		LogFullDebug(COMPONENT_STATE,
+			     "State %p state_refcount now %" PRIi32, state,
+			     refcount);
+	else
+		LogDebug(COMPONENT_STATE, "No state in stateid slot %" PRIu32,
+			 index);
+
+	return state;
 }
 
 /**
@@ -621,6 +907,9 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	struct hash_latch latch;
 	struct state_t *state;
 
+	if (stateid_other_in_slot(other))
+		return stateid_slot_get(other);
+
 	buffkey.addr = other;
 	buffkey.len = OTHERSIZE;
 
@@ -721,6 +1010,17 @@ bool nfs4_State_Del(state_t *state)
 	buffkey.addr = state->stateid_other;
 	buffkey.len = OTHERSIZE;
 
+	if (stateid_other_in_slot(state->stateid_other)) {
+		if (!stateid_slot_release(state->stateid_other, state)) {
+			/* Already gone */
+			return false;
+		}
+
+		old_value.addr = state;
+		old_value.len = sizeof(state_t);
+		goto del_obj;
+	}
+
 	err = HashTable_Del(ht_state_id, &buffkey, &old_key, &old_value);
 
 	if (err == HASHTABLE_ERROR_NO_SUCH_KEY) {
@@ -739,6 +1039,7 @@ bool nfs4_State_Del(state_t *state)
 
 	assert(state == old_value.addr);
 
+del_obj:
 	/* If stateid is a LOCK or SHARE state, we had also indexed by
 	 * entry/owner
 	 */
@@ -97,7 +97,7 @@ static int fs_convert_opaque_value_max_for_dir(struct display_buffer *dspbuf,
  *
  * @param[in] clientid Client record
  */
-static void fs_create_clid_name(nfs_client_id_t *clientid)
+void fs_create_clid_name(nfs_client_id_t *clientid)
 {
 	nfs_client_record_t *cl_rec = clientid->cid_client_record;
 	const char *str_client_addr = "(unknown)";
@@ -26,6 +26,7 @@
 extern char v4_recov_dir[PATH_MAX];
 extern unsigned int v4_recov_dir_len;
 
+void fs_create_clid_name(nfs_client_id_t *clientid);
 void fs_add_clid(nfs_client_id_t *clientid);
 void fs_rm_clid(nfs_client_id_t *clientid);
 void fs_add_revoke_fh(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle);
@@ -0,0 +1,1058 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/**
+ * @file recovery_fs_journal.c
+ * @brief Journaled filesystem recovery backend
+ *
+ * The fs and fs_ng backends store each client as a directory hierarchy,
+ * so every EXCHANGE_ID and every expiry costs synchronous mkdir/rmdir
+ * calls.  This backend instead appends client and revoked handle records
+ * to a log, and many concurrent callers share a single fdatasync (group
+ * commit).
+ *
+ * The recovery database of a node is made of two files in the recovery
+ * directory, named after the node:
+ *
+ * - <node>.snap holds the clients (and their revoked handles) as of some
+ *   generation.
+ * - <node>.log holds the records appended since that snapshot.  It is only
+ *   replayed if its header carries the generation of the snapshot.
+ *
+ * As with fs_ng, the clients of a new epoch are logged to <node>.next until
+ * the grace period ends, so that a restart during grace still sees the
+ * clients of the previous epoch.  At the end of grace, and whenever the log
+ * grows large compared to the number of clients, the clients are compacted
+ * into a new snapshot with the next generation, then a new empty log is
+ * started.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include "bsd-base64.h"
+#include "gsh_list.h"
+#include "abstract_mem.h"
+#include "city.h"
+#include "recovery_fs.h"
+
+#define JOURNAL_MAGIC 0x4a4e5352 /* "RSNJ" */
+#define JOURNAL_VERSION 1
+
+/**
+ * @brief Number of buckets of the client table, should be prime.
+ */
+#define JOURNAL_BUCKETS 4099
+
+/**
+ * @brief Compact once the log holds that many more records than twice
+ *        the number of clients.
+ */
+#define JOURNAL_COMPACT_SLACK 4096
+
+/**
+ * @brief Largest record payload, a client tag and an encoded handle are
+ *        both well under PATH_MAX.
+ */
+#define JOURNAL_MAX_RECORD (2 * PATH_MAX)
+
+enum journal_rec_type {
+	JOURNAL_ADD_CLID = 1,
+	JOURNAL_RM_CLID = 2,
+	JOURNAL_REVOKE_FH = 3,
+};
+
+/**
+ * @brief Header of the snapshot and log files
+ */
+struct journal_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t generation; /*< Generation of the snapshot */
+};
+
+/**
+ * @brief Header of a record, followed by the client tag and, for revoked
+ *        handles, the encoded handle
+ */
+struct journal_rec {
+	uint64_t checksum; /*< Hash of the rest of the header and payload */
+	uint32_t len; /*< Length of the payload */
+	uint16_t type; /*< enum journal_rec_type */
+	uint16_t tag_len; /*< Length of the client tag */
+};
+
+/**
+ * @brief A client, as replayed from the journal
+ */
+struct journal_client {
+	struct glist_head node; /*< Node in the bucket list */
+	struct glist_head revoked; /*< Revoked handles */
+	size_t tag_len; /*< Length of tag */
+	char tag[]; /*< Client tag, NUL terminated */
+};
+
+/**
+ * @brief A revoked handle of a client
+ */
+struct journal_revoked {
+	struct glist_head node; /*< Node in the client list */
+	char fh[]; /*< Encoded handle, NUL terminated */
+};
+
+/**
+ * @brief Set of clients
+ */
+struct journal_table {
+	struct glist_head buckets[JOURNAL_BUCKETS];
+	uint32_t count; /*< Number of clients */
+};
+
+/**
+ * @brief Growable buffer of encoded records
+ */
+struct journal_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * @brief State of the journal
+ *
+ * Records are encoded into pending under lock, and applied to clients.
+ * One of the callers waiting for its record to be durable becomes the
+ * flusher: it swaps the buffers, writes and syncs them without the lock,
+ * then wakes everybody up.
+ *
+ * Compaction also writes without the lock.  Records appended while it
+ * runs are encoded into carry as well, to be copied to the new log.
+ */
+static struct {
+	pthread_mutex_t lock; /*< Protects everything below */
+	pthread_cond_t cond; /*< Signalled when a flush completes */
+	struct journal_table clients; /*< Clients of the current epoch */
+	struct journal_buf pending; /*< Records not written yet */
+	struct journal_buf flushing; /*< Records being written */
+	struct journal_buf carry; /*< Records appended while compacting */
+	uint64_t appended; /*< Sequence of the last record appended */
+	uint64_t durable; /*< Sequence of the last record synced */
+	uint64_t failed; /*< Sequence of the last record that failed */
+	bool in_flush; /*< A flusher is writing */
+	bool compacting; /*< A compaction is writing */
+	bool committed; /*< fd is the log of the latest snapshot */
+	int fd; /*< File records are appended to, -1 if none */
+	uint64_t generation; /*< Generation of the latest snapshot */
+	uint32_t records; /*< Records appended since the latest snapshot */
+} journal;
+
+static char journal_base[PATH_MAX]; /*< <root>/<dir>/<node> */
+
+static inline struct glist_head *journal_bucket(struct journal_table *table,
+						const char *tag, size_t len)
+{
+	return &table->buckets[CityHash64(tag, len) % JOURNAL_BUCKETS];
+}
+
+static void journal_table_init(struct journal_table *table)
+{
+	int i;
+
+	for (i = 0; i < JOURNAL_BUCKETS; i++)
+		glist_init(&table->buckets[i]);
+
+	table->count = 0;
+}
+
+static struct journal_client *journal_lookup(struct journal_table *table,
+					     const char *tag, size_t len)
+{
+	struct glist_head *glist;
+	struct journal_client *client;
+
+	glist_for_each(glist, journal_bucket(table, tag, len)) {
+		client = glist_entry(glist, struct journal_client, node);
+
+		if (client->tag_len == len && memcmp(client->tag, tag, len) == 0)
+			return client;
+	}
+
+	return NULL;
+}
+
+static void journal_client_free(struct journal_client *client)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &client->revoked) {
+		glist_del(glist);
+		gsh_free(glist_entry(glist, struct journal_revoked, node));
+	}
+
+	gsh_free(client);
+}
+
+static void journal_table_clear(struct journal_table *table)
+{
+	struct glist_head *glist, *glistn;
+	int i;
+
+	for (i = 0; i < JOURNAL_BUCKETS; i++) {
+		glist_for_each_safe(glist, glistn, &table->buckets[i]) {
+			glist_del(glist);
+			journal_client_free(
+				glist_entry(glist, struct journal_client, node));
+		}
+	}
+
+	table->count = 0;
+}
+
+/**
+ * @brief Apply a record to a set of clients
+ */
+static void journal_apply(struct journal_table *table, uint16_t type,
+			  const char *tag, size_t tag_len, const char *fh,
+			  size_t fh_len)
+{
+	struct journal_client *client = journal_lookup(table, tag, tag_len);
+	struct journal_revoked *revoked;
+
+	switch (type) {
+	case JOURNAL_ADD_CLID:
+		if (client != NULL)
+			return;
+
+		client = gsh_malloc(sizeof(*client) + tag_len + 1);
+		glist_init(&client->revoked);
+		client->tag_len = tag_len;
+		memcpy(client->tag, tag, tag_len);
+		client->tag[tag_len] = '\0';
+		glist_add_tail(journal_bucket(table, tag, tag_len),
+			       &client->node);
+		table->count++;
+		return;
+
+	case JOURNAL_RM_CLID:
+		if (client == NULL)
+			return;
+
+		glist_del(&client->node);
+		journal_client_free(client);
+		table->count--;
+		return;
+
+	case JOURNAL_REVOKE_FH:
+		if (client == NULL)
+			return;
+
+		revoked = gsh_malloc(sizeof(*revoked) + fh_len + 1);
+		memcpy(revoked->fh, fh, fh_len);
+		revoked->fh[fh_len] = '\0';
+		glist_add_tail(&client->revoked, &revoked->node);
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Unknown journal record type %" PRIu16,
+		 type);
+}
+
+static void journal_buf_add(struct journal_buf *buf, const void *data,
+			    size_t len)
+{
+	if (buf->len + len > buf->size) {
+		if (buf->size == 0)
+			buf->size = 4096;
+		while (buf->len + len > buf->size)
+			buf->size *= 2;
+		buf->data = gsh_realloc(buf->data, buf->size);
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static uint64_t journal_checksum(const struct journal_rec *rec,
+				 const char *payload)
+{
+	uint64_t seed = ((uint64_t)rec->type << 48) |
+			((uint64_t)rec->tag_len << 32) | rec->len;
+
+	return CityHash64WithSeed(payload, rec->len, seed);
+}
+
+static void journal_encode(struct journal_buf *buf, uint16_t type,
+			   const char *tag, size_t tag_len, const char *fh,
+			   size_t fh_len)
+{
+	struct journal_rec rec = {
+		.len = tag_len + fh_len,
+		.type = type,
+		.tag_len = tag_len,
+	};
+	size_t start;
+
+	journal_buf_add(buf, &rec, sizeof(rec));
+	start = buf->len;
+	journal_buf_add(buf, tag, tag_len);
+	if (fh_len != 0)
+		journal_buf_add(buf, fh, fh_len);
+
+	/* Fill in the checksum now that the payload is contiguous */
+	rec.checksum = journal_checksum(&rec, buf->data + start);
+	memcpy(buf->data + start - sizeof(rec), &rec, sizeof(rec));
+}
+
+static int journal_write(int fd, const char *data, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, data, len);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+static void journal_sync_dir(void)
+{
+	char dir[PATH_MAX];
+	char *slash;
+	int fd;
+
+	(void)strlcpy(dir, journal_base, sizeof(dir));
+	slash = strrchr(dir, '/');
+	if (slash != NULL)
+		*slash = '\0';
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return;
+
+	if (fsync(fd) < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to sync recovery dir (%s): %s (%d)", dir,
+			 strerror(errno), errno);
+	close(fd);
+}
+
+static int journal_path(char *path, size_t size, const char *suffix)
+{
+	int rc = snprintf(path, size, "%s.%s", journal_base, suffix);
+
+	if (unlikely(rc >= size)) {
+		LogCrit(COMPONENT_CLIENTID, "Path too long %s.%s",
+			journal_base, suffix);
+		return -EINVAL;
+	} else if (unlikely(rc < 0)) {
+		int error = errno;
+
+		LogCrit(COMPONENT_CLIENTID,
+			"Unexpected return from snprintf %d error %s (%d)", rc,
+			strerror(error), error);
+		return -error;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Create a file holding a header and records, and sync it
+ *
+ * @return A file descriptor open for appending, or a negative error.
+ */
+static int journal_write_file(const char *suffix, uint64_t generation,
+			      const struct journal_buf *records)
+{
+	struct journal_header hdr = {
+		.magic = JOURNAL_MAGIC,
+		.version = JOURNAL_VERSION,
+		.generation = generation,
+	};
+	char path[PATH_MAX];
+	int fd, rc;
+
+	rc = journal_path(path, sizeof(path), suffix);
+	if (rc != 0)
+		return rc;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (fd < 0) {
+		rc = -errno;
+		LogEvent(COMPONENT_CLIENTID, "Failed to create %s: %s (%d)",
+			 path, strerror(-rc), -rc);
+		return rc;
+	}
+
+	rc = journal_write(fd, (const char *)&hdr, sizeof(hdr));
+
+	if (rc == 0 && records != NULL)
+		rc = journal_write(fd, records->data, records->len);
+
+	if (rc == 0 && fdatasync(fd) < 0)
+		rc = -errno;
+
+	if (rc != 0) {
+		LogEvent(COMPONENT_CLIENTID, "Failed to write %s: %s (%d)",
+			 path, strerror(-rc), -rc);
+		close(fd);
+		(void)unlink(path);
+		return rc;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Move a file written by journal_write_file() into place
+ *
+ * @return 0, or a negative error.
+ */
+static int journal_rename(const char *from, const char *to)
+{
+	char src[PATH_MAX], dst[PATH_MAX];
+	int rc;
+
+	rc = journal_path(src, sizeof(src), from);
+	if (rc == 0)
+		rc = journal_path(dst, sizeof(dst), to);
+	if (rc != 0)
+		return rc;
+
+	if (rename(src, dst) < 0) {
+		rc = -errno;
+		LogEvent(COMPONENT_CLIENTID, "Failed to rename %s: %s (%d)",
+			 src, strerror(-rc), -rc);
+		(void)unlink(src);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Create a file holding a header and records, and sync it
+ *
+ * The file is written under a temporary name and renamed into place.
+ *
+ * @return A file descriptor open for appending, or a negative error.
+ */
+static int journal_create(const char *suffix, uint64_t generation,
+			  const struct journal_buf *records)
+{
+	int fd = journal_write_file("tmp", generation, records);
+
+	if (fd < 0)
+		return fd;
+
+	if (journal_rename("tmp", suffix) != 0) {
+		close(fd);
+		return -EIO;
+	}
+
+	journal_sync_dir();
+
+	return fd;
+}
+
+/**
+ * @brief Replay a snapshot or log file into a set of clients
+ *
+ * Replay stops at the first torn or corrupted record.
+ *
+ * @param[in]     suffix     File to replay
+ * @param[in,out] generation Generation to expect, or 0 to accept any and
+ *                           return the one found
+ * @param[in]     table      Set of clients to update
+ *
+ * @return 0, or a negative error if the file could not be used.
+ */
+static int journal_replay(const char *suffix, uint64_t *generation,
+			  struct journal_table *table)
+{
+	struct journal_header hdr;
+	struct journal_rec rec;
+	struct stat st;
+	char path[PATH_MAX];
+	char *payload = NULL;
+	off_t left;
+	FILE *fp;
+	int rc;
+
+	rc = journal_path(path, sizeof(path), suffix);
+	if (rc != 0)
+		return rc;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -errno;
+
+	if (fstat(fileno(fp), &st) < 0) {
+		rc = -errno;
+		goto out;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != JOURNAL_MAGIC || hdr.version != JOURNAL_VERSION) {
+		LogEvent(COMPONENT_CLIENTID, "Invalid recovery journal %s",
+			 path);
+		rc = -EINVAL;
+		goto out;
+	}
+
+	if (*generation != 0 && hdr.generation != *generation) {
+		/* Log of an older snapshot, that was already compacted */
+		rc = -ESTALE;
+		goto out;
+	}
+
+	*generation = hdr.generation;
+	left = st.st_size - sizeof(hdr);
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		left -= sizeof(rec);
+
+		/* Check the lengths before trusting them with an allocation */
+		if (rec.len > JOURNAL_MAX_RECORD || rec.len > left ||
+		    rec.tag_len > rec.len) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Recovery journal %s truncated at a bad record",
+				 path);
+			break;
+		}
+
+		payload = gsh_realloc(payload, rec.len + 1);
+		left -= rec.len;
+
+		if (fread(payload, rec.len, 1, fp) != 1 ||
+		    journal_checksum(&rec, payload) != rec.checksum) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Recovery journal %s truncated at a bad record",
+				 path);
+			break;
+		}
+
+		journal_apply(table, rec.type, payload, rec.tag_len,
+			      payload + rec.tag_len, rec.len - rec.tag_len);
+	}
+
+out:
+	gsh_free(payload);
+	(void)fclose(fp);
+	return rc;
+}
+
+/**
+ * @brief Load the committed clients of this node
+ */
+static void journal_load(struct journal_table *table, uint64_t *generation)
+{
+	int rc;
+
+	*generation = 0;
+
+	rc = journal_replay("snap", generation, table);
+	if (rc != 0) {
+		if (rc != -ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to read recovery snapshot: %s (%d)",
+				 strerror(-rc), -rc);
+		*generation = 0;
+		return;
+	}
+
+	rc = journal_replay("log", generation, table);
+	if (rc != 0 && rc != -ENOENT && rc != -ESTALE)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to read recovery log: %s (%d)", strerror(-rc),
+			 -rc);
+}
+
+/**
+ * @brief Encode the current clients as snapshot records
+ *
+ * @note The caller must hold journal.lock.
+ */
+static void journal_snapshot(struct journal_buf *snap)
+{
+	struct glist_head *glist, *glistr;
+	struct journal_client *client;
+	struct journal_revoked *revoked;
+	int i;
+
+	for (i = 0; i < JOURNAL_BUCKETS; i++) {
+		glist_for_each(glist, &journal.clients.buckets[i]) {
+			client = glist_entry(glist, struct journal_client,
+					     node);
+			journal_encode(snap, JOURNAL_ADD_CLID, client->tag,
+				       client->tag_len, NULL, 0);
+
+			glist_for_each(glistr, &client->revoked) {
+				revoked = glist_entry(glistr,
+						      struct journal_revoked,
+						      node);
+				journal_encode(snap, JOURNAL_REVOKE_FH,
+					       client->tag, client->tag_len,
+					       revoked->fh,
+					       strlen(revoked->fh));
+			}
+		}
+	}
+}
+
+/**
+ * @brief Write the current clients as a new snapshot and start a new log
+ *
+ * The snapshot and the new log are written under temporary names without
+ * the lock, while records keep being appended to the current file and to
+ * carry.  Once carry has been copied to the new log and no flush is in
+ * progress, both are renamed into place and the new log becomes current.
+ *
+ * @note The caller must hold journal.lock, with no flush or compaction
+ *       in progress.  The lock is dropped while writing.
+ */
+static void journal_compact(void)
+{
+	struct journal_buf snap = { NULL, 0, 0 };
+	struct journal_buf carry = { NULL, 0, 0 };
+	struct journal_buf swap;
+	uint64_t generation = journal.generation + 1;
+	char tmp[PATH_MAX];
+	int fd, rc = 0;
+
+	journal_snapshot(&snap);
+	journal.compacting = true;
+
+	PTHREAD_MUTEX_unlock(&journal.lock);
+
+	fd = journal_write_file("snap.tmp", generation, &snap);
+	gsh_free(snap.data);
+
+	if (fd >= 0) {
+		close(fd);
+		fd = journal_write_file("log.tmp", generation, NULL);
+	}
+
+	PTHREAD_MUTEX_lock(&journal.lock);
+
+	/* Catch up with the records appended meanwhile, and let the flusher
+	 * finish with the current file before it is replaced.
+	 */
+	while (fd >= 0 && (journal.carry.len != 0 || journal.in_flush)) {
+		if (journal.carry.len == 0) {
+			PTHREAD_COND_wait(&journal.cond, &journal.lock);
+			continue;
+		}
+
+		swap = carry;
+		carry = journal.carry;
+		journal.carry = swap;
+
+		PTHREAD_MUTEX_unlock(&journal.lock);
+
+		rc = journal_write(fd, carry.data, carry.len);
+		if (rc == 0 && fdatasync(fd) < 0)
+			rc = -errno;
+		carry.len = 0;
+
+		PTHREAD_MUTEX_lock(&journal.lock);
+
+		if (rc != 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to write new recovery log: %s (%d)",
+				 strerror(-rc), -rc);
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	gsh_free(carry.data);
+	gsh_free(journal.carry.data);
+	memset(&journal.carry, 0, sizeof(journal.carry));
+	journal.compacting = false;
+
+	if (fd < 0 || journal_rename("snap.tmp", "snap") != 0) {
+		/* Keep appending to the current file */
+		if (fd >= 0)
+			close(fd);
+		if (journal_path(tmp, sizeof(tmp), "snap.tmp") == 0)
+			(void)unlink(tmp);
+		if (journal_path(tmp, sizeof(tmp), "log.tmp") == 0)
+			(void)unlink(tmp);
+		PTHREAD_COND_broadcast(&journal.cond);
+		return;
+	}
+
+	/* The snapshot holds everything, a crash before the new log is in
+	 * place leaves a log of the previous generation that is ignored.
+	 */
+	if (journal_rename("log.tmp", "log") != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Could not start a new recovery log, clients will not be recorded until one is started");
+		close(fd);
+		fd = -1;
+	}
+
+	journal_sync_dir();
+
+	if (journal.fd >= 0)
+		close(journal.fd);
+
+	if (!journal.committed) {
+		char next[PATH_MAX];
+
+		if (journal_path(next, sizeof(next), "next") == 0)
+			(void)unlink(next);
+		journal.committed = true;
+	}
+
+	journal.fd = fd;
+	journal.generation = generation;
+	journal.records = 0;
+
+	/* Everything appended so far is in the snapshot or the new log */
+	journal.pending.len = 0;
+	journal.durable = journal.appended;
+	PTHREAD_COND_broadcast(&journal.cond);
+
+	LogDebug(COMPONENT_CLIENTID,
+		 "Compacted %" PRIu32 " clients into generation %" PRIu64,
+		 journal.clients.count, generation);
+}
+
+/**
+ * @brief Write and sync the pending records
+ *
+ * Records that could not be written are marked failed rather than
+ * durable.  Without a log, compaction is attempted again on each flush,
+ * as the snapshot it writes holds all the records.
+ *
+ * @note The caller must hold journal.lock, with no flush in progress.
+ *       The lock is dropped while writing.
+ */
+static void journal_flush(void)
+{
+	struct journal_buf swap = journal.flushing;
+	uint64_t upto = journal.appended;
+	int fd = journal.fd;
+	int rc = -EBADF;
+
+	journal.flushing = journal.pending;
+	journal.pending = swap;
+	journal.pending.len = 0;
+	journal.in_flush = true;
+
+	PTHREAD_MUTEX_unlock(&journal.lock);
+
+	if (fd >= 0) {
+		rc = journal_write(fd, journal.flushing.data,
+				   journal.flushing.len);
+		if (rc == 0 && fdatasync(fd) < 0)
+			rc = -errno;
+	}
+
+	if (rc != 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to write recovery journal: %s (%d)",
+			strerror(-rc), -rc);
+
+	PTHREAD_MUTEX_lock(&journal.lock);
+
+	journal.flushing.len = 0;
+	journal.in_flush = false;
+
+	if (rc == 0)
+		journal.durable = upto;
+	else
+		journal.failed = upto;
+
+	if (journal.committed && !journal.compacting &&
+	    (journal.fd < 0 ||
+	     journal.records >
+		     2 * journal.clients.count + JOURNAL_COMPACT_SLACK))
+		journal_compact();
+
+	PTHREAD_COND_broadcast(&journal.cond);
+}
+
+/**
+ * @brief Append a record and wait for it to be durable, or to fail
+ */
+static void journal_append(uint16_t type, const char *tag, const char *fh)
+{
+	size_t tag_len = strlen(tag);
+	size_t fh_len = fh != NULL ? strlen(fh) : 0;
+	uint64_t seq;
+
+	PTHREAD_MUTEX_lock(&journal.lock);
+
+	journal_encode(&journal.pending, type, tag, tag_len, fh, fh_len);
+	if (journal.compacting)
+		journal_encode(&journal.carry, type, tag, tag_len, fh, fh_len);
+	journal_apply(&journal.clients, type, tag, tag_len, fh, fh_len);
+	seq = ++journal.appended;
+	journal.records++;
+
+	while (journal.durable < seq && journal.failed < seq) {
+		if (journal.in_flush)
+			PTHREAD_COND_wait(&journal.cond, &journal.lock);
+		else
+			journal_flush();
+	}
+
+	PTHREAD_MUTEX_unlock(&journal.lock);
+}
+
+static int fs_journal_init(void)
+{
+	char host[NI_MAXHOST];
+	char next[PATH_MAX];
+	struct journal_table committed;
+	int err;
+
+	err = mkdir(nfs_param.nfsv4_param.recov_root, 0700);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s): %s (%d)",
+			 nfs_param.nfsv4_param.recov_root, strerror(errno),
+			 errno);
+	}
+
+	err = snprintf(v4_recov_dir, sizeof(v4_recov_dir), "%s/%s",
+		       nfs_param.nfsv4_param.recov_root,
+		       nfs_param.nfsv4_param.recov_dir);
+
+	if (unlikely(err >= sizeof(v4_recov_dir) || err < 0)) {
+		LogCrit(COMPONENT_CLIENTID, "Path too long %s/%s",
+			nfs_param.nfsv4_param.recov_root,
+			nfs_param.nfsv4_param.recov_dir);
+		return -EINVAL;
+	}
+
+	v4_recov_dir_len = err;
+
+	err = mkdir(v4_recov_dir, 0700);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir(%s): %s (%d)",
+			 v4_recov_dir, strerror(errno), errno);
+	}
+
+	if (nfs_param.core_param.clustered) {
+		err = snprintf(host, sizeof(host), "node%d", g_nodeid);
+		if (unlikely(err >= sizeof(host) || err < 0)) {
+			LogCrit(COMPONENT_CLIENTID, "node%d too long",
+				g_nodeid);
+			return -EINVAL;
+		}
+	} else if (gethostname(host, sizeof(host)) != 0) {
+		err = errno;
+		LogEvent(COMPONENT_CLIENTID, "Failed to gethostname: %s (%d)",
+			 strerror(err), err);
+		return -err;
+	}
+
+	err = snprintf(journal_base, sizeof(journal_base), "%s/%s",
+		       v4_recov_dir, host);
+	if (unlikely(err >= sizeof(journal_base) || err < 0)) {
+		LogCrit(COMPONENT_CLIENTID, "Path too long %s/%s",
+			v4_recov_dir, host);
+		return -EINVAL;
+	}
+
+	PTHREAD_MUTEX_init(&journal.lock, NULL);
+	PTHREAD_COND_init(&journal.cond, NULL);
+	journal_table_init(&journal.clients);
+	journal.committed = false;
+	journal.records = 0;
+
+	/* Only the generation is needed here, the clients are loaded again
+	 * by fs_journal_read_clids().
+	 */
+	journal_table_init(&committed);
+	journal_load(&committed, &journal.generation);
+	journal_table_clear(&committed);
+
+	/* Clients of this epoch are logged apart until the end of grace,
+	 * any left over from a previous run in grace are discarded.
+	 */
+	journal.fd = journal_create("next", journal.generation + 1, NULL);
+	if (journal.fd < 0) {
+		(void)journal_path(next, sizeof(next), "next");
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to create recovery journal %s", next);
+		return journal.fd;
+	}
+
+	LogInfo(COMPONENT_CLIENTID,
+		"Recovery journal %s at generation %" PRIu64, journal_base,
+		journal.generation);
+
+	return 0;
+}
+
+static void fs_journal_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&journal.lock);
+
+	while (journal.in_flush || journal.compacting)
+		PTHREAD_COND_wait(&journal.cond, &journal.lock);
+
+	if (journal.fd >= 0) {
+		close(journal.fd);
+		journal.fd = -1;
+	}
+
+	journal_table_clear(&journal.clients);
+	gsh_free(journal.pending.data);
+	gsh_free(journal.flushing.data);
+	memset(&journal.pending, 0, sizeof(journal.pending));
+	memset(&journal.flushing, 0, sizeof(journal.flushing));
+
+	PTHREAD_MUTEX_unlock(&journal.lock);
+}
+
+static void fs_journal_read_clids(nfs_grace_start_t *gsp,
+				  add_clid_entry_hook add_clid_entry,
+				  add_rfh_entry_hook add_rfh_entry)
+{
+	struct journal_table *table;
+	struct glist_head *glist, *glistr;
+	struct journal_client *client;
+	struct journal_revoked *revoked;
+	clid_entry_t *clid_ent;
+	uint64_t generation;
+	int i;
+
+	if (gsp != NULL) {
+		/* Takeover is not supported, as with fs_ng */
+		return;
+	}
+
+	table = gsh_malloc(sizeof(*table));
+	journal_table_init(table);
+	journal_load(table, &generation);
+
+	for (i = 0; i < JOURNAL_BUCKETS; i++) {
+		glist_for_each(glist, &table->buckets[i]) {
+			client = glist_entry(glist, struct journal_client,
+					     node);
+			clid_ent = add_clid_entry(client->tag);
+
+			LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+				 clid_ent->cl_name);
+
+			glist_for_each(glistr, &client->revoked) {
+				revoked = glist_entry(glistr,
+						      struct journal_revoked,
+						      node);
+				(void)add_rfh_entry(clid_ent, revoked->fh);
+			}
+		}
+	}
+
+	LogEvent(COMPONENT_CLIENTID,
+		 "Loaded %" PRIu32 " clients from recovery generation %" PRIu64,
+		 table->count, generation);
+
+	journal_table_clear(table);
+	gsh_free(table);
+}
+
+static void fs_journal_end_grace(void)
+{
+	PTHREAD_MUTEX_lock(&journal.lock);
+
+	while (journal.in_flush || journal.compacting)
+		PTHREAD_COND_wait(&journal.cond, &journal.lock);
+
+	journal_compact();
+
+	PTHREAD_MUTEX_unlock(&journal.lock);
+}
+
+static void fs_journal_add_clid(nfs_client_id_t *clientid)
+{
+	fs_create_clid_name(clientid);
+
+	if (clientid->cid_recov_tag == NULL)
+		return;
+
+	journal_append(JOURNAL_ADD_CLID, clientid->cid_recov_tag, NULL);
+}
+
+static void fs_journal_rm_clid(nfs_client_id_t *clientid)
+{
+	char *tag = clientid->cid_recov_tag;
+
+	if (tag == NULL)
+		return;
+
+	clientid->cid_recov_tag = NULL;
+	journal_append(JOURNAL_RM_CLID, tag, NULL);
+	gsh_free(tag);
+}
+
+static void fs_journal_add_revoke_fh(nfs_client_id_t *delr_clid,
+				     nfs_fh4 *delr_handle)
+{
+	char rhdlstr[NAME_MAX];
+	int retval;
+
+	assert(delr_clid->cid_recov_tag != NULL);
+
+	/* Same encoding as the fs backends */
+	retval = base64url_encode(delr_handle->nfs_fh4_val,
+				  delr_handle->nfs_fh4_len, rhdlstr,
+				  sizeof(rhdlstr));
+	assert(retval != -1);
+
+	journal_append(JOURNAL_REVOKE_FH, delr_clid->cid_recov_tag, rhdlstr);
+}
+
+static struct nfs4_recovery_backend fs_journal_backend = {
+	.recovery_init = fs_journal_init,
+	.recovery_shutdown = fs_journal_shutdown,
+	.end_grace = fs_journal_end_grace,
+	.recovery_read_clids = fs_journal_read_clids,
+	.add_clid = fs_journal_add_clid,
+	.rm_clid = fs_journal_rm_clid,
+	.add_revoke_fh = fs_journal_add_revoke_fh,
+};
+
+void fs_journal_backend_init(struct nfs4_recovery_backend **backend)
+{
+	*backend = &fs_journal_backend;
+}
@@ -534,7 +534,7 @@ void rados_kv_rm_clid(nfs_client_id_t *clientid)
 		return;
 	}
 
-	free(clientid->cid_recov_tag);
+	gsh_free(clientid->cid_recov_tag);
 	clientid->cid_recov_tag = NULL;
 }
 
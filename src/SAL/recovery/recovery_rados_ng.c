@@ -243,7 +243,7 @@ static void rados_ng_rm_clid(nfs_client_id_t *clientid)
 		return;
 	}
 
-	free(clientid->cid_recov_tag);
+	gsh_free(clientid->cid_recov_tag);
 	clientid->cid_recov_tag = NULL;
 }
 
@@ -38,6 +38,7 @@
 #include "conf_yacc.h"
 #include "log.h"
 #include "fsal_convert.h"
+#include "city.h"
 
 /* config_ParseFile:
  * Reads the content of a configuration file and
@@ -1461,6 +1462,56 @@ uint64_t get_parse_root_generation(void *node)
 	return get_config_generation(root);
 }
 
+/**
+ * @brief Compute a digest of a parse tree sub-tree
+ *
+ * The digest covers block and parameter names, term types and values
+ * in the order they appear in the configuration.  File names and line
+ * numbers are not included, so moving an unchanged block around, or into
+ * an included file, does not change its digest.
+ *
+ * @param node [IN] pointer to a TYPE_BLOCK or TYPE_STMT node.
+ * @param seed [IN] digest to chain from.
+ *
+ * @return the digest, never 0.
+ */
+
+static uint64_t node_digest(struct config_node *node, uint64_t seed)
+{
+	struct glist_head *ns;
+	uint64_t hash = CityHash64WithSeed((char *)&node->type,
+					   sizeof(node->type), seed);
+
+	if (node->type == TYPE_TERM) {
+		hash = CityHash64WithSeed((char *)&node->u.term.type,
+					  sizeof(node->u.term.type), hash);
+		if (node->u.term.op_code != NULL)
+			hash = CityHash64WithSeed(node->u.term.op_code,
+						  strlen(node->u.term.op_code),
+						  hash);
+		return CityHash64WithSeed(node->u.term.varvalue,
+					  strlen(node->u.term.varvalue), hash);
+	}
+
+	hash = CityHash64WithSeed(node->u.nterm.name,
+				  strlen(node->u.nterm.name), hash);
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+	{
+		hash = node_digest(glist_entry(ns, struct config_node, node),
+				   hash);
+	}
+
+	return hash;
+}
+
+uint64_t config_node_digest(void *node, uint64_t seed)
+{
+	uint64_t hash = node_digest((struct config_node *)node, seed);
+
+	return hash != 0 ? hash : 1;
+}
+
 /**
  * @brief Data structures for walking parse trees
  *
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Checks the MDCACHE negative lookup filter of a fully read directory:
+ * it never rules out a name of the directory, it keeps ruling out missing
+ * names while the dirent chunks of the directory are reaped and read back,
+ * and it is dropped once the directory outgrows it.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "gtest.hh"
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For the name filter.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#define TEST_ROOT "name_filter_correctness"
+#define TEST_DIR "test_directory"
+#define DIR_COUNT 1000
+#define MISSING_COUNT 10000
+#define REREAD_COUNT 50
+/* Missing names the filter must rule out, in percent */
+#define MIN_EXCLUDED 90
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  class NameFilterCorrectnessTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct fsal_attrlist attrs_out;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      status = fsal_create(test_root, TEST_DIR, DIRECTORY, &attrs, NULL,
+                           &test_dir, &attrs_out, nullptr, nullptr);
+      ASSERT_EQ(status.major, 0);
+      ASSERT_NE(test_dir, nullptr);
+
+      fsal_release_attrs(&attrs_out);
+
+      /* Reads the whole directory, which builds its filter */
+      create_and_prime_many(DIR_COUNT, NULL, test_dir);
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+      char fname[NAMELEN];
+
+      for (int i = 0; i < grown; ++i) {
+        sprintf(fname, "g-%08x", i);
+        status = fsal_remove(test_dir, fname, NULL, NULL);
+        EXPECT_EQ(status.major, 0);
+      }
+
+      remove_many(DIR_COUNT, NULL, test_dir);
+
+      status = fsal_remove(test_root, TEST_DIR, NULL, NULL);
+      EXPECT_EQ(0, status.major);
+      test_dir->obj_ops->put_ref(test_dir);
+      test_dir = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    void read_dir() {
+      fsal_status_t status;
+      unsigned int num_entries;
+      bool eod_met;
+      uint32_t tracker;
+
+      status = fsal_readdir(test_dir, 0, &num_entries, &eod_met, 0,
+                            readdir_callback, &tracker);
+      ASSERT_EQ(status.major, 0);
+      ASSERT_TRUE(eod_met);
+    }
+
+    void check_names() {
+      char fname[NAMELEN];
+
+      for (int i = 0; i < DIR_COUNT; ++i) {
+        sprintf(fname, "f-%08x", i);
+        ASSERT_FALSE(mdcdb_name_filter_excludes(test_dir, fname)) << fname;
+      }
+    }
+
+    /* Missing names ruled out by the filter, in percent */
+    int excluded_missing() {
+      char fname[NAMELEN];
+      int excluded = 0;
+
+      for (int i = 0; i < MISSING_COUNT; ++i) {
+        sprintf(fname, "m-%08x", i);
+        if (mdcdb_name_filter_excludes(test_dir, fname))
+          excluded++;
+      }
+
+      return excluded * 100 / MISSING_COUNT;
+    }
+
+    struct fsal_obj_handle *test_dir = nullptr;
+    int grown = 0;
+  };
+
+} /* namespace */
+
+TEST_F(NameFilterCorrectnessTest, BUILT)
+{
+  check_names();
+  EXPECT_GE(excluded_missing(), MIN_EXCLUDED);
+}
+
+TEST_F(NameFilterCorrectnessTest, REREAD)
+{
+  /* Each read back counts every name again, which must not fill up the
+   * filter since no name was added.
+   */
+  for (int i = 0; i < REREAD_COUNT; ++i) {
+    mdcdb_reap_dir_chunks(test_dir);
+    read_dir();
+  }
+
+  check_names();
+  EXPECT_GE(excluded_missing(), MIN_EXCLUDED);
+}
+
+TEST_F(NameFilterCorrectnessTest, GROW)
+{
+  fsal_status_t status;
+  struct fsal_attrlist attrs_out;
+  struct fsal_obj_handle *obj;
+  char fname[NAMELEN];
+
+  /* The filter has room for the directory to double, not more */
+  for (; grown < 3 * DIR_COUNT; ++grown) {
+    fsal_prepare_attrs(&attrs_out, 0);
+    sprintf(fname, "g-%08x", grown);
+
+    status = fsal_create(test_dir, fname, REGULAR_FILE, &attrs, NULL,
+                         &obj, &attrs_out, nullptr, nullptr);
+    ASSERT_EQ(status.major, 0);
+
+    fsal_release_attrs(&attrs_out);
+    obj->obj_ops->put_ref(obj);
+  }
+
+  EXPECT_EQ(excluded_missing(), 0);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
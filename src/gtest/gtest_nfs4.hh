@@ -45,7 +45,7 @@ namespace gtest {
     virtual void SetUp() {
       gtest::GaneshaFSALBaseTest::SetUp();
 
-      data = (compound_data_t *) gsh_calloc(1, sizeof(*data));
+      data = compound_data_alloc();
 
       memset(&arg, 0, sizeof(nfs_arg_t));
       memset(&resp, 0, sizeof(struct nfs_resop4));
@@ -79,9 +79,14 @@ namespace gtest {
     void setCurrentFH(struct fsal_obj_handle *entry) {
       bool fhres;
 
+      /* Filehandles of the compound live in its arena */
+      if (data->currentFH.nfs_fh4_val == NULL)
+        compound_alloc_fh(data, &data->currentFH);
+      data->currentFH.nfs_fh4_len = NFS4_FHSIZE;
+
       /* Convert root_obj to a file handle in the args */
-      fhres = nfs4_FSALToFhandle(data->currentFH.nfs_fh4_val == NULL,
-                                 &data->currentFH, entry, op_ctx->ctx_export);
+      fhres = nfs4_FSALToFhandle(false, &data->currentFH, entry,
+                                 op_ctx->ctx_export);
       EXPECT_EQ(fhres, true);
 
       set_current_entry(data, entry);
@@ -90,9 +95,14 @@ namespace gtest {
     void setSavedFH(struct fsal_obj_handle *entry) {
       bool fhres;
 
+      /* Filehandles of the compound live in its arena */
+      if (data->savedFH.nfs_fh4_val == NULL)
+        compound_alloc_fh(data, &data->savedFH);
+      data->savedFH.nfs_fh4_len = NFS4_FHSIZE;
+
       /* Convert root_obj to a file handle in the args */
-      fhres = nfs4_FSALToFhandle(data->savedFH.nfs_fh4_val == NULL,
-                                 &data->savedFH, entry, op_ctx->ctx_export);
+      fhres = nfs4_FSALToFhandle(false, &data->savedFH, entry,
+                                 op_ctx->ctx_export);
       EXPECT_EQ(fhres, true);
 
       set_saved_entry(data, entry);
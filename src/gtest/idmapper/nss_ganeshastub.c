@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nss_ganeshastub.c
+ * @brief NSS module standing in for a slow directory server
+ *
+ * Every user "stub<uid>" exists, with primary group <uid> and <uid> + 1
+ * as its only supplementary group.  Each lookup sleeps for
+ * GANESHA_NSS_STUB_DELAY_MS milliseconds, and the module counts the
+ * lookups made and the most it saw in progress at once.
+ */
+
+#include <errno.h>
+#include <nss.h>
+#include <pwd.h>
+#include <grp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned int stub_calls;
+static unsigned int stub_running;
+static unsigned int stub_running_max;
+
+unsigned int nss_ganeshastub_calls(void)
+{
+	return __atomic_load_n(&stub_calls, __ATOMIC_SEQ_CST);
+}
+
+unsigned int nss_ganeshastub_running_max(void)
+{
+	return __atomic_load_n(&stub_running_max, __ATOMIC_SEQ_CST);
+}
+
+void nss_ganeshastub_reset(void)
+{
+	__atomic_store_n(&stub_calls, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&stub_running_max, 0, __ATOMIC_SEQ_CST);
+}
+
+static void stub_enter(void)
+{
+	const char *delay = getenv("GANESHA_NSS_STUB_DELAY_MS");
+	unsigned int running, max;
+	struct timespec ts;
+	long ms;
+
+	__atomic_add_fetch(&stub_calls, 1, __ATOMIC_SEQ_CST);
+	running = __atomic_add_fetch(&stub_running, 1, __ATOMIC_SEQ_CST);
+
+	max = __atomic_load_n(&stub_running_max, __ATOMIC_SEQ_CST);
+	while (running > max &&
+	       !__atomic_compare_exchange_n(&stub_running_max, &max, running,
+					    false, __ATOMIC_SEQ_CST,
+					    __ATOMIC_SEQ_CST))
+		;
+
+	ms = delay != NULL ? atol(delay) : 0;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+static void stub_leave(void)
+{
+	__atomic_sub_fetch(&stub_running, 1, __ATOMIC_SEQ_CST);
+}
+
+static enum nss_status stub_fill_pw(uid_t uid, struct passwd *pw, char *buf,
+				    size_t buflen, int *errnop)
+{
+	int len = snprintf(buf, buflen, "stub%u", (unsigned int)uid);
+
+	if (len < 0 || (size_t)len + 2 > buflen) {
+		*errnop = ERANGE;
+		return NSS_STATUS_TRYAGAIN;
+	}
+
+	/* Every other string is the empty one after the name */
+	buf[len + 1] = '\0';
+	pw->pw_name = buf;
+	pw->pw_passwd = buf + len + 1;
+	pw->pw_uid = uid;
+	pw->pw_gid = uid;
+	pw->pw_gecos = pw->pw_passwd;
+	pw->pw_dir = pw->pw_passwd;
+	pw->pw_shell = pw->pw_passwd;
+
+	return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_ganeshastub_getpwuid_r(uid_t uid, struct passwd *pw,
+					    char *buf, size_t buflen,
+					    int *errnop)
+{
+	enum nss_status status;
+
+	stub_enter();
+	status = stub_fill_pw(uid, pw, buf, buflen, errnop);
+	stub_leave();
+
+	return status;
+}
+
+enum nss_status _nss_ganeshastub_getpwnam_r(const char *name,
+					    struct passwd *pw, char *buf,
+					    size_t buflen, int *errnop)
+{
+	enum nss_status status = NSS_STATUS_NOTFOUND;
+	char *end;
+	unsigned long uid;
+
+	stub_enter();
+	if (strncmp(name, "stub", 4) == 0) {
+		uid = strtoul(name + 4, &end, 10);
+		if (end != name + 4 && *end == '\0')
+			status = stub_fill_pw(uid, pw, buf, buflen, errnop);
+	}
+	stub_leave();
+
+	return status;
+}
+
+enum nss_status _nss_ganeshastub_getgrgid_r(gid_t gid, struct group *gr,
+					    char *buf, size_t buflen,
+					    int *errnop)
+{
+	/* The empty member list goes first, where buf is aligned enough */
+	size_t names = sizeof(char *);
+	int len;
+
+	stub_enter();
+	len = buflen > names ? snprintf(buf + names, buflen - names,
+					"stubgrp%u", (unsigned int)gid)
+			     : -1;
+	if (len < 0 || names + len + 2 > buflen) {
+		stub_leave();
+		*errnop = ERANGE;
+		return NSS_STATUS_TRYAGAIN;
+	}
+
+	gr->gr_mem = (char **)buf;
+	gr->gr_mem[0] = NULL;
+	gr->gr_name = buf + names;
+	buf[names + len + 1] = '\0';
+	gr->gr_passwd = buf + names + len + 1;
+	gr->gr_gid = gid;
+	stub_leave();
+
+	return NSS_STATUS_SUCCESS;
+}
+
+enum nss_status _nss_ganeshastub_initgroups_dyn(const char *user, gid_t group,
+						long int *start,
+						long int *size,
+						gid_t **groupsp,
+						long int limit, int *errnop)
+{
+	gid_t *groups;
+
+	stub_enter();
+	if (*start == *size) {
+		groups = realloc(*groupsp, 2 * *size * sizeof(gid_t));
+		if (groups == NULL) {
+			stub_leave();
+			*errnop = ENOMEM;
+			return NSS_STATUS_TRYAGAIN;
+		}
+		*groupsp = groups;
+		*size *= 2;
+	}
+	if (limit <= 0 || *start < limit)
+		(*groupsp)[(*start)++] = group + 1;
+	stub_leave();
+
+	return NSS_STATUS_SUCCESS;
+}
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Directory lookup deduplication and throttling
+ *
+ * User-groups lookups are pointed at libnss_ganeshastub, an NSS module
+ * answering every uid after --delay milliseconds, and the test checks
+ * that concurrent misses for one user make a single trip to it, that
+ * cached users make none, and that no more than Cache_Refresh_Threads
+ * lookups for different users are in progress at once.
+ */
+
+#include <sys/types.h>
+#include <dlfcn.h>
+#include <nss.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Don't include rpcent.h; it has C++ issues, and is unneeded */
+#define _RPC_RPCENT_H
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "idmapper.h"
+#include "uid2grp.h"
+}
+
+namespace {
+
+  std::string stub_path = NSS_STUB_PATH;
+  unsigned int delay_ms = 100;
+  unsigned int lookup_slots = 2;
+  unsigned int threads = 16;
+
+  unsigned int (*stub_calls)(void);
+  unsigned int (*stub_running_max)(void);
+  void (*stub_reset)(void);
+
+  /* Each stub lookup of a user is a getpwuid_r plus an initgroups */
+  const unsigned int calls_per_user = 2;
+
+  class IdmapperFlightTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      uid2grp_clear_cache();
+      stub_reset();
+    }
+
+    /* Look users up from threads started together, return the ms taken */
+    long lookup(const std::vector<uid_t>& uids) {
+      std::vector<std::thread> workers;
+      std::vector<int> found(uids.size(), 0);
+      auto start = std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < uids.size(); i++) {
+	workers.emplace_back([&, i]() {
+	    struct group_data *gdata;
+
+	    if (uid2grp(uids[i], &gdata)) {
+	      found[i] = gdata->nbgroups > 0 &&
+		gdata->groups[gdata->nbgroups - 1] == uids[i] + 1;
+	      uid2grp_unref(gdata);
+	    }
+	  });
+      }
+
+      for (auto& worker : workers)
+	worker.join();
+
+      for (size_t i = 0; i < uids.size(); i++)
+	EXPECT_TRUE(found[i]) << "uid " << uids[i];
+
+      return std::chrono::duration_cast<std::chrono::milliseconds>(
+	std::chrono::steady_clock::now() - start).count();
+    }
+  };
+
+} /* namespace */
+
+TEST_F(IdmapperFlightTest, CONCURRENT_MISSES_ONE_LOOKUP)
+{
+  std::vector<uid_t> uids(threads, 70000);
+  long ms = lookup(uids);
+
+  EXPECT_EQ(stub_calls(), calls_per_user);
+  EXPECT_EQ(stub_running_max(), 1U);
+  /* Waiters ride along with the leader instead of queueing behind it */
+  EXPECT_LT(ms, (long)(2 * calls_per_user * delay_ms));
+  std::cout << threads << " misses for one user took " << ms << " ms"
+	    << std::endl;
+}
+
+TEST_F(IdmapperFlightTest, CACHED_NO_LOOKUP)
+{
+  std::vector<uid_t> uids(1, 70001);
+
+  lookup(uids);
+  stub_reset();
+
+  uids.assign(threads, 70001);
+  long ms = lookup(uids);
+
+  EXPECT_EQ(stub_calls(), 0U);
+  EXPECT_LT(ms, (long)delay_ms);
+}
+
+TEST_F(IdmapperFlightTest, DISTINCT_MISSES_BOUNDED)
+{
+  std::vector<uid_t> uids;
+
+  for (unsigned int i = 0; i < threads; i++)
+    uids.push_back(80000 + i);
+
+  long ms = lookup(uids);
+  unsigned int rounds = (threads + lookup_slots - 1) / lookup_slots;
+
+  EXPECT_EQ(stub_calls(), threads * calls_per_user);
+  EXPECT_LE(stub_running_max(), lookup_slots);
+  /* The directory sees lookup_slots users at a time, and no fewer */
+  EXPECT_GE(ms, (long)(rounds * calls_per_user * delay_ms));
+  EXPECT_LT(ms, (long)(2 * rounds * calls_per_user * delay_ms));
+  std::cout << threads << " misses for distinct users took " << ms
+	    << " ms with " << lookup_slots << " lookup slots" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("stub", po::value<string>(),
+	"path to libnss_ganeshastub.so.2")
+
+      ("delay", po::value<unsigned int>(),
+	"milliseconds each stub lookup takes")
+
+      ("slots", po::value<unsigned int>(),
+	"Cache_Refresh_Threads, lookups allowed at once (not 0)")
+
+      ("threads", po::value<unsigned int>(),
+	"concurrent lookups per test")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    vm_iter = vm.find("stub");
+    if (vm_iter != vm.end())
+      stub_path = vm_iter->second.as<std::string>();
+    vm_iter = vm.find("delay");
+    if (vm_iter != vm.end())
+      delay_ms = vm_iter->second.as<unsigned int>();
+    vm_iter = vm.find("slots");
+    if (vm_iter != vm.end())
+      lookup_slots = vm_iter->second.as<unsigned int>();
+    vm_iter = vm.find("threads");
+    if (vm_iter != vm.end())
+      threads = vm_iter->second.as<unsigned int>();
+
+    if (lookup_slots == 0) {
+      cerr << "--slots must not be 0" << endl;
+      return 1;
+    }
+
+    /* glibc finds the module already loaded rather than searching for it */
+    void *stub = dlopen(stub_path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+
+    if (stub == nullptr) {
+      cerr << "Cannot load " << stub_path << ": " << dlerror() << endl;
+      return 1;
+    }
+
+    stub_calls = (unsigned int (*)(void))dlsym(stub, "nss_ganeshastub_calls");
+    stub_running_max = (unsigned int (*)(void))
+      dlsym(stub, "nss_ganeshastub_running_max");
+    stub_reset = (void (*)(void))dlsym(stub, "nss_ganeshastub_reset");
+
+    setenv("GANESHA_NSS_STUB_DELAY_MS", to_string(delay_ms).c_str(), 1);
+
+    if (__nss_configure_lookup("passwd", "ganeshastub") != 0 ||
+	__nss_configure_lookup("group", "ganeshastub") != 0 ||
+	__nss_configure_lookup("initgroups", "ganeshastub") != 0) {
+      cerr << "Cannot point NSS at the stub" << endl;
+      return 1;
+    }
+
+    nfs_param.core_param.manage_gids_expiration = 1800;
+    nfs_param.directory_services_param.cache_user_groups_max_count = 1000;
+    nfs_param.directory_services_param.cache_refresh_threads = lookup_slots;
+
+    uid2grp_cache_init();
+    idmapper_flight_init();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    code = RUN_ALL_TESTS();
+
+    idmapper_flight_destroy();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
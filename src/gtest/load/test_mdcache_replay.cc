@@ -0,0 +1,373 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * MDCACHE replacement policy trace replay
+ *
+ * A trace of object accesses is replayed against a cache of --cache
+ * entries with each replacement policy in turn, and the hit ratio of each
+ * is reported.  Objects are accessed by file handle, as by PUTFH, so only
+ * the entry cache is involved.
+ *
+ * With --trace, the trace is a file with the index of the object accessed
+ * on each line, objects being numbered from 0.  Otherwise a trace is
+ * generated: --scan-share percent of the accesses walk a set of --scan
+ * objects, as a find or a backup would, and the others pick one of --hot
+ * objects at random.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <boost/program_options.hpp>
+
+#include "gtest.hh"
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For the LRU state.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#define TEST_ROOT "mdcache_replay"
+
+namespace {
+
+  char* trace_path = nullptr;
+  unsigned int hot_count = 4000;
+  unsigned int scan_count = 50000;
+  unsigned int cache_size = 6000;
+  unsigned int access_count = 400000;
+  unsigned int scan_share = 50;
+
+  /* One access of the trace, scan accesses are told apart for reporting */
+  struct trace_access {
+    uint32_t index;
+    bool scan;
+  };
+
+  struct replay_stats {
+    uint64_t accesses = 0;
+    uint64_t misses = 0;
+    uint64_t hot_accesses = 0;
+    uint64_t hot_misses = 0;
+  };
+
+  class ReplayTest : public gtest::GaneshaFSALBaseTest {
+
+  protected:
+
+    virtual void SetUp() {
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      if (trace_path != nullptr)
+        load_trace();
+      else
+        generate_trace();
+
+      create_and_prime_many(count, objs.data());
+
+      for (auto obj : objs) {
+        char buf[NFS4_FHSIZE];
+        struct gsh_buffdesc fh_desc = { buf, sizeof(buf) };
+        fsal_status_t status;
+
+        status = obj->obj_ops->handle_to_wire(obj, FSAL_DIGEST_NFSV4,
+                                              &fh_desc);
+        ASSERT_EQ(status.major, 0);
+        handles.emplace_back(buf, fh_desc.len);
+      }
+    }
+
+    virtual void TearDown() {
+      mdcache_lru_set_policy(
+              (enum mdcache_lru_policy) mdcache_param.lru_policy,
+              mdcache_param.entries_hwmark);
+
+      remove_many(count, released ? nullptr : objs.data());
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    void load_trace() {
+      std::ifstream in(trace_path);
+      uint32_t index;
+
+      ASSERT_TRUE(in.good());
+
+      count = 0;
+      while (in >> index) {
+        trace.push_back({index, false});
+        count = std::max(count, index + 1);
+      }
+
+      ASSERT_NE(count, 0);
+      objs.resize(count);
+    }
+
+    void generate_trace() {
+      std::mt19937 gen(0);
+      std::uniform_int_distribution<uint32_t> hot(0, hot_count - 1);
+      std::uniform_int_distribution<uint32_t> share(0, 99);
+      uint32_t next_scan = 0;
+
+      count = hot_count + scan_count;
+      objs.resize(count);
+
+      for (unsigned int i = 0; i < access_count; ++i) {
+        if (share(gen) < scan_share) {
+          trace.push_back({hot_count + next_scan, true});
+          next_scan = (next_scan + 1) % scan_count;
+        } else {
+          trace.push_back({hot(gen), false});
+        }
+      }
+    }
+
+    /* Drop every unreferenced entry, so each policy starts cold */
+    void flush_cache(enum mdcache_lru_policy policy) {
+      if (!released) {
+        for (auto obj : objs)
+          obj->obj_ops->put_ref(obj);
+        released = true;
+      }
+
+      mdcache_lru_set_policy(policy, 1);
+      (void)mdcache_lru_release_entries(-1);
+      mdcache_lru_set_policy(policy, cache_size);
+    }
+
+    replay_stats replay(enum mdcache_lru_policy policy) {
+      struct fsal_export *exp = a_export->fsal_export;
+      replay_stats stats;
+
+      flush_cache(policy);
+
+      for (auto& a : trace) {
+        std::string& handle = handles[a.index];
+        char buf[NFS4_FHSIZE];
+        struct gsh_buffdesc fh_desc = { buf, handle.size() };
+        struct fsal_obj_handle *obj;
+        uint64_t added = atomic_fetch_uint64_t(&cache_stp->inode_added);
+        fsal_status_t status;
+        bool miss;
+
+        memcpy(buf, handle.data(), handle.size());
+
+        status = exp->exp_ops.wire_to_host(exp, FSAL_DIGEST_NFSV4, &fh_desc,
+                                           0);
+        EXPECT_EQ(status.major, 0);
+
+        status = exp->exp_ops.create_handle(exp, &fh_desc, &obj, NULL);
+        EXPECT_EQ(status.major, 0);
+        obj->obj_ops->put_ref(obj);
+
+        miss = atomic_fetch_uint64_t(&cache_stp->inode_added) != added;
+
+        stats.accesses++;
+        stats.misses += miss;
+        if (!a.scan) {
+          stats.hot_accesses++;
+          stats.hot_misses += miss;
+        }
+      }
+
+      return stats;
+    }
+
+    void report(const char *name, const replay_stats& stats,
+                const struct lru_state& before) {
+      std::cout << std::left << std::setw(6) << name << std::right
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << ratio(stats.accesses, stats.misses)
+                << std::setw(10)
+                << ratio(stats.hot_accesses, stats.hot_misses)
+                << std::setw(12)
+                << lru_state.scan_evictions - before.scan_evictions
+                << std::setw(12)
+                << lru_state.protected_evictions -
+                   before.protected_evictions
+                << std::setw(12) << lru_state.ghost_hits - before.ghost_hits
+                << std::endl;
+    }
+
+    static double ratio(uint64_t accesses, uint64_t misses) {
+      if (accesses == 0)
+        return 0.0;
+
+      return 100.0 * (accesses - misses) / accesses;
+    }
+
+    uint32_t count;
+    bool released = false;
+    std::vector<trace_access> trace;
+    std::vector<struct fsal_obj_handle *> objs;
+    std::vector<std::string> handles;
+  };
+
+} /* namespace */
+
+TEST_F(ReplayTest, COMPARE)
+{
+  const struct {
+    const char *name;
+    enum mdcache_lru_policy policy;
+  } policies[] = {
+    { "lru", MDCACHE_LRU_POLICY_LRU },
+    { "twoq", MDCACHE_LRU_POLICY_2Q },
+  };
+
+  std::cout << count << " objects, " << trace.size() << " accesses, "
+            << cache_size << " entries" << std::endl;
+  std::cout << std::left << std::setw(6) << "policy" << std::right
+            << std::setw(10) << "hit %" << std::setw(10) << "hot hit %"
+            << std::setw(12) << "scan evict" << std::setw(12)
+            << "prot evict" << std::setw(12) << "ghost hits" << std::endl;
+
+  for (auto& p : policies) {
+    struct lru_state before = lru_state;
+    replay_stats stats = replay(p.policy);
+
+    report(p.name, stats, before);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+       "LTTng session name")
+
+      ("trace", po::value<string>(),
+       "file of object indexes to replay, instead of a generated trace")
+
+      ("hot", po::value<unsigned int>(&hot_count),
+       "objects of the working set of the generated trace")
+
+      ("scan", po::value<unsigned int>(&scan_count),
+       "objects scanned by the generated trace")
+
+      ("scan-share", po::value<unsigned int>(&scan_share),
+       "percentage of the generated accesses that are part of the scan")
+
+      ("accesses", po::value<unsigned int>(&access_count),
+       "length of the generated trace")
+
+      ("cache", po::value<unsigned int>(&cache_size),
+       "cache entries while replaying")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+         (char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("trace");
+    if (vm_iter != vm.end()) {
+      trace_path = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    if (hot_count == 0 || scan_count == 0 || cache_size == 0 ||
+        scan_share > 100) {
+      cout << "Invalid replay parameters" << endl;
+      return 1;
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+                                        session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
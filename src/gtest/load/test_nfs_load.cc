@@ -0,0 +1,1123 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * In-process NFS load generator
+ *
+ * Each test is a workload profile run by a number of worker threads for a
+ * fixed duration.  Workers drive NFSv3 procedures and NFSv4 COMPOUNDs
+ * directly, without a transport, so what is measured is the protocol layer,
+ * MDCACHE and the FSAL.  Each profile reports its throughput, the latency
+ * percentiles of its requests and a per operation breakdown.  Lock
+ * contention is profiled while the profile runs, and the lock sites that
+ * were waited for the longest are reported.  The profile covers every
+ * thread of the server, not only the workers.
+ *
+ * Requests that the FSAL completes asynchronously can't be resumed without
+ * a transport, the export must do its I/O inline (FSAL_VFS, or FSAL_MEM
+ * with Async_Type = inline).
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/program_options.hpp>
+
+#include "gtest_nfs4.hh"
+
+extern "C" {
+/* Manually forward this, an 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "nfs_proto_tools.h"
+#include "common_utils.h"
+#include "lock_profile.h"
+}
+
+#define TEST_ROOT "nfs_load"
+
+namespace {
+
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  unsigned int threads = 8;
+  unsigned int duration = 10;
+  unsigned int file_count = 10000;
+  unsigned int small_size = 4096;
+  unsigned int io_size = 1024 * 1024;
+  uint64_t file_size = 64 * 1024 * 1024;
+  unsigned int dir_width = 32;
+  unsigned int lock_sites = 10;
+
+  /* Statistics of one kind of operation */
+  struct op_stats {
+    uint64_t count = 0;
+    uint64_t errors = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    void add(uint64_t ns, bool error) {
+      count++;
+      if (error)
+        errors++;
+      total_ns += ns;
+      max_ns = std::max(max_ns, ns);
+    }
+
+    void merge(const op_stats &other) {
+      count += other.count;
+      errors += other.errors;
+      total_ns += other.total_ns;
+      max_ns = std::max(max_ns, other.max_ns);
+    }
+
+    double avg_us() const {
+      return count ? total_ns / 1000.0 / count : 0.0;
+    }
+  };
+
+  /* What a run, or one of its workers, measured */
+  struct load_stats {
+    std::vector<uint64_t> latencies; /* of each request, in ns */
+    std::map<std::string, op_stats> ops;
+    uint64_t bytes = 0;
+    double seconds = 0;
+
+    void merge(const load_stats &other) {
+      latencies.insert(latencies.end(), other.latencies.begin(),
+                       other.latencies.end());
+      for (auto &op : other.ops)
+        ops[op.first].merge(op.second);
+      bytes += other.bytes;
+    }
+  };
+
+  /* What workers of a run operate on */
+  struct load_target {
+    struct gsh_export *exp;
+    struct fsal_obj_handle *dir; /* the test root */
+    struct fsal_obj_handle *shared_dir; /* for the contend profile */
+    struct fsal_obj_handle *shared_file; /* for the contend profile */
+  };
+
+  uint64_t elapsed_ns(const struct timespec *start)
+  {
+    struct timespec end;
+
+    now(&end);
+    return timespec_diff(start, &end);
+  }
+
+  class LoadWorker {
+  public:
+    LoadWorker(const load_target &_target, unsigned int _id,
+               uint32_t _nfs_vers) :
+      target(_target), id(_id), nfs_vers(_nfs_vers),
+      buf(std::max(io_size, small_size), 'x') {}
+
+    virtual ~LoadWorker() {}
+
+    /* Set up the op context of the worker thread */
+    void begin() {
+      get_gsh_export_ref(target.exp);
+      init_op_context(&ctx, target.exp, target.exp->fsal_export, NULL,
+                      nfs_vers, 0, NFS_REQUEST);
+      /* Only used by operations that need a transport, which the
+       * profiles don't issue.
+       */
+      reqdata = (nfs_request_t *) gsh_calloc(1, sizeof(*reqdata));
+    }
+
+    void end() {
+      gsh_free(reqdata);
+      reqdata = nullptr;
+      release_op_context();
+    }
+
+    /* Set up the workload, not measured */
+    virtual void prepare() {}
+
+    /* Run one unit of the workload */
+    virtual void step() = 0;
+
+    /* Clean up after the workload, not measured */
+    virtual void finish() {}
+
+    load_stats stats;
+
+  protected:
+    typedef int (*nfs3_func_t)(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+
+    void check_sync(int rc) {
+      if (rc == NFS_REQ_ASYNC_WAIT) {
+        /* Nothing would ever resume the request */
+        std::cerr << "FSAL completed a request asynchronously, "
+                  << "the export must do its I/O inline" << std::endl;
+        abort();
+      }
+    }
+
+    void create_obj(struct fsal_obj_handle *parent, const char *name,
+                    object_file_type_t type, struct fsal_obj_handle **obj) {
+      struct fsal_attrlist attrs;
+      fsal_status_t status;
+
+      memset(&attrs, 0, sizeof(attrs));
+      FSAL_SET_MASK(attrs.valid_mask, ATTR_MODE);
+      attrs.mode = type == DIRECTORY ? 0755 : 0644;
+
+      status = fsal_create(parent, name, type, &attrs, NULL, obj, NULL,
+                           nullptr, nullptr);
+      ASSERT_EQ(status.major, 0);
+    }
+
+    /* Remove entries named fmt % 0 ... fmt % (count - 1) */
+    void remove_entries(struct fsal_obj_handle *parent, const char *fmt,
+                        uint32_t count) {
+      char name[NAMELEN];
+      fsal_status_t status;
+
+      for (uint32_t i = 0; i < count; ++i) {
+        sprintf(name, fmt, i);
+        status = fsal_remove(parent, name, NULL, NULL);
+        EXPECT_EQ(status.major, 0);
+      }
+    }
+
+#ifdef _USE_NFS3
+    /* Issue an NFSv3 request, the result must be released by the caller */
+    nfsstat3 call3(const char *name, nfs3_func_t func, nfs_arg_t *arg,
+                   nfs_res_t *res) {
+      struct timespec start;
+      nfsstat3 status;
+      uint64_t ns;
+      int rc;
+
+      memset(res, 0, sizeof(*res));
+
+      now(&start);
+      rc = func(arg, &reqdata->svc, res);
+      ns = elapsed_ns(&start);
+
+      check_sync(rc);
+
+      /* All results start with their status */
+      status = res->res_getattr3.status;
+
+      stats.ops[name].add(ns, status != NFS3_OK);
+      stats.latencies.push_back(ns);
+
+      return status;
+    }
+
+    void make_fh3(struct fsal_obj_handle *obj, nfs_fh3 *fh) {
+      bool fhres = nfs3_FSALToFhandle(true, fh, obj, target.exp);
+
+      ASSERT_EQ(fhres, true);
+    }
+
+    /* Copy a handle returned by a request, the result is about to be
+     * released.
+     */
+    void copy_fh3(nfs_fh3 *dst, const post_op_fh3 *src) {
+      const nfs_fh3 *fh = &src->post_op_fh3_u.handle;
+
+      if (dst->data.data_val == NULL)
+        dst->data.data_val = (char *) gsh_malloc(NFS3_FHSIZE);
+
+      memcpy(dst->data.data_val, fh->data.data_val, fh->data.data_len);
+      dst->data.data_len = fh->data.data_len;
+    }
+
+    void set_mode3(sattr3 *attrs, mode3 mode) {
+      memset(attrs, 0, sizeof(*attrs));
+      attrs->mode.set_it = true;
+      attrs->mode.set_mode3_u.mode = mode;
+    }
+
+    nfsstat3 create3(nfs_fh3 *dir, const char *name, nfs_fh3 *fh) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_create3.where.dir = *dir;
+      arg.arg_create3.where.name = (char *) name;
+      arg.arg_create3.how.mode = UNCHECKED;
+      set_mode3(&arg.arg_create3.how.createhow3_u.obj_attributes, 0644);
+
+      status = call3("CREATE", nfs3_create, &arg, &res);
+      if (status == NFS3_OK && fh != nullptr)
+        copy_fh3(fh, &res.res_create3.CREATE3res_u.resok.obj);
+
+      nfs3_create_free(&res);
+      return status;
+    }
+
+    nfsstat3 mkdir3(nfs_fh3 *dir, const char *name, nfs_fh3 *fh) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_mkdir3.where.dir = *dir;
+      arg.arg_mkdir3.where.name = (char *) name;
+      set_mode3(&arg.arg_mkdir3.attributes, 0755);
+
+      status = call3("MKDIR", nfs3_mkdir, &arg, &res);
+      if (status == NFS3_OK)
+        copy_fh3(fh, &res.res_mkdir3.MKDIR3res_u.resok.obj);
+
+      nfs3_mkdir_free(&res);
+      return status;
+    }
+
+    nfsstat3 write3(nfs_fh3 *fh, uint64_t offset, uint32_t len) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+      struct iovec iov;
+
+      iov.iov_base = buf.data();
+      iov.iov_len = len;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_write3.file = *fh;
+      arg.arg_write3.offset = offset;
+      arg.arg_write3.count = len;
+      arg.arg_write3.stable = UNSTABLE;
+      arg.arg_write3.data.data_len = len;
+      arg.arg_write3.data.iovcnt = 1;
+      arg.arg_write3.data.iov = &iov;
+
+      status = call3("WRITE", nfs3_write, &arg, &res);
+      if (status == NFS3_OK)
+        stats.bytes += res.res_write3.WRITE3res_u.resok.count;
+
+      nfs3_write_free(&res);
+      return status;
+    }
+
+    /* Set the mode and mtime, as an untar does once a file is written */
+    nfsstat3 setattr3(nfs_fh3 *fh) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_setattr3.object = *fh;
+      set_mode3(&arg.arg_setattr3.new_attributes, 0644);
+      arg.arg_setattr3.new_attributes.mtime.set_it = SET_TO_CLIENT_TIME;
+      arg.arg_setattr3.new_attributes.mtime.set_mtime_u.mtime.tv_sec =
+        1000000000 + id;
+
+      status = call3("SETATTR", nfs3_setattr, &arg, &res);
+
+      nfs3_setattr_free(&res);
+      return status;
+    }
+
+    nfsstat3 getattr3(nfs_fh3 *fh) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_getattr3.object = *fh;
+
+      status = call3("GETATTR", nfs3_getattr, &arg, &res);
+
+      nfs3_getattr_free(&res);
+      return status;
+    }
+
+    nfsstat3 remove3(nfs_fh3 *dir, const char *name) {
+      nfs_arg_t arg;
+      nfs_res_t res;
+      nfsstat3 status;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_remove3.object.dir = *dir;
+      arg.arg_remove3.object.name = (char *) name;
+
+      status = call3("REMOVE", nfs3_remove, &arg, &res);
+
+      nfs3_remove_free(&res);
+      return status;
+    }
+#endif /* _USE_NFS3 */
+
+    /* Issue an NFSv4.0 COMPOUND, returns the status of the last op run */
+    nfsstat4 compound(nfs_argop4 *ops, uint32_t len) {
+      struct timespec start, op_start;
+      compound_data_t *data;
+      COMPOUND4res *res4;
+      nfs_resop4 *resop;
+      nfs_res_t res;
+      nfsstat4 status = NFS4_OK;
+      enum nfs_req_result result = NFS_REQ_OK;
+      uint64_t ns;
+
+      now(&start);
+
+      data = compound_data_alloc();
+      data->req = &reqdata->svc;
+      data->argarray = ops;
+      data->argarray_len = len;
+      data->minorversion = 0;
+      data->tagname = TEST_ROOT;
+
+      res.res_compound4_extended = (struct COMPOUND4res_extended *)
+        gsh_calloc(1, sizeof(*res.res_compound4_extended));
+      res.res_compound4_extended->res_refcnt = 1;
+      res4 = &res.res_compound4_extended->res_compound4;
+      res4->resarray.resarray_len = len;
+      res4->resarray.resarray_val =
+        (nfs_resop4 *) gsh_calloc(len, sizeof(nfs_resop4));
+
+      data->res = &res;
+      data->resarray = res4->resarray.resarray_val;
+      data->resp_size = sizeof(COMPOUND4res) - sizeof(nfs_resop4 *);
+
+      /* The export of the op context never changes, PUTFH doesn't need
+       * the transport to check access to it.
+       */
+      for (data->oppos = 0; data->oppos < len; data->oppos++) {
+        now(&op_start);
+        result = process_one_op(data, &status);
+        stats.ops[data->opname].add(elapsed_ns(&op_start),
+                                    status != NFS4_OK);
+
+        check_sync(result);
+
+        if (result != NFS_REQ_OK)
+          break;
+
+        resop = &data->resarray[data->oppos];
+
+        if (resop->resop == NFS4_OP_READ)
+          stats.bytes += resop->nfs_resop4_u.opread.READ4res_u.resok4
+                           .data.data_len;
+        else if (resop->resop == NFS4_OP_WRITE)
+          stats.bytes += resop->nfs_resop4_u.opwrite.WRITE4res_u.resok4
+                           .count;
+      }
+
+      res4->status = status;
+
+      compound_data_Free(data);
+      release_nfs4_res_compound(res.res_compound4_extended);
+
+      ns = elapsed_ns(&start);
+      stats.latencies.push_back(ns);
+
+      return status;
+    }
+
+    void make_fh4(struct fsal_obj_handle *obj, nfs_fh4 *fh) {
+      bool fhres = nfs4_FSALToFhandle(true, fh, obj, target.exp);
+
+      ASSERT_EQ(fhres, true);
+    }
+
+    void putfh4(nfs_argop4 *op, nfs_fh4 *fh) {
+      op->argop = NFS4_OP_PUTFH;
+      op->nfs_argop4_u.opputfh.object = *fh;
+    }
+
+    /* READ and WRITE with the anonymous stateid */
+    void read4(nfs_argop4 *op, uint64_t offset, uint32_t len) {
+      memset(op, 0, sizeof(*op));
+      op->argop = NFS4_OP_READ;
+      op->nfs_argop4_u.opread.offset = offset;
+      op->nfs_argop4_u.opread.count = len;
+    }
+
+    void write4(nfs_argop4 *op, struct iovec *iov, uint64_t offset,
+                uint32_t len, stable_how4 stable) {
+      iov->iov_base = buf.data();
+      iov->iov_len = len;
+
+      memset(op, 0, sizeof(*op));
+      op->argop = NFS4_OP_WRITE;
+      op->nfs_argop4_u.opwrite.offset = offset;
+      op->nfs_argop4_u.opwrite.stable = stable;
+      op->nfs_argop4_u.opwrite.data.data_len = len;
+      op->nfs_argop4_u.opwrite.data.iovcnt = 1;
+      op->nfs_argop4_u.opwrite.data.iov = iov;
+    }
+
+    const load_target &target;
+    unsigned int id;
+    uint32_t nfs_vers;
+    std::vector<char> buf;
+    struct req_op_context ctx;
+    nfs_request_t *reqdata = nullptr;
+  };
+
+#ifdef _USE_NFS3
+  /* Create small files in a directory of its own.  As an untar, also make
+   * a new directory every dir_width files, and set the attributes of each
+   * file once written.
+   */
+  class CreateWorker : public LoadWorker {
+  public:
+    CreateWorker(const load_target &_target, unsigned int _id,
+                 bool _untar = false) :
+      LoadWorker(_target, _id, NFS_V3), untar(_untar) {}
+
+    virtual void prepare() {
+      sprintf(name, "w-%04x", id);
+      create_obj(target.dir, name, DIRECTORY, &wdir);
+      make_fh3(wdir, &wdir_fh);
+    }
+
+    virtual void step() {
+      nfs_fh3 *dir = &wdir_fh;
+      uint32_t *count = &files;
+
+      if (untar) {
+        if (subdirs.empty() || subdirs.back() == dir_width) {
+          sprintf(name, "d-%08zx", subdirs.size());
+          if (mkdir3(&wdir_fh, name, &sub_fh) != NFS3_OK)
+            return;
+          subdirs.push_back(0);
+        }
+        dir = &sub_fh;
+        count = &subdirs.back();
+      }
+
+      sprintf(name, "f-%08x", *count);
+      if (create3(dir, name, &file_fh) != NFS3_OK)
+        return;
+      (*count)++;
+
+      if (write3(&file_fh, 0, small_size) != NFS3_OK)
+        return;
+
+      if (untar)
+        setattr3(&file_fh);
+    }
+
+    virtual void finish() {
+      struct fsal_obj_handle *sub;
+      fsal_status_t status;
+
+      for (size_t i = 0; i < subdirs.size(); ++i) {
+        sprintf(name, "d-%08zx", i);
+        status = fsal_lookup(wdir, name, &sub, NULL);
+        ASSERT_EQ(status.major, 0);
+        remove_entries(sub, "f-%08x", subdirs[i]);
+        sub->obj_ops->put_ref(sub);
+        status = fsal_remove(wdir, name, NULL, NULL);
+        EXPECT_EQ(status.major, 0);
+      }
+
+      remove_entries(wdir, "f-%08x", files);
+
+      wdir->obj_ops->put_ref(wdir);
+      sprintf(name, "w-%04x", id);
+      status = fsal_remove(target.dir, name, NULL, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      gsh_free(wdir_fh.data.data_val);
+      gsh_free(sub_fh.data.data_val);
+      gsh_free(file_fh.data.data_val);
+    }
+
+  protected:
+    bool untar;
+    char name[NAMELEN];
+    struct fsal_obj_handle *wdir = nullptr;
+    nfs_fh3 wdir_fh = {};
+    nfs_fh3 sub_fh = {};
+    nfs_fh3 file_fh = {};
+    uint32_t files = 0;
+    std::vector<uint32_t> subdirs; /* files created in each */
+  };
+
+  class UntarWorker : public CreateWorker {
+  public:
+    UntarWorker(const load_target &_target, unsigned int _id) :
+      CreateWorker(_target, _id, true) {}
+  };
+
+  /* All workers create and remove entries in a single directory, and
+   * change and fetch the attributes of a single file.
+   */
+  class ContendWorker : public LoadWorker {
+  public:
+    ContendWorker(const load_target &_target, unsigned int _id) :
+      LoadWorker(_target, _id, NFS_V3) {}
+
+    virtual void prepare() {
+      make_fh3(target.shared_dir, &dir_fh);
+      make_fh3(target.shared_file, &file_fh);
+    }
+
+    virtual void step() {
+      sprintf(name, "c-%04x-%08x", id, count++);
+
+      if (create3(&dir_fh, name, nullptr) == NFS3_OK)
+        remove3(&dir_fh, name);
+
+      setattr3(&file_fh);
+      getattr3(&file_fh);
+    }
+
+    virtual void finish() {
+      gsh_free(dir_fh.data.data_val);
+      gsh_free(file_fh.data.data_val);
+    }
+
+  protected:
+    char name[NAMELEN];
+    nfs_fh3 dir_fh = {};
+    nfs_fh3 file_fh = {};
+    uint32_t count = 0;
+  };
+#endif /* _USE_NFS3 */
+
+  /* LOOKUP and GETATTR random files among file_count */
+  class StatWorker : public LoadWorker {
+  public:
+    StatWorker(const load_target &_target, unsigned int _id) :
+      LoadWorker(_target, _id, NFS_V4), rng(_id) {}
+
+    virtual void prepare() {
+      make_fh4(target.dir, &dir_fh);
+
+      memset(ops, 0, sizeof(ops));
+      putfh4(&ops[0], &dir_fh);
+      ops[1].argop = NFS4_OP_LOOKUP;
+      ops[1].nfs_argop4_u.oplookup.objname.utf8string_val = name;
+      ops[2].argop = NFS4_OP_GETATTR;
+      set_attribute_in_bitmap(&ops[2].nfs_argop4_u.opgetattr.attr_request,
+                              FATTR4_TYPE);
+      set_attribute_in_bitmap(&ops[2].nfs_argop4_u.opgetattr.attr_request,
+                              FATTR4_CHANGE);
+      set_attribute_in_bitmap(&ops[2].nfs_argop4_u.opgetattr.attr_request,
+                              FATTR4_SIZE);
+      set_attribute_in_bitmap(&ops[2].nfs_argop4_u.opgetattr.attr_request,
+                              FATTR4_MODE);
+      set_attribute_in_bitmap(&ops[2].nfs_argop4_u.opgetattr.attr_request,
+                              FATTR4_TIME_MODIFY);
+    }
+
+    virtual void step() {
+      std::uniform_int_distribution<uint32_t> pick(0, file_count - 1);
+
+      ops[1].nfs_argop4_u.oplookup.objname.utf8string_len =
+        sprintf(name, "f-%08x", pick(rng));
+
+      compound(ops, 3);
+    }
+
+    virtual void finish() {
+      gsh_free(dir_fh.nfs_fh4_val);
+    }
+
+  protected:
+    std::minstd_rand rng;
+    char name[NAMELEN];
+    nfs_fh4 dir_fh = {};
+    nfs_argop4 ops[3];
+  };
+
+  /* Stream through a file of file_size of its own by io_size */
+  class StreamWorker : public LoadWorker {
+  public:
+    StreamWorker(const load_target &_target, unsigned int _id,
+                 bool _write) :
+      LoadWorker(_target, _id, NFS_V4), write(_write) {}
+
+    virtual void prepare() {
+      nfs_argop4 ops[2];
+      struct iovec iov;
+
+      sprintf(name, "s-%04x", id);
+      create_obj(target.dir, name, REGULAR_FILE, &file);
+      make_fh4(file, &fh);
+
+      if (write)
+        return;
+
+      /* Fill the file to read */
+      putfh4(&ops[0], &fh);
+      for (offset = 0; offset < file_size; offset += io_size) {
+        write4(&ops[1], &iov, offset, io_size, FILE_SYNC4);
+        ASSERT_EQ(compound(ops, 2), NFS4_OK);
+      }
+      offset = 0;
+    }
+
+    virtual void step() {
+      nfs_argop4 ops[2];
+      struct iovec iov;
+
+      putfh4(&ops[0], &fh);
+
+      if (write)
+        write4(&ops[1], &iov, offset, io_size, UNSTABLE4);
+      else
+        read4(&ops[1], offset, io_size);
+
+      compound(ops, 2);
+
+      offset += io_size;
+      if (offset < file_size)
+        return;
+
+      offset = 0;
+
+      if (write) {
+        memset(&ops[1], 0, sizeof(ops[1]));
+        ops[1].argop = NFS4_OP_COMMIT;
+        compound(ops, 2);
+      }
+    }
+
+    virtual void finish() {
+      fsal_status_t status;
+
+      file->obj_ops->put_ref(file);
+      status = fsal_remove(target.dir, name, NULL, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      gsh_free(fh.nfs_fh4_val);
+    }
+
+  protected:
+    bool write;
+    char name[NAMELEN];
+    struct fsal_obj_handle *file = nullptr;
+    nfs_fh4 fh = {};
+    uint64_t offset = 0;
+  };
+
+  class SeqReadWorker : public StreamWorker {
+  public:
+    SeqReadWorker(const load_target &_target, unsigned int _id) :
+      StreamWorker(_target, _id, false) {}
+  };
+
+  class SeqWriteWorker : public StreamWorker {
+  public:
+    SeqWriteWorker(const load_target &_target, unsigned int _id) :
+      StreamWorker(_target, _id, true) {}
+  };
+
+  class LoadTest : public gtest::GaneshaFSALBaseTest {
+
+  protected:
+
+    virtual void SetUp() {
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      memset(&target, 0, sizeof(target));
+      target.exp = a_export;
+      target.dir = test_root;
+    }
+
+    /* Run a profile on nworkers threads for the duration */
+    template <class W>
+    load_stats run(unsigned int nworkers) {
+      std::vector<std::unique_ptr<LoadWorker>> workers;
+      std::vector<std::thread> pool;
+      std::atomic<unsigned int> ready(0);
+      std::atomic<bool> go(false), stop(false);
+      struct timespec start;
+      load_stats stats;
+
+      for (unsigned int i = 0; i < nworkers; ++i)
+        workers.emplace_back(new W(target, i));
+
+      for (auto &w : workers) {
+        LoadWorker *worker = w.get();
+
+        pool.emplace_back([worker, &ready, &go, &stop] {
+          worker->begin();
+          worker->prepare();
+          worker->stats = load_stats();
+          ready++;
+
+          while (!go)
+            std::this_thread::yield();
+
+          while (!stop)
+            worker->step();
+
+          worker->finish();
+          worker->end();
+        });
+      }
+
+      while (ready < nworkers)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+      /* Don't profile the set up of the workload */
+      if (lock_sites > 0)
+        lock_profile_reset();
+
+      now(&start);
+      go = true;
+      std::this_thread::sleep_for(std::chrono::seconds(duration));
+      stop = true;
+
+      /* Workers finish the step they are at before stopping */
+      for (auto &t : pool)
+        t.join();
+
+      stats.seconds = elapsed_ns(&start) / 1e9;
+
+      for (auto &w : workers)
+        stats.merge(w->stats);
+
+      std::sort(stats.latencies.begin(), stats.latencies.end());
+
+      return stats;
+    }
+
+    static double percentile_us(const load_stats &stats, double p) {
+      size_t n = stats.latencies.size();
+
+      if (n == 0)
+        return 0.0;
+
+      return stats.latencies[std::min(n - 1, (size_t)(p * n))] / 1000.0;
+    }
+
+    void report(const char *profile, unsigned int nworkers,
+                const load_stats &stats) {
+      using namespace std;
+      size_t requests = stats.latencies.size();
+
+      cout << fixed << setprecision(1);
+      cout << profile << ": " << nworkers << " threads, " << stats.seconds
+           << " s, " << requests << " requests, "
+           << requests / stats.seconds << " req/s, "
+           << stats.bytes / stats.seconds / (1024 * 1024) << " MiB/s"
+           << endl;
+      cout << "  latency us: p50 " << percentile_us(stats, 0.5)
+           << " p90 " << percentile_us(stats, 0.9)
+           << " p99 " << percentile_us(stats, 0.99)
+           << " p99.9 " << percentile_us(stats, 0.999)
+           << " max " << (requests ? stats.latencies.back() / 1000.0 : 0)
+           << endl;
+
+      cout << "  " << left << setw(12) << "op" << right << setw(12)
+           << "count" << setw(8) << "errors" << setw(12) << "avg us"
+           << setw(12) << "max us" << endl;
+
+      for (auto &op : stats.ops) {
+        cout << "  " << left << setw(12) << op.first << right << setw(12)
+             << op.second.count << setw(8) << op.second.errors << setw(12)
+             << op.second.avg_us() << setw(12)
+             << op.second.max_ns / 1000.0 << endl;
+      }
+    }
+
+    /* The lock sites waited for the longest during the run */
+    void report_locks(const load_stats &stats) {
+      using namespace std;
+      struct lock_profile_sum *sums;
+      uint64_t dropped;
+      size_t count;
+
+      count = lock_profile_collect(&sums, &dropped);
+
+      cout << "  lock contention: " << count << " sites";
+      if (dropped != 0)
+        cout << ", " << dropped << " waits not accounted";
+      cout << endl;
+
+      cout << "  " << right << setw(10) << "wait ms" << setw(10)
+           << "% of run" << setw(10) << "waits" << setw(10) << "max us"
+           << "  " << left << setw(6) << "kind" << "lock" << endl;
+
+      for (size_t i = 0; i < std::min(count, (size_t) lock_sites); ++i) {
+        struct lock_profile_sum *sum = &sums[i];
+
+        /* Share of the time the workers ran for spent waiting there */
+        cout << "  " << right << setw(10) << sum->wait_ns / 1e6
+             << setw(9) << 100.0 * sum->wait_ns /
+                (stats.seconds * 1e9 * threads) << "%"
+             << setw(10) << sum->contended << setw(10)
+             << sum->max_ns / 1000.0 << "  " << left << setw(6)
+             << sum->site->kind << sum->site->name << " at "
+             << sum->site->file << ":" << sum->site->line << endl;
+      }
+
+      gsh_free(sums);
+    }
+
+    template <class W>
+    void measure(const char *profile) {
+      load_stats stats;
+
+      if (lock_sites > 0)
+        ASSERT_TRUE(lock_profile_enable(true));
+
+      enableEvents(event_list);
+      if (profile_out)
+        ProfilerStart(profile_out);
+
+      stats = run<W>(threads);
+
+      if (profile_out)
+        ProfilerStop();
+      disableEvents(event_list);
+
+      if (lock_sites > 0)
+        (void)lock_profile_enable(false);
+
+      report(profile, threads, stats);
+
+      if (lock_sites > 0)
+        report_locks(stats);
+
+      for (auto &op : stats.ops)
+        EXPECT_EQ(op.second.errors, 0) << profile << " " << op.first;
+    }
+
+    load_target target;
+  };
+
+  class StatLoadTest : public LoadTest {
+
+  protected:
+
+    virtual void SetUp() {
+      LoadTest::SetUp();
+
+      create_and_prime_many(file_count);
+    }
+
+    virtual void TearDown() {
+      remove_many(file_count);
+
+      LoadTest::TearDown();
+    }
+  };
+
+  class ContendLoadTest : public LoadTest {
+
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+
+      LoadTest::SetUp();
+
+      status = fsal_create(test_root, "contend", DIRECTORY, &attrs, NULL,
+                           &target.shared_dir, NULL, nullptr, nullptr);
+      ASSERT_EQ(status.major, 0);
+
+      status = fsal_create(test_root, "shared", REGULAR_FILE, &attrs, NULL,
+                           &target.shared_file, NULL, nullptr, nullptr);
+      ASSERT_EQ(status.major, 0);
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+
+      target.shared_file->obj_ops->put_ref(target.shared_file);
+      status = fsal_remove(test_root, "shared", NULL, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      target.shared_dir->obj_ops->put_ref(target.shared_dir);
+      status = fsal_remove(test_root, "contend", NULL, NULL);
+      EXPECT_EQ(status.major, 0);
+
+      LoadTest::TearDown();
+    }
+  };
+
+} /* namespace */
+
+#ifdef _USE_NFS3
+TEST_F(LoadTest, UNTAR)
+{
+  measure<UntarWorker>("untar");
+}
+
+TEST_F(LoadTest, CREATE)
+{
+  measure<CreateWorker>("create");
+}
+
+TEST_F(ContendLoadTest, CONTEND)
+{
+  measure<ContendWorker>("contend");
+}
+#endif /* _USE_NFS3 */
+
+TEST_F(StatLoadTest, STAT)
+{
+  measure<StatWorker>("stat");
+}
+
+TEST_F(LoadTest, SEQREAD)
+{
+  measure<SeqReadWorker>("seqread");
+}
+
+TEST_F(LoadTest, SEQWRITE)
+{
+  measure<SeqWriteWorker>("seqwrite");
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+       "LTTng session name")
+
+      ("event-list", po::value<string>(),
+       "LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+       "Enable profiling and set output file.")
+
+      ("threads", po::value<unsigned int>(&threads),
+       "number of worker threads")
+
+      ("duration", po::value<unsigned int>(&duration),
+       "seconds each profile runs for")
+
+      ("files", po::value<unsigned int>(&file_count),
+       "number of files of the stat profile")
+
+      ("small-size", po::value<unsigned int>(&small_size),
+       "size of the files of the untar and create profiles")
+
+      ("io-size", po::value<unsigned int>(&io_size),
+       "size of the READs and WRITEs of the seqread and seqwrite profiles")
+
+      ("file-size", po::value<uint64_t>(&file_size),
+       "size of the files of the seqread and seqwrite profiles")
+
+      ("dir-width", po::value<unsigned int>(&dir_width),
+       "files per directory of the untar profile")
+
+      ("lock-sites", po::value<unsigned int>(&lock_sites),
+       "most contended lock sites reported, 0 to not profile locks")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+         (char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    if (threads == 0 || file_count == 0 || io_size == 0 ||
+        file_size < io_size || dir_width == 0) {
+      cout << "Invalid load parameters" << endl;
+      return 1;
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+                                        session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
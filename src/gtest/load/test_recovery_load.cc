@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Recovery backend reconnect storm
+ *
+ * Each recovery backend in turn records --clients clients from --threads
+ * threads, as EXCHANGE_ID does after a failover, ends the grace period,
+ * expires half the clients and is restarted to read the other half back.
+ * The time taken by each phase, and the latency of recording a client,
+ * are reported so that fs_journal can be compared with fs_ng.
+ *
+ * The recovery databases are created under --dir, which should be on the
+ * filesystem the server keeps its RecoveryRoot on.
+ */
+
+#include <sys/types.h>
+#include <ftw.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Don't include rpcent.h; it has C++ issues, and is unneeded */
+#define _RPC_RPCENT_H
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "sal_data.h"
+#include "sal_functions.h"
+#include "client_mgr.h"
+#include "abstract_mem.h"
+}
+
+namespace {
+
+  std::string dir = "/tmp";
+  unsigned int client_count = 50000;
+  unsigned int thread_count = 64;
+
+  typedef std::chrono::steady_clock clock_type;
+
+  double ms_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+      clock_type::now() - start).count();
+  }
+
+  int remove_entry(const char *path, const struct stat *unused_sb,
+                   int unused_flag, struct FTW *unused_ftw) {
+    return remove(path);
+  }
+
+  /* fs and fs_ng can't read back the tags of clients with no address */
+  struct gsh_client client_host;
+
+  clid_entry_t reclaimed;
+  unsigned int reclaimed_count;
+
+  clid_entry_t *add_clid_entry(char *unused_name) {
+    reclaimed_count++;
+    return &reclaimed;
+  }
+
+  rdel_fh_t *add_rfh_entry(clid_entry_t *unused_clid, char *unused_fh) {
+    return nullptr;
+  }
+
+  class RecoveryLoadTest : public ::testing::Test {
+
+  protected:
+
+    virtual void SetUp() {
+      char root[] = "ganesha_recovery_load.XXXXXX";
+      std::string path = dir + "/" + root;
+
+      ASSERT_NE(mkdtemp(&path[0]), nullptr);
+      recov_root = path;
+      nfs_param.nfsv4_param.recov_root = &recov_root[0];
+      strcpy(client_host.hostaddr_str, "192.0.2.1");
+
+      /* The same opaque client ids a Linux client would send */
+      for (unsigned int i = 0; i < client_count; i++) {
+        std::string owner = "Linux NFSv4.1 client-" + std::to_string(i);
+        nfs_client_record_t *record = (nfs_client_record_t *)
+          gsh_calloc(1, sizeof(*record) + owner.size());
+        nfs_client_id_t *client = (nfs_client_id_t *)
+          gsh_calloc(1, sizeof(*client));
+
+        record->cr_client_val_len = owner.size();
+        memcpy(record->cr_client_val, owner.data(), owner.size());
+        client->cid_client_record = record;
+        client->gsh_client = &client_host;
+        clients.push_back(client);
+      }
+    }
+
+    virtual void TearDown() {
+      for (auto client : clients) {
+        gsh_free(client->cid_recov_tag);
+        gsh_free(client->cid_client_record);
+        gsh_free(client);
+      }
+
+      (void)nftw(recov_root.c_str(), remove_entry, 16,
+                 FTW_DEPTH | FTW_PHYS);
+    }
+
+    /* Run fn on every client in [first, last) from thread_count threads,
+     * return the latency of each call in microseconds.
+     */
+    std::vector<double> storm(size_t first, size_t last,
+                              void (*fn)(nfs_client_id_t *)) {
+      std::vector<double> latency(last - first);
+      std::vector<std::thread> threads;
+
+      for (unsigned int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = first + t; i < last; i += thread_count) {
+              auto start = clock_type::now();
+
+              fn(clients[i]);
+              latency[i - first] = ms_since(start) * 1000;
+            }
+          });
+      }
+
+      for (auto& thread : threads)
+        thread.join();
+
+      std::sort(latency.begin(), latency.end());
+      return latency;
+    }
+
+    void report(const char *phase, double ms,
+                const std::vector<double>& latency) {
+      std::cout << std::setw(12) << phase << std::fixed
+                << std::setprecision(1) << std::setw(10) << ms << " ms";
+
+      if (!latency.empty()) {
+        std::cout << std::setw(10) << latency.size() * 1000 / ms
+                  << " ops/s  p50 " << latency[latency.size() / 2]
+                  << " us  p99 " << latency[latency.size() * 99 / 100]
+                  << " us";
+      }
+
+      std::cout << std::endl;
+    }
+
+    void run(void (*backend_init)(struct nfs4_recovery_backend **)) {
+      struct nfs4_recovery_backend *backend;
+      std::vector<double> latency;
+      size_t half = clients.size() / 2;
+      clock_type::time_point start;
+
+      backend_init(&backend);
+
+      ASSERT_EQ(backend->recovery_init(), 0);
+      backend->recovery_read_clids(nullptr, add_clid_entry, add_rfh_entry);
+
+      start = clock_type::now();
+      latency = storm(0, clients.size(), backend->add_clid);
+      report("add_clid", ms_since(start), latency);
+
+      start = clock_type::now();
+      backend->end_grace();
+      report("end_grace", ms_since(start), {});
+
+      start = clock_type::now();
+      latency = storm(half, clients.size(), backend->rm_clid);
+      report("rm_clid", ms_since(start), latency);
+
+      if (backend->recovery_shutdown != nullptr)
+        backend->recovery_shutdown();
+
+      ASSERT_EQ(backend->recovery_init(), 0);
+
+      reclaimed_count = 0;
+      start = clock_type::now();
+      backend->recovery_read_clids(nullptr, add_clid_entry, add_rfh_entry);
+      report("read_clids", ms_since(start), {});
+      EXPECT_EQ(reclaimed_count, half);
+
+      backend->end_grace();
+      if (backend->recovery_shutdown != nullptr)
+        backend->recovery_shutdown();
+    }
+
+    std::string recov_root;
+    std::vector<nfs_client_id_t *> clients;
+  };
+
+} /* namespace */
+
+TEST_F(RecoveryLoadTest, FS_NG)
+{
+  run(fs_ng_backend_init);
+}
+
+TEST_F(RecoveryLoadTest, FS_JOURNAL)
+{
+  run(fs_journal_backend_init);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("dir", po::value<string>(&dir),
+       "directory the recovery databases are created in")
+
+      ("clients", po::value<unsigned int>(&client_count),
+       "clients recorded per backend")
+
+      ("threads", po::value<unsigned int>(&thread_count),
+       "threads recording clients")
+      ;
+
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    if (client_count < 2 || thread_count == 0) {
+      cout << "Invalid storm parameters" << endl;
+      return 1;
+    }
+
+    nfs_param.nfsv4_param.recov_dir = (char *)"v4recov";
+
+    ::testing::InitGoogleTest(&argc, argv);
+    code = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Counts the heap allocations made by a PUTFH, SAVEFH, LOOKUP compound,
+ * with the compound data and filehandles allocated from the compound
+ * arena, and allocated the way nfs4_Compound() did before the arena.
+ *
+ * malloc and friends are interposed by this executable and count the
+ * allocations of the test thread.  The address sanitizer interposes them
+ * too, so with it only the time per compound is reported.
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "gtest_nfs4.hh"
+
+extern "C" {
+/* Manually forward this, an 9P is not C++ safe */
+void admin_halt(void);
+
+/* The glibc allocator the interposed functions forward to */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+#define TEST_ROOT "nfs4_compound_allocs"
+#define WARMUP_COUNT 1000
+#define LOOP_COUNT 100000
+
+namespace {
+
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+
+  __thread bool counting;
+  __thread uint64_t allocations;
+
+} /* namespace */
+
+#ifndef SANITIZE_ADDRESS
+extern "C" {
+
+void *malloc(size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  void *p;
+
+  if (counting)
+    allocations++;
+  p = __libc_memalign(alignment, size);
+  if (p == NULL)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
+} /* extern "C" */
+#endif /* SANITIZE_ADDRESS */
+
+namespace {
+
+  class CompoundAllocsTest : public gtest::GaeshaNFS4BaseTest {
+
+  protected:
+
+    virtual void SetUp() {
+      GaeshaNFS4BaseTest::SetUp();
+
+      create_and_prime_many(1, objs);
+
+      /* PUTFH test_root, SAVEFH, LOOKUP f-00000000 */
+      gsh_free(ops);
+      ops = (struct nfs_argop4 *) gsh_calloc(3, sizeof(struct nfs_argop4));
+      arg.arg_compound4.argarray.argarray_len = 3;
+      arg.arg_compound4.argarray.argarray_val = ops;
+
+      setup_putfh(0, test_root);
+      ops[1].argop = NFS4_OP_SAVEFH;
+      setup_lookup(2, "f-00000000");
+    }
+
+    virtual void TearDown() {
+      remove_many(1, objs);
+
+      GaeshaNFS4BaseTest::TearDown();
+    }
+
+    /* Run the compound on its own compound data, the way nfs4_Compound()
+     * does, with the data and filehandles from the arena or, as before
+     * the arena, from the heap.
+     */
+    void run_compound(bool arena) {
+      compound_data_t *fixture = data;
+      char *tagname = nullptr;
+      int rc;
+
+      if (arena) {
+        data = compound_data_alloc();
+        data->tagname = "NO TAG";
+      } else {
+        data = (compound_data_t *) gsh_calloc(1, sizeof(*data));
+        tagname = gsh_strdup("NO TAG");
+        data->tagname = tagname;
+        /* PUTFH and SAVEFH used nfs4_AllocateFH() */
+        data->currentFH.nfs_fh4_val = (char *) gsh_malloc(NFS4_FHSIZE);
+        data->savedFH.nfs_fh4_val = (char *) gsh_malloc(NFS4_FHSIZE);
+      }
+
+      rc = nfs4_op_putfh(&ops[0], data, &resp);
+      EXPECT_EQ(rc, NFS4_OK);
+      nfs4_Compound_FreeOne(&resp);
+
+      rc = nfs4_op_savefh(&ops[1], data, &resp);
+      EXPECT_EQ(rc, NFS4_OK);
+      nfs4_Compound_FreeOne(&resp);
+
+      rc = nfs4_op_lookup(&ops[2], data, &resp);
+      EXPECT_EQ(rc, NFS4_OK);
+      EXPECT_EQ(objs[0], data->current_obj);
+      nfs4_Compound_FreeOne(&resp);
+
+      compound_data_Free(data);
+
+      if (!arena) {
+        gsh_free(data->currentFH.nfs_fh4_val);
+        gsh_free(data->savedFH.nfs_fh4_val);
+        gsh_free(tagname);
+        gsh_free(data);
+      }
+
+      data = fixture;
+    }
+
+    /* Allocations per compound, in hundredths */
+    uint64_t count_allocations(bool arena) {
+      struct timespec s_time, e_time;
+      uint64_t count;
+
+      for (int i = 0; i < WARMUP_COUNT; ++i)
+        run_compound(arena);
+
+      enableEvents(event_list);
+      if (profile_out)
+        ProfilerStart(profile_out);
+
+      now(&s_time);
+      allocations = 0;
+      counting = true;
+
+      for (int i = 0; i < LOOP_COUNT; ++i)
+        run_compound(arena);
+
+      counting = false;
+      count = allocations;
+      now(&e_time);
+
+      if (profile_out)
+        ProfilerStop();
+      disableEvents(event_list);
+
+      fprintf(stderr, "%s: %" PRIu64 ".%02" PRIu64
+              " allocations and %" PRIu64 " ns per compound\n",
+              arena ? "arena" : "heap", count / LOOP_COUNT,
+              count * 100 / LOOP_COUNT % 100,
+              timespec_diff(&s_time, &e_time) / LOOP_COUNT);
+
+      return count * 100 / LOOP_COUNT;
+    }
+
+    struct fsal_obj_handle *objs[1];
+  };
+
+} /* namespace */
+
+TEST_F(CompoundAllocsTest, HEAP)
+{
+  count_allocations(false);
+}
+
+TEST_F(CompoundAllocsTest, ARENA)
+{
+  count_allocations(true);
+}
+
+TEST_F(CompoundAllocsTest, COMPARE)
+{
+  uint64_t heap = count_allocations(false);
+  uint64_t arena = count_allocations(true);
+
+#ifndef SANITIZE_ADDRESS
+  /* The compound data, the tag and both filehandles */
+  EXPECT_LE(arena + 4 * 100, heap);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+       "LTTng session name")
+
+      ("event-list", po::value<string>(),
+       "LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+       "Enable profiling and set output file.")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+         (char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+                                        session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
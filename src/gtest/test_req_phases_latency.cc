@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Cost and accounting of the request phase statistics
+ *
+ * --threads workers each put --requests NFSv4 requests through the marks of
+ * the flight recorder, the way nfs_rpc_process_request() does, with an FSAL
+ * call made under a state lock, and the time per request is reported.  The
+ * recent request rings and the slow request log are off, so with
+ * --phase-stats=false nothing is recorded and the difference between the
+ * two runs is the cost of the phase statistics.
+ *
+ * Every phase must then have been accounted once per request, and no
+ * request may have more FSAL and SAL time than its execution took.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Don't include rpcent.h; it has C++ issues, and is unneeded */
+#define _RPC_RPCENT_H
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "nfs_proto_data.h"
+#include "req_recorder.h"
+#include "sal_functions.h"
+#include "fsal.h"
+/* For the timing of FSAL calls */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_int.h"
+}
+
+namespace {
+
+  unsigned int threads = 4;
+  unsigned int request_count = 1000000;
+  bool phase_stats = true;
+
+  class ReqPhasesLatency : public ::testing::Test {
+  protected:
+
+    /* Run the requests of one worker, returns the time it took and the
+     * number of requests whose FSAL and SAL time exceed their execution.
+     */
+    static void run_requests(uint64_t *elapsed, uint64_t *overlaps) {
+      struct req_op_context op_context;
+      struct timespec s_time, e_time, op_start;
+      nfs_request_t *reqdata;
+      struct req_record *record, *fsal_record;
+      uint64_t fsal_start = 0;
+
+      reqdata = (nfs_request_t *) gsh_calloc(1, sizeof(*reqdata));
+      reqdata->svc.rq_msg.cb_prog = nfs_param.core_param.program[P_NFS];
+      reqdata->svc.rq_msg.cb_vers = NFS_V4;
+
+      init_op_context_simple(&op_context, NULL, NULL);
+      record = &reqdata->record;
+      *overlaps = 0;
+
+      now(&s_time);
+
+      for (unsigned int i = 0; i < request_count; ++i) {
+        /* Requests are zeroed when allocated */
+        memset(&reqdata->record, 0, sizeof(reqdata->record));
+
+        req_record_mark(reqdata, REQ_MARK_RECEIVED);
+        req_record_mark(reqdata, REQ_MARK_PROCESS);
+        req_record_start(reqdata);
+        req_record_mark(reqdata, REQ_MARK_DUPREQ);
+        req_record_mark(reqdata, REQ_MARK_EXECUTE);
+        req_record_mark(reqdata, REQ_MARK_DISPATCH);
+
+        /* An FSAL call under a state lock, as OPEN makes */
+        req_record_sal_lock();
+        fsal_record = req_record_fsal_start(&fsal_start);
+        req_record_fsal_done(fsal_record, fsal_start);
+        req_record_sal_unlock();
+
+        now(&op_start);
+        req_record_op(NFS4_OP_SEQUENCE, "SEQUENCE", &op_start, NFS4_OK);
+        req_record_op(NFS4_OP_GETATTR, "GETATTR", &op_start, NFS4_OK);
+
+        req_record_mark(reqdata, REQ_MARK_SERVICE);
+
+        if (record->fsal_cycles + record->sal_cycles >
+            record->marks[REQ_MARK_SERVICE] - record->marks[REQ_MARK_EXECUTE])
+          (*overlaps)++;
+
+        req_record_done(reqdata, 0);
+      }
+
+      now(&e_time);
+
+      release_op_context();
+      gsh_free(reqdata);
+
+      *elapsed = timespec_diff(&s_time, &e_time);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(ReqPhasesLatency, RUN)
+{
+  std::vector<std::thread> workers;
+  std::vector<uint64_t> elapsed(threads), overlaps(threads);
+  uint64_t requests = (uint64_t) threads * request_count;
+  uint64_t count[REQ_PHASE_COUNT], sum[REQ_PHASE_COUNT];
+  uint64_t total = 0;
+  int phase;
+
+  req_recorder_reset();
+
+  for (unsigned int i = 0; i < threads; ++i)
+    workers.emplace_back(run_requests, &elapsed[i], &overlaps[i]);
+
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers[i].join();
+    total += elapsed[i];
+    EXPECT_EQ(0u, overlaps[i]) << "worker " << i;
+  }
+
+  fprintf(stderr, "phase stats %s, %u threads: %" PRIu64
+          " ns per request\n", phase_stats ? "on" : "off", threads,
+          total / requests);
+
+  for (phase = 0; phase < REQ_PHASE_COUNT; ++phase) {
+    req_recorder_phase_total((enum req_phase) phase, &count[phase],
+                             &sum[phase]);
+    EXPECT_EQ(phase_stats ? requests : 0, count[phase]) << "phase " << phase;
+  }
+
+  /* FSAL calls made with a state lock held are only FSAL time */
+  EXPECT_LE(sum[REQ_PHASE_FSAL] + sum[REQ_PHASE_SAL], sum[REQ_PHASE_EXECUTE]);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("threads", po::value<unsigned int>(&threads),
+       "number of workers")
+
+      ("requests", po::value<unsigned int>(&request_count),
+       "requests per worker")
+
+      ("phase-stats", po::value<bool>(&phase_stats),
+       "account the phases of requests (default true)")
+      ;
+
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    /* Only the phase statistics, as Enable_Request_Phase_Stats does */
+    nfs_param.core_param.program[P_NFS] = NFS_PROGRAM;
+    nfs_param.core_param.request_recorder_size = 0;
+    nfs_param.core_param.slow_request_threshold = 0;
+    nfs_param.core_param.enable_request_phase_stats = phase_stats;
+    req_recorder_init();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Stale stateids after the reuse of their slot
+ *
+ * A state is put in a slot of the stateid table, and enough states are
+ * kept to hold every other slot of the first chunk, so that the states
+ * created after it is deleted all reuse its slot.  None of them, nor any
+ * state after the slot ran out of generations, may be found by the
+ * stateid of the first state.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include "gtest/gtest.h"
+/* Make sure urcu-bp.h is included as C++ */
+#include <urcu-bp.h>
+
+extern "C" {
+/* Don't include rpcent.h; it has C++ issues, and is unneeded */
+#define _RPC_RPCENT_H
+/* Ganesha headers */
+#include "nfs_core.h"
+#include "sal_functions.h"
+}
+
+/* Slots of a chunk of the table, and generations of a slot */
+#define CHUNK_SLOTS 4096
+#define SLOT_GENERATIONS 4096
+
+namespace {
+
+  class StateidReuse : public ::testing::Test {
+  protected:
+
+    virtual void SetUp() {
+      memset(&clientid, 0, sizeof(clientid));
+      clientid.cid_clientid = 0x0000000100000001ULL;
+    }
+
+    virtual void TearDown() {
+      for (state_t *state : held)
+        delete_state(state);
+
+      held.clear();
+
+      /* Let the deleted states be freed */
+      rcu_barrier();
+    }
+
+    state_t *create_state() {
+      state_t *state = (state_t *) gsh_calloc(1, sizeof(*state));
+
+      PTHREAD_MUTEX_init(&state->state_mutex, NULL);
+      state->state_type = STATE_TYPE_DELEG;
+      state->state_refcount = 1;
+      nfs4_BuildStateId_Other(&clientid, state->stateid_other);
+
+      EXPECT_EQ(STATE_SUCCESS, nfs4_State_Set(state));
+
+      return state;
+    }
+
+    void delete_state(state_t *state) {
+      EXPECT_TRUE(nfs4_State_Del(state));
+      dec_nfs4_state_ref(state);
+    }
+
+    /* Whether a stateid other finds a state */
+    bool found(char *other, state_t *expected) {
+      state_t *state = nfs4_State_Get_Pointer(other);
+
+      if (state == NULL)
+        return false;
+
+      EXPECT_EQ(expected, state);
+      dec_nfs4_state_ref(state);
+
+      return true;
+    }
+
+    nfs_client_id_t clientid;
+    std::vector<state_t *> held;
+  };
+
+} /* namespace */
+
+TEST_F(StateidReuse, STALE_AFTER_SLOT_REUSE)
+{
+  char stale[OTHERSIZE];
+  state_t *first, *state;
+
+  first = create_state();
+  memcpy(stale, first->stateid_other, OTHERSIZE);
+  EXPECT_TRUE(found(stale, first));
+
+  /* Hold the other slots so the next states reuse the slot of first */
+  for (int i = 1; i < CHUNK_SLOTS; ++i)
+    held.push_back(create_state());
+
+  delete_state(first);
+  EXPECT_FALSE(found(stale, NULL));
+
+  for (int i = 1; i <= SLOT_GENERATIONS; ++i) {
+    state = create_state();
+
+    EXPECT_NE(0, memcmp(stale, state->stateid_other, OTHERSIZE))
+      << "stateid reused after " << i << " states";
+    EXPECT_FALSE(found(stale, state))
+      << "stale stateid found after " << i << " states";
+
+    delete_state(state);
+  }
+
+  EXPECT_FALSE(found(stale, NULL));
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+
+  if (nfs4_Init_state_id() != 0) {
+    std::cerr << "Could not initialize the stateid table" << std::endl;
+    return 1;
+  }
+
+  return RUN_ALL_TESTS();
+}
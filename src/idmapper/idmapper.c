@@ -61,6 +61,8 @@
 #include "idmapper.h"
 #include "server_stats_private.h"
 #include "idmapper_monitoring.h"
+#include "mem_accounting.h"
+#include <urcu-bp.h>
 
 struct owner_domain_holder {
 	struct gsh_buffdesc domain;
@@ -217,10 +219,13 @@ bool set_idmapping_status(bool status_enabled)
  */
 void idmapper_cleanup(void)
 {
+	idmapper_snapshot_destroy();
+
 	if (cache_reaper_fridge != NULL) {
 		fridgethr_destroy(cache_reaper_fridge);
 		cache_reaper_fridge = NULL;
 	}
+	idmapper_flight_destroy();
 	idmapper_clear_owner_domain();
 	idmapper_destroy_cache();
 	idmapper_negative_cache_destroy();
@@ -281,6 +286,26 @@ static void idmapper_reaper_init(void)
 	LogInfo(COMPONENT_IDMAPPER, "Idmapper reaper initialized");
 }
 
+/**
+ * @brief Clear the caches while the idmapper is over its memory limit
+ *
+ * Called by the reaper, see gsh_mem_check().  Entries are not charged to
+ * anything finer than the component, so all of them go.
+ *
+ * @param[in] excess	Bytes allocated over Cache_Memory_Limit
+ */
+static void idmapper_reclaim_memory(uint64_t excess)
+{
+	LogEvent(COMPONENT_IDMAPPER,
+		 "Clearing the idmapper caches, %" PRIu64
+		 " bytes over Cache_Memory_Limit",
+		 excess);
+
+	idmapper_clear_cache();
+	idmapper_negative_cache_clear();
+	uid2grp_clear_cache();
+}
+
 /**
  * @brief Initialize the ID Mapper
  *
@@ -306,12 +331,18 @@ bool idmapper_init(void)
 
 	idmapper_cache_init();
 	idmapper_negative_cache_init();
+	idmapper_flight_init();
 	idmapper_reaper_init();
 
 	idmapper_cleanup_element.clean = idmapper_cleanup;
 	RegisterCleanup(&idmapper_cleanup_element);
 
 	idmapper_monitoring__init();
+	idmapper_snapshot_init();
+
+	gsh_mem_set_limit(COMPONENT_IDMAPPER,
+			  nfs_param.directory_services_param.cache_memory_limit,
+			  idmapper_reclaim_memory);
 
 	return true;
 }
@@ -335,7 +366,7 @@ static void add_user_to_cache(const struct gsh_buffdesc *name, uid_t uid,
 			uid);
 		return;
 	}
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
+	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
 
 	/* Recheck after obtaining the lock */
 	if (!idmapping_enabled) {
@@ -395,7 +426,7 @@ static void add_group_to_cache(const struct gsh_buffdesc *name, gid_t gid)
 			gid);
 		return;
 	}
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+	PTHREAD_RWLOCK_rdlock(&idmapper_group_lock);
 
 	/* Recheck after obtaining the lock */
 	if (!idmapping_enabled) {
@@ -455,6 +486,8 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 	const struct gsh_buffdesc *found;
 	uint32_t not_a_size_t;
 	bool success = false;
+	struct idmapper_flight *flight = NULL;
+	bool retried = false;
 
 	if (nfs_param.nfsv4_param.only_numeric_owners) {
 		/* 2**32 is 10 digits long in decimal */
@@ -473,8 +506,8 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 			"Idmapping is disabled, encode-nfs4-principal skipped");
 		return false;
 	}
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+again:
+	rcu_read_lock();
 	if (group)
 		success = idmapper_lookup_by_gid(id, &found);
 	else
@@ -487,12 +520,23 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		   hash table, no matter what our lookup method. */
 		success = inline_xdr_bytes(xdrs, (char **)&found->addr,
 					   &not_a_size_t, UINT32_MAX);
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-					      &idmapper_user_lock);
+		rcu_read_unlock();
 		return success;
 	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-					      &idmapper_user_lock);
+		rcu_read_unlock();
+
+		/* Only one thread looks a given id up, the others wait
+		 * for it and then find the result in the cache.
+		 */
+		if (!retried) {
+			retried = true;
+			if (!idmapper_flight_join(
+				    group ? IDMAPPER_FLIGHT_GID_TO_NAME :
+					    IDMAPPER_FLIGHT_UID_TO_NAME,
+				    &id, sizeof(id), &flight))
+				goto again;
+		}
+
 		int rc;
 		size_t size;
 		bool looked_up = false;
@@ -537,7 +581,7 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 				if (owner_domain_len == 0) {
 					LogInfo(COMPONENT_IDMAPPER,
 						"owner_domain.domain is NULL, cannot encode nfs4 principal");
-					return false;
+					goto out;
 				}
 				size += owner_domain_len + 2;
 			}
@@ -594,7 +638,7 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					if (owner_domain_len == 0) {
 						LogInfo(COMPONENT_IDMAPPER,
 							"owner_domain.domain is NULL, cannot encode nfs4 principal");
-						return false;
+						goto out;
 					}
 					memcpy(cursor, owner_domain_addr,
 					       owner_domain_len);
@@ -664,9 +708,15 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 			add_user_to_cache(&new_name, id, NULL, false);
 
 		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
+		success = inline_xdr_bytes(xdrs, (char **)&new_name.addr,
+					   &not_a_size_t, UINT32_MAX);
 	}
+
+out:
+	if (flight != NULL)
+		idmapper_flight_land(flight);
+
+	return success;
 }
 
 /**
@@ -1022,15 +1072,16 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 	char *at;
 	bool got_gid = false;
 	bool looked_up = false;
+	struct idmapper_flight *flight = NULL;
+	bool retried = false;
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+again:
+	rcu_read_lock();
 	if (group)
 		success = idmapper_lookup_by_gname(name, id);
 	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
-	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+		success = idmapper_lookup_by_uname(name, id, NULL);
+	rcu_read_unlock();
 
 	if (success)
 		return true;
@@ -1050,6 +1101,17 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		return true;
 	}
 
+	/* Only one thread looks a given name up, the others wait for it and
+	 * then find the result in the cache.
+	 */
+	if (!retried) {
+		retried = true;
+		if (!idmapper_flight_join(group ? IDMAPPER_FLIGHT_NAME_TO_GID :
+						  IDMAPPER_FLIGHT_NAME_TO_UID,
+					  name->addr, name->len, &flight))
+			goto again;
+	}
+
 	/* Something we can mutate and count on as terminated */
 	namebuff = alloca(name->len + 1);
 
@@ -1063,7 +1125,7 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		else if (atless2id(namebuff, name->len, id, anon))
 			looked_up = true;
 		else
-			return false;
+			goto out;
 	} else if (nfs_param.nfsv4_param.use_getpwnam) {
 		looked_up =
 			pwentname2id(namebuff, id, group, &gid, &got_gid, at);
@@ -1083,16 +1145,19 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 			add_group_to_negative_cache(name);
 		else
 			add_user_to_negative_cache(name);
-
-		return true;
-	}
-
-	if (group)
+	} else if (group) {
 		add_group_to_cache(name, *id);
-	else
+	} else {
 		add_user_to_cache(name, *id, got_gid ? &gid : NULL, false);
+	}
 
-	return true;
+	success = true;
+
+out:
+	if (flight != NULL)
+		idmapper_flight_land(flight);
+
+	return success;
 }
 
 /**
@@ -1235,19 +1300,18 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 	}
 
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
-	success = idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres,
-					   true);
+	rcu_read_lock();
+	success = idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres);
 
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
 	 * failure.
 	 */
 	if (success && (gss_gidres != NULL)) {
 		gss_gid = *gss_gidres;
-		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+		rcu_read_unlock();
 		goto out;
 	}
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+	rcu_read_unlock();
 
 	/* Lookup negative cache */
 	PTHREAD_RWLOCK_rdlock(&idmapper_negative_cache_user_lock);
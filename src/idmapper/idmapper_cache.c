@@ -31,6 +31,16 @@
 /**
  * @file    idmapper_cache.c
  * @brief   Id mapping cache functions
+ *
+ * Users and groups are cached in four maps: users by name, users by
+ * UID, groups by name and groups by GID.  Each map is a hash table split
+ * into shards; lookups walk the hash chains under rcu_read_lock() and
+ * take no lock at all, while updates of a shard are serialized by the
+ * shard's mutex.  Removed entries are freed after a grace period.
+ *
+ * When a shard grows beyond its share of the configured maximum, entries
+ * are evicted in CLOCK order: lookups mark entries as referenced, and the
+ * eviction hand gives referenced entries a second chance.
  */
 #include "config.h"
 #include "log.h"
@@ -45,307 +55,409 @@
 #include "gsh_dbus.h"
 #endif
 #include "common_utils.h"
-#include "avltree.h"
 #include "idmapper.h"
 #include "nfs_core.h"
 #include "abstract_atomic.h"
 #include "server_stats_private.h"
 #include "idmapper_monitoring.h"
+#include "city.h"
+#include <urcu-bp.h>
 
 /**
- * @brief User entry in the IDMapper cache
+ * @brief Number of shards of each map, should be a power of two
  */
 
-struct cache_user {
-	struct gsh_buffdesc uname; /*< Username */
-	uid_t uid; /*< Corresponding UID */
-	gid_t gid; /*< Corresponding GID */
-	bool gid_set; /*< if the GID has been set */
-	struct avltree_node uname_node; /*< Node in the name tree */
-	struct avltree_node uid_node; /*< Node in the UID tree */
-	bool in_uidtree; /* true iff this is in uid_tree */
-	time_t epoch;
-	TAILQ_ENTRY(cache_user) queue_entry; /* Node in user-fifo-queue */
-};
-
-#define user_expired(user)            \
-	(time(NULL) - (user)->epoch > \
-	 nfs_param.directory_services_param.idmapped_user_time_validity)
+#define idmapper_cache_shards 32
 
 /**
- * @brief Group entry in the IDMapper cache
+ * @brief Number of hash buckets of each shard, should be a power of two
  */
 
-struct cache_group {
-	struct gsh_buffdesc gname; /*< Group name */
-	gid_t gid; /*< Group ID */
-	struct avltree_node gname_node; /*< Node in the name tree */
-	struct avltree_node gid_node; /*< Node in the GID tree */
-	TAILQ_ENTRY(cache_group) queue_entry; /* Node in group-fifo-queue */
-	time_t epoch;
-};
-
-#define group_expired(group)           \
-	(time(NULL) - (group)->epoch > \
-	 nfs_param.directory_services_param.idmapped_group_time_validity)
+#define idmapper_shard_buckets 128
 
 /**
- * @brief Number of entries in the UID cache, should be prime.
+ * @brief User or group entry in one of the IDMapper cache maps
  */
 
-#define id_cache_size 1009
+struct cache_entry {
+	struct cache_entry *next; /*< Next in hash chain, RCU protected */
+	struct glist_head clock_node; /*< Node in the shard's clock list */
+	struct rcu_head rcu_head; /*< For freeing after a grace period */
+	uint64_t hash; /*< Hash of the key of the map */
+	time_t epoch; /*< When the entry was cached */
+	uint32_t referenced; /*< Clock bit, set by lookups */
+	uint32_t id; /*< UID or GID */
+	gid_t gid; /*< Corresponding GID of a user */
+	bool gid_set; /*< if the GID has been set */
+	struct gsh_buffdesc name; /*< User or group name */
+};
 
 /**
- * @brief A user fifo queue ordered by insertion timestamp
- *
- * This fifo queue also mimics the order of expiration time of the cache
- * entries, since the expiration time is a linear function of the insertion
- * time.
- *
- *   Expiration_time = Insertion_time + Cache_time_validity (constant)
- *
- * The head of the queue contains the entry with least time-validity.
- * The tail of the queue contains the entry with most time-validity.
- * The eviction happens from the head, and insertion happens at the tail.
+ * @brief A shard of a map
  */
-static TAILQ_HEAD(, cache_user) user_fifo_queue;
-
-/* Similar to above, this is the fifo queue containing group entries */
-static TAILQ_HEAD(, cache_group) group_fifo_queue;
 
-/**
- * @brief UID cache, may only be accessed with idmapper_user_lock
- * held.  If idmapper_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
- */
+struct cache_shard {
+	pthread_mutex_t lock; /*< Serializes updates of the shard */
+	struct glist_head clock; /*< Entries, oldest first */
+	uint32_t count; /*< Number of entries */
+	GSH_CACHE_PAD(0);
+	uint64_t hits; /*< Lookups that found an entry */
+	uint64_t misses; /*< Lookups that did not */
+	uint64_t evictions; /*< Entries evicted for room */
+	GSH_CACHE_PAD(1);
+	struct cache_entry *buckets[idmapper_shard_buckets];
+};
 
-static struct avltree_node *uid_cache[id_cache_size];
+/* The maps are stored in warm-restart snapshots with their index as type */
+enum cache_map_type {
+	CACHE_MAP_UNAME = IDMAPPER_SNAPSHOT_UNAME,
+	CACHE_MAP_UID = IDMAPPER_SNAPSHOT_UID,
+	CACHE_MAP_GNAME = IDMAPPER_SNAPSHOT_GNAME,
+	CACHE_MAP_GID = IDMAPPER_SNAPSHOT_GID,
+	CACHE_MAP_COUNT
+};
 
 /**
- * @brief GID cache, may only be accessed with idmapper_group_lock
- * held.  If idmapper_group_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief One of the IDMapper cache maps
  */
 
-static struct avltree_node *gid_cache[id_cache_size];
+struct cache_map {
+	const char *name; /*< For stats */
+	bool by_name; /*< Keyed by name, else by id */
+	bool user; /*< Holds users, else groups */
+	struct cache_shard shards[idmapper_cache_shards];
+};
+
+static struct cache_map cache_maps[CACHE_MAP_COUNT] = {
+	[CACHE_MAP_UNAME] = { .name = "uname", .by_name = true, .user = true },
+	[CACHE_MAP_UID] = { .name = "uid", .by_name = false, .user = true },
+	[CACHE_MAP_GNAME] = { .name = "gname", .by_name = true, .user = false },
+	[CACHE_MAP_GID] = { .name = "gid", .by_name = false, .user = false },
+};
 
 /**
- * @brief Lock that protects the idmapper user cache
+ * @brief Lock that keeps user additions and cache clearing apart
+ *
+ * Held for read while adding users, so that entries looked up before
+ * idmapping got disabled do not make it into a cleared cache, and for
+ * write while clearing.  Lookups do not take it.
  */
 
 pthread_rwlock_t idmapper_user_lock;
 
 /**
- * @brief Lock that protects the idmapper group cache
+ * @brief Lock that keeps group additions and cache clearing apart
  */
 
 pthread_rwlock_t idmapper_group_lock;
 
-/**
- * @brief Tree of users, by name
- */
+static inline bool cache_entry_expired(const struct cache_map *map,
+				       const struct cache_entry *entry)
+{
+	const directory_services_param_t *ds_param =
+		&nfs_param.directory_services_param;
 
-static struct avltree uname_tree;
+	return time(NULL) - entry->epoch >
+	       (map->user ? ds_param->idmapped_user_time_validity :
+			    ds_param->idmapped_group_time_validity);
+}
 
 /**
- * @brief Tree of users, by ID
+ * @brief Share of the configured maximum number of entries of a shard
  */
 
-static struct avltree uid_tree;
-
-/**
- * @brief Tree of groups, by name
- */
-static struct avltree gname_tree;
+static inline uint32_t cache_shard_max(const struct cache_map *map)
+{
+	const directory_services_param_t *ds_param =
+		&nfs_param.directory_services_param;
+	uint32_t max = map->user ? ds_param->cache_users_max_count :
+				   ds_param->cache_groups_max_count;
 
-/**
- * @brief Tree of groups, by ID
- */
+	return (max + idmapper_cache_shards - 1) / idmapper_cache_shards;
+}
 
-static struct avltree gid_tree;
+static inline uint64_t cache_name_hash(const struct gsh_buffdesc *name)
+{
+	return CityHash64(name->addr, name->len);
+}
 
-/**
- * @brief Comparison for user names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+static inline uint64_t cache_id_hash(uint32_t id)
+{
+	return CityHash64((char *)&id, sizeof(id));
+}
 
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static inline struct cache_shard *cache_map_shard(struct cache_map *map,
+						  uint64_t hash)
 {
-	struct cache_user *user1 =
-		avltree_container_of(node1, struct cache_user, uname_node);
-	struct cache_user *usera =
-		avltree_container_of(nodea, struct cache_user, uname_node);
+	return &map->shards[hash % idmapper_cache_shards];
+}
 
-	return gsh_buffdesc_comparator(&user1->uname, &usera->uname);
+static inline struct cache_entry **cache_shard_bucket(struct cache_shard *shard,
+						      uint64_t hash)
+{
+	return &shard->buckets[(hash / idmapper_cache_shards) %
+			       idmapper_shard_buckets];
 }
 
 /**
- * @brief Comparison for UIDs
+ * @brief Find the entry for a key in a map
+ *
+ * @note The caller must be in an RCU read-side critical section or hold
+ * the shard lock.
  *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+ * @param[in] map  The map to search
+ * @param[in] hash Hash of the key
+ * @param[in] name The key, for maps by name
+ * @param[in] id   The key, for maps by id
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @return The entry, or NULL.
  */
 
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static struct cache_entry *cache_map_find(struct cache_map *map, uint64_t hash,
+					  const struct gsh_buffdesc *name,
+					  uint32_t id)
 {
-	struct cache_user *user1 =
-		avltree_container_of(node1, struct cache_user, uid_node);
-	struct cache_user *usera =
-		avltree_container_of(nodea, struct cache_user, uid_node);
-
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
+	struct cache_shard *shard = cache_map_shard(map, hash);
+	struct cache_entry *entry;
+
+	for (entry = rcu_dereference(*cache_shard_bucket(shard, hash));
+	     entry != NULL; entry = rcu_dereference(entry->next)) {
+		if (entry->hash != hash)
+			continue;
+		if (map->by_name ?
+			    gsh_buffdesc_comparator(&entry->name, name) == 0 :
+			    entry->id == id)
+			return entry;
+	}
+
+	return NULL;
 }
 
 /**
- * @brief Comparison for group names
+ * @brief Look up a key on behalf of a caller, updating clock bit and stats
  *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must be in an RCU read-side critical section.
  */
 
-static inline int gname_comparator(const struct avltree_node *node1,
-				   const struct avltree_node *nodea)
+static struct cache_entry *cache_map_lookup(struct cache_map *map,
+					    uint64_t hash,
+					    const struct gsh_buffdesc *name,
+					    uint32_t id)
 {
-	struct cache_group *group1 =
-		avltree_container_of(node1, struct cache_group, gname_node);
-	struct cache_group *groupa =
-		avltree_container_of(nodea, struct cache_group, gname_node);
+	struct cache_shard *shard = cache_map_shard(map, hash);
+	struct cache_entry *entry = cache_map_find(map, hash, name, id);
+
+	if (unlikely(entry == NULL)) {
+		atomic_inc_uint64_t(&shard->misses);
+		return NULL;
+	}
 
-	return gsh_buffdesc_comparator(&group1->gname, &groupa->gname);
+	atomic_inc_uint64_t(&shard->hits);
+
+	/* Avoid dirtying the cache line when already marked */
+	if (!atomic_fetch_uint32_t(&entry->referenced))
+		atomic_store_uint32_t(&entry->referenced, 1);
+
+	return entry;
+}
+
+static struct cache_entry *cache_entry_alloc(const struct gsh_buffdesc *name,
+					     uint32_t id, const gid_t *gid)
+{
+	struct cache_entry *entry;
+
+	entry = gsh_malloc(sizeof(struct cache_entry) + name->len);
+	entry->epoch = time(NULL);
+	entry->referenced = 0;
+	entry->name.addr = (char *)entry + sizeof(struct cache_entry);
+	entry->name.len = name->len;
+	memcpy(entry->name.addr, name->addr, name->len);
+	entry->id = id;
+	if (gid) {
+		entry->gid = *gid;
+		entry->gid_set = true;
+	} else {
+		entry->gid = -1;
+		entry->gid_set = false;
+	}
+
+	return entry;
+}
+
+static void cache_entry_free(struct rcu_head *head)
+{
+	gsh_free(container_of(head, struct cache_entry, rcu_head));
 }
 
 /**
- * @brief Comparison for GIDs
+ * @brief Remove an entry from its shard
  *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+ * The entry is freed once all current readers are done with it.
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must hold the shard lock.
  */
 
-static int gid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static void cache_shard_remove(struct cache_shard *shard,
+			       struct cache_entry *entry)
 {
-	struct cache_group *group1 =
-		avltree_container_of(node1, struct cache_group, gid_node);
-	struct cache_group *groupa =
-		avltree_container_of(nodea, struct cache_group, gid_node);
-
-	if (group1->gid < groupa->gid)
-		return -1;
-	else if (group1->gid > groupa->gid)
-		return 1;
-	else
-		return 0;
+	struct cache_entry **pprev = cache_shard_bucket(shard, entry->hash);
+
+	while (*pprev != entry)
+		pprev = &(*pprev)->next;
+
+	rcu_assign_pointer(*pprev, entry->next);
+	glist_del(&entry->clock_node);
+	shard->count--;
+	call_rcu(&entry->rcu_head, cache_entry_free);
 }
 
 /**
- * @brief Remove user entry from all user cache data structures
+ * @brief Evict entries from a shard until it is within bounds
+ *
+ * Entries are examined oldest first; an entry referenced since the hand
+ * last went by has its bit cleared and gets moved to the back.
  *
- * @note The caller must hold idmapper_user_lock for write.
+ * @note The caller must hold the shard lock.
  */
-static void remove_cache_user(struct cache_user *user)
+
+static void cache_shard_evict(struct cache_map *map, struct cache_shard *shard)
 {
-	avltree_remove(&user->uname_node, &uname_tree);
-	if (user->in_uidtree) {
-		uid_cache[user->uid % id_cache_size] = NULL;
-		avltree_remove(&user->uid_node, &uid_tree);
+	uint32_t max = cache_shard_max(map);
+	struct cache_entry *entry;
+	time_t cached_duration;
+
+	while (shard->count > max) {
+		entry = glist_first_entry(&shard->clock, struct cache_entry,
+					  clock_node);
+
+		if (atomic_fetch_uint32_t(&entry->referenced) &&
+		    !cache_entry_expired(map, entry)) {
+			atomic_store_uint32_t(&entry->referenced, 0);
+			glist_move_tail(&shard->clock, &entry->clock_node);
+			continue;
+		}
+
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Cache size limit violated, evicting %s entry",
+			 map->user ? "user" : "group");
+
+		cached_duration = time(NULL) - entry->epoch;
+		cache_shard_remove(shard, entry);
+		shard->evictions++;
+		idmapper_monitoring__evicted_cache_entity(
+			map->user ? IDMAPPING_CACHE_ENTITY_USER :
+				    IDMAPPING_CACHE_ENTITY_GROUP,
+			cached_duration);
 	}
-	/* Remove from users fifo queue */
-	TAILQ_REMOVE(&user_fifo_queue, user, queue_entry);
-	gsh_free(user);
 }
 
 /**
- * @brief Remove group entry from all group cache data structures
+ * @brief Insert an entry in a map, replacing any entry for the same key
+ *
+ * @note The caller must be in an RCU read-side critical section to look
+ * at the returned entry, which is freed after a grace period.
+ *
+ * @param[in] map The map
+ * @param[in] new The entry to insert, its hash will be set
  *
- * @note The caller must hold idmapper_group_lock for write.
+ * @return The replaced entry, or NULL.
  */
-static void remove_cache_group(struct cache_group *group)
+
+static struct cache_entry *cache_map_replace(struct cache_map *map,
+					     struct cache_entry *new)
 {
-	gid_cache[group->gid % id_cache_size] = NULL;
-	avltree_remove(&group->gid_node, &gid_tree);
-	avltree_remove(&group->gname_node, &gname_tree);
-	/* Remove from groups fifo queue */
-	TAILQ_REMOVE(&group_fifo_queue, group, queue_entry);
-	gsh_free(group);
+	struct cache_shard *shard;
+	struct cache_entry **bucket;
+	struct cache_entry *old;
+
+	new->hash = map->by_name ? cache_name_hash(&new->name) :
+				   cache_id_hash(new->id);
+	shard = cache_map_shard(map, new->hash);
+	bucket = cache_shard_bucket(shard, new->hash);
+
+	PTHREAD_MUTEX_lock(&shard->lock);
+
+	old = cache_map_find(map, new->hash, &new->name, new->id);
+
+	if (old != NULL) {
+		/* The same mapping may be added by a plain idmapping lookup,
+		 * that does not know the GID, and a principal lookup that
+		 * does. Keep what is known.
+		 */
+		if (old->id == new->id &&
+		    gsh_buffdesc_comparator(&old->name, &new->name) == 0 &&
+		    !new->gid_set && old->gid_set &&
+		    !cache_entry_expired(map, old)) {
+			new->gid = old->gid;
+			new->gid_set = true;
+		}
+		cache_shard_remove(shard, old);
+	}
+
+	new->next = *bucket;
+	rcu_assign_pointer(*bucket, new);
+	glist_add_tail(&shard->clock, &new->clock_node);
+	shard->count++;
+
+	cache_shard_evict(map, shard);
+
+	PTHREAD_MUTEX_unlock(&shard->lock);
+
+	return old;
 }
 
 /**
- * @brief Reaps the cache user entries
+ * @brief Remove the entry for a key from a map if it maps name and id
  *
- * Since the user-fifo queue stores entries in increasing order of time
- * validity, the reaper reaps from the queue head in the same order. It
- * stops when it first encounters a non-expired entry.
+ * @param[in] map  The map
+ * @param[in] name Name of the mapping to remove
+ * @param[in] id   Id of the mapping to remove
  */
-static void reap_users_cache(void)
+
+static void cache_map_remove(struct cache_map *map,
+			     const struct gsh_buffdesc *name, uint32_t id)
 {
-	struct cache_user *user;
+	uint64_t hash = map->by_name ? cache_name_hash(name) :
+				       cache_id_hash(id);
+	struct cache_shard *shard = cache_map_shard(map, hash);
+	struct cache_entry *entry;
 
-	LogFullDebug(COMPONENT_IDMAPPER,
-		     "Idmapper user-cache reaper run started");
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
+	PTHREAD_MUTEX_lock(&shard->lock);
 
-	for (user = TAILQ_FIRST(&user_fifo_queue); user != NULL;) {
-		if (!user_expired(user))
-			break;
-		remove_cache_user(user);
-		user = TAILQ_FIRST(&user_fifo_queue);
-	}
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-	LogFullDebug(COMPONENT_IDMAPPER,
-		     "Idmapper user-cache reaper run ended");
+	entry = cache_map_find(map, hash, name, id);
+
+	if (entry != NULL && entry->id == id &&
+	    gsh_buffdesc_comparator(&entry->name, name) == 0)
+		cache_shard_remove(shard, entry);
+
+	PTHREAD_MUTEX_unlock(&shard->lock);
 }
 
 /**
- * @brief Reaps the cache group entries
- *
- * Since the group-fifo queue stores entries in increasing order of time
- * validity, the reaper reaps from the queue head in the same order. It
- * stops when it first encounters a non-expired entry.
+ * @brief Remove entries of a map, all or only the expired ones
  */
-static void reap_groups_cache(void)
+
+static void cache_map_prune(struct cache_map *map, bool expired_only)
 {
-	struct cache_group *group;
+	struct cache_shard *shard;
+	struct cache_entry *entry;
+	struct glist_head *glist, *glistn;
+	int i;
 
-	LogFullDebug(COMPONENT_IDMAPPER,
-		     "Idmapper group-cache reap run started");
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+	for (i = 0; i < idmapper_cache_shards; i++) {
+		shard = &map->shards[i];
+
+		PTHREAD_MUTEX_lock(&shard->lock);
+
+		glist_for_each_safe(glist, glistn, &shard->clock) {
+			entry = glist_entry(glist, struct cache_entry,
+					    clock_node);
+			if (!expired_only || cache_entry_expired(map, entry))
+				cache_shard_remove(shard, entry);
+		}
 
-	for (group = TAILQ_FIRST(&group_fifo_queue); group != NULL;) {
-		if (!group_expired(group))
-			break;
-		remove_cache_group(group);
-		group = TAILQ_FIRST(&group_fifo_queue);
+		PTHREAD_MUTEX_unlock(&shard->lock);
 	}
-	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
-	LogFullDebug(COMPONENT_IDMAPPER,
-		     "Idmapper group-cache reaper run ended");
 }
 
 /**
@@ -353,8 +465,14 @@ static void reap_groups_cache(void)
  */
 void idmapper_cache_reap(void)
 {
-	reap_users_cache();
-	reap_groups_cache();
+	int i;
+
+	LogFullDebug(COMPONENT_IDMAPPER, "Idmapper cache reaper run started");
+
+	for (i = 0; i < CACHE_MAP_COUNT; i++)
+		cache_map_prune(&cache_maps[i], true);
+
+	LogFullDebug(COMPONENT_IDMAPPER, "Idmapper cache reaper run ended");
 }
 
 /**
@@ -363,25 +481,27 @@ void idmapper_cache_reap(void)
 
 void idmapper_cache_init(void)
 {
+	struct cache_shard *shard;
+	int i, j;
+
 	PTHREAD_RWLOCK_init(&idmapper_user_lock, NULL);
 	PTHREAD_RWLOCK_init(&idmapper_group_lock, NULL);
 
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	avltree_init(&gname_tree, gname_comparator, 0);
-	avltree_init(&gid_tree, gid_comparator, 0);
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	TAILQ_INIT(&user_fifo_queue);
-	TAILQ_INIT(&group_fifo_queue);
+	for (i = 0; i < CACHE_MAP_COUNT; i++) {
+		for (j = 0; j < idmapper_cache_shards; j++) {
+			shard = &cache_maps[i].shards[j];
+			PTHREAD_MUTEX_init(&shard->lock, NULL);
+			glist_init(&shard->clock);
+			shard->count = 0;
+			memset(shard->buckets, 0, sizeof(shard->buckets));
+		}
+	}
 }
 
 /**
  * @brief Add a user entry to the cache
  *
- * @note The caller must hold idmapper_user_lock for write.
+ * @note The caller must hold idmapper_user_lock for read.
  *
  * @param[in] name The user name
  * @param[in] uid  The user ID
@@ -396,112 +516,44 @@ void idmapper_cache_init(void)
 bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		       const gid_t *gid, bool gss_princ)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_user *old;
-	struct cache_user *new;
-	struct cache_user *user_fifo_queue_head_node;
-
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
-	new->epoch = time(NULL);
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
-	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
-	if (gid) {
-		new->gid = *gid;
-		new->gid_set = true;
-	} else {
-		new->gid = -1;
-		new->gid_set = false;
-	}
-	new->in_uidtree = (gss_princ) ? false : true;
+	struct cache_entry *old;
 
 	/*
-	 * There are 3 cases why we find an existing cache entry.
-	 *
-	 * Case 1:
-	 * The threads that lookup by-name or by-id use the read lock.
-	 * If they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping.
-	 *
-	 * Case 2:
-	 * It is also possible that name got a different id or an id got
-	 * a different name causing us to find an existing entry when we
-	 * are trying to add an entry. This case calls for removing the
-	 * stale entry and update with this new entry.
-	 *
-	 * Case 3:
-	 * The username to id mapping could be from plain nfs idmapping
-	 * in which case we will not have a valid gid. If this is for a
-	 * kerberos principal mapping, we will have uid and gid but we
-	 * will not have "uid to name" cache entry (the reverse
-	 * mapping). This case requires us to combine the old entry and
-	 * the new entry!
+	 * Finding an existing entry means that several threads looked the
+	 * same name or id up, or that a name got a different id or an id
+	 * got a different name. In the latter case the reverse mapping of
+	 * the replaced entry is stale as well and is removed.
 	 *
-	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
-	 * and LOCAL_REALMS are set to the same value!
+	 * The name to id mapping of a kerberos principal comes with a gid
+	 * and no id to name mapping, while plain nfs idmapping has no gid:
+	 * when IDMAPD_DOMAIN and LOCAL_REALMS are the same the two get
+	 * combined by cache_map_replace().
 	 */
-	found_name = avltree_insert(&new->uname_node, &uname_tree);
-	if (unlikely(found_name)) {
-		old = avltree_container_of(found_name, struct cache_user,
-					   uname_node);
-		/* Combine non-expired old into new if uid's match */
-		if ((old->uid == new->uid) && !user_expired(old)) {
-			if (!new->gid_set && old->gid_set) {
-				new->gid = old->gid;
-				new->gid_set = true;
-			}
-			if (!new->in_uidtree && old->in_uidtree)
-				new->in_uidtree = true;
-		}
+	rcu_read_lock();
+
+	old = cache_map_replace(&cache_maps[CACHE_MAP_UNAME],
+				cache_entry_alloc(name, uid, gid));
+	if (old != NULL && old->id != uid)
+		cache_map_remove(&cache_maps[CACHE_MAP_UID], name, old->id);
 
-		/* Remove the old and insert the new */
-		remove_cache_user(old);
-		found_name = avltree_insert(&new->uname_node, &uname_tree);
-		assert(found_name == NULL);
+	if (!gss_princ) {
+		old = cache_map_replace(&cache_maps[CACHE_MAP_UID],
+					cache_entry_alloc(name, uid, gid));
+		if (old != NULL &&
+		    gsh_buffdesc_comparator(&old->name, name) != 0)
+			cache_map_remove(&cache_maps[CACHE_MAP_UNAME],
+					 &old->name, uid);
 	}
 
-	if (!new->in_uidtree) /* all done */
-		goto add_to_queue;
+	rcu_read_unlock();
 
-	found_id = avltree_insert(&new->uid_node, &uid_tree);
-	if (unlikely(found_id)) {
-		old = avltree_container_of(found_id, struct cache_user,
-					   uid_node);
-		remove_cache_user(old);
-		found_id = avltree_insert(&new->uid_node, &uid_tree);
-		assert(found_id == NULL);
-	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
-
-add_to_queue:
-
-	TAILQ_INSERT_TAIL(&user_fifo_queue, new, queue_entry);
-
-	/* If we breach max-cache capacity, remove the user queue's head node */
-	if (avltree_size(&uname_tree) >
-	    nfs_param.directory_services_param.cache_users_max_count) {
-		LogDebug(
-			COMPONENT_IDMAPPER,
-			"Cache size limit violated, removing user with least time validity");
-		user_fifo_queue_head_node = TAILQ_FIRST(&user_fifo_queue);
-		const time_t cached_duration =
-			time(NULL) - user_fifo_queue_head_node->epoch;
-		remove_cache_user(user_fifo_queue_head_node);
-		idmapper_monitoring__evicted_cache_entity(
-			IDMAPPING_CACHE_ENTITY_USER, cached_duration);
-	}
 	return true;
 }
 
 /**
  * @brief Add a group entry to the cache
  *
- * @note The caller must hold idmapper_group_lock for write.
+ * @note The caller must hold idmapper_group_lock for read.
  *
  * @param[in] name The user name
  * @param[in] gid  The group id
@@ -512,74 +564,30 @@ add_to_queue:
 
 bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_group *tmp;
-	struct cache_group *new;
-	struct cache_group *group_fifo_queue_head_node;
-
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
-	new->epoch = time(NULL);
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
-	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
+	struct cache_entry *old;
 
-	/*
-	 * The threads that lookup by-name or by-id use the read lock. If
-	 * they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping. It is also possible
-	 * that name got a different id or an id got a different name
-	 * causing us to find an existing entry when we are trying to
-	 * add an entry!
-	 *
-	 * If we find an existing entry, we remove it from both the name
-	 * and the id AVL trees, and then add the new entry.
-	 */
-	found_name = avltree_insert(&new->gname_node, &gname_tree);
-	if (unlikely(found_name)) {
-		tmp = avltree_container_of(found_name, struct cache_group,
-					   gname_node);
-		remove_cache_group(tmp);
-		found_name = avltree_insert(&new->gname_node, &gname_tree);
-		assert(found_name == NULL);
-	}
+	rcu_read_lock();
+
+	old = cache_map_replace(&cache_maps[CACHE_MAP_GNAME],
+				cache_entry_alloc(name, gid, NULL));
+	if (old != NULL && old->id != gid)
+		cache_map_remove(&cache_maps[CACHE_MAP_GID], name, old->id);
+
+	old = cache_map_replace(&cache_maps[CACHE_MAP_GID],
+				cache_entry_alloc(name, gid, NULL));
+	if (old != NULL && gsh_buffdesc_comparator(&old->name, name) != 0)
+		cache_map_remove(&cache_maps[CACHE_MAP_GNAME], &old->name, gid);
+
+	rcu_read_unlock();
 
-	found_id = avltree_insert(&new->gid_node, &gid_tree);
-	if (unlikely(found_id)) {
-		tmp = avltree_container_of(found_id, struct cache_group,
-					   gid_node);
-		remove_cache_group(tmp);
-		found_id = avltree_insert(&new->gid_node, &gid_tree);
-		assert(found_id == NULL);
-	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
-
-	TAILQ_INSERT_TAIL(&group_fifo_queue, new, queue_entry);
-
-	/* If we breach max-cache capacity, remove the user queue's head node */
-	if (avltree_size(&gname_tree) >
-	    nfs_param.directory_services_param.cache_groups_max_count) {
-		LogDebug(
-			COMPONENT_IDMAPPER,
-			"Cache size limit violated, removing group with least time validity");
-		group_fifo_queue_head_node = TAILQ_FIRST(&group_fifo_queue);
-		const time_t cached_duration =
-			time(NULL) - group_fifo_queue_head_node->epoch;
-		remove_cache_group(group_fifo_queue_head_node);
-		idmapper_monitoring__evicted_cache_entity(
-			IDMAPPING_CACHE_ENTITY_GROUP, cached_duration);
-	}
 	return true;
 }
 
 /**
  * @brief Look up a user by name
  *
- * @note The caller must hold idmapper_user_lock for read.
+ * @note The caller must be in an RCU read-side critical section for as
+ * long as it uses the returned gid.
  *
  * @param[in]  name The user name to look up.
  * @param[out] uid  The user ID found.  May be NULL if the caller
@@ -594,45 +602,30 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
  */
 
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+			      const gid_t **gid)
 {
-	struct cache_user prototype = { .uname = *name };
-	struct avltree_node *found_node =
-		avltree_lookup(&prototype.uname_node, &uname_tree);
-	struct cache_user *found_user;
-	void **cache_slot;
+	struct cache_map *map = &cache_maps[CACHE_MAP_UNAME];
+	struct cache_entry *found_user;
 
-	if (unlikely(!found_node))
-		return false;
-
-	found_user =
-		avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
-		/* I assume that if someone likes this user enough to look it
-		   up by name, they'll like it enough to look it up by ID
-		   later.
+	found_user = cache_map_lookup(map, cache_name_hash(name), name, 0);
 
-		   If the name is gss principal it does not have entry
-		   in uid tree */
-
-		cache_slot =
-			(void **)&uid_cache[found_user->uid % id_cache_size];
-		atomic_store_voidptr(cache_slot, &found_user->uid_node);
-	}
+	if (unlikely(!found_user))
+		return false;
 
 	if (likely(uid))
-		*uid = found_user->uid;
+		*uid = found_user->id;
 
 	if (unlikely(gid))
 		*gid = (found_user->gid_set ? &found_user->gid : NULL);
 
-	return user_expired(found_user) ? false : true;
+	return cache_entry_expired(map, found_user) ? false : true;
 }
 
 /**
  * @brief Look up a user by ID
  *
- * @note The caller must hold idmapper_user_lock for read.
+ * @note The caller must be in an RCU read-side critical section for as
+ * long as it uses the returned name and gid.
  *
  * @param[in]  uid  The user ID to look up.
  * @param[out] name The user name to look up. (May be NULL if the user
@@ -648,42 +641,27 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 			    const gid_t **gid)
 {
-	struct cache_user prototype = { .uid = uid };
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_user *found_user;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_user = avltree_container_of(found_node, struct cache_user,
-						  uid_node);
-		if (found_user->uid == uid)
-			found = true;
-	}
+	struct cache_map *map = &cache_maps[CACHE_MAP_UID];
+	struct cache_entry *found_user;
 
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
+	found_user = cache_map_lookup(map, cache_id_hash(uid), NULL, uid);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_user = avltree_container_of(found_node, struct cache_user,
-						  uid_node);
-	}
+	if (unlikely(!found_user))
+		return false;
 
 	if (likely(name))
-		*name = &found_user->uname;
+		*name = &found_user->name;
 
 	if (gid)
 		*gid = (found_user->gid_set ? &found_user->gid : NULL);
 
-	return user_expired(found_user) ? false : true;
+	return cache_entry_expired(map, found_user) ? false : true;
 }
 
 /**
  * @brief Lookup a group by name
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @note The caller must be in an RCU read-side critical section.
  *
  * @param[in]  name The user name to look up.
  * @param[out] gid  The group ID found.  May be NULL if the caller
@@ -697,37 +675,27 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 {
-	struct cache_group prototype = { .gname = *name };
-	struct avltree_node *found_node =
-		avltree_lookup(&prototype.gname_node, &gname_tree);
-	struct cache_group *found_group;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
+	struct cache_map *map = &cache_maps[CACHE_MAP_GNAME];
+	struct cache_entry *found_group;
 
-	found_group = avltree_container_of(found_node, struct cache_group,
-					   gname_node);
+	found_group = cache_map_lookup(map, cache_name_hash(name), name, 0);
 
-	/* I assume that if someone likes this group enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	if (unlikely(!found_group))
+		return false;
 
 	if (likely(gid))
-		*gid = found_group->gid;
+		*gid = found_group->id;
 	else
 		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
 
-	return group_expired(found_group) ? false : true;
+	return cache_entry_expired(map, found_group) ? false : true;
 }
 
 /**
  * @brief Look up a group by ID
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @note The caller must be in an RCU read-side critical section for as
+ * long as it uses the returned name.
  *
  * @param[in]  gid  The group ID to look up.
  * @param[out] name The user name to look up. (May be NULL if the user
@@ -739,72 +707,115 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 
 bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 {
-	struct cache_group prototype = { .gid = gid };
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_group *found_group;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_group = avltree_container_of(
-			found_node, struct cache_group, gid_node);
-		if (found_group->gid == gid)
-			found = true;
-	}
+	struct cache_map *map = &cache_maps[CACHE_MAP_GID];
+	struct cache_entry *found_group;
 
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
-		if (unlikely(!found_node))
-			return false;
+	found_group = cache_map_lookup(map, cache_id_hash(gid), NULL, gid);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_group = avltree_container_of(
-			found_node, struct cache_group, gid_node);
-	}
+	if (unlikely(!found_group))
+		return false;
 
 	if (likely(name))
-		*name = &found_group->gname;
+		*name = &found_group->name;
 	else
 		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
 
-	return group_expired(found_group) ? false : true;
+	return cache_entry_expired(map, found_group) ? false : true;
 }
 
 /**
- * @brief Wipe out the idmapper cache
+ * @brief Add the valid entries of the cache to a warm-restart snapshot
+ *
+ * @param[in] snapshot Snapshot being built
  */
 
-void idmapper_clear_cache(void)
+void idmapper_cache_save(struct idmapper_snapshot *snapshot)
 {
-	struct avltree_node *node;
+	struct cache_map *map;
+	struct cache_shard *shard;
+	struct cache_entry *entry;
+	struct glist_head *glist;
+	int i, j;
+
+	for (i = 0; i < CACHE_MAP_COUNT; i++) {
+		map = &cache_maps[i];
+		for (j = 0; j < idmapper_cache_shards; j++) {
+			shard = &map->shards[j];
+
+			PTHREAD_MUTEX_lock(&shard->lock);
+
+			glist_for_each(glist, &shard->clock) {
+				entry = glist_entry(glist, struct cache_entry,
+						    clock_node);
+				if (cache_entry_expired(map, entry))
+					continue;
+				idmapper_snapshot_add(
+					snapshot, i, &entry->name, NULL,
+					entry->id,
+					entry->gid_set ? &entry->gid : NULL,
+					NULL, 0, entry->epoch);
+			}
 
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+			PTHREAD_MUTEX_unlock(&shard->lock);
+		}
+	}
+}
 
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+/**
+ * @brief Restore an entry from a warm-restart snapshot
+ *
+ * The entry keeps the time it was originally cached at, so that it
+ * expires as it would have without the restart.
+ *
+ * @param[in] type  Which map the entry belongs to
+ * @param[in] name  User or group name
+ * @param[in] id    UID or GID
+ * @param[in] gid   GID of a user, or NULL
+ * @param[in] epoch When the entry was cached
+ *
+ * @retval true if the entry was restored.
+ * @retval false if it has expired since.
+ */
+
+bool idmapper_cache_restore(enum idmapper_snapshot_type type,
+			    const struct gsh_buffdesc *name, uint32_t id,
+			    const gid_t *gid, time_t epoch)
+{
+	struct cache_map *map = &cache_maps[type];
+	struct cache_entry *entry;
+	pthread_rwlock_t *lock = map->user ? &idmapper_user_lock :
+					     &idmapper_group_lock;
 
-	for (node = avltree_first(&uname_tree); node != NULL;
-	     node = avltree_first(&uname_tree)) {
-		struct cache_user *user;
+	entry = cache_entry_alloc(name, id, gid);
+	entry->epoch = epoch;
 
-		user = avltree_container_of(node, struct cache_user,
-					    uname_node);
-		remove_cache_user(user);
+	if (cache_entry_expired(map, entry)) {
+		gsh_free(entry);
+		return false;
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
+	PTHREAD_RWLOCK_rdlock(lock);
+	rcu_read_lock();
+	(void)cache_map_replace(map, entry);
+	rcu_read_unlock();
+	PTHREAD_RWLOCK_unlock(lock);
 
-	for (node = avltree_first(&gname_tree); node != NULL;
-	     node = avltree_first(&gname_tree)) {
-		struct cache_group *group;
+	return true;
+}
 
-		group = avltree_container_of(node, struct cache_group,
-					     gname_node);
-		remove_cache_group(group);
-	}
+/**
+ * @brief Wipe out the idmapper cache
+ */
+
+void idmapper_clear_cache(void)
+{
+	int i;
+
+	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
+	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
 
-	assert(avltree_first(&gid_tree) == NULL);
+	for (i = 0; i < CACHE_MAP_COUNT; i++)
+		cache_map_prune(&cache_maps[i], false);
 
 	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
 	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
@@ -817,7 +828,17 @@ void idmapper_clear_cache(void)
  */
 void idmapper_destroy_cache(void)
 {
+	int i, j;
+
 	idmapper_clear_cache();
+
+	/* Wait for the removed entries to be freed */
+	rcu_barrier();
+
+	for (i = 0; i < CACHE_MAP_COUNT; i++)
+		for (j = 0; j < idmapper_cache_shards; j++)
+			PTHREAD_MUTEX_destroy(&cache_maps[i].shards[j].lock);
+
 	PTHREAD_RWLOCK_destroy(&idmapper_user_lock);
 	PTHREAD_RWLOCK_destroy(&idmapper_group_lock);
 }
@@ -834,11 +855,13 @@ static bool show_idmapper(DBusMessageIter *args, DBusMessage *reply,
 			  DBusError *error)
 {
 	struct timespec timestamp;
-	struct avltree_node *node;
+	struct cache_shard *shard;
+	struct cache_entry *user;
 	uint32_t val;
 	DBusMessageIter iter, sub_iter, id_iter;
 	char *namebuff = gsh_malloc(1024);
 	dbus_bool_t gid_set;
+	int i, j;
 
 	dbus_message_iter_init_append(reply, &iter);
 	now(&timestamp);
@@ -846,44 +869,48 @@ static bool show_idmapper(DBusMessageIter *args, DBusMessage *reply,
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(subu)",
 					 &sub_iter);
 
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
+	rcu_read_lock();
 	/* Traverse idmapper cache */
-	for (node = avltree_first(&uname_tree); node != NULL;
-	     node = avltree_next(node)) {
-		struct cache_user *user;
-
-		user = avltree_container_of(node, struct cache_user,
-					    uname_node);
-		dbus_message_iter_open_container(&sub_iter, DBUS_TYPE_STRUCT,
-						 NULL, &id_iter);
-		memcpy(namebuff, user->uname.addr, user->uname.len);
-		if (user->uname.len > 255)
-			/*Truncate the name */
-			*(namebuff + 255) = '\0';
-		else
-			*(namebuff + user->uname.len) = '\0';
-
-		dbus_message_iter_append_basic(&id_iter, DBUS_TYPE_STRING,
-					       &namebuff);
-		val = user->uid;
-		dbus_message_iter_append_basic(&id_iter, DBUS_TYPE_UINT32,
-					       &val);
-
-		if (user->gid_set) {
-			val = user->gid;
-			gid_set = true;
-		} else {
-			val = 0;
-			gid_set = false;
+	for (i = 0; i < idmapper_cache_shards; i++) {
+		shard = &cache_maps[CACHE_MAP_UNAME].shards[i];
+		for (j = 0; j < idmapper_shard_buckets; j++) {
+			for (user = rcu_dereference(shard->buckets[j]);
+			     user != NULL; user = rcu_dereference(user->next)) {
+				dbus_message_iter_open_container(
+					&sub_iter, DBUS_TYPE_STRUCT, NULL,
+					&id_iter);
+				memcpy(namebuff, user->name.addr,
+				       user->name.len);
+				if (user->name.len > 255)
+					/*Truncate the name */
+					*(namebuff + 255) = '\0';
+				else
+					*(namebuff + user->name.len) = '\0';
+
+				dbus_message_iter_append_basic(
+					&id_iter, DBUS_TYPE_STRING, &namebuff);
+				val = user->id;
+				dbus_message_iter_append_basic(
+					&id_iter, DBUS_TYPE_UINT32, &val);
+
+				if (user->gid_set) {
+					val = user->gid;
+					gid_set = true;
+				} else {
+					val = 0;
+					gid_set = false;
+				}
+				dbus_message_iter_append_basic(
+					&id_iter, DBUS_TYPE_BOOLEAN, &gid_set);
+				dbus_message_iter_append_basic(
+					&id_iter, DBUS_TYPE_UINT32, &val);
+				dbus_message_iter_close_container(&sub_iter,
+								  &id_iter);
+			}
 		}
-		dbus_message_iter_append_basic(&id_iter, DBUS_TYPE_BOOLEAN,
-					       &gid_set);
-		dbus_message_iter_append_basic(&id_iter, DBUS_TYPE_UINT32,
-					       &val);
-		dbus_message_iter_close_container(&sub_iter, &id_iter);
 	}
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-	free(namebuff);
+	rcu_read_unlock();
+	gsh_free(namebuff);
 	dbus_message_iter_close_container(&iter, &sub_iter);
 	return true;
 }
@@ -895,6 +922,73 @@ struct gsh_dbus_method cachemgr_show_idmapper = {
 		  { .name = "ids", .type = "a(subu)", .direction = "out" },
 		  END_ARG_LIST }
 };
+
+/**
+ *@brief Dbus method for showing idmapper cache shard statistics
+ *
+ *@param[in]  args
+ *@param[out] reply
+ */
+static bool show_idmapper_shards(DBusMessageIter *args, DBusMessage *reply,
+				 DBusError *error)
+{
+	struct timespec timestamp;
+	struct cache_shard *shard;
+	DBusMessageIter iter, sub_iter, shard_iter;
+	uint32_t val;
+	uint64_t stat;
+	int i, j;
+
+	dbus_message_iter_init_append(reply, &iter);
+	now(&timestamp);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(suuttt)",
+					 &sub_iter);
+
+	for (i = 0; i < CACHE_MAP_COUNT; i++) {
+		for (j = 0; j < idmapper_cache_shards; j++) {
+			shard = &cache_maps[i].shards[j];
+
+			dbus_message_iter_open_container(
+				&sub_iter, DBUS_TYPE_STRUCT, NULL, &shard_iter);
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_STRING,
+						       &cache_maps[i].name);
+			val = j;
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_UINT32, &val);
+			PTHREAD_MUTEX_lock(&shard->lock);
+			val = shard->count;
+			PTHREAD_MUTEX_unlock(&shard->lock);
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_UINT32, &val);
+			stat = atomic_fetch_uint64_t(&shard->hits);
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_UINT64, &stat);
+			stat = atomic_fetch_uint64_t(&shard->misses);
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_UINT64, &stat);
+			PTHREAD_MUTEX_lock(&shard->lock);
+			stat = shard->evictions;
+			PTHREAD_MUTEX_unlock(&shard->lock);
+			dbus_message_iter_append_basic(&shard_iter,
+						       DBUS_TYPE_UINT64, &stat);
+			dbus_message_iter_close_container(&sub_iter,
+							  &shard_iter);
+		}
+	}
+
+	dbus_message_iter_close_container(&iter, &sub_iter);
+	return true;
+}
+
+struct gsh_dbus_method cachemgr_show_idmapper_shards = {
+	.name = "showidmapper_shards",
+	.method = show_idmapper_shards,
+	.args = { TIMESTAMP_REPLY,
+		  { .name = "shards", .type = "a(suuttt)", .direction = "out" },
+		  END_ARG_LIST }
+};
 #endif
 
 /** @} */
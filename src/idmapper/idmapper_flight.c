@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup idmapper
+ * @{
+ */
+
+/**
+ * @file    idmapper_flight.c
+ * @brief   Deduplication and background refresh of directory lookups
+ *
+ * A "flight" is a directory service lookup (getpwuid, getgrouplist,
+ * nfsidmap...) in progress for a given key.  The first thread to miss
+ * the cache for a key becomes the leader of the flight and performs the
+ * lookup; any other thread missing the cache for the same key while the
+ * flight is in the air waits for it to land and then retries the cache
+ * instead of issuing its own lookup.
+ *
+ * Flights can also be started in the background, on a bounded pool of
+ * threads, to refresh cache entries that are about to expire.
+ *
+ * The size of that pool also bounds the number of flights, synchronous
+ * or background, in the air at once, so that a burst of cache misses
+ * does not turn into a burst of requests to the directory.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "gsh_list.h"
+#include "common_utils.h"
+#include "abstract_mem.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "idmapper.h"
+#include "city.h"
+
+/**
+ * @brief Number of buckets of the in-flight table, should be prime.
+ */
+
+#define flight_table_size 127
+
+/**
+ * @brief A directory lookup in progress
+ */
+
+struct idmapper_flight {
+	struct glist_head node; /*< Node in the bucket list */
+	enum idmapper_flight_type type; /*< What is being looked up */
+	uint64_t hash; /*< Hash of type and key */
+	uint32_t refcount; /*< Leader plus waiters */
+	bool landed; /*< Lookup is over */
+	bool slot; /*< Holds one of the lookup slots */
+	pthread_cond_t cond; /*< Signalled when landed */
+	size_t len; /*< Length of key */
+	char key[]; /*< Copy of the key */
+};
+
+/**
+ * @brief In-flight lookups, protected by flight_lock
+ */
+
+static struct glist_head flight_table[flight_table_size];
+static pthread_mutex_t flight_lock;
+
+/**
+ * @brief Lookups that may still take off, protected by flight_lock
+ *
+ * Only enforced when flight_slots_max is not 0.
+ */
+
+static uint32_t flight_slots_max;
+static uint32_t flight_slots_free;
+static pthread_cond_t flight_slots_cond;
+
+/**
+ * @brief Bounded pool of threads running background refreshes
+ */
+
+static struct fridgethr *refresh_fridge;
+
+/**
+ * @brief Background refresh request
+ */
+
+struct refresh_work {
+	struct idmapper_flight *flight;
+	void (*refresh)(enum idmapper_flight_type, const void *, size_t);
+};
+
+static uint64_t flight_hash(enum idmapper_flight_type type, const void *key,
+			    size_t len)
+{
+	return CityHash64WithSeed(key, len, type);
+}
+
+static struct idmapper_flight *
+flight_lookup(enum idmapper_flight_type type, const void *key, size_t len,
+	      uint64_t hash)
+{
+	struct glist_head *glist;
+	struct idmapper_flight *flight;
+
+	glist_for_each(glist, &flight_table[hash % flight_table_size]) {
+		flight = glist_entry(glist, struct idmapper_flight, node);
+
+		if (flight->hash == hash && flight->type == type &&
+		    flight->len == len && memcmp(flight->key, key, len) == 0)
+			return flight;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Drop a reference on a flight
+ *
+ * @note The caller must hold flight_lock.
+ */
+
+static void flight_put(struct idmapper_flight *flight)
+{
+	if (--flight->refcount == 0) {
+		PTHREAD_COND_destroy(&flight->cond);
+		gsh_free(flight);
+	}
+}
+
+static bool flight_take_off(enum idmapper_flight_type type, const void *key,
+			    size_t len, bool wait,
+			    struct idmapper_flight **leader)
+{
+	uint64_t hash = flight_hash(type, key, len);
+	struct idmapper_flight *flight;
+
+	PTHREAD_MUTEX_lock(&flight_lock);
+
+	flight = flight_lookup(type, key, len, hash);
+
+	if (flight == NULL && flight_slots_max != 0 &&
+	    flight_slots_free == 0 && !wait) {
+		/* Background refreshes never wait for a slot */
+		PTHREAD_MUTEX_unlock(&flight_lock);
+
+		*leader = NULL;
+		return false;
+	}
+
+	if (flight == NULL) {
+		flight = gsh_malloc(sizeof(struct idmapper_flight) + len);
+		flight->type = type;
+		flight->hash = hash;
+		flight->refcount = 1;
+		flight->landed = false;
+		flight->slot = flight_slots_max != 0;
+		flight->len = len;
+		memcpy(flight->key, key, len);
+		PTHREAD_COND_init(&flight->cond, NULL);
+
+		/* Hash it first so that lookups of the same key wait for
+		 * this one rather than for a slot of their own.
+		 */
+		glist_add_tail(&flight_table[hash % flight_table_size],
+			       &flight->node);
+
+		if (flight->slot) {
+			while (flight_slots_free == 0) {
+				LogFullDebug(COMPONENT_IDMAPPER,
+					     "Waiting for a lookup slot for type %d",
+					     type);
+				PTHREAD_COND_wait(&flight_slots_cond,
+						  &flight_lock);
+			}
+			flight_slots_free--;
+		}
+		PTHREAD_MUTEX_unlock(&flight_lock);
+
+		*leader = flight;
+		return true;
+	}
+
+	if (wait) {
+		LogFullDebug(COMPONENT_IDMAPPER,
+			     "Waiting for lookup of type %d in flight", type);
+
+		flight->refcount++;
+		while (!flight->landed)
+			PTHREAD_COND_wait(&flight->cond, &flight_lock);
+		flight_put(flight);
+	}
+
+	PTHREAD_MUTEX_unlock(&flight_lock);
+
+	*leader = NULL;
+	return false;
+}
+
+/**
+ * @brief Join or lead the lookup of a key
+ *
+ * If no lookup is in progress for the key, the caller becomes the leader
+ * and must perform the lookup, populate the cache, and then call
+ * idmapper_flight_land(); it may first have to wait for one of the
+ * lookups in progress for other keys to land.  Otherwise the caller
+ * sleeps until the lookup in progress completes; it should then look the
+ * key up in the cache again.
+ *
+ * @param[in]  type   Kind of lookup
+ * @param[in]  key    Key being looked up
+ * @param[in]  len    Length of key
+ * @param[out] leader Flight to land if the caller is the leader
+ *
+ * @retval true if the caller is the leader.
+ * @retval false if another lookup for the key just completed.
+ */
+
+bool idmapper_flight_join(enum idmapper_flight_type type, const void *key,
+			  size_t len, struct idmapper_flight **leader)
+{
+	return flight_take_off(type, key, len, true, leader);
+}
+
+/**
+ * @brief Complete a lookup and wake up any waiters
+ *
+ * @param[in] flight The flight returned by idmapper_flight_join()
+ */
+
+void idmapper_flight_land(struct idmapper_flight *flight)
+{
+	PTHREAD_MUTEX_lock(&flight_lock);
+	glist_del(&flight->node);
+	flight->landed = true;
+	if (flight->slot) {
+		flight_slots_free++;
+		PTHREAD_COND_signal(&flight_slots_cond);
+	}
+	PTHREAD_COND_broadcast(&flight->cond);
+	flight_put(flight);
+	PTHREAD_MUTEX_unlock(&flight_lock);
+}
+
+static void refresh_run(struct fridgethr_context *ctx)
+{
+	struct refresh_work *work = ctx->arg;
+	struct idmapper_flight *flight = work->flight;
+
+	work->refresh(flight->type, flight->key, flight->len);
+
+	idmapper_flight_land(flight);
+	gsh_free(work);
+}
+
+/**
+ * @brief Refresh a cache entry in the background
+ *
+ * Nothing is done if a lookup for the key is already in progress, or if
+ * all the lookup slots are taken: the entry will then be refreshed by a
+ * later caller, or looked up synchronously once it expires.
+ *
+ * @param[in] type    Kind of lookup
+ * @param[in] key     Key to refresh
+ * @param[in] len     Length of key
+ * @param[in] refresh Function performing the lookup and updating the cache
+ */
+
+void idmapper_flight_refresh(enum idmapper_flight_type type, const void *key,
+			     size_t len,
+			     void (*refresh)(enum idmapper_flight_type,
+					     const void *, size_t))
+{
+	struct idmapper_flight *flight;
+	struct refresh_work *work;
+	int rc;
+
+	if (refresh_fridge == NULL)
+		return;
+
+	if (!flight_take_off(type, key, len, false, &flight))
+		return;
+
+	work = gsh_malloc(sizeof(struct refresh_work));
+	work->flight = flight;
+	work->refresh = refresh;
+
+	rc = fridgethr_submit(refresh_fridge, refresh_run, work);
+
+	if (rc != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Could not schedule refresh of type %d, error %d",
+			 type, rc);
+		gsh_free(work);
+		idmapper_flight_land(flight);
+	}
+}
+
+/**
+ * @brief Decide whether a cached entry should be used and/or refreshed
+ *
+ * @param[in]  epoch    Time the entry was cached
+ * @param[in]  validity Time validity of such entries
+ * @param[out] refresh  Whether a background refresh should be started
+ *
+ * @retval true if the entry may be returned to the caller.
+ * @retval false if it is too old and a synchronous lookup is required.
+ */
+
+bool idmapper_flight_usable(time_t epoch, int64_t validity, bool *refresh)
+{
+	const directory_services_param_t *ds_param =
+		&nfs_param.directory_services_param;
+	int64_t age = time(NULL) - epoch;
+	int64_t ahead = ds_param->cache_refresh_ahead_time;
+
+	/* Never refresh ahead more than half way through validity */
+	if (ahead > validity / 2)
+		ahead = validity / 2;
+
+	*refresh = refresh_fridge != NULL && ahead > 0 &&
+		   age >= validity - ahead;
+
+	if (age <= validity)
+		return true;
+
+	/* Expired, serve it while it is being refreshed if allowed */
+	*refresh = refresh_fridge != NULL;
+
+	return *refresh && age <= validity + ds_param->cache_stale_serve_time;
+}
+
+/**
+ * @brief Initialize the in-flight table and the refresh threads
+ *
+ * Cache_Refresh_Threads sizes both the refresh pool and the number of
+ * lookups allowed in the air at once; 0 disables background refreshes
+ * and leaves synchronous lookups unbounded.
+ */
+
+void idmapper_flight_init(void)
+{
+	struct fridgethr_params frp;
+	int i, rc;
+
+	PTHREAD_MUTEX_init(&flight_lock, NULL);
+	PTHREAD_COND_init(&flight_slots_cond, NULL);
+
+	for (i = 0; i < flight_table_size; i++)
+		glist_init(&flight_table[i]);
+
+	flight_slots_max =
+		nfs_param.directory_services_param.cache_refresh_threads;
+	flight_slots_free = flight_slots_max;
+
+	if (flight_slots_max == 0) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Idmapper background refresh is disabled");
+		return;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.directory_services_param.cache_refresh_threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&refresh_fridge, "idmapper_refresh", &frp);
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_IDMAPPER,
+			"Idmapper refresh fridge init failed. Error: %d", rc);
+		refresh_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the refresh threads
+ */
+
+void idmapper_flight_destroy(void)
+{
+	if (refresh_fridge != NULL) {
+		int rc = fridgethr_sync_command(refresh_fridge,
+						fridgethr_comm_stop, 120);
+
+		if (rc != 0)
+			LogMajor(COMPONENT_IDMAPPER,
+				 "Failed shutting down idmapper refresh threads: %d",
+				 rc);
+		fridgethr_destroy(refresh_fridge);
+		refresh_fridge = NULL;
+	}
+
+	PTHREAD_COND_destroy(&flight_slots_cond);
+	PTHREAD_MUTEX_destroy(&flight_lock);
+}
+
+/** @} */
@@ -57,6 +57,12 @@ static counter_metric_handle_t
 static histogram_metric_handle_t
 	evicted_entries_cached_duration[IDMAPPING_CACHE_ENTITY_COUNT];
 
+/* Warm-restart snapshot, entries loaded or skipped as expired */
+static gauge_metric_handle_t
+	snapshot_entries[IDMAPPING_CACHE_ENTITY_COUNT][IDMAPPING_STATUS_COUNT];
+static gauge_metric_handle_t snapshot_load_time;
+static gauge_metric_handle_t snapshot_save_time;
+
 /* 8 buckets in increasing powers of 2 */
 static const int64_t groups_buckets[] = { 0,  1,  2,   4,   8,	 16,
 					  32, 64, 128, 256, 512, 1024 };
@@ -156,6 +162,10 @@ static const char *get_cache_entity_name(idmapping_cache_entity_t cache_entity)
 		return "NEGATIVE_USER";
 	case IDMAPPING_CACHE_ENTITY_NEGATIVE_GROUP:
 		return "NEGATIVE_GROUP";
+	case IDMAPPING_CACHE_ENTITY_NETGROUP:
+		return "NETGROUP";
+	case IDMAPPING_CACHE_ENTITY_NEGATIVE_NETGROUP:
+		return "NEGATIVE_NETGROUP";
 	default:
 		LogFatal(COMPONENT_IDMAPPER,
 			 "Unsupported idmapping cache entity: %d",
@@ -263,6 +273,39 @@ static void register_evicted_entries_cache_duration_metrics(void)
 	}
 }
 
+static void register_snapshot_metrics(void)
+{
+	const metric_label_t empty_labels[] = {};
+
+	for (int i = 0; i < IDMAPPING_CACHE_ENTITY_COUNT; i++) {
+		for (int j = 0; j < IDMAPPING_STATUS_COUNT; j++) {
+			const metric_label_t labels[] = {
+				METRIC_LABEL("cache_entity",
+					     get_cache_entity_name(i)),
+				METRIC_LABEL("loaded", get_status_name(j))
+			};
+			snapshot_entries[i][j] = monitoring__register_gauge(
+				"idmapping__snapshot_entries",
+				METRIC_METADATA(
+					"Entries of the warm-restart snapshot "
+					"loaded, or skipped as expired",
+					METRIC_UNIT_NONE),
+				labels, ARRAY_SIZE(labels));
+		}
+	}
+
+	snapshot_load_time = monitoring__register_gauge(
+		"idmapping__snapshot_load_time",
+		METRIC_METADATA("Time taken to load the warm-restart snapshot",
+				METRIC_UNIT_MILLISECOND),
+		empty_labels, ARRAY_SIZE(empty_labels));
+	snapshot_save_time = monitoring__register_gauge(
+		"idmapping__snapshot_save_time",
+		METRIC_METADATA("Time taken to save the warm-restart snapshot",
+				METRIC_UNIT_MILLISECOND),
+		empty_labels, ARRAY_SIZE(empty_labels));
+}
+
 void idmapper_monitoring__init(void)
 {
 	register_user_groups_metric();
@@ -270,6 +313,7 @@ void idmapper_monitoring__init(void)
 	register_cache_uses_total_metrics();
 	register_failure_total_metrics();
 	register_evicted_entries_cache_duration_metrics();
+	register_snapshot_metrics();
 }
 
 void idmapper_monitoring__cache_usage(idmapping_cache_t idmapping_cache,
@@ -324,4 +368,25 @@ void idmapper_monitoring__user_groups(int num_groups)
 	monitoring__histogram_observe(idmapping_user_groups_total, num_groups);
 }
 
+void idmapper_monitoring__snapshot_load(int64_t load_time_ms,
+					const uint32_t *loaded,
+					const uint32_t *expired)
+{
+	monitoring__gauge_set(snapshot_load_time, load_time_ms);
+
+	for (int i = 0; i < IDMAPPING_CACHE_ENTITY_COUNT; i++) {
+		monitoring__gauge_set(
+			snapshot_entries[i][IDMAPPING_STATUS_SUCCESS],
+			loaded[i]);
+		monitoring__gauge_set(
+			snapshot_entries[i][IDMAPPING_STATUS_FAILURE],
+			expired[i]);
+	}
+}
+
+void idmapper_monitoring__snapshot_save(int64_t save_time_ms)
+{
+	monitoring__gauge_set(snapshot_save_time, save_time_ms);
+}
+
 /** @} */
@@ -0,0 +1,533 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup idmapper
+ * @{
+ */
+
+/**
+ * @file    idmapper_snapshot.c
+ * @brief   Warm-restart snapshot of the identity and netgroup caches
+ *
+ * The idmapper, uid2grp and netgroup caches are saved periodically and on
+ * shutdown to Cache_Snapshot_Path, and loaded back at startup so that a
+ * restarted server does not have to look every active user up again
+ * while clients are reclaiming state.
+ *
+ * The file is a header followed by variable sized records, all in host
+ * byte order and 8 byte aligned, so that it can be mapped and walked in
+ * place.  Each record is a struct snapshot_record followed by its
+ * supplementary groups, its name and its second name (netgroup host).
+ * Entries keep the time they were first cached at, so that they expire
+ * after a restart exactly when they would have without one.
+ */
+
+#include "config.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "common_utils.h"
+#include "abstract_mem.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "idmapper.h"
+#include "uid2grp.h"
+#include "netgroup_cache.h"
+#include "idmapper_monitoring.h"
+#include "city.h"
+
+#define SNAPSHOT_MAGIC "GSHIDSN\0"
+#define SNAPSHOT_VERSION 1
+
+/* The user entry has a GID */
+#define SNAPSHOT_GID_SET 0x0001
+
+struct snapshot_header {
+	char magic[8]; /*< SNAPSHOT_MAGIC */
+	uint32_t version; /*< SNAPSHOT_VERSION */
+	uint32_t count; /*< Number of records */
+	int64_t saved; /*< When the snapshot was taken */
+	uint64_t length; /*< Length of the records */
+	uint64_t checksum; /*< CityHash64 of the records */
+};
+
+struct snapshot_record {
+	uint16_t type; /*< enum idmapper_snapshot_type */
+	uint16_t flags; /*< SNAPSHOT_* flags */
+	uint16_t name_len; /*< Length of name */
+	uint16_t name2_len; /*< Length of second name */
+	uint32_t id; /*< UID or GID */
+	uint32_t gid; /*< GID of a user */
+	uint32_t ngroups; /*< Number of supplementary groups */
+	uint32_t size; /*< Size of the record, with its payload */
+	int64_t epoch; /*< When the entry was cached */
+};
+
+/**
+ * @brief A snapshot being built in memory
+ */
+
+struct idmapper_snapshot {
+	char *buf; /*< Header and records */
+	size_t len; /*< Used length of buf */
+	size_t alloc; /*< Allocated length of buf */
+	uint32_t count; /*< Number of records */
+};
+
+/* Switch to enable or disable idmapping */
+extern bool idmapping_enabled;
+
+static struct fridgethr *snapshot_fridge;
+
+static const idmapping_cache_entity_t
+	snapshot_entity[IDMAPPER_SNAPSHOT_TYPE_COUNT] = {
+		[IDMAPPER_SNAPSHOT_UNAME] = IDMAPPING_CACHE_ENTITY_USER,
+		[IDMAPPER_SNAPSHOT_UID] = IDMAPPING_CACHE_ENTITY_USER,
+		[IDMAPPER_SNAPSHOT_GNAME] = IDMAPPING_CACHE_ENTITY_GROUP,
+		[IDMAPPER_SNAPSHOT_GID] = IDMAPPING_CACHE_ENTITY_GROUP,
+		[IDMAPPER_SNAPSHOT_USER_GROUPS] =
+			IDMAPPING_CACHE_ENTITY_USER_GROUPS,
+		[IDMAPPER_SNAPSHOT_NETGROUP] = IDMAPPING_CACHE_ENTITY_NETGROUP,
+		[IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP] =
+			IDMAPPING_CACHE_ENTITY_NEGATIVE_NETGROUP,
+	};
+
+static inline size_t snapshot_align(size_t len)
+{
+	return (len + 7) & ~(size_t)7;
+}
+
+/**
+ * @brief Add an entry to a snapshot
+ *
+ * @param[in] snapshot Snapshot being built
+ * @param[in] type     Kind of entry
+ * @param[in] name     Name of the entry
+ * @param[in] name2    Second name of the entry, or NULL
+ * @param[in] id       UID or GID
+ * @param[in] gid      GID of a user, or NULL
+ * @param[in] groups   Supplementary groups, or NULL
+ * @param[in] ngroups  Number of supplementary groups
+ * @param[in] epoch    When the entry was cached
+ */
+
+void idmapper_snapshot_add(struct idmapper_snapshot *snapshot,
+			   enum idmapper_snapshot_type type,
+			   const struct gsh_buffdesc *name,
+			   const struct gsh_buffdesc *name2, uint32_t id,
+			   const gid_t *gid, const gid_t *groups,
+			   uint32_t ngroups, time_t epoch)
+{
+	size_t name2_len = name2 != NULL ? name2->len : 0;
+	size_t groups_len = ngroups * sizeof(gid_t);
+	size_t size;
+	struct snapshot_record *record;
+	char *cursor;
+
+	if (name->len > UINT16_MAX || name2_len > UINT16_MAX)
+		return;
+
+	size = snapshot_align(sizeof(struct snapshot_record) + groups_len +
+			      name->len + name2_len);
+
+	if (snapshot->len + size > snapshot->alloc) {
+		while (snapshot->len + size > snapshot->alloc)
+			snapshot->alloc *= 2;
+		snapshot->buf = gsh_realloc(snapshot->buf, snapshot->alloc);
+	}
+
+	cursor = snapshot->buf + snapshot->len;
+	memset(cursor, 0, size);
+
+	record = (struct snapshot_record *)cursor;
+	record->type = type;
+	record->flags = gid != NULL ? SNAPSHOT_GID_SET : 0;
+	record->name_len = name->len;
+	record->name2_len = name2_len;
+	record->id = id;
+	record->gid = gid != NULL ? *gid : 0;
+	record->ngroups = ngroups;
+	record->size = size;
+	record->epoch = epoch;
+
+	cursor += sizeof(struct snapshot_record);
+	if (groups_len != 0)
+		memcpy(cursor, groups, groups_len);
+	cursor += groups_len;
+	memcpy(cursor, name->addr, name->len);
+	cursor += name->len;
+	if (name2_len != 0)
+		memcpy(cursor, name2->addr, name2_len);
+
+	snapshot->len += size;
+	snapshot->count++;
+}
+
+/**
+ * @brief Write the caches to the snapshot file
+ *
+ * The snapshot is written to a temporary file, which is then renamed
+ * over the previous snapshot.
+ */
+
+static void idmapper_snapshot_save(void)
+{
+	const char *path =
+		nfs_param.directory_services_param.cache_snapshot_path;
+	struct idmapper_snapshot snapshot;
+	struct snapshot_header *header;
+	struct timespec s_time, e_time;
+	char *tmp_path;
+	size_t written = 0;
+	ssize_t rc;
+	int fd;
+
+	/* Do not overwrite a good snapshot with emptied caches */
+	if (path == NULL || !idmapping_enabled)
+		return;
+
+	now_mono(&s_time);
+
+	snapshot.alloc = 64 * 1024;
+	snapshot.buf = gsh_malloc(snapshot.alloc);
+	snapshot.len = sizeof(struct snapshot_header);
+	snapshot.count = 0;
+
+	idmapper_cache_save(&snapshot);
+	uid2grp_cache_save(&snapshot);
+	ng_cache_save(&snapshot);
+
+	header = (struct snapshot_header *)snapshot.buf;
+	memset(header, 0, sizeof(struct snapshot_header));
+	memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+	header->version = SNAPSHOT_VERSION;
+	header->count = snapshot.count;
+	header->saved = time(NULL);
+	header->length = snapshot.len - sizeof(struct snapshot_header);
+	header->checksum =
+		CityHash64(snapshot.buf + sizeof(struct snapshot_header),
+			   header->length);
+
+	tmp_path = gsh_concat(path, ".tmp");
+
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Could not create cache snapshot %s: %s", tmp_path,
+			strerror(errno));
+		goto out;
+	}
+
+	while (written < snapshot.len) {
+		rc = write(fd, snapshot.buf + written, snapshot.len - written);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			LogWarn(COMPONENT_IDMAPPER,
+				"Could not write cache snapshot %s: %s",
+				tmp_path, strerror(errno));
+			close(fd);
+			unlink(tmp_path);
+			goto out;
+		}
+		written += rc;
+	}
+
+	if (fsync(fd) < 0 || close(fd) < 0 || rename(tmp_path, path) < 0) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Could not commit cache snapshot %s: %s", path,
+			strerror(errno));
+		unlink(tmp_path);
+		goto out;
+	}
+
+	now_mono(&e_time);
+	idmapper_monitoring__snapshot_save(timespec_diff(&s_time, &e_time) /
+					   NS_PER_MSEC);
+
+	LogDebug(COMPONENT_IDMAPPER,
+		 "Saved %" PRIu32 " cache entries to %s in %" PRIu64 " ms",
+		 snapshot.count, path,
+		 timespec_diff(&s_time, &e_time) / NS_PER_MSEC);
+
+out:
+	gsh_free(tmp_path);
+	gsh_free(snapshot.buf);
+}
+
+/**
+ * @brief Restore one snapshot record in its cache
+ *
+ * @return true if restored, false if expired.
+ */
+
+static bool idmapper_snapshot_restore(const struct snapshot_record *record,
+				      const gid_t *groups, const char *name,
+				      const char *name2)
+{
+	struct gsh_buffdesc name_desc = { .addr = (char *)name,
+					  .len = record->name_len };
+	gid_t gid = record->gid;
+
+	switch (record->type) {
+	case IDMAPPER_SNAPSHOT_UNAME:
+	case IDMAPPER_SNAPSHOT_UID:
+	case IDMAPPER_SNAPSHOT_GNAME:
+	case IDMAPPER_SNAPSHOT_GID:
+		return idmapper_cache_restore(
+			record->type, &name_desc, record->id,
+			record->flags & SNAPSHOT_GID_SET ? &gid : NULL,
+			record->epoch);
+	case IDMAPPER_SNAPSHOT_USER_GROUPS:
+		return uid2grp_cache_restore(&name_desc, record->id, gid,
+					     groups, record->ngroups,
+					     record->epoch);
+	case IDMAPPER_SNAPSHOT_NETGROUP:
+	case IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP:
+		return ng_cache_restore(
+			name, name2,
+			record->type == IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP,
+			record->epoch);
+	}
+
+	return false;
+}
+
+/**
+ * @brief Check that a record fits and is well formed
+ */
+
+static bool idmapper_snapshot_valid(const struct snapshot_record *record,
+				    size_t left)
+{
+	size_t payload;
+	const char *name;
+
+	if (left < sizeof(struct snapshot_record) || record->size > left ||
+	    record->size % 8 != 0 || record->type >= IDMAPPER_SNAPSHOT_TYPE_COUNT)
+		return false;
+
+	payload = (size_t)record->ngroups * sizeof(gid_t) + record->name_len +
+		  record->name2_len;
+
+	if (payload > record->size - sizeof(struct snapshot_record))
+		return false;
+
+	if (record->type != IDMAPPER_SNAPSHOT_NETGROUP &&
+	    record->type != IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP)
+		return true;
+
+	/* Netgroup names are stored with their terminating NUL */
+	name = (const char *)(record + 1) + record->ngroups * sizeof(gid_t);
+
+	return record->name_len != 0 && record->name2_len != 0 &&
+	       name[record->name_len - 1] == '\0' &&
+	       name[record->name_len + record->name2_len - 1] == '\0';
+}
+
+/**
+ * @brief Load the caches from the snapshot file
+ */
+
+static void idmapper_snapshot_load(void)
+{
+	const char *path =
+		nfs_param.directory_services_param.cache_snapshot_path;
+	const struct snapshot_header *header;
+	const struct snapshot_record *record;
+	uint32_t loaded[IDMAPPING_CACHE_ENTITY_COUNT] = { 0 };
+	uint32_t expired[IDMAPPING_CACHE_ENTITY_COUNT] = { 0 };
+	uint32_t total_loaded = 0;
+	struct timespec s_time, e_time;
+	struct stat st;
+	const char *cursor, *end;
+	const gid_t *groups;
+	const char *name;
+	void *map;
+	uint32_t i;
+	int fd;
+
+	if (path == NULL)
+		return;
+
+	now_mono(&s_time);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			LogInfo(COMPONENT_IDMAPPER, "No cache snapshot at %s",
+				path);
+		else
+			LogWarn(COMPONENT_IDMAPPER,
+				"Could not open cache snapshot %s: %s", path,
+				strerror(errno));
+		return;
+	}
+
+	if (fstat(fd, &st) < 0 ||
+	    st.st_size < (off_t)sizeof(struct snapshot_header)) {
+		LogWarn(COMPONENT_IDMAPPER, "Ignoring truncated cache snapshot %s",
+			path);
+		close(fd);
+		return;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		LogWarn(COMPONENT_IDMAPPER, "Could not map cache snapshot %s: %s",
+			path, strerror(errno));
+		return;
+	}
+
+	header = map;
+	cursor = (const char *)map + sizeof(struct snapshot_header);
+	end = (const char *)map + st.st_size;
+
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+	    header->version != SNAPSHOT_VERSION ||
+	    header->length != (uint64_t)(end - cursor) ||
+	    header->checksum != CityHash64(cursor, header->length)) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Ignoring invalid or incompatible cache snapshot %s",
+			path);
+		goto out;
+	}
+
+	for (i = 0; i < header->count; i++) {
+		record = (const struct snapshot_record *)cursor;
+
+		if (!idmapper_snapshot_valid(record, end - cursor)) {
+			LogWarn(COMPONENT_IDMAPPER,
+				"Corrupt record %" PRIu32
+				" in cache snapshot %s, stopping",
+				i, path);
+			break;
+		}
+
+		groups = (const gid_t *)(record + 1);
+		name = (const char *)(groups + record->ngroups);
+
+		if (idmapper_snapshot_restore(record, groups, name,
+					      name + record->name_len)) {
+			loaded[snapshot_entity[record->type]]++;
+			total_loaded++;
+		} else {
+			expired[snapshot_entity[record->type]]++;
+		}
+
+		cursor += record->size;
+	}
+
+	now_mono(&e_time);
+	idmapper_monitoring__snapshot_load(timespec_diff(&s_time, &e_time) /
+						   NS_PER_MSEC,
+					   loaded, expired);
+
+	LogEvent(COMPONENT_IDMAPPER,
+		 "Loaded %" PRIu32 " of %" PRIu32
+		 " cache entries from snapshot %s in %" PRIu64 " ms",
+		 total_loaded, header->count, path,
+		 timespec_diff(&s_time, &e_time) / NS_PER_MSEC);
+
+out:
+	munmap(map, st.st_size);
+}
+
+static void snapshot_run(struct fridgethr_context *unused_ctx)
+{
+	idmapper_snapshot_save();
+}
+
+/**
+ * @brief Load the snapshot and start saving it periodically
+ */
+
+void idmapper_snapshot_init(void)
+{
+	const directory_services_param_t *ds_param =
+		&nfs_param.directory_services_param;
+	struct fridgethr_params thread_params;
+	int rc;
+
+	if (ds_param->cache_snapshot_path == NULL || !ds_param->idmapping_active)
+		return;
+
+	idmapper_snapshot_load();
+
+	if (ds_param->cache_snapshot_interval == 0) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Periodic cache snapshots are disabled");
+		return;
+	}
+
+	memset(&thread_params, 0, sizeof(struct fridgethr_params));
+	thread_params.thr_max = 1;
+	thread_params.thr_min = 1;
+	thread_params.thread_delay = ds_param->cache_snapshot_interval;
+	thread_params.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&snapshot_fridge, "idmapper_snapshot",
+			    &thread_params);
+	if (rc != 0) {
+		LogCrit(COMPONENT_IDMAPPER,
+			"Idmapper snapshot fridge init failed. Error: %d", rc);
+		snapshot_fridge = NULL;
+		return;
+	}
+
+	rc = fridgethr_submit(snapshot_fridge, snapshot_run, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_IDMAPPER,
+			"Unable to start idmapper snapshots. Error: %d.", rc);
+		fridgethr_destroy(snapshot_fridge);
+		snapshot_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop periodic snapshots and save a last one
+ */
+
+void idmapper_snapshot_destroy(void)
+{
+	if (snapshot_fridge != NULL) {
+		int rc = fridgethr_sync_command(snapshot_fridge,
+						fridgethr_comm_stop, 120);
+
+		if (rc != 0) {
+			/* A save may still be writing the temporary file */
+			LogMajor(COMPONENT_IDMAPPER,
+				 "Failed shutting down idmapper snapshot thread: %d, not saving a last snapshot",
+				 rc);
+			return;
+		}
+		fridgethr_destroy(snapshot_fridge);
+		snapshot_fridge = NULL;
+	}
+
+	idmapper_snapshot_save();
+}
+
+/** @} */
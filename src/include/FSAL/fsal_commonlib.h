@@ -315,6 +315,9 @@ bool check_verifier_attrlist(struct fsal_attrlist *attrs,
 bool fsal_common_is_referral(struct fsal_obj_handle *obj_hdl,
 			     struct fsal_attrlist *attrs, bool cache_attrs);
 
+void fsal_metrics__readahead(const char *result, uint64_t bytes,
+			     uint16_t export_id);
+
 fsal_status_t update_export(struct fsal_module *fsal_hdl, void *parse_node,
 			    struct config_error_type *err_type,
 			    struct fsal_export *original,
@@ -74,11 +74,16 @@ struct fsal_filesystem {
 
 	struct avltree_node avl_fsid; /*< AVL indexed by fsid */
 	struct avltree_node avl_dev; /*< AVL indexed by dev */
+	struct avltree_node avl_path; /*< AVL indexed by path */
+	uint64_t generation; /*< Last mount table scan that saw it */
+	int mnt_id; /*< Mount id in /proc/self/mountinfo, -1 if unknown */
+	fsal_dev_t mnt_dev; /*< Device of the mount in mountinfo */
 	struct fsal_fsid__ fsid; /*< file system id */
 	fsal_dev_t dev; /*< device filesystem is on */
 	enum fsid_type fsid_type; /*< type of fsid present */
 	bool in_fsid_avl; /*< true if inserted in fsid avl */
 	bool in_dev_avl; /*< true if inserted in dev avl */
+	bool in_path_avl; /*< true if inserted in path avl */
 	int claims[CLAIM_NUM]; /*< number of each type of claim */
 	bool trunc_verif; /*< true if the filesystem needs
 					    atime/mtime to be truncated to 31
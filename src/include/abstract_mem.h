@@ -41,6 +41,8 @@
 #define ABSTRACT_MEM_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 #include "log.h"
@@ -57,6 +59,167 @@
  * memory tracking or that call allocators with other names.
  */
 
+#ifdef USE_MEM_ACCOUNTING
+
+/**
+ * @page MemAccounting Memory accounting
+ *
+ * When built with USE_MEM_ACCOUNTING, every block is preceded by a
+ * gsh_mem_header recording its size and the log component it is charged
+ * to.  Each use of the allocation macros has a static gsh_mem_site whose
+ * component is found from its source file the first time it allocates,
+ * so MDCACHE, the DRC, SAL state, sessions and the idmapper are told
+ * apart without changing their code.  Memory allocated by ntirpc through
+ * the hooks below is charged to TIRPC.
+ *
+ * Blocks from these functions must be released with gsh_free, not free.
+ * A block allocated by a library with malloc must be released with free,
+ * or be handed to gsh_foreign() first if it is to be released with
+ * gsh_free, since gsh_free only looks for a header before blocks it was
+ * not told about.
+ */
+
+/**
+ * @brief A place in the code allocating memory
+ */
+struct gsh_mem_site {
+	const char *file; /*< Source file of the site */
+	int32_t component; /*< log_components_t, -1 until found */
+};
+
+#define GSH_MEM_SITE                              \
+	{                                         \
+		.file = __FILE__, .component = -1 \
+	}
+
+void *gsh_mem_alloc(struct gsh_mem_site *site, size_t align, size_t n,
+		    bool zero);
+void *gsh_mem_realloc(struct gsh_mem_site *site, void *p, size_t n);
+void gsh_mem_free(void *p);
+void gsh_mem_foreign(void *p);
+
+extern struct gsh_mem_site gsh_mem_tirpc_site;
+
+static inline void *gsh_malloc__(size_t n, const char *file, int line,
+				 const char *function)
+{
+	void *p = gsh_mem_alloc(&gsh_mem_tirpc_site, 0, n, false);
+
+	if (p == NULL) {
+		LogMallocFailure(file, line, function, "gsh_malloc");
+		abort();
+	}
+
+	return p;
+}
+
+#define gsh_malloc(n)                                            \
+	({                                                       \
+		static struct gsh_mem_site site_ = GSH_MEM_SITE; \
+		void *p_ = gsh_mem_alloc(&site_, 0, n, false);   \
+		if (p_ == NULL) {                                \
+			LogMallocFailure(__FILE__, __LINE__,     \
+					 __func__, "gsh_malloc"); \
+			abort();                                 \
+		}                                                \
+		p_;                                              \
+	})
+
+static inline void *gsh_malloc_aligned__(size_t a, size_t n, const char *file,
+					 int line, const char *function)
+{
+	void *p = gsh_mem_alloc(&gsh_mem_tirpc_site, a, n, false);
+
+	if (p == NULL) {
+		LogMallocFailure(file, line, function, "gsh_malloc_aligned");
+		abort();
+	}
+
+	return p;
+}
+
+#define gsh_malloc_aligned(a, n)                                 \
+	({                                                       \
+		static struct gsh_mem_site site_ = GSH_MEM_SITE; \
+		void *p_ = gsh_mem_alloc(&site_, a, n, false);   \
+		if (p_ == NULL) {                                \
+			LogMallocFailure(__FILE__, __LINE__,     \
+					 __func__,               \
+					 "gsh_malloc_aligned");  \
+			abort();                                 \
+		}                                                \
+		p_;                                              \
+	})
+
+static inline void *gsh_calloc__(size_t n, size_t s, const char *file, int line,
+				 const char *function)
+{
+	void *p = NULL;
+
+	if (s == 0 || n <= SIZE_MAX / s)
+		p = gsh_mem_alloc(&gsh_mem_tirpc_site, 0, n * s, true);
+
+	if (p == NULL) {
+		LogMallocFailure(file, line, function, "gsh_calloc");
+		abort();
+	}
+
+	return p;
+}
+
+#define gsh_calloc(n, s)                                         \
+	({                                                       \
+		static struct gsh_mem_site site_ = GSH_MEM_SITE; \
+		size_t n_ = (n), s_ = (s);                       \
+		void *p_ = NULL;                                 \
+		if (s_ == 0 || n_ <= SIZE_MAX / s_)              \
+			p_ = gsh_mem_alloc(&site_, 0, n_ * s_,   \
+					   true);                \
+		if (p_ == NULL) {                                \
+			LogMallocFailure(__FILE__, __LINE__,     \
+					 __func__, "gsh_calloc"); \
+			abort();                                 \
+		}                                                \
+		p_;                                              \
+	})
+
+static inline void *gsh_realloc__(void *p, size_t n, const char *file, int line,
+				  const char *function)
+{
+	void *p2 = gsh_mem_realloc(&gsh_mem_tirpc_site, p, n);
+
+	if (n != 0 && p2 == NULL) {
+		LogMallocFailure(file, line, function, "gsh_realloc");
+		abort();
+	}
+
+	return p2;
+}
+
+#define gsh_realloc(p, n)                                        \
+	({                                                       \
+		static struct gsh_mem_site site_ = GSH_MEM_SITE; \
+		size_t n_ = (n);                                 \
+		void *p2_ = gsh_mem_realloc(&site_, p, n_);      \
+		if (n_ != 0 && p2_ == NULL) {                    \
+			LogMallocFailure(__FILE__, __LINE__,     \
+					 __func__, "gsh_realloc"); \
+			abort();                                 \
+		}                                                \
+		p2_;                                             \
+	})
+
+#define gsh_strdup(s)                              \
+	({                                         \
+		const char *s_ = (s);              \
+		size_t l_ = strlen(s_) + 1;        \
+		char *p_ = (char *)gsh_malloc(l_); \
+		memcpy(p_, s_, l_);                \
+		p_;                                \
+	})
+
+#else /* USE_MEM_ACCOUNTING */
+
 /**
  * @brief Allocate memory
  *
@@ -202,13 +365,14 @@ static inline void *gsh_realloc__(void *p, size_t n, const char *file, int line,
 	return p2;
 }
 
-#define gsh_realloc(p, n)                    \
-	({                                   \
-		void *p2_ = realloc(p, n);   \
-		if (n != 0 && p2_ == NULL) { \
-			abort();             \
-		}                            \
-		p2_;                         \
+#define gsh_realloc(p, n)                     \
+	({                                    \
+		size_t n_ = (n);              \
+		void *p2_ = realloc(p, n_);   \
+		if (n_ != 0 && p2_ == NULL) { \
+			abort();              \
+		}                             \
+		p2_;                          \
 	})
 
 #define gsh_strdup(s)                 \
@@ -220,6 +384,8 @@ static inline void *gsh_realloc__(void *p, size_t n, const char *file, int line,
 		p_;                   \
 	})
 
+#endif /* USE_MEM_ACCOUNTING */
+
 #define gsh_strldup(s, l, n)                          \
 	({                                            \
 		char *p_ = (char *)gsh_malloc(l + 1); \
@@ -257,7 +423,11 @@ static inline void *gsh_realloc__(void *p, size_t n, const char *file, int line,
  */
 static inline void gsh_free(void *p)
 {
+#ifdef USE_MEM_ACCOUNTING
+	gsh_mem_free(p);
+#else
 	free(p);
+#endif
 }
 
 /**
@@ -272,7 +442,31 @@ static inline void gsh_free(void *p)
  */
 static inline void gsh_free_size(void *p, size_t n __attribute__((unused)))
 {
+#ifdef USE_MEM_ACCOUNTING
+	gsh_mem_free(p);
+#else
 	free(p);
+#endif
+}
+
+/**
+ * @brief Let gsh_free release a block allocated by a library
+ *
+ * Memory a library allocated with malloc is normally released with free.
+ * Where it is kept with memory from gsh_malloc and released with gsh_free,
+ * it must be handed over with this function first.
+ *
+ * @param[in] p  Block from a library's malloc, may be NULL
+ *
+ * @return The block.
+ */
+static inline void *gsh_foreign(void *p)
+{
+#ifdef USE_MEM_ACCOUNTING
+	if (p != NULL)
+		gsh_mem_foreign(p);
+#endif
+	return p;
 }
 
 /**
@@ -380,17 +380,51 @@ static inline int PTHREAD_create(pthread_t *thread, pthread_attr_t *attr,
 		}                                                             \
 	} while (0)
 
+/**
+ * @brief A place in the code that takes a lock, for contention profiling
+ *
+ * Each use of the lock macros below has its own static site.
+ */
+struct lock_site {
+	const char *name; /*< The lock, as written at the site */
+	const char *file; /*< Source file of the site */
+	int line; /*< Source line of the site */
+	const char *kind; /*< "mutex", "read" or "write" */
+};
+
+#define LOCK_SITE(_name, _kind)                            \
+	{                                                  \
+		.name = _name, .file = __FILE__,           \
+		.line = __LINE__, .kind = _kind            \
+	}
+
+extern bool lock_profiling;
+
+int lock_profile_mutex_lock(pthread_mutex_t *mtx, struct lock_site *site);
+int lock_profile_rwlock_rdlock(pthread_rwlock_t *lock,
+			       struct lock_site *site);
+int lock_profile_rwlock_wrlock(pthread_rwlock_t *lock,
+			       struct lock_site *site);
+
 /**
  * @brief Logging write-lock
  *
+ * When lock profiling is enabled, the time spent waiting for a lock that
+ * is contended is accounted to the site.
+ *
  * @param[in,out] _lock Read-write lock
  */
 
 #define PTHREAD_RWLOCK_wrlock(_lock)                                     \
 	do {                                                             \
 		int rc;                                                  \
+		static struct lock_site site_ =                          \
+			LOCK_SITE(#_lock, "write");                      \
                                                                          \
-		rc = pthread_rwlock_wrlock(_lock);                       \
+		if (unlikely(lock_profiling))                            \
+			rc = lock_profile_rwlock_wrlock(_lock, &site_);  \
+		else                                                     \
+			rc = pthread_rwlock_wrlock(_lock);               \
 		if (rc == 0) {                                           \
 			LogFullDebug(COMPONENT_RW_LOCK,                  \
 				     "Got write lock on %p (%s) "        \
@@ -414,8 +448,13 @@ static inline int PTHREAD_create(pthread_t *thread, pthread_attr_t *attr,
 #define PTHREAD_RWLOCK_rdlock(_lock)                                     \
 	do {                                                             \
 		int rc;                                                  \
+		static struct lock_site site_ =                          \
+			LOCK_SITE(#_lock, "read");                       \
                                                                          \
-		rc = pthread_rwlock_rdlock(_lock);                       \
+		if (unlikely(lock_profiling))                            \
+			rc = lock_profile_rwlock_rdlock(_lock, &site_);  \
+		else                                                     \
+			rc = pthread_rwlock_rdlock(_lock);               \
 		if (rc == 0) {                                           \
 			LogFullDebug(COMPONENT_RW_LOCK,                  \
 				     "Got read lock on %p (%s) "         \
@@ -533,8 +572,12 @@ static inline int PTHREAD_create(pthread_t *thread, pthread_attr_t *attr,
 #define PTHREAD_MUTEX_lock(_mtx)                                              \
 	do {                                                                  \
 		int rc;                                                       \
+		static struct lock_site site_ = LOCK_SITE(#_mtx, "mutex");    \
                                                                               \
-		rc = pthread_mutex_lock(_mtx);                                \
+		if (unlikely(lock_profiling))                                 \
+			rc = lock_profile_mutex_lock(_mtx, &site_);           \
+		else                                                          \
+			rc = pthread_mutex_lock(_mtx);                        \
 		if (rc == 0) {                                                \
 			LogFullDebug(COMPONENT_RW_LOCK,                       \
 				     "Acquired mutex %p (%s) at %s:%d", _mtx, \
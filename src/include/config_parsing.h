@@ -866,6 +866,9 @@ uint64_t get_config_generation(struct config_root *root);
 /* Get the generation of the config tree from config_node */
 uint64_t get_parse_root_generation(void *node);
 
+/* Get a digest of the contents of a config_node and its sub-nodes */
+uint64_t config_node_digest(void *node, uint64_t seed);
+
 struct config_node_list {
 	void *tree_node;
 	struct config_node_list *next;
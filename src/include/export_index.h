@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file export_index.h
+ * @brief Indexes of the exports by path, pseudo path and tag
+ *
+ * Only for the export manager, which holds its lock for write around
+ * export_index_add() and export_index_remove().  Lookups take no lock.
+ */
+
+#ifndef EXPORT_INDEX_H
+#define EXPORT_INDEX_H
+
+#include <stdbool.h>
+#include "export_mgr.h"
+
+void export_index_add(struct gsh_export *export, enum export_index_type type);
+void export_index_remove(struct gsh_export *export,
+			 enum export_index_type type);
+struct gsh_export *export_index_lookup(enum export_index_type type,
+				       const char *key, bool exact_match);
+
+#endif /* EXPORT_INDEX_H */
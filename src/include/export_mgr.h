@@ -124,6 +124,19 @@ enum export_status {
 	EXPORT_STALE, /*< export is no longer valid */
 };
 
+/**
+ * @brief Keys exports are indexed by, besides their id
+ */
+
+enum export_index_type {
+	EXPORT_INDEX_PATH, /*< Full path, by longest prefix */
+	EXPORT_INDEX_PSEUDO, /*< Pseudo path, by longest prefix */
+	EXPORT_INDEX_TAG, /*< Tag */
+	EXPORT_INDEX_COUNT
+};
+
+struct export_index_entry;
+
 /**
  * @brief Represents an export.
  *
@@ -136,6 +149,12 @@ struct gsh_export {
 	struct glist_head exp_list;
 	/** gsh_exports are kept in an AVL tree by export_id */
 	struct avltree_node node_k;
+	/** Entries in the indexes by path, pseudo path and tag, NULL when
+	 *  not indexed.  Protected by the export manager lock. */
+	struct export_index_entry *index_entries[EXPORT_INDEX_COUNT];
+	/** Rank of the export in the export list, the exports sharing a key
+	 *  are kept in that order in the indexes. */
+	uint64_t index_order;
 	/** List of NFS v4 state belonging to this export */
 	struct glist_head exp_state_list;
 	/** List of locks belonging to this export */
@@ -154,6 +173,12 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG config_generation that last touched this export */
 	uint64_t config_gen;
+	/** CFG digest of the EXPORT block that last updated this export, 0
+	 *  if the block must be processed again on every update */
+	uint64_t config_digest;
+	/** CFG Some clients are host names or netgroups, resolved when the
+	 *  EXPORT block is processed */
+	bool clients_by_name;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
 	/** Entry for the junction of this export.  Protected by lock */
@@ -194,6 +219,16 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: Cache entries the export may keep while the cache is under
+	 *  pressure, 0 for no limit - atomic changeable option */
+	uint32_t cache_entries_soft;
+	/** CFG: Cache entries the export may never exceed, 0 for no limit -
+	 *  atomic changeable option */
+	uint32_t cache_entries_hard;
+	/** CFG: Dirent chunks soft limit - atomic changeable option */
+	uint32_t cache_chunks_soft;
+	/** CFG: Dirent chunks hard limit - atomic changeable option */
+	uint32_t cache_chunks_hard;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
@@ -313,6 +348,8 @@ void dbus_export_init(void);
 #endif
 struct gsh_export *alloc_export(void);
 bool insert_gsh_export(struct gsh_export *a_export);
+void reindex_gsh_export_paths(struct gsh_export *a_export, bool fullpath,
+			      bool pseudopath);
 struct gsh_export *get_gsh_export(uint16_t export_id);
 struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match);
 struct gsh_export *get_gsh_export_by_path_locked(char *path, bool exact_match);
@@ -371,7 +408,7 @@ struct gsh_export *export_take_mount_work(void);
 extern struct config_block add_export_param;
 extern struct config_block update_export_param;
 
-void prune_defunct_exports(uint64_t generation);
+int prune_defunct_exports(uint64_t generation);
 void remove_all_exports(void);
 
 extern struct timespec nfs_stats_time;
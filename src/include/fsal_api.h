@@ -354,7 +354,7 @@ extern struct gsh_refstr *no_export;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 4
 
 /* Forward references for object methods */
 
@@ -504,6 +504,8 @@ struct req_op_context {
 	struct {
 		bool pseudo_fsal_internal_lookup;
 	} flags;
+	struct req_record *req_record; /*< flight recorder record of the
+					   request, NULL if not recorded */
 };
 
 /**
@@ -2790,6 +2792,95 @@ struct fsal_obj_ops {
 	bool (*is_referral)(struct fsal_obj_handle *obj_hdl,
 			    struct fsal_attrlist *attrs, bool cache_attrs);
 
+	/**
+ * @brief Receive I/O statistics for a layout
+ *
+ * This function is called by nfs4_op_layoutstats.  The FSAL may use the
+ * statistics to steer future layouts towards less loaded devices.
+ *
+ * @param[in] obj_hdl  The file the statistics apply to
+ * @param[in] lou_body An XDR stream containing the layout type-specific
+ *                     portion of the LAYOUTSTATS arguments.
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 63.
+ */
+	nfsstat4 (*layoutstats)(struct fsal_obj_handle *obj_hdl, XDR *lou_body,
+				const struct fsal_layoutstats_arg *arg);
+
+	/**
+ * @brief Receive a device error for a layout
+ *
+ * This function is called by nfs4_op_layouterror.  The FSAL may use the
+ * error to avoid handing out the failing device in future layouts.
+ *
+ * @param[in] obj_hdl  The file the error applies to
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 61.
+ */
+	nfsstat4 (*layouterror)(struct fsal_obj_handle *obj_hdl,
+				const struct fsal_layouterror_arg *arg);
+
+	/**
+ * @brief Get a validator for cached listings of a directory
+ *
+ * The validator changes whenever the content of the directory changes,
+ * and whenever the attributes of an object handed out by readdir may have
+ * changed.  It allows READDIR replies to be cached in encoded form and
+ * served again without walking the directory.
+ *
+ * @param[in]  dir_hdl Directory to validate
+ * @param[out] change  Change attribute of the directory
+ * @param[out] epoch   Epoch covering the attributes of its entries
+ *
+ * @return true if the listing of the directory may be cached.
+ */
+	bool (*readdir_validator)(struct fsal_obj_handle *dir_hdl,
+				  uint64_t *change, uint64_t *epoch);
+
+	/**
+ * @brief Look up encoded attributes memoized on an object
+ *
+ * The protocol layer may memoize the XDR encoding of the attributes of an
+ * object, under an opaque key describing what was requested.  A memoized
+ * encoding is only returned while the attributes in @a mask it was built
+ * from are still valid.
+ *
+ * On a miss, @a generation is set to the value to pass back to
+ * fattr_cache_put() once the attributes have been fetched and encoded, or
+ * to 0 if the FSAL does not memoize encodings for the object.
+ *
+ * @param[in]  obj_hdl    Object to look up
+ * @param[in]  mask       Attributes the encoding depends on
+ * @param[in]  key        Opaque key of the encoding
+ * @param[out] fattr      Copy of the encoding, to be freed by the caller
+ * @param[out] generation Generation of the attributes
+ *
+ * @return true if an encoding was copied to @a fattr.
+ */
+	bool (*fattr_cache_get)(struct fsal_obj_handle *obj_hdl,
+				attrmask_t mask,
+				const struct gsh_buffdesc *key,
+				struct gsh_buffdesc *fattr,
+				uint64_t *generation);
+
+	/**
+ * @brief Memoize encoded attributes on an object
+ *
+ * The encoding is dropped if the attributes changed since @a generation
+ * was returned by fattr_cache_get().
+ *
+ * @param[in] obj_hdl    Object the attributes were encoded from
+ * @param[in] key        Opaque key of the encoding
+ * @param[in] fattr      The encoding, ownership passes to the FSAL
+ * @param[in] generation Generation returned by fattr_cache_get()
+ */
+	void (*fattr_cache_put)(struct fsal_obj_handle *obj_hdl,
+				const struct gsh_buffdesc *key,
+				struct gsh_buffdesc *fattr,
+				uint64_t generation);
+
 	/**@{*/
 
 	/**
@@ -166,6 +166,9 @@ struct fsal_layoutget_arg {
 	/** The maximum number of bytes the client is willing to accept
 	    in the response, including XDR overhead. */
 	uint32_t maxcount;
+	/** The layout stateid the segments are granted under, with the
+	 *  seqid it will have in the reply. */
+	stateid4 stateid;
 };
 
 /**
@@ -321,6 +324,40 @@ struct fsal_layoutcommit_res {
 	bool commit_done;
 };
 
+/**
+ * Input parameters to FSAL_layoutstats
+ */
+
+struct fsal_layoutstats_arg {
+	/** The type of the layout the statistics apply to */
+	layouttype4 type;
+	/** Start of the byte range the statistics apply to */
+	uint64_t offset;
+	/** Length of the byte range the statistics apply to */
+	uint64_t length;
+	/** Number of READs and bytes read through the layout */
+	io_info4 read;
+	/** Number of WRITEs and bytes written through the layout */
+	io_info4 write;
+};
+
+/**
+ * Input parameters to FSAL_layouterror
+ */
+
+struct fsal_layouterror_arg {
+	/** Start of the byte range the error applies to */
+	uint64_t offset;
+	/** Length of the byte range the error applies to */
+	uint64_t length;
+	/** The device on which the error occurred */
+	struct pnfs_deviceid deviceid;
+	/** The error the client got from the device */
+	nfsstat4 status;
+	/** The operation that failed */
+	nfs_opnum4 opnum;
+};
+
 /**
  * In/out and output parameters to FSAL_getdevicelist
  */
@@ -217,6 +217,7 @@ typedef struct fsal_acl__ {
 	fsal_ace_t *aces;
 	pthread_rwlock_t acl_lock;
 	uint32_t ref;
+	uint64_t id; /*< Never reused, keys memoized access decisions */
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
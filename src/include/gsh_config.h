@@ -440,6 +440,19 @@ typedef struct nfs_core_param {
 	bool enable_AUTHSTATS;
 	/** Whether to collect client all ops stats. Defaults to false. */
 	bool enable_CLNTALLSTATS;
+	/** Requests taking longer than this many milliseconds are kept in
+	    the slow request log, 0 to disable it. Defaults to 1000. */
+	uint32_t slow_request_threshold;
+	/** Number of requests kept in the slow request log. */
+	uint32_t slow_request_log_size;
+	/** Number of recent requests kept per worker thread, 0 to disable. */
+	uint32_t request_recorder_size;
+	/** Whether to keep histograms of the phases of requests. Defaults to
+	    true. */
+	bool enable_request_phase_stats;
+	/** Whether to account the time waited for contended locks to the
+	    code taking them. Defaults to false. */
+	bool enable_lock_profiling;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -497,6 +510,10 @@ typedef struct nfs_core_param {
 	*  nfs request). range 32-1M
 	*/
 	uint32_t readdir_max_count;
+	/** Number of encoded READDIR replies to cache, 0 disables the
+	 *  cache.  Settable by Readdir_Cache_Size.
+	 */
+	uint32_t readdir_cache_size;
 	/** Whether to call getattrs in nfs4_complete_read and
 		nfs3_complete_read.
 		Defaults to true and settable by Getattrs_In_Complete_Read. */
@@ -705,6 +722,24 @@ typedef struct directory_services_param {
 	/** Whether to use fully qualified names for idmapping with pw-utils.
 	    Defaults to false. */
 	bool pwutils_use_fully_qualified_names;
+	/** Seconds before expiry at which user-groups entries still in use
+	    are refreshed in the background. 0 disables refresh ahead. */
+	int64_t cache_refresh_ahead_time;
+	/** Seconds after expiry during which user-groups entries may still
+	    be served while they are refreshed in the background. */
+	int64_t cache_stale_serve_time;
+	/** Number of threads doing background directory lookups, and
+	    most lookups in progress at once. 0 disables background
+	    refresh and the bound. */
+	uint32_t cache_refresh_threads;
+	/** File the identity and netgroup caches are saved to, and loaded
+	    from at startup. NULL disables snapshots. */
+	char *cache_snapshot_path;
+	/** Seconds between snapshots. 0 saves only on shutdown. */
+	int64_t cache_snapshot_interval;
+	/** Bytes allocated by the idmapper caches above which they are
+	    cleared, 0 for no limit. Needs USE_MEM_ACCOUNTING. */
+	uint64_t cache_memory_limit;
 } directory_services_param_t;
 
 /** @} */
@@ -31,6 +31,7 @@ enum recovery_backend {
 	RECOVERY_BACKEND_RADOS_KV,
 	RECOVERY_BACKEND_RADOS_NG,
 	RECOVERY_BACKEND_RADOS_CLUSTER,
+	RECOVERY_BACKEND_FS_JOURNAL,
 };
 
 /**
@@ -68,7 +68,7 @@ void idmapper_cache_reap(void);
 bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *, bool);
 bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
+			      const gid_t **);
 bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
 			    const gid_t **);
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
@@ -83,6 +83,61 @@ void idmapper_negative_cache_clear(void);
 void idmapper_negative_cache_destroy(void);
 void idmapper_negative_cache_reap(void);
 
+/**
+ * @brief Kinds of directory lookups that can be deduplicated
+ */
+enum idmapper_flight_type {
+	IDMAPPER_FLIGHT_UID_TO_NAME,
+	IDMAPPER_FLIGHT_GID_TO_NAME,
+	IDMAPPER_FLIGHT_NAME_TO_UID,
+	IDMAPPER_FLIGHT_NAME_TO_GID,
+	IDMAPPER_FLIGHT_UID_TO_GROUPS,
+	IDMAPPER_FLIGHT_NAME_TO_GROUPS,
+	IDMAPPER_FLIGHT_PRINCIPAL_TO_GROUPS,
+};
+
+struct idmapper_flight;
+
+void idmapper_flight_init(void);
+void idmapper_flight_destroy(void);
+bool idmapper_flight_join(enum idmapper_flight_type, const void *, size_t,
+			  struct idmapper_flight **);
+void idmapper_flight_land(struct idmapper_flight *);
+void idmapper_flight_refresh(enum idmapper_flight_type, const void *, size_t,
+			     void (*)(enum idmapper_flight_type, const void *,
+				      size_t));
+bool idmapper_flight_usable(time_t, int64_t, bool *);
+
+/**
+ * @brief Kinds of entries in a warm-restart snapshot
+ *
+ * The values are stored in snapshot files, only ever append.
+ */
+enum idmapper_snapshot_type {
+	IDMAPPER_SNAPSHOT_UNAME,
+	IDMAPPER_SNAPSHOT_UID,
+	IDMAPPER_SNAPSHOT_GNAME,
+	IDMAPPER_SNAPSHOT_GID,
+	IDMAPPER_SNAPSHOT_USER_GROUPS,
+	IDMAPPER_SNAPSHOT_NETGROUP,
+	IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP,
+	IDMAPPER_SNAPSHOT_TYPE_COUNT
+};
+
+struct idmapper_snapshot;
+
+void idmapper_snapshot_init(void);
+void idmapper_snapshot_destroy(void);
+void idmapper_snapshot_add(struct idmapper_snapshot *,
+			   enum idmapper_snapshot_type,
+			   const struct gsh_buffdesc *,
+			   const struct gsh_buffdesc *, uint32_t, const gid_t *,
+			   const gid_t *, uint32_t, time_t);
+void idmapper_cache_save(struct idmapper_snapshot *);
+bool idmapper_cache_restore(enum idmapper_snapshot_type,
+			    const struct gsh_buffdesc *, uint32_t,
+			    const gid_t *, time_t);
+
 /** @} */
 
 bool idmapper_init(void);
@@ -111,6 +166,7 @@ bool principal2uid(char *, uid_t *, gid_t *);
 
 #ifdef USE_DBUS
 extern struct gsh_dbus_method cachemgr_show_idmapper;
+extern struct gsh_dbus_method cachemgr_show_idmapper_shards;
 extern struct gsh_dbus_method auth_statistics;
 #endif
 
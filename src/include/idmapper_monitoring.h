@@ -82,6 +82,8 @@ typedef enum idmapping_cache_entity {
 	IDMAPPING_CACHE_ENTITY_USER_GROUPS,
 	IDMAPPING_CACHE_ENTITY_NEGATIVE_USER,
 	IDMAPPING_CACHE_ENTITY_NEGATIVE_GROUP,
+	IDMAPPING_CACHE_ENTITY_NETGROUP,
+	IDMAPPING_CACHE_ENTITY_NEGATIVE_NETGROUP,
 	IDMAPPING_CACHE_ENTITY_COUNT,
 } idmapping_cache_entity_t;
 
@@ -120,5 +122,17 @@ void idmapper_monitoring__user_groups(int num_groups);
 void idmapper_monitoring__evicted_cache_entity(idmapping_cache_entity_t,
 					       time_t cached_duration_in_sec);
 
+/**
+ * @brief Updates idmapping metrics of the last warm-restart snapshot load
+ */
+void idmapper_monitoring__snapshot_load(int64_t load_time_ms,
+					const uint32_t *loaded,
+					const uint32_t *expired);
+
+/**
+ * @brief Updates idmapping metric of the last warm-restart snapshot save
+ */
+void idmapper_monitoring__snapshot_save(int64_t save_time_ms);
+
 #endif /* IDMAPPER_MONITORING_H */
 /** @} */
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file lock_profile.h
+ * @brief Contention profiling of the PTHREAD_* lock wrappers
+ *
+ * The lock_site and the profiled lock functions used by the wrappers are
+ * in common_utils.h.
+ */
+
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct lock_site;
+
+/**
+ * @brief Waits at a site, summed over all the threads
+ */
+struct lock_profile_sum {
+	struct lock_site *site; /*< Site waited at */
+	uint64_t contended; /*< Number of times the lock was busy */
+	uint64_t wait_ns; /*< Total time waited for the lock */
+	uint64_t max_ns; /*< Longest wait */
+};
+
+void lock_profile_init(void);
+bool lock_profile_enable(bool enable);
+void lock_profile_reset(void);
+size_t lock_profile_collect(struct lock_profile_sum **sums,
+			    uint64_t *dropped);
+
+#endif /* LOCK_PROFILE_H */
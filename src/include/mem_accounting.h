@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_accounting.h
+ * @brief Memory accounting per log component
+ *
+ * The allocation side is in abstract_mem.h.  Without USE_MEM_ACCOUNTING
+ * these are no-ops, so subsystems may set their limits unconditionally.
+ */
+
+#ifndef MEM_ACCOUNTING_H
+#define MEM_ACCOUNTING_H
+
+#include <stdint.h>
+#include "log.h"
+
+/**
+ * @brief Release memory of a component over its limit
+ *
+ * @param[in] excess	Bytes allocated over the limit
+ */
+typedef void (*gsh_mem_reclaim_t)(uint64_t excess);
+
+#ifdef USE_MEM_ACCOUNTING
+void gsh_mem_set_limit(log_components_t component, uint64_t limit,
+		       gsh_mem_reclaim_t reclaim);
+void gsh_mem_check(void);
+void gsh_mem_reset(void);
+#else
+static inline void gsh_mem_set_limit(log_components_t component,
+				     uint64_t limit, gsh_mem_reclaim_t reclaim)
+{
+}
+
+static inline void gsh_mem_check(void)
+{
+}
+
+static inline void gsh_mem_reset(void)
+{
+}
+#endif /* USE_MEM_ACCOUNTING */
+
+#endif /* MEM_ACCOUNTING_H */
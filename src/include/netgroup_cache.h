@@ -24,7 +24,16 @@
 
 #ifndef NETGROUP_CACHE_H
 #define NETGROUP_CACHE_H
+#include <stdbool.h>
+#include <time.h>
+
 void ng_cache_init(void);
 void ng_clear_cache(void);
 bool ng_innetgr(const char *group, const char *host);
+
+struct idmapper_snapshot;
+
+void ng_cache_save(struct idmapper_snapshot *snapshot);
+bool ng_cache_restore(const char *group, const char *host, bool negative,
+		      time_t epoch);
 #endif
@@ -41,6 +41,43 @@ typedef int fsal_acl_status_t;
 #define NFS_V4_ACL_INIT_ENTRY_FAILED 6
 #define NFS_V4_ACL_NOT_FOUND 7
 
+/* Number of access decisions memoized per thread, a power of 2 */
+#define FSAL_ACL_DECISIONS 64
+
+/* Callers with more alternate groups are not memoized */
+#define FSAL_ACL_DECISION_GROUPS 16
+
+/* Flags of a memoized access decision */
+#define FSAL_ACL_DECISION_VALID 0x0001 /*< Slot is in use */
+#define FSAL_ACL_DECISION_DIR 0x0002 /*< Object is a directory */
+#define FSAL_ACL_DECISION_ROOT 0x0004 /*< Caller is superuser */
+#define FSAL_ACL_DECISION_ALLOWED 0x0008 /*< Allowed mask was asked for */
+#define FSAL_ACL_DECISION_DENIED 0x0010 /*< Denied mask was asked for */
+
+/**
+ * @brief Result of evaluating an ACL for a caller
+ *
+ * The ACEs of an ACL entry never change, so the outcome of walking them
+ * only depends on the caller, the object owner and what was asked for.
+ */
+
+struct fsal_acl_decision {
+	/* Key */
+	uint64_t acl_id; /*< Id of the ACL entry */
+	uid_t caller_uid;
+	gid_t caller_gid;
+	uint32_t caller_glen;
+	gid_t caller_garray[FSAL_ACL_DECISION_GROUPS]; /*< Alternate groups */
+	uid_t owner; /*< Owner of the object */
+	gid_t group; /*< Group of the object */
+	fsal_aceperm_t v4mask; /*< Requested access */
+	uint32_t flags; /*< FSAL_ACL_DECISION_* */
+	/* Result */
+	fsal_errors_t major;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+};
+
 fsal_acl_t *nfs4_acl_alloc(void);
 fsal_ace_t *nfs4_ace_alloc(int nace);
 
@@ -54,6 +91,9 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *pacldata,
 
 void nfs4_acl_release_entry(fsal_acl_t *pacl);
 
+bool nfs4_acl_decision_get(struct fsal_acl_decision *decision);
+void nfs4_acl_decision_set(const struct fsal_acl_decision *decision);
+
 int nfs4_acls_init(void);
 
 #endif /* _NFS4_ACLS_H */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_fattr_cache.h
+ * @brief Memoization of encoded NFSv4 attributes
+ */
+
+#ifndef NFS4_FATTR_CACHE_H
+#define NFS4_FATTR_CACHE_H
+
+#include "nfs_proto_data.h"
+
+/**
+ * @brief What an encoding of attributes depends on besides the object
+ *
+ * The structure is compared as a whole, it must be zeroed before being
+ * filled in.
+ */
+struct fattr_cache_key {
+	uint32_t map[BITMAP4_MAPLEN]; /*< Requested attributes */
+	uint16_t export_id; /*< Export the object is accessed through */
+	uint8_t minorversion; /*< NFSv4 minor version */
+};
+
+/**
+ * @brief State of a lookup, to be passed on to fattr_cache_put()
+ */
+struct fattr_cache_ctx {
+	struct fattr_cache_key key; /*< Key of the encoding */
+	uint64_t generation; /*< Generation of the attributes, 0 if the
+				 encoding may not be memoized */
+};
+
+void fattr_cache_init(void);
+bool fattr_cache_get(compound_data_t *data, struct bitmap4 *Bitmap,
+		     attrmask_t mask, struct fattr_cache_ctx *ctx,
+		     fattr4 *Fattr);
+void fattr_cache_put(compound_data_t *data, struct fattr_cache_ctx *ctx,
+		     const fattr4 *Fattr);
+
+#endif /* NFS4_FATTR_CACHE_H */
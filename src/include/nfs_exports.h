@@ -75,6 +75,7 @@ extern struct global_export_perms export_opt;
 struct exportlist_client_entry {
 	struct base_client_entry client_entry;
 	struct export_perms client_perms; /*< Available mount options */
+	bool by_name; /*< Proto client, a client is a host name or netgroup */
 };
 
 /* Constants for export options masks */
@@ -39,17 +39,27 @@
 #define IP_NAME_SUCCESS 0
 #define IP_NAME_INSERT_MALLOC_ERROR 1
 #define IP_NAME_NOT_FOUND 2
+#define IP_NAME_PENDING 3
 
 #define IP_NAME_PREALLOC_SIZE 200
 
 /* NFS IPaddr cache entry structure */
 typedef struct nfs_ip_name__ {
 	time_t timestamp;
+	bool resolved; /*< false if hostname is the address itself */
 	char hostname[];
 } nfs_ip_name_t;
 
+/* What to do with a client whose address is still being resolved */
+enum ip_name_unresolved {
+	IP_NAME_UNRESOLVED_DENY, /*< Only match it by address */
+	IP_NAME_UNRESOLVED_WAIT, /*< Wait a bit for the resolution */
+	IP_NAME_UNRESOLVED_ADDRESS /*< Use the address as hostname */
+};
+
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size);
+int nfs_ip_name_lookup(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_remove(sockaddr_t *ipaddr);
 
 #endif
@@ -38,6 +38,7 @@
 #define NFS_PROTO_DATA_H
 
 #include "fsal_api.h"
+#include "req_recorder.h"
 #include "rquota.h"
 
 /*
@@ -205,6 +206,7 @@ typedef int (*nfs_protocol_function_t)(nfs_arg_t *, struct svc_req *,
 				       nfs_res_t *);
 
 typedef struct compound_data compound_data_t;
+struct compound_chunk;
 
 typedef enum nfs_req_result (*nfs4_function_t)(struct nfs_argop4 *,
 					       compound_data_t *,
@@ -232,6 +234,7 @@ typedef struct nfs_request {
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
 	void *proc_data;
+	struct req_record record; /*< Flight recorder timeline */
 	/** This request may be queued up pending completion of the request
 	 *  this is a dupreq of.
 	 */
@@ -366,7 +369,7 @@ struct compound_data {
 	uint32_t oppos; /*< Position of the operation within the
 				    request processed  */
 	const char *opname; /*< Name of the operation */
-	char *tagname;
+	const char *tagname;
 	void *op_data; /*< operation specific data for resume */
 	nfs41_session_t *session; /*< Related session
 					   (found by OP_SEQUENCE) */
@@ -376,6 +379,10 @@ struct compound_data {
 				   (if applicable) */
 	uint32_t resp_size; /*< Running total response size. */
 	uint32_t op_resp_size; /*< Current op's response size. */
+	struct compound_chunk *arena; /*< Chunk compound_alloc() carves
+					  from, this structure lives at
+					  the start of the oldest one */
+	size_t arena_used; /*< Bytes used in arena */
 };
 
 #define VARIABLE_RESP_SIZE (0)
@@ -593,9 +593,13 @@ void nfs4_op_write_Free(nfs_resop4 *);
 void nfs4_op_destroy_clientid_Free(nfs_resop4 *);
 void nfs4_op_reclaim_complete_Free(nfs_resop4 *);
 
+compound_data_t *compound_data_alloc(void);
 void compound_data_Free(compound_data_t *);
+void *compound_alloc(compound_data_t *data, size_t size);
+void compound_alloc_fh(compound_data_t *data, nfs_fh4 *fh);
 uint32_t get_nfs4_opcodes(compound_data_t *data, nfs_opnum4 *opcodes,
 			  uint32_t opcodes_array_len);
+enum nfs_req_result process_one_op(compound_data_t *data, nfsstat4 *status);
 bool xdr_COMPOUND4res_extended(XDR *xdrs, struct COMPOUND4res_extended **objp);
 
 /* Pseudo FS functions */
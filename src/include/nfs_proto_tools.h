@@ -297,6 +297,8 @@ int bitmap4_to_attrmask_t(bitmap4 *bitmap4, attrmask_t *mask);
 nfsstat4 file_To_Fattr(compound_data_t *data, attrmask_t mask,
 		       struct fsal_attrlist *attr, fattr4 *Fattr,
 		       struct bitmap4 *Bitmap);
+nfsstat4 file_To_Fattr_Access(compound_data_t *data, struct bitmap4 *Bitmap);
+bool nfs4_Fattr_Cacheable(struct bitmap4 *Bitmap);
 
 bool nfs4_Fattr_Check_Access(fattr4 *, int);
 bool nfs4_Fattr_Check_Access_Bitmap(struct bitmap4 *, int);
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_readdir_cache.h
+ * @brief Cache of encoded READDIR and READDIRPLUS replies
+ */
+
+#ifndef NFS_READDIR_CACHE_H
+#define NFS_READDIR_CACHE_H
+
+#include "gsh_rpc.h"
+#include "fsal.h"
+
+/**
+ * @brief Request parameters an encoded listing depends on
+ *
+ * The structure is hashed and compared as a whole, it must be zeroed
+ * before being filled in.
+ */
+struct readdir_cache_key {
+	uint64_t cookie; /*< Cookie the listing starts after */
+	uint32_t mem_avail; /*< Space available for the entries */
+	uint32_t max_count; /*< Maximum number of entries */
+	uint32_t attrs[BITMAP4_MAPLEN]; /*< Requested attributes (NFSv4) */
+	uint16_t export_id; /*< Export the directory is listed through */
+	uint8_t vers; /*< NFS version */
+	uint8_t minorversion; /*< NFSv4 minor version */
+};
+
+/**
+ * @brief State of a cache lookup, to be passed on to readdir_cache_put()
+ */
+struct readdir_cache_ctx {
+	struct readdir_cache_key key; /*< To be filled in by the caller */
+	struct gsh_buffdesc fh; /*< Handle key of the directory */
+	uint64_t hash; /*< Hash of key and fh */
+	uint64_t change; /*< Directory validator */
+	uint64_t epoch; /*< Directory validator */
+	bool cacheable; /*< A reply may be inserted */
+};
+
+struct readdir_reply;
+
+void readdir_cache_init(void);
+struct readdir_reply *readdir_cache_get(struct fsal_obj_handle *dir,
+					struct readdir_cache_ctx *ctx);
+struct readdir_reply *readdir_cache_put(struct readdir_cache_ctx *ctx,
+					uint8_t *body, u_int len);
+void readdir_reply_put(struct readdir_reply *reply);
+u_int readdir_reply_length(const struct readdir_reply *reply);
+struct xdr_uio *readdir_reply_uio(struct readdir_reply *reply, uint8_t *head,
+				  u_int head_len);
+
+#endif /* NFS_READDIR_CACHE_H */
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file req_recorder.h
+ * @brief Flight recorder of NFS requests
+ */
+
+#ifndef REQ_RECORDER_H
+#define REQ_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "gsh_types.h"
+
+/**
+ * @brief Operations of a compound kept in a record
+ */
+#define REQ_RECORD_OPS 16
+
+/**
+ * @brief Points in the processing of a request
+ */
+enum req_record_mark {
+	REQ_MARK_RECEIVED, /*< Request allocated by the transport */
+	REQ_MARK_PROCESS, /*< Picked up by nfs_rpc_process_request */
+	REQ_MARK_START, /*< Decoded and authenticated */
+	REQ_MARK_DUPREQ, /*< Looking up the duplicate request cache */
+	REQ_MARK_EXECUTE, /*< Not a duplicate, being executed */
+	REQ_MARK_DISPATCH, /*< Handed to the protocol handler */
+	REQ_MARK_SERVICE, /*< Back from the protocol handler */
+	REQ_MARK_REPLY, /*< Reply sent */
+	REQ_MARK_COUNT
+};
+
+/**
+ * @brief Phases of a request, measured between marks
+ *
+ * The FSAL and SAL phases are the parts of the execute phase spent in FSAL
+ * calls and in the state lock of objects.  They do not overlap, FSAL calls
+ * made with a state lock held are only FSAL time.
+ */
+enum req_phase {
+	REQ_PHASE_QUEUE, /*< Received to picked up */
+	REQ_PHASE_DECODE, /*< Authentication, decoding, client lookup */
+	REQ_PHASE_DUPREQ, /*< Duplicate request cache */
+	REQ_PHASE_EXECUTE, /*< Protocol handler */
+	REQ_PHASE_FSAL, /*< FSAL calls */
+	REQ_PHASE_SAL, /*< State locks outside of FSAL calls */
+	REQ_PHASE_REPLY, /*< Encoding and sending the reply */
+	REQ_PHASE_COUNT
+};
+
+/**
+ * @brief An NFSv4 operation of a recorded request
+ */
+struct req_record_op {
+	const char *name; /*< Name of the operation */
+	uint32_t status; /*< nfsstat4 of the operation */
+	int32_t export_id; /*< Export once done, -1 if none */
+	nsecs_elapsed_t duration; /*< Time spent in the operation */
+};
+
+/**
+ * @brief Timeline of a request being processed
+ *
+ * The request is zeroed when allocated, marks that are still 0 were not
+ * reached.  Marks and the FSAL and SAL times are in req_cycles() units.
+ */
+struct req_record {
+	struct timespec start; /*< Request decoded and authenticated */
+	uint64_t marks[REQ_MARK_COUNT]; /*< When each mark was reached */
+	uint64_t fsal_cycles; /*< Time spent in FSAL calls */
+	uint64_t sal_cycles; /*< Time spent in state locks */
+	uint64_t sal_start; /*< State lock taken at */
+	uint32_t sal_depth; /*< State locks held */
+	uint32_t fsal_depth; /*< FSAL calls in progress */
+	uint32_t fsal_calls; /*< Number of FSAL calls */
+	uint32_t main_op; /*< Operation the compound is accounted to */
+	uint32_t num_ops; /*< Operations, may exceed REQ_RECORD_OPS */
+	struct req_record_op ops[REQ_RECORD_OPS];
+};
+
+extern double req_ns_per_cycle;
+
+/**
+ * @brief Read the clock used to time the phases of requests
+ *
+ * This is the cycle counter where there is one, assumed to be invariant
+ * and synchronized across CPUs as it is on any recent x86 or ARM server,
+ * and CLOCK_MONOTONIC otherwise.  req_recorder_init() calibrates it.
+ */
+static inline uint64_t req_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t val;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(val));
+	return val;
+#else
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+#endif
+}
+
+static inline nsecs_elapsed_t req_cycles_to_ns(uint64_t cycles)
+{
+	return cycles * req_ns_per_cycle;
+}
+
+struct nfs_request;
+
+void req_recorder_init(void);
+void req_record_mark(struct nfs_request *reqdata, enum req_record_mark mark);
+void req_record_start(struct nfs_request *reqdata);
+void req_record_op(uint32_t opcode, const char *name,
+		   const struct timespec *start, int status);
+void req_record_done(struct nfs_request *reqdata, int rc);
+void req_recorder_reset(void);
+void req_recorder_phase_total(enum req_phase phase, uint64_t *count,
+			      uint64_t *sum);
+
+#endif /* REQ_RECORDER_H */
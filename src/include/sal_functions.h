@@ -43,6 +43,7 @@
 #include "sal_data.h"
 #include "fsal.h"
 #include "gsh_recovery.h"
+#include "req_recorder.h"
 
 /**
  * @brief Divisions in state and clientid tables.
@@ -81,6 +82,32 @@ void free_state_owner(state_owner_t *owner);
 		}                                                          \
 	} while (0)
 
+/**
+ * @brief Account the time a request spends in state locks
+ *
+ * The time is counted from the first lock being requested to the last one
+ * being released, so it covers both waiting for and holding them.  It is
+ * paused while FSAL calls run, see req_record_fsal_start() in MDCACHE, so
+ * that they are only accounted as FSAL time.
+ */
+static inline void req_record_sal_lock(void)
+{
+	struct req_record *record = op_ctx ? op_ctx->req_record : NULL;
+
+	if (record != NULL && record->sal_depth++ == 0 &&
+	    record->fsal_depth == 0)
+		record->sal_start = req_cycles();
+}
+
+static inline void req_record_sal_unlock(void)
+{
+	struct req_record *record = op_ctx ? op_ctx->req_record : NULL;
+
+	if (record != NULL && record->sal_depth != 0 &&
+	    --record->sal_depth == 0 && record->fsal_depth == 0)
+		record->sal_cycles += req_cycles() - record->sal_start;
+}
+
 /**
  * @brief Acquire exclusive st_lock and set no_cleanup=true
  *
@@ -89,6 +116,7 @@ void free_state_owner(state_owner_t *owner);
  */
 #define STATELOCK_lock(obj)                                     \
 	do {                                                    \
+		req_record_sal_lock();                          \
 		PTHREAD_MUTEX_lock(&(obj)->state_hdl->st_lock); \
 		(obj)->state_hdl->no_cleanup = true;            \
 	} while (0)
@@ -103,6 +131,7 @@ void free_state_owner(state_owner_t *owner);
 	do {                                                      \
 		(obj)->state_hdl->no_cleanup = false;             \
 		PTHREAD_MUTEX_unlock(&(obj)->state_hdl->st_lock); \
+		req_record_sal_unlock();                          \
 	} while (0)
 
 state_owner_t *get_state_owner(care_t care, state_owner_t *pkey,
@@ -1036,6 +1065,7 @@ struct nfs4_recovery_backend {
 
 void fs_backend_init(struct nfs4_recovery_backend **);
 void fs_ng_backend_init(struct nfs4_recovery_backend **);
+void fs_journal_backend_init(struct nfs4_recovery_backend **);
 int load_recovery_param_from_conf(config_file_t, struct config_error_type *);
 
 #endif /* SAL_FUNCTIONS_H */
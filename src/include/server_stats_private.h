@@ -424,8 +424,60 @@ struct auth_stats {
 
 #define LRU_UTILIZATION_REPLY                                         \
 	{                                                             \
-		.name = "lru_data_utilization", .type = "stsussstst", \
-		.direction = "out"                                    \
+		.name = "lru_data_utilization",                       \
+		.type = "stsussststssstststst", .direction = "out"    \
+	}
+
+#define MDCACHE_EXPORTS_REPLY                                       \
+	{                                                           \
+		.name = "export_cache_usage", .type = "a(qtuuttuut)", \
+		.direction = "out"                                  \
+	}
+
+/* xid, client, procedure, program, version, procedure number, export,
+ * result, start (sec, nsec), dispatch, service and reply times from the
+ * start, FSAL time, FSAL calls, number of operations and the operations
+ * (name, status, export, duration)
+ */
+#define REQ_RECORD_DBUS_TYPE "(ussuuuiittttttuua(suit))"
+
+#define SLOW_REQUESTS_REPLY                                        \
+	{ .name = "slow_total", .type = "t", .direction = "out" }, \
+	{                                                          \
+		.name = "slow_requests",                           \
+		.type = "a" REQ_RECORD_DBUS_TYPE,                  \
+		.direction = "out"                                 \
+	}
+
+#define RECENT_REQUESTS_REPLY                       \
+	{                                           \
+		.name = "recent_requests",          \
+		.type = "a" REQ_RECORD_DBUS_TYPE,   \
+		.direction = "out"                  \
+	}
+
+#define REQUEST_PHASES_REPLY                                              \
+	{ .name = "bucket_bounds", .type = "at", .direction = "out" },    \
+	{                                                                 \
+		.name = "phases", .type = "a(sssttat)", .direction = "out" \
+	}
+
+#define LOCK_PROFILE_DBUS_TYPE "(sssuttt)"
+
+#define LOCK_CONTENTION_REPLY                                             \
+	{ .name = "enabled", .type = "b", .direction = "out" },           \
+	{ .name = "dropped", .type = "t", .direction = "out" },           \
+	{                                                                 \
+		.name = "sites", .type = "a" LOCK_PROFILE_DBUS_TYPE,      \
+		.direction = "out"                                        \
+	}
+
+#define MEM_ACCOUNTING_DBUS_TYPE "(sxxxtt)"
+
+#define MEMORY_REPLY                                                        \
+	{                                                                   \
+		.name = "components", .type = "a" MEM_ACCOUNTING_DBUS_TYPE, \
+		.direction = "out"                                          \
 	}
 
 #define FD_USAGE_SUMM_REPLY                                             \
@@ -466,6 +518,14 @@ void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
 void mdcache_utilization(DBusMessageIter *iter);
+void mdcache_dbus_export_usage(DBusMessageIter *iter);
+void req_recorder_dbus_slow(DBusMessageIter *iter);
+void req_recorder_dbus_recent(DBusMessageIter *iter);
+void req_recorder_dbus_phases(DBusMessageIter *iter);
+void lock_profile_dbus_report(DBusMessageIter *iter);
+#ifdef USE_MEM_ACCOUNTING
+void gsh_mem_dbus_report(DBusMessageIter *iter);
+#endif
 #ifdef _USE_NFS3
 void server_dbus_v3_full_stats(DBusMessageIter *iter);
 #endif
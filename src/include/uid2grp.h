@@ -90,5 +90,11 @@ void uid2grp_hold_group_data(struct group_data *);
 void uid2grp_release_group_data(struct group_data *);
 bool uid2grp_is_group_data_expired(struct group_data *);
 
+struct idmapper_snapshot;
+
+void uid2grp_cache_save(struct idmapper_snapshot *);
+bool uid2grp_cache_restore(const struct gsh_buffdesc *, uid_t, gid_t,
+			   const gid_t *, int, time_t);
+
 #endif /* UID2GRP_H */
 /** @} */
@@ -180,6 +180,11 @@ void Exposer::stop() {
 	}
 }
 
+void Exposer::add_collect_hook(void (*hook)(void)) {
+	const std::lock_guard<std::mutex> lock(hooks_mutex_);
+	collect_hooks_.push_back(hook);
+}
+
 void *Exposer::server_thread(void *arg) {
 	Exposer *const exposer = (Exposer *)arg;
 	char buffer[1024];
@@ -194,6 +199,13 @@ void *Exposer::server_thread(void *arg) {
 		}
 		recv(client_fd, buffer, sizeof(buffer), 0);
 
+		{
+			const std::lock_guard<std::mutex> lock(
+				exposer->hooks_mutex_);
+			for (auto hook : exposer->collect_hooks_)
+				hook();
+		}
+
 		auto families = exposer->registry_.Collect();
 		for (auto &family : families) {
 			compact_family(family);
@@ -29,6 +29,7 @@
  * @brief Prometheus client that exposes HTTP interface for metrics scraping.
  */
 #include <thread>
+#include <vector>
 
 #include "prometheus/registry.h"
 
@@ -46,6 +47,10 @@ class Exposer {
 	void start(uint16_t port);
 	void stop(void);
 
+	// Registers a function called before every scrape, to update the
+	// metrics that are only aggregated on demand
+	void add_collect_hook(void (*hook)(void));
+
     private:
 	prometheus::Registry &registry_;
 	static constexpr int INVALID_FD = -1;
@@ -53,6 +58,8 @@ class Exposer {
 	bool running_ = false;
 	std::thread thread_id_;
 	std::mutex mutex_;
+	std::mutex hooks_mutex_;
+	std::vector<void (*)(void)> collect_hooks_;
 
 	// Delete copy/move constructor/assignment
 	Exposer(const Exposer &) = delete;
@@ -166,6 +166,11 @@ void monitoring_register_export_label(export_id_t export_id, const char *label);
 /* Inits monitoring module and exposes a Prometheus-format HTTP endpoint. */
 void monitoring__init(uint16_t port, bool enable_dynamic_metrics);
 
+/* Registers a function called before each scrape, for metrics that are
+ * aggregated by their module and only published on demand.
+ */
+void monitoring_register_collect_hook(void (*hook)(void));
+
 /*
  * The following two functions generate the following metrics,
  * exported both as total and per export.
@@ -197,6 +202,40 @@ void monitoring__dynamic_mdcache_cache_hit(const char *operation,
 void monitoring__dynamic_mdcache_cache_miss(const char *operation,
 					    export_id_t export_id);
 
+/* FSAL readahead of detected sequential streams. result is "hit" or "miss"
+ * for a read of a stream, or NULL when only counting issued bytes.
+ */
+void monitoring__dynamic_fsal_readahead(const char *result, uint64_t bytes,
+					export_id_t export_id);
+
+/* MDCache entry replacement: evictions from each LRU queue and ghost list
+ * hits.
+ */
+void monitoring__dynamic_mdcache_lru_event(const char *event);
+
+/* MDCache per export quotas. resource is "entries" or "chunks". */
+void monitoring__dynamic_mdcache_export_usage(export_id_t export_id,
+					      const char *resource,
+					      uint64_t value);
+void monitoring__dynamic_mdcache_export_reclaim(export_id_t export_id,
+						const char *resource);
+
+/* Time spent by requests in a phase of their processing, since the last
+ * call for the same phase. operation is the NFSv3 procedure or the main
+ * operation of an NFSv4 compound. buckets counts the requests under 1, 2, 4
+ * ... 2^22 us and above, sum is their total time.
+ */
+void monitoring__dynamic_request_phases(const char *version,
+					const char *operation,
+					const char *phase,
+					const uint64_t *buckets,
+					uint16_t num_buckets,
+					nsecs_elapsed_t sum);
+
+/* Memory allocated by a component, with USE_MEM_ACCOUNTING. */
+void monitoring__dynamic_memory_usage(const char *component, int64_t bytes,
+				      int64_t high_water);
+
 #else /* USE_MONITORING */
 
 /** The empty implementations below enable using monitoring functions
@@ -259,6 +298,7 @@ void monitoring__dynamic_mdcache_cache_miss(const char *operation,
 #define monitoring__buckets_exp2() ((histogram_buckets_t){ 0 })
 #define monitoring__buckets_exp2_compact() ((histogram_buckets_t){ 0 })
 #define monitoring__init(port) ({ UNUSED_EXPR(port); })
+#define monitoring_register_collect_hook(hook) ({ UNUSED_EXPR(hook); })
 #define monitoring_register_export_label(export_id, label) \
 	({                                                 \
 		UNUSED_EXPR(export_id);                    \
@@ -295,6 +335,41 @@ void monitoring__dynamic_mdcache_cache_miss(const char *operation,
 		UNUSED_EXPR(operation);                              \
 		UNUSED_EXPR(export_id);                              \
 	})
+#define monitoring__dynamic_fsal_readahead(result, bytes, export_id) \
+	({                                                            \
+		UNUSED_EXPR(result);                                  \
+		UNUSED_EXPR(bytes);                                   \
+		UNUSED_EXPR(export_id);                               \
+	})
+#define monitoring__dynamic_mdcache_lru_event(event) \
+	({ UNUSED_EXPR(event); })
+#define monitoring__dynamic_mdcache_export_usage(export_id, resource, value) \
+	({                                                                    \
+		UNUSED_EXPR(export_id);                                       \
+		UNUSED_EXPR(resource);                                        \
+		UNUSED_EXPR(value);                                           \
+	})
+#define monitoring__dynamic_mdcache_export_reclaim(export_id, resource) \
+	({                                                               \
+		UNUSED_EXPR(export_id);                                  \
+		UNUSED_EXPR(resource);                                   \
+	})
+#define monitoring__dynamic_request_phases(version, operation, phase, \
+					   buckets, num_buckets, sum) \
+	({                                                            \
+		UNUSED_EXPR(version);                                 \
+		UNUSED_EXPR(operation);                               \
+		UNUSED_EXPR(phase);                                   \
+		UNUSED_EXPR(buckets);                                 \
+		UNUSED_EXPR(num_buckets);                             \
+		UNUSED_EXPR(sum);                                     \
+	})
+#define monitoring__dynamic_memory_usage(component, bytes, high_water) \
+	({                                                              \
+		UNUSED_EXPR(component);                                 \
+		UNUSED_EXPR(bytes);                                     \
+		UNUSED_EXPR(high_water);                                \
+	})
 
 #endif /* USE_MONITORING */
 
@@ -41,8 +41,13 @@
  */
 
 static const char kClient[] = "client";
+static const char kComponent[] = "component";
+static const char kEvent[] = "event";
 static const char kExport[] = "export";
 static const char kOperation[] = "operation";
+static const char kPhase[] = "phase";
+static const char kResource[] = "resource";
+static const char kResult[] = "result";
 static const char kStatus[] = "status";
 static const char kVersion[] = "version";
 
@@ -68,6 +73,11 @@ static const HistogramDouble::BucketBoundaries latencyBuckets =
  12.9, 19.4, 29.1, 43.7, 65.6, 98.5, 147, 221, 332, 498, 748, 1122, 1683, 2525,
  3787, 5681, 8522, 12783};
 
+// 23 phase time buckets: 1 us to 4 seconds as powers of 2.
+static const HistogramDouble::BucketBoundaries phaseLatencyBuckets =
+{1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
+ 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304};
+
 class DynamicMetrics {
  public:
   DynamicMetrics(prometheus::Registry &registry);
@@ -77,6 +87,10 @@ class DynamicMetrics {
   CounterInt::Family &mdcacheCacheMissesTotal;
   CounterInt::Family &mdcacheCacheHitsByExportTotal;
   CounterInt::Family &mdcacheCacheMissesByExportTotal;
+  CounterInt::Family &readaheadReadsByExportTotal;
+  CounterInt::Family &readaheadBytesByExportTotal;
+  CounterInt::Family &mdcacheLruEventsTotal;
+  CounterInt::Family &mdcacheReclaimsByExportTotal;
   CounterInt::Family &rpcsReceivedTotal;
   CounterInt::Family &rpcsCompletedTotal;
   CounterInt::Family &errorsByVersionOperationStatus;
@@ -91,6 +105,9 @@ class DynamicMetrics {
   // Gauges
   GaugeInt::Family &rpcsInFlight;
   GaugeInt::Family &lastClientUpdate;
+  GaugeInt::Family &mdcacheUsageByExport;
+  GaugeInt::Family &memoryBytesByComponent;
+  GaugeInt::Family &memoryHighWaterByComponent;
 
   // Per {operation} NFS request metrics.
   CounterInt::Family &requestsTotalByOperation;
@@ -107,6 +124,9 @@ class DynamicMetrics {
   HistogramInt::Family &requestSizeByOperationExport;
   HistogramInt::Family &responseSizeByOperationExport;
   HistogramDouble::Family &latencyByOperationExport;
+
+  // Per {version, operation, phase} request phase metrics.
+  HistogramDouble::Family &phaseLatencyByOperation;
 };
 
 DynamicMetrics::DynamicMetrics(prometheus::Registry &registry) :
@@ -131,6 +151,26 @@ DynamicMetrics::DynamicMetrics(prometheus::Registry &registry) :
       .Name("mdcache_cache_misses_by_export_total")
       .Help("Counter for total cache misses in mdcache, by export.")
       .Register(registry)),
+  readaheadReadsByExportTotal(
+      prometheus::Builder<CounterInt>()
+      .Name("fsal_readahead_reads_by_export_total")
+      .Help("Reads of detected streams, by export and readahead result.")
+      .Register(registry)),
+  readaheadBytesByExportTotal(
+      prometheus::Builder<CounterInt>()
+      .Name("fsal_readahead_bytes_by_export_total")
+      .Help("Bytes of readahead issued by the FSAL, by export.")
+      .Register(registry)),
+  mdcacheLruEventsTotal(
+      prometheus::Builder<CounterInt>()
+      .Name("mdcache_lru_events_total")
+      .Help("MDCache entry evictions by queue, and ghost list hits.")
+      .Register(registry)),
+  mdcacheReclaimsByExportTotal(
+      prometheus::Builder<CounterInt>()
+      .Name("mdcache_reclaims_by_export_total")
+      .Help("MDCache entries and chunks reclaimed to enforce export quotas.")
+      .Register(registry)),
   rpcsReceivedTotal(
       prometheus::Builder<CounterInt>()
       .Name("rpcs_received_total")
@@ -175,6 +215,21 @@ DynamicMetrics::DynamicMetrics(prometheus::Registry &registry) :
       .Name("last_client_update")
       .Help("Last update timestamp, per client.")
       .Register(registry)),
+  mdcacheUsageByExport(
+      prometheus::Builder<GaugeInt>()
+      .Name("mdcache_usage_by_export")
+      .Help("MDCache entries and dirent chunks charged to each export.")
+      .Register(registry)),
+  memoryBytesByComponent(
+      prometheus::Builder<GaugeInt>()
+      .Name("memory_bytes")
+      .Help("Bytes allocated by each component.")
+      .Register(registry)),
+  memoryHighWaterByComponent(
+      prometheus::Builder<GaugeInt>()
+      .Name("memory_high_water_bytes")
+      .Help("Most bytes allocated by each component.")
+      .Register(registry)),
 
   // Per {operation} NFS request metrics.
   requestsTotalByOperation(
@@ -238,6 +293,11 @@ DynamicMetrics::DynamicMetrics(prometheus::Registry &registry) :
       prometheus::Builder<HistogramDouble>()
       .Name("nfs_latency_ms_by_export")
       .Help("Request latency by export in ms.")
+      .Register(registry)),
+  phaseLatencyByOperation(
+      prometheus::Builder<HistogramDouble>()
+      .Name("nfs_request_phase_latency_us")
+      .Help("Time spent by requests in each phase of their processing in us.")
       .Register(registry)) {
 }
 
@@ -428,6 +488,10 @@ void monitoring_register_export_label(const export_id_t export_id,
   exportLabels.InsertOrUpdate(export_id, std::string(label));
 }
 
+void monitoring_register_collect_hook(void (*hook)(void)) {
+  exposer.add_collect_hook(hook);
+}
+
 void monitoring__init(uint16_t port, bool enable_dynamic_metrics)
 {
   static bool initialized;
@@ -578,6 +642,75 @@ void monitoring__dynamic_mdcache_cache_miss(const char *operation,
   }
 }
 
+void monitoring__dynamic_fsal_readahead(const char *result, uint64_t bytes,
+                                        export_id_t export_id) {
+  if (!dynamic_metrics) return;
+  const std::string exportLabel = GetExportLabel(export_id);
+  if (result != NULL) {
+    dynamic_metrics->readaheadReadsByExportTotal
+        .Add({{kExport, exportLabel}, {kResult, result}})
+        .Increment();
+  }
+  if (bytes != 0) {
+    dynamic_metrics->readaheadBytesByExportTotal
+        .Add({{kExport, exportLabel}})
+        .Increment(bytes);
+  }
+}
+
+void monitoring__dynamic_mdcache_lru_event(const char *event) {
+  if (!dynamic_metrics) return;
+  dynamic_metrics->mdcacheLruEventsTotal
+      .Add({{kEvent, event}})
+      .Increment();
+}
+
+void monitoring__dynamic_mdcache_export_usage(export_id_t export_id,
+                                              const char *resource,
+                                              uint64_t value) {
+  if (!dynamic_metrics) return;
+  dynamic_metrics->mdcacheUsageByExport
+      .Add({{kExport, GetExportLabel(export_id)}, {kResource, resource}})
+      .Set(value);
+}
+
+void monitoring__dynamic_mdcache_export_reclaim(export_id_t export_id,
+                                                const char *resource) {
+  if (!dynamic_metrics) return;
+  dynamic_metrics->mdcacheReclaimsByExportTotal
+      .Add({{kExport, GetExportLabel(export_id)}, {kResource, resource}})
+      .Increment();
+}
+
+void monitoring__dynamic_request_phases(const char *version,
+                                        const char *operation,
+                                        const char *phase,
+                                        const uint64_t *buckets,
+                                        uint16_t num_buckets,
+                                        nsecs_elapsed_t sum) {
+  if (!dynamic_metrics) return;
+  if (num_buckets != phaseLatencyBuckets.size() + 1) return;
+  std::string operationLowerCase = std::string(operation);
+  toLowerCase(operationLowerCase);
+  dynamic_metrics->phaseLatencyByOperation
+      .Add({{kVersion, version},
+            {kOperation, operationLowerCase},
+            {kPhase, phase}}, phaseLatencyBuckets)
+      .ObserveMultiple(std::vector<double>(buckets, buckets + num_buckets),
+                       sum / (double)NS_PER_USEC);
+}
+
+void monitoring__dynamic_memory_usage(const char *component, int64_t bytes,
+                                      int64_t high_water) {
+  if (!dynamic_metrics) return;
+  dynamic_metrics->memoryBytesByComponent
+      .Add({{kComponent, component}})
+      .Set(bytes);
+  dynamic_metrics->memoryHighWaterByComponent
+      .Add({{kComponent, component}})
+      .Set(high_water);
+}
+
 }  // extern "C"
 
 }  // namespace ganesha_monitoring
@@ -240,6 +240,31 @@ class RetrieveExportStats():
         stats_op = self.exportmgrobj.get_dbus_method("GetExportDetails",
                                  self.dbus_exportstats_name)
         return ExportDetails(stats_op(export_id))
+    # slow request log
+    def slow_requests(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowSlowRequests",
+                                                     self.dbus_exportstats_name)
+        return RequestRecords(stats_op(), True)
+    # recent requests of each worker
+    def recent_requests(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowRecentRequests",
+                                                     self.dbus_exportstats_name)
+        return RequestRecords(stats_op(), False)
+    # request phase histograms
+    def request_phases(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowRequestPhases",
+                                                     self.dbus_exportstats_name)
+        return RequestPhases(stats_op())
+
+    def lock_contention(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowLockContention",
+                                                     self.dbus_exportstats_name)
+        return LockContention(stats_op())
+
+    def memory(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowMemory",
+                                                     self.dbus_exportstats_name)
+        return Memory(stats_op())
 
 
 class RetrieveClientStats():
@@ -875,6 +900,180 @@ class InodeStats(Report):
             output += "\n" + (self.stats[4][4]).ljust(25) + (self.stats[4][5]).ljust(30)
             output += "\n" + (self.stats[4][6]).ljust(25) + "%s" % (str(self.stats[4][7]).rjust(20))
             output += "\n" + (self.stats[4][8]).ljust(25) + "%s" % (str(self.stats[4][9]).rjust(20))
+            if len(self.stats[4]) > 10:
+                output += "\n" + (self.stats[4][10]).ljust(25) + (self.stats[4][11]).ljust(30)
+                for i in range(12, len(self.stats[4]), 2):
+                    output += "\n" + (self.stats[4][i]).ljust(25) + "%s" % (str(self.stats[4][i + 1]).rjust(20))
+            if len(self.stats) > 5 and len(self.stats[5]) > 0:
+                output += "\n\nExport Cache Usage"
+                output += "\n" + "Export".rjust(8) + "Entries".rjust(12) + "Soft".rjust(10) + "Hard".rjust(10)
+                output += "Reclaimed".rjust(12) + "Chunks".rjust(10) + "Soft".rjust(10) + "Hard".rjust(10)
+                output += "Reclaimed".rjust(12)
+                for export in self.stats[5]:
+                    output += "\n" + str(export[0]).rjust(8)
+                    output += str(export[1]).rjust(12) + str(export[2]).rjust(10) + str(export[3]).rjust(10)
+                    output += str(export[4]).rjust(12) + str(export[5]).rjust(10) + str(export[6]).rjust(10)
+                    output += str(export[7]).rjust(10) + str(export[8]).rjust(12)
+        return output
+
+
+class RequestRecords(Report):
+    def __init__(self, stats, slow):
+        super().__init__(stats)
+        self.stats = stats
+        self.slow = slow
+
+    def records(self):
+        return self.stats[4] if self.slow else self.stats[3]
+
+    def fill_report(self, report):
+        if self.slow:
+            report['slow_total'] = dbus_to_std(self.stats[3])
+        report['requests'] = []
+        for rec in self.records():
+            report['requests'].append({
+                'xid': int(rec[0]), 'client': str(rec[1]),
+                'procedure': str(rec[2]), 'program': int(rec[3]),
+                'version': int(rec[4]), 'proc': int(rec[5]),
+                'export_id': int(rec[6]), 'result': int(rec[7]),
+                'start': timestr((rec[8], rec[9])),
+                'dispatch_ns': int(rec[10]), 'service_ns': int(rec[11]),
+                'reply_ns': int(rec[12]), 'fsal_ns': int(rec[13]),
+                'fsal_calls': int(rec[14]), 'num_ops': int(rec[15]),
+                'ops': [{'op': str(op[0]), 'status': int(op[1]),
+                         'export_id': int(op[2]), 'duration_ns': int(op[3])}
+                        for op in rec[16]]})
+
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        if self.slow:
+            output += "\nSlow requests since last reset: " + str(self.stats[3]) + "\n"
+        output += "\n" + "Start".ljust(22) + "Client".ljust(20) + "Request".ljust(14) + "Xid".rjust(12)
+        output += "Export".rjust(8) + "Dispatch".rjust(12) + "Service".rjust(12) + "Reply".rjust(12)
+        output += "FSAL".rjust(12) + "Calls".rjust(7) + "   (times in usecs)"
+        for rec in self.records():
+            output += "\n" + timestr((rec[8], rec[9])).ljust(22) + str(rec[1]).ljust(20)
+            output += str(rec[2]).ljust(14) + str(rec[0]).rjust(12) + str(rec[6]).rjust(8)
+            output += str(rec[10] // 1000).rjust(12) + str(rec[11] // 1000).rjust(12)
+            output += str(rec[12] // 1000).rjust(12) + str(rec[13] // 1000).rjust(12)
+            output += str(rec[14]).rjust(7)
+            for op in rec[16]:
+                output += "\n" + "".ljust(42) + str(op[0]).ljust(20) + "status " + str(op[1]).ljust(6)
+                output += "export " + str(op[2]).ljust(6) + str(op[3] // 1000).rjust(12)
+            if rec[15] > len(rec[16]):
+                output += "\n" + "".ljust(42) + "... " + str(rec[15] - len(rec[16])) + " more operations"
+        return output
+
+
+class RequestPhases(Report):
+    def __init__(self, stats):
+        super().__init__(stats)
+        self.stats = stats
+
+    # Upper bound, in usecs, of the bucket holding the given percentile
+    def percentile(self, buckets, count, pct):
+        bounds = self.stats[3]
+        target = count * pct / 100.0
+        seen = 0
+        for i, val in enumerate(buckets):
+            seen += val
+            if seen >= target:
+                return int(bounds[i]) if i < len(bounds) else None
+        return None
+
+    def fill_report(self, report):
+        report['bucket_bounds_us'] = [int(b) for b in self.stats[3]]
+        report['phases'] = []
+        for phase in self.stats[4]:
+            report['phases'].append({
+                'version': str(phase[0]), 'operation': str(phase[1]),
+                'phase': str(phase[2]), 'count': int(phase[3]),
+                'sum_ns': int(phase[4]),
+                'buckets': [int(b) for b in phase[5]]})
+
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\n" + "Version".ljust(9) + "Operation".ljust(22) + "Phase".ljust(9)
+        output += "Count".rjust(12) + "Mean us".rjust(12) + "p50 us <".rjust(12) + "p99 us <".rjust(12)
+        for phase in self.stats[4]:
+            count = int(phase[3])
+            p50 = self.percentile(phase[5], count, 50)
+            p99 = self.percentile(phase[5], count, 99)
+            output += "\n" + str(phase[0]).ljust(9) + str(phase[1]).ljust(22) + str(phase[2]).ljust(9)
+            output += str(count).rjust(12) + ("%.1f" % (phase[4] / 1000.0 / count)).rjust(12)
+            output += (str(p50) if p50 is not None else "-").rjust(12)
+            output += (str(p99) if p99 is not None else "-").rjust(12)
+        return output
+
+
+class LockContention(Report):
+    def __init__(self, stats):
+        super().__init__(stats)
+        self.stats = stats
+
+    def fill_report(self, report):
+        report['enabled'] = bool(self.stats[3])
+        report['dropped'] = int(self.stats[4])
+        report['sites'] = []
+        for site in self.stats[5]:
+            report['sites'].append({
+                'lock': str(site[0]), 'kind': str(site[1]),
+                'file': str(site[2]), 'line': int(site[3]),
+                'contended': int(site[4]), 'wait_ns': int(site[5]),
+                'max_wait_ns': int(site[6])})
+
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\nLock profiling: " + ("enabled" if self.stats[3] else "disabled")
+        if self.stats[4]:
+            output += ", " + str(int(self.stats[4])) + " waits not accounted"
+        output += "\n\n" + "Wait ms".rjust(12) + "Contended".rjust(12) + "Mean us".rjust(10)
+        output += "Max us".rjust(10) + "  Kind ".ljust(8) + "Lock at site"
+        for site in self.stats[5]:
+            count = int(site[4])
+            output += "\n" + ("%.1f" % (site[5] / 1e6)).rjust(12) + str(count).rjust(12)
+            output += ("%.1f" % (site[5] / 1e3 / count)).rjust(10)
+            output += ("%.1f" % (site[6] / 1e3)).rjust(10)
+            output += "  " + str(site[1]).ljust(6) + str(site[0]) + " at "
+            output += str(site[2]) + ":" + str(site[3])
+        return output
+
+
+class Memory(Report):
+    def __init__(self, stats):
+        super().__init__(stats)
+        self.stats = stats
+
+    def fill_report(self, report):
+        report['components'] = []
+        for comp in self.stats[3]:
+            report['components'].append({
+                'component': str(comp[0]), 'bytes': int(comp[1]),
+                'blocks': int(comp[2]), 'high_water': int(comp[3]),
+                'limit': int(comp[4]), 'reclaims': int(comp[5])})
+
+    def __str__(self):
+        output = ""
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output += "\nTimestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs\n"
+        output += "\n" + "Component".ljust(22) + "KiB".rjust(12) + "Blocks".rjust(12)
+        output += "High KiB".rjust(12) + "Limit KiB".rjust(12) + "Reclaims".rjust(10)
+        for comp in sorted(self.stats[3], key=lambda c: -c[1]):
+            output += "\n" + str(comp[0]).ljust(22)
+            output += str(int(comp[1]) // 1024).rjust(12) + str(int(comp[2])).rjust(12)
+            output += str(int(comp[3]) // 1024).rjust(12)
+            output += (str(int(comp[4]) // 1024) if comp[4] else "-").rjust(12)
+            output += str(int(comp[5])).rjust(10)
         return output
 
 
@@ -50,6 +50,19 @@ To display stat counters use:
               client_io_ops <ip address> | export_details <export id> |
               client_all_ops <ip address>]
 
+To display the slow request log or the recent requests of each worker use:
+  {progname} [slow | recent]
+
+To display the time spent by requests in each phase of their processing use:
+  {progname} phases
+
+To display the most contended locks, once lock profiling is enabled, use:
+  {progname} locks
+
+To display the memory allocated by each component, when built with
+USE_MEM_ACCOUNTING, use:
+  {progname} memory
+
 To display stat counters in json format use:
   {progname} json <command>
 
@@ -58,7 +71,7 @@ To reset stat counters use:
 
 To enable/disable stat counters use:
   {progname} [enable | disable] [all | nfs | fsal | v3_full |
-                                 v4_full | auth | client_all_ops]
+                                 v4_full | auth | client_all_ops | lock]
 
 """
     )
@@ -90,7 +103,8 @@ commands = (
     'help', 'list_clients', 'deleg', 'global', 'inode', 'iov3', 'iov4',
     'iov41', 'iov42', 'iomon', 'export', 'total', 'fast', 'pnfs', 'fsal',
     'reset', 'enable', 'disable', 'status', 'v3_full', 'v4_full', 'auth',
-    'client_io_ops', 'export_details', 'client_all_ops', 'json'
+    'client_io_ops', 'export_details', 'client_all_ops', 'slow', 'recent',
+    'phases', 'locks', 'memory', 'json'
 )
 
 if command not in commands:
@@ -128,12 +142,12 @@ elif command in ('fsal'):
     command_arg = opts[0]
 elif command in ('enable', 'disable'):
     if not len(opts) == 1:
-        print("\nError: Option '%s' must be followed by all/nfs/fsal/v3_full/v4_full/auth/client_all_ops" %
+        print("\nError: Option '%s' must be followed by all/nfs/fsal/v3_full/v4_full/auth/client_all_ops/lock" %
             command)
         print_usage_exit(1)
     command_arg = opts[0]
-    if command_arg not in ('all', 'nfs', 'fsal', 'v3_full', 'v4_full', 'auth', 'client_all_ops'):
-        print("\nError: Option '%s' must be followed by all/nfs/fsal/v3_full/v4_full/auth/client_all_ops" %
+    if command_arg not in ('all', 'nfs', 'fsal', 'v3_full', 'v4_full', 'auth', 'client_all_ops', 'lock'):
+        print("\nError: Option '%s' must be followed by all/nfs/fsal/v3_full/v4_full/auth/client_all_ops/lock" %
             command)
         print_usage_exit(1)
 elif command == "help":
@@ -193,6 +207,16 @@ try:
         result = exp_interface.disable_stats(command_arg)
     elif command == "status":
         result = exp_interface.status_stats()
+    elif command == "slow":
+        result = exp_interface.slow_requests()
+    elif command == "recent":
+        result = exp_interface.recent_requests()
+    elif command == "phases":
+        result = exp_interface.request_phases()
+    elif command == "locks":
+        result = exp_interface.lock_contention()
+    elif command == "memory":
+        result = exp_interface.memory()
 
     print(result.json()) if output_json else print(result)
 except dbus.exceptions.DBusException:
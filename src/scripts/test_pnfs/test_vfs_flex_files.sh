@@ -0,0 +1,189 @@
+#!/bin/bash
+#
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# Runs a FSAL_VFS flex files MDS and two data servers as separate
+# ganesha.nfsd instances on localhost, all exporting the same directory,
+# then checks through a NFSv4.1 mount of the MDS that:
+#  - a file written and read back is unchanged, also in the backing dir,
+#  - the client got layouts and did its READs and WRITEs on the data
+#    servers rather than on the MDS,
+#  - a data server refuses I/O when the MDS and it don't share PNFS_Key.
+#
+# Must be run as root, with the pNFS flex files client module available.
+#
+# Usage: test_vfs_flex_files.sh <path to ganesha.nfsd> [work dir]
+
+GANESHA=$1
+WORK=${2:-$(mktemp -d /tmp/ganesha_ff.XXXXXX)}
+KEY="flex-files-test-key-0123456789"
+MDS_PORT=20490
+DS_PORTS="20491 20492"
+PIDS=""
+
+if [[ ! -x "$GANESHA" ]]; then
+	echo "Usage: $0 <path to ganesha.nfsd> [work dir]"
+	exit 1
+fi
+
+cleanup()
+{
+	umount -f "$WORK/mnt" 2>/dev/null
+	for pid in $PIDS; do
+		kill "$pid" 2>/dev/null
+	done
+	wait 2>/dev/null
+}
+
+trap cleanup EXIT
+
+fail()
+{
+	echo "FAIL: $*"
+	for log in "$WORK"/*/ganesha.log; do
+		echo "=== $log"
+		tail -20 "$log"
+	done
+	exit 1
+}
+
+# Core parameters letting several instances share the host
+core_params()
+{
+	cat <<EOF
+NFS_CORE_PARAM {
+	NFS_Port = $1;
+	Protocols = 4;
+	Enable_NLM = false;
+	Enable_RQUOTA = false;
+	Dbus_Name_Prefix = "$2";
+}
+
+NFSv4 {
+	Graceless = true;
+	RecoveryRoot = "$WORK/$2/recovery";
+}
+EOF
+}
+
+# start_instance <name> <port> <key> <export id> [PNFS block]
+start_instance()
+{
+	local dir="$WORK/$1"
+	local role="PNFS_DS = true;"
+
+	[[ -n "$5" ]] && role="PNFS_MDS = true;"
+
+	mkdir -p "$dir/recovery"
+
+	{
+		core_params "$2" "$1"
+		cat <<EOF
+
+VFS {
+	$role
+	PNFS_Key = "$3";
+}
+
+EXPORT {
+	Export_Id = $4;
+	Path = "$WORK/data";
+	Pseudo = "/data";
+	Access_Type = RW;
+	Squash = No_Root_Squash;
+	Protocols = 4;
+	SecType = sys;
+	FSAL {
+		Name = VFS;
+		$5
+	}
+}
+EOF
+	} > "$dir/ganesha.conf"
+
+	"$GANESHA" -F -f "$dir/ganesha.conf" -L "$dir/ganesha.log" \
+		-p "$dir/ganesha.pid" -N NIV_EVENT &
+	PIDS="$PIDS $!"
+}
+
+# mountstat <op> <field>: field 1 is the number of operations sent
+mountstat()
+{
+	awk -v mnt="$WORK/mnt" -v op="$1:" -v field="$2" '
+		$1 == "device" { mine = ($5 == mnt) }
+		mine && $1 == op { print $(field + 1); exit }
+	' /proc/self/mountstats
+}
+
+run()
+{
+	local ds_key=$1
+	local pnfs="PNFS {
+			Stripe_Unit = 65536;"
+	local id=101
+
+	mkdir -p "$WORK/data" "$WORK/mnt"
+
+	for port in $DS_PORTS; do
+		start_instance "ds$id" "$port" "$ds_key" "$id"
+		pnfs="$pnfs
+			Data_Server {
+				DS_Addr = 127.0.0.1;
+				DS_Port = $port;
+				DS_Id = $id;
+			}"
+		id=$((id + 1))
+	done
+
+	start_instance mds "$MDS_PORT" "$KEY" 1 "$pnfs
+		}"
+
+	sleep 5
+
+	mount -t nfs -o vers=4.1,port=$MDS_PORT,noac \
+		127.0.0.1:/data "$WORK/mnt" || fail "mount of the MDS"
+}
+
+stop()
+{
+	umount "$WORK/mnt" || fail "umount"
+	cleanup
+	PIDS=""
+}
+
+dd if=/dev/urandom of="$WORK/reference" bs=1M count=8 status=none
+
+echo "Flex files layouts over two data servers..."
+run "$KEY"
+
+dd if="$WORK/reference" of="$WORK/mnt/file" bs=1M oflag=direct \
+	status=none || fail "write through the MDS mount"
+dd if="$WORK/mnt/file" of="$WORK/readback" bs=1M iflag=direct \
+	status=none || fail "read through the MDS mount"
+
+cmp "$WORK/reference" "$WORK/readback" || fail "data read back differs"
+cmp "$WORK/reference" "$WORK/data/file" || fail "backing file differs"
+
+[[ $(mountstat LAYOUTGET 1) -gt 0 ]] || fail "no LAYOUTGET was sent"
+[[ $(mountstat WRITE 1) -eq 0 ]] || fail "WRITEs went to the MDS"
+[[ $(mountstat READ 1) -eq 0 ]] || fail "READs went to the MDS"
+
+rm -f "$WORK/mnt/file"
+stop
+
+echo "Data servers with another PNFS_Key refuse the layout stateids..."
+run "not-the-key-of-the-mds-0123456789"
+
+# The client falls back to the MDS when the data servers refuse it
+dd if="$WORK/reference" of="$WORK/mnt/file" bs=1M oflag=direct \
+	status=none || fail "write through the MDS mount"
+
+cmp "$WORK/reference" "$WORK/data/file" || fail "backing file differs"
+
+[[ $(mountstat WRITE 1) -gt 0 ]] || fail "data servers accepted WRITEs"
+
+rm -f "$WORK/mnt/file"
+stop
+
+rm -rf "$WORK"
+echo "PASS"
@@ -1574,17 +1574,12 @@ struct base_client_entry *client_match(enum log_components component,
 
 		case NETGROUP_CLIENT:
 			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr, hostname,
-						     sizeof(hostname));
-			}
+			rc = nfs_ip_name_lookup(hostaddr, hostname,
+						sizeof(hostname));
 
+			/* Not resolved yet, or fatal failure */
 			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
+				break;
 
 			/* At this point 'hostname' should contain the
 			 * name that was found
@@ -1608,19 +1603,13 @@ struct base_client_entry *client_match(enum log_components component,
 			}
 
 			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside op_context...
-				 */
-				rc = nfs_ip_name_add(hostaddr, hostname,
-						     sizeof(hostname));
-			}
+
+			/** @todo this change from 1.5 is not IPv6
+			 * useful.  come back to this and use the
+			 * string from client mgr inside op_context...
+			 */
+			rc = nfs_ip_name_lookup(hostaddr, hostname,
+						sizeof(hostname));
 
 			if (rc != IP_NAME_SUCCESS)
 				break;
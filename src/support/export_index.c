@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file export_index.c
+ * @brief Indexes of the exports by path, pseudo path and tag
+ *
+ * Paths are indexed in tries with a node per path component, so that
+ * finding the export of a path, or of its longest exported prefix, costs
+ * a hash lookup per component of the path rather than a comparison with
+ * every export.  The tag index is a single level of the same structure.
+ *
+ * The nodes of all the indexes are kept in one hash table, keyed by
+ * parent node and component.  Lookups walk the hash chains and the
+ * exports of a node under rcu_read_lock() and take no lock at all, while
+ * updates are serialized by the export manager lock.  Removed nodes and
+ * entries are freed after a grace period, and the export manager waits
+ * for one before releasing the sentinel reference of a removed export, so
+ * that a lookup may always take a reference on what it finds.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <assert.h>
+#include "log.h"
+#include "gsh_intrinsic.h"
+#include "abstract_mem.h"
+#include "gsh_refstr.h"
+#include "export_mgr.h"
+#include "export_index.h"
+#include "city.h"
+#include <urcu-bp.h>
+
+/**
+ * @brief Number of hash buckets for the nodes, should be a power of two
+ */
+
+#define EXPORT_INDEX_BUCKETS 16384
+
+/**
+ * @brief A path component, or a tag, in one of the indexes
+ */
+
+struct export_index_node {
+	struct export_index_node *next; /*< Next in hash chain, RCU protected */
+	struct export_index_node *parent; /*< NULL for the root of an index */
+	struct export_index_entry *entries; /*< Exports, RCU protected */
+	struct rcu_head rcu_head; /*< For freeing after a grace period */
+	uint64_t hash; /*< Hash of the parent and the component */
+	uint32_t children; /*< Number of nodes with this parent */
+	uint32_t len; /*< Length of the component */
+	char name[]; /*< The component, not NUL terminated */
+};
+
+/**
+ * @brief An export at a node, exports with the same key are kept in the
+ *	  order of the export list
+ */
+
+struct export_index_entry {
+	struct export_index_entry *next; /*< Next export, RCU protected */
+	struct export_index_node *node; /*< Node of the key */
+	struct gsh_export *export; /*< The export */
+	struct rcu_head rcu_head; /*< For freeing after a grace period */
+};
+
+/**
+ * @brief Iterator over the components of a key
+ */
+
+struct export_key_iter {
+	const char *next; /*< Next component, NULL when done */
+	const char *end; /*< End of the key */
+	bool split; /*< Whether to split at '/', i.e. a path */
+};
+
+static const char *const export_index_names[EXPORT_INDEX_COUNT] = {
+	[EXPORT_INDEX_PATH] = "path",
+	[EXPORT_INDEX_PSEUDO] = "pseudo path",
+	[EXPORT_INDEX_TAG] = "tag",
+};
+
+static struct export_index_node export_index_roots[EXPORT_INDEX_COUNT];
+static struct export_index_node *export_index_buckets[EXPORT_INDEX_BUCKETS];
+
+/**
+ * @brief Start iterating over the components of a key
+ *
+ * A path is split at each '/', ignoring a trailing one, so that "" and
+ * "/" are a single empty component and "/a/b" is "", "a" then "b".  An
+ * export is then the export of every path its components are a prefix
+ * of, as with the comparisons of paths the index replaces.  A tag is a
+ * single component.
+ */
+
+static void export_key_start(struct export_key_iter *iter,
+			     enum export_index_type type, const char *key)
+{
+	size_t len = strlen(key);
+
+	iter->split = type != EXPORT_INDEX_TAG;
+
+	if (iter->split && len > 1 && key[len - 1] == '/')
+		len--;
+
+	iter->next = key;
+	iter->end = key + len;
+}
+
+static bool export_key_next(struct export_key_iter *iter, const char **name,
+			    size_t *len)
+{
+	const char *slash = NULL;
+
+	if (iter->next == NULL)
+		return false;
+
+	*name = iter->next;
+
+	if (iter->split)
+		slash = memchr(iter->next, '/', iter->end - iter->next);
+
+	if (slash == NULL) {
+		*len = iter->end - iter->next;
+		iter->next = NULL;
+	} else {
+		*len = slash - iter->next;
+		/* Only "/" is left ending with a '/', it has no second
+		 * component.
+		 */
+		iter->next = slash + 1 == iter->end ? NULL : slash + 1;
+	}
+
+	return true;
+}
+
+static inline bool export_key_last(const struct export_key_iter *iter)
+{
+	return iter->next == NULL;
+}
+
+static inline uint64_t export_index_hash(const struct export_index_node *parent,
+					 const char *name, size_t len)
+{
+	return CityHash64WithSeed(name, len, (uintptr_t)parent);
+}
+
+static inline struct export_index_node **export_index_bucket(uint64_t hash)
+{
+	return &export_index_buckets[hash % EXPORT_INDEX_BUCKETS];
+}
+
+/**
+ * @brief Find the child of a node for a component
+ *
+ * @note The caller must be in an RCU read-side critical section or hold
+ * the export manager lock for write.
+ *
+ * @param[in] parent The node
+ * @param[in] hash   Hash of the node and the component
+ * @param[in] name   The component
+ * @param[in] len    Length of the component
+ *
+ * @return The child, or NULL.
+ */
+
+static struct export_index_node *
+export_index_child(const struct export_index_node *parent, uint64_t hash,
+		   const char *name, size_t len)
+{
+	struct export_index_node *node;
+
+	for (node = rcu_dereference(*export_index_bucket(hash)); node != NULL;
+	     node = rcu_dereference(node->next)) {
+		if (node->hash == hash && node->parent == parent &&
+		    node->len == len && memcmp(node->name, name, len) == 0)
+			return node;
+	}
+
+	return NULL;
+}
+
+static void export_index_node_free(struct rcu_head *head)
+{
+	gsh_free(container_of(head, struct export_index_node, rcu_head));
+}
+
+static void export_index_entry_free(struct rcu_head *head)
+{
+	gsh_free(container_of(head, struct export_index_entry, rcu_head));
+}
+
+/**
+ * @brief Index an export by one of its keys
+ *
+ * The key is taken from the export, an export without one, such as an
+ * export without a pseudo path, is not indexed.
+ *
+ * @note The caller must hold the export manager lock for write.
+ *
+ * @param[in] export The export
+ * @param[in] type   The index
+ */
+
+void export_index_add(struct gsh_export *export, enum export_index_type type)
+{
+	struct export_index_node *node = &export_index_roots[type];
+	struct export_index_node *child, **bucket;
+	struct export_index_entry *entry, **pprev;
+	struct export_key_iter iter;
+	struct gsh_refstr *ref_key = NULL;
+	const char *key, *name;
+	size_t len;
+	uint64_t hash;
+
+	assert(export->index_entries[type] == NULL);
+
+	switch (type) {
+	case EXPORT_INDEX_PATH:
+	case EXPORT_INDEX_PSEUDO:
+		rcu_read_lock();
+		ref_key = rcu_dereference(type == EXPORT_INDEX_PATH ?
+						  export->fullpath :
+						  export->pseudopath);
+		if (ref_key != NULL)
+			gsh_refstr_get(ref_key);
+		rcu_read_unlock();
+
+		if (ref_key == NULL)
+			return;
+
+		key = ref_key->gr_val;
+		break;
+
+	case EXPORT_INDEX_TAG:
+		if (export->FS_tag == NULL)
+			return;
+
+		key = export->FS_tag;
+		break;
+
+	default:
+		return;
+	}
+
+	export_key_start(&iter, type, key);
+
+	while (export_key_next(&iter, &name, &len)) {
+		hash = export_index_hash(node, name, len);
+		child = export_index_child(node, hash, name, len);
+
+		if (child == NULL) {
+			child = gsh_calloc(1, sizeof(*child) + len);
+			child->parent = node;
+			child->hash = hash;
+			child->len = len;
+			memcpy(child->name, name, len);
+
+			bucket = export_index_bucket(hash);
+			child->next = *bucket;
+			rcu_assign_pointer(*bucket, child);
+			node->children++;
+		}
+
+		node = child;
+	}
+
+	entry = gsh_calloc(1, sizeof(*entry));
+	entry->node = node;
+	entry->export = export;
+
+	for (pprev = &node->entries; *pprev != NULL &&
+				     (*pprev)->export->index_order <
+					     export->index_order;
+	     pprev = &(*pprev)->next)
+		;
+
+	entry->next = *pprev;
+	rcu_assign_pointer(*pprev, entry);
+	export->index_entries[type] = entry;
+
+	LogFullDebug(COMPONENT_EXPORT, "Indexed export %d by %s %s",
+		     export->export_id, export_index_names[type], key);
+
+	if (ref_key != NULL)
+		gsh_refstr_put(ref_key);
+}
+
+/**
+ * @brief Remove an export from one of the indexes
+ *
+ * Nodes left without exports or children are removed as well.  Does
+ * nothing if the export is not indexed.
+ *
+ * @note The caller must hold the export manager lock for write.
+ *
+ * @param[in] export The export
+ * @param[in] type   The index
+ */
+
+void export_index_remove(struct gsh_export *export,
+			 enum export_index_type type)
+{
+	struct export_index_entry *entry = export->index_entries[type];
+	struct export_index_node *node, *parent, **pnode;
+	struct export_index_entry **pprev;
+
+	if (entry == NULL)
+		return;
+
+	export->index_entries[type] = NULL;
+	node = entry->node;
+
+	for (pprev = &node->entries; *pprev != entry; pprev = &(*pprev)->next)
+		;
+
+	rcu_assign_pointer(*pprev, entry->next);
+	call_rcu(&entry->rcu_head, export_index_entry_free);
+
+	while (node->parent != NULL && node->entries == NULL &&
+	       node->children == 0) {
+		parent = node->parent;
+
+		for (pnode = export_index_bucket(node->hash); *pnode != node;
+		     pnode = &(*pnode)->next)
+			;
+
+		rcu_assign_pointer(*pnode, node->next);
+		call_rcu(&node->rcu_head, export_index_node_free);
+
+		parent->children--;
+		node = parent;
+	}
+}
+
+/**
+ * @brief Look up an export by path, pseudo path or tag
+ *
+ * @param[in] type        The index
+ * @param[in] key         The path or tag
+ * @param[in] exact_match Whether a path must match exactly, rather than
+ *			  find the export of its longest exported prefix
+ *
+ * @return The export with a reference, or NULL.
+ */
+
+struct gsh_export *export_index_lookup(enum export_index_type type,
+				       const char *key, bool exact_match)
+{
+	struct export_index_node *node = &export_index_roots[type];
+	struct export_index_entry *entry, *found = NULL;
+	struct gsh_export *export = NULL;
+	struct export_key_iter iter;
+	const char *name;
+	size_t len;
+
+	rcu_read_lock();
+
+	export_key_start(&iter, type, key);
+
+	while (export_key_next(&iter, &name, &len)) {
+		node = export_index_child(node, export_index_hash(node, name,
+								  len),
+					  name, len);
+		if (node == NULL)
+			break;
+
+		entry = rcu_dereference(node->entries);
+		if (entry != NULL && (!exact_match || export_key_last(&iter)))
+			found = entry;
+	}
+
+	if (found != NULL) {
+		export = found->export;
+		get_gsh_export_ref(export);
+	}
+
+	rcu_read_unlock();
+
+	return export;
+}
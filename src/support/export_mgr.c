@@ -57,6 +57,7 @@
 #include "gsh_dbus.h"
 #endif
 #include "export_mgr.h"
+#include "export_index.h"
 #include "client_mgr.h"
 #include "server_stats_private.h"
 #include "server_stats.h"
@@ -66,6 +67,9 @@
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
 #include "idmapper.h"
+#include "req_recorder.h"
+#include "lock_profile.h"
+#include "mem_accounting.h"
 
 /** Mutex to serialize export admin operations.
  */
@@ -93,6 +97,9 @@ struct export_by_id {
 
 static struct export_by_id export_by_id;
 
+/** Rank of the last export inserted, protected by eid_lock */
+static uint64_t export_index_order;
+
 /** List of all active exports,
   * protected by export_admin_mutex
   */
@@ -145,6 +152,32 @@ static inline uint16_t eid_cache_offsetof(uint16_t k)
 	return k % EXPORT_BY_ID_CACHE_SIZE;
 }
 
+/**
+ * @brief Add an export to the indexes by path, pseudo path and tag
+ *
+ * @note The caller must hold the export manager lock for write.
+ */
+static void index_gsh_export(struct gsh_export *export)
+{
+	int type;
+
+	for (type = 0; type < EXPORT_INDEX_COUNT; type++)
+		export_index_add(export, type);
+}
+
+/**
+ * @brief Remove an export from the indexes, if indexed
+ *
+ * @note The caller must hold the export manager lock for write.
+ */
+static void unindex_gsh_export(struct gsh_export *export)
+{
+	int type;
+
+	for (type = 0; type < EXPORT_INDEX_COUNT; type++)
+		export_index_remove(export, type);
+}
+
 /**
  * @brief Revert export_commit()
  *
@@ -165,9 +198,13 @@ void export_revert(struct gsh_export *export)
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
 	glist_del(&export->exp_work);
+	unindex_gsh_export(export);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
 
+	/* Let index lookups that found the export take their reference */
+	synchronize_rcu();
+
 	init_op_context_simple(&op_context, export, export->fsal_export);
 
 	if (export->has_pnfs_ds) {
@@ -265,11 +302,46 @@ bool insert_gsh_export(struct gsh_export *export)
 	/* update cache */
 	atomic_store_voidptr(cache_slot, &export->node_k);
 	glist_add_tail(&exportlist, &export->exp_list);
+	export->index_order = ++export_index_order;
+	index_gsh_export(export);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
 	return true;
 }
 
+/**
+ * @brief Index an export again after its paths changed
+ *
+ * Called when an update replaced the paths of an inserted export, with
+ * the export_admin_mutex held.  The export keeps its rank among the
+ * exports sharing its paths.
+ *
+ * @param export [IN] the export
+ * @param fullpath [IN] whether the path changed
+ * @param pseudopath [IN] whether the pseudo path changed
+ */
+
+void reindex_gsh_export_paths(struct gsh_export *export, bool fullpath,
+			      bool pseudopath)
+{
+	if (!fullpath && !pseudopath)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&export_by_id.eid_lock);
+
+	if (fullpath) {
+		export_index_remove(export, EXPORT_INDEX_PATH);
+		export_index_add(export, EXPORT_INDEX_PATH);
+	}
+
+	if (pseudopath) {
+		export_index_remove(export, EXPORT_INDEX_PSEUDO);
+		export_index_add(export, EXPORT_INDEX_PSEUDO);
+	}
+
+	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
+}
+
 /**
  * @brief Lookup the export manager struct for this export id
  *
@@ -332,9 +404,9 @@ out:
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
+ * Gets the export of a path, or of its longest exported prefix, from the
+ * index by path.  Kept for callers holding the export manager lock (such
+ * as from within foreach_gsh_export), the index needs no lock.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -345,86 +417,12 @@ out:
 
 struct gsh_export *get_gsh_export_by_path_locked(char *path, bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct gsh_export *ret_exp;
 
 	LogFullDebug(COMPONENT_EXPORT, "Searching for export matching path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist)
-	{
-		struct gsh_refstr *ref_fullpath;
-
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		rcu_read_lock();
-
-		ref_fullpath =
-			gsh_refstr_get(rcu_dereference(export->fullpath));
-
-		rcu_read_unlock();
-
-		if (ref_fullpath == NULL) {
-			LogFatal(COMPONENT_EXPORT, "Export %d has no fullpath",
-				 export->export_id);
-		}
-
-		len_export = strlen(ref_fullpath->gr_val);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			gsh_refstr_put(ref_fullpath);
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export || len_export < len_ret) {
-			gsh_refstr_put(ref_fullpath);
-			continue;
-		}
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export) {
-			gsh_refstr_put(ref_fullpath);
-			continue;
-		}
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 && path[len_export] != '/' &&
-		    path[len_export] != '\0') {
-			gsh_refstr_put(ref_fullpath);
-			continue;
-		}
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(ref_fullpath->gr_val, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path) {
-				gsh_refstr_put(ref_fullpath);
-				break;
-			}
-		}
-	}
-
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	ret_exp = export_index_lookup(EXPORT_INDEX_PATH, path, exact_match);
 
 	LOG_EXPORT(NIV_DEBUG, "Found", ret_exp, false);
 
@@ -434,8 +432,8 @@ struct gsh_export *get_gsh_export_by_path_locked(char *path, bool exact_match)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list.
+ * Gets the export of a path, or of its longest exported prefix, from the
+ * index by path.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -446,23 +444,15 @@ struct gsh_export *get_gsh_export_by_path_locked(char *path, bool exact_match)
 
 struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 {
-	struct gsh_export *exp;
-
-	PTHREAD_RWLOCK_rdlock(&export_by_id.eid_lock);
-
-	exp = get_gsh_export_by_path_locked(path, exact_match);
-
-	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
-
-	return exp;
+	return get_gsh_export_by_path_locked(path, exact_match);
 }
 
 /**
  * @brief Lookup the export manager struct by export pseudo path
  *
- * Gets an export entry from its pseudo (if it exists), assumes
- * being called with export manager lock held (such as from within
- * foreach_gsh_export.
+ * Gets an export entry from its pseudo (if it exists) from the index by
+ * pseudo path.  Kept for callers holding the export manager lock (such
+ * as from within foreach_gsh_export), the index needs no lock.
  *
  * @param path        [IN] the path for the entry to be found.
  * @param exact_match [IN] the path must match exactly
@@ -472,96 +462,12 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path, bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct gsh_export *ret_exp;
 
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching pseudo path %s", path);
 
-	glist_for_each(glist, &exportlist)
-	{
-		struct gsh_refstr *ref_pseudopath;
-
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		rcu_read_lock();
-
-		ref_pseudopath =
-			gsh_refstr_get(rcu_dereference(export->pseudopath));
-
-		rcu_read_unlock();
-
-		if (ref_pseudopath == NULL) {
-			LogFatal(COMPONENT_EXPORT,
-				 "Export %d has no pseudopath",
-				 export->export_id);
-		}
-
-		len_export = strlen(ref_pseudopath->gr_val);
-
-		LogFullDebug(COMPONENT_EXPORT, "Comparing %s %d to %s %d", path,
-			     len_path, ref_pseudopath->gr_val, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			gsh_refstr_put(ref_pseudopath);
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export || len_export < len_ret) {
-			gsh_refstr_put(ref_pseudopath);
-			continue;
-		}
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export) {
-			gsh_refstr_put(ref_pseudopath);
-			continue;
-		}
-
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 && path[len_export] != '/' &&
-		    path[len_export] != '\0') {
-			gsh_refstr_put(ref_pseudopath);
-			continue;
-		}
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(ref_pseudopath->gr_val, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path) {
-				gsh_refstr_put(ref_pseudopath);
-				break;
-			}
-		}
-
-		gsh_refstr_put(ref_pseudopath);
-	}
-
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	ret_exp = export_index_lookup(EXPORT_INDEX_PSEUDO, path, exact_match);
 
 	LOG_EXPORT(NIV_DEBUG, "Found", ret_exp, false);
 
@@ -581,23 +487,15 @@ struct gsh_export *get_gsh_export_by_pseudo_locked(char *path, bool exact_match)
 
 struct gsh_export *get_gsh_export_by_pseudo(char *path, bool exact_match)
 {
-	struct gsh_export *exp;
-
-	PTHREAD_RWLOCK_rdlock(&export_by_id.eid_lock);
-
-	exp = get_gsh_export_by_pseudo_locked(path, exact_match);
-
-	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
-
-	return exp;
+	return get_gsh_export_by_pseudo_locked(path, exact_match);
 }
 
 /**
  * @brief Lookup the export manager struct by export tag
  *
- * Gets an export entry from its pseudo (if it exists)
+ * Gets an export entry from its tag (if it exists)
  *
- * @param path       [IN] the path for the entry to be found.
+ * @param tag        [IN] the tag for the entry to be found.
  *
  * @return pointer to ref locked export
  */
@@ -605,28 +503,8 @@ struct gsh_export *get_gsh_export_by_pseudo(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_tag(char *tag)
 {
 	struct gsh_export *export;
-	struct glist_head *glist;
 
-	PTHREAD_RWLOCK_rdlock(&export_by_id.eid_lock);
-
-	glist_for_each(glist, &exportlist)
-	{
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->FS_tag != NULL && !strcmp(export->FS_tag, tag))
-			goto out;
-	}
-
-	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
-
-	LOG_EXPORT(NIV_DEBUG, "Found", NULL, false);
-
-	return NULL;
-
-out:
-	get_gsh_export_ref(export);
-
-	PTHREAD_RWLOCK_unlock(&export_by_id.eid_lock);
+	export = export_index_lookup(EXPORT_INDEX_TAG, tag, true);
 
 	LOG_EXPORT(NIV_DEBUG, "Found", export, false);
 
@@ -762,8 +640,9 @@ void remove_gsh_export(uint16_t export_id)
 
 		export = avltree_container_of(node, struct gsh_export, node_k);
 
-		/* Remove the export from the export list */
+		/* Remove the export from the export list and indexes */
 		glist_del(&export->exp_list);
+		unindex_gsh_export(export);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
@@ -773,6 +652,11 @@ void remove_gsh_export(uint16_t export_id)
 
 	/* removal has a once-only semantic */
 	if (export != NULL) {
+		/* Let index lookups that found the export take their
+		 * reference before the sentinel one goes.
+		 */
+		synchronize_rcu();
+
 		if (export->has_pnfs_ds) {
 			/* once-only, so no need for lock here */
 			export->has_pnfs_ds = false;
@@ -884,11 +768,16 @@ void remove_all_exports(void)
 	EXPORT_ADMIN_UNLOCK();
 }
 
+struct prune_defunct_state {
+	uint64_t generation;
+	int count;
+};
+
 static bool prune_defunct_export(struct gsh_export *exp, void *state)
 {
-	uint64_t generation = *((uint64_t *)state);
+	struct prune_defunct_state *prune = state;
 
-	if (exp->config_gen < generation) {
+	if (exp->config_gen < prune->generation) {
 		if (isDebug(COMPONENT_EXPORT)) {
 			struct tmp_export_paths tmp;
 
@@ -903,13 +792,23 @@ static bool prune_defunct_export(struct gsh_export *exp, void *state)
 		}
 
 		export_add_to_unexport_work(exp);
+		prune->count++;
 	}
 	return true;
 }
 
-void prune_defunct_exports(uint64_t generation)
+/**
+ * @brief Unexport all exports not touched by the given config generation
+ *
+ * @param[in] generation Generation of the config that was just loaded
+ *
+ * @return The number of exports pruned.
+ */
+
+int prune_defunct_exports(uint64_t generation)
 {
 	struct req_op_context op_context;
+	struct prune_defunct_state prune = { .generation = generation };
 
 	/*
 	 * Initialize op_context, we use NFSv4 types here to make paths show
@@ -917,11 +816,13 @@ void prune_defunct_exports(uint64_t generation)
 	 */
 	init_op_context(&op_context, NULL, NULL, NULL, NFS_V4, 0, NFS_RELATED);
 
-	(void)foreach_gsh_export(prune_defunct_export, true, &generation);
+	(void)foreach_gsh_export(prune_defunct_export, true, &prune);
 
 	/* now run the work */
 	process_unexports();
 	release_op_context();
+
+	return prune.count;
 }
 
 /**
@@ -2180,6 +2081,7 @@ static bool show_mdcache_stats(DBusMessageIter *args, DBusMessage *reply,
 
 	mdcache_dbus_show(&iter);
 	mdcache_utilization(&iter);
+	mdcache_dbus_export_usage(&iter);
 
 	return true;
 }
@@ -2202,6 +2104,103 @@ static bool show_fd_usage_summary(DBusMessageIter *args, DBusMessage *reply,
 	return true;
 }
 
+static bool show_slow_requests(DBusMessageIter *args, DBusMessage *reply,
+			       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	gsh_dbus_status_reply(&iter, success, errormsg);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+
+	req_recorder_dbus_slow(&iter);
+
+	return true;
+}
+
+static bool show_recent_requests(DBusMessageIter *args, DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	gsh_dbus_status_reply(&iter, success, errormsg);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+
+	req_recorder_dbus_recent(&iter);
+
+	return true;
+}
+
+static bool show_request_phases(DBusMessageIter *args, DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	gsh_dbus_status_reply(&iter, success, errormsg);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+
+	req_recorder_dbus_phases(&iter);
+
+	return true;
+}
+
+static bool show_lock_contention(DBusMessageIter *args, DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	gsh_dbus_status_reply(&iter, success, errormsg);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+
+	lock_profile_dbus_report(&iter);
+
+	return true;
+}
+
+static bool show_memory(DBusMessageIter *args, DBusMessage *reply,
+			DBusError *error)
+{
+#ifdef USE_MEM_ACCOUNTING
+	bool success = true;
+	char *errormsg = "OK";
+#else
+	bool success = false;
+	char *errormsg = "Memory accounting is not built in";
+#endif
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	gsh_dbus_status_reply(&iter, success, errormsg);
+	gsh_dbus_append_timestamp(&iter, &timestamp);
+
+#ifdef USE_MEM_ACCOUNTING
+	gsh_mem_dbus_report(&iter);
+#endif
+
+	return true;
+}
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -2254,6 +2253,9 @@ static bool stats_reset(DBusMessageIter *args, DBusMessage *reply,
 	reset_fsal_stats();
 	reset_server_stats();
 	reset_auth_stats();
+	req_recorder_reset();
+	lock_profile_reset();
+	gsh_mem_reset();
 
 	/* update the stats counting time */
 	nfs_init_stats_time();
@@ -2453,6 +2455,9 @@ static bool stats_disable(DBusMessageIter *args, DBusMessage *reply,
 			 "Disabling auth statistics counting");
 		/* reset auth counters */
 		reset_auth_stats();
+		nfs_param.core_param.enable_lock_profiling = false;
+		(void)lock_profile_enable(false);
+		lock_profile_reset();
 	}
 	if (strcmp(stat_type, "nfs") == 0) {
 		nfs_param.core_param.enable_NFSSTATS = false;
@@ -2503,6 +2508,12 @@ static bool stats_disable(DBusMessageIter *args, DBusMessage *reply,
 		/* reset client all ops counters */
 		reset_clnt_allops_stats();
 	}
+	if (strcmp(stat_type, "lock") == 0) {
+		nfs_param.core_param.enable_lock_profiling = false;
+		(void)lock_profile_enable(false);
+		/* reset lock contention counters */
+		lock_profile_reset();
+	}
 
 	gsh_dbus_status_reply(&iter, true, errormsg);
 	now(&timestamp);
@@ -2641,6 +2652,15 @@ static bool stats_enable(DBusMessageIter *args, DBusMessage *reply,
 		LogEvent(COMPONENT_CONFIG, "Enabling auth statistics counting");
 		now(&auth_stats_time);
 	}
+	/* Lock profiling costs a try-lock per lock, "all" leaves it alone */
+	if (strcmp(stat_type, "lock") == 0 &&
+	    !nfs_param.core_param.enable_lock_profiling) {
+		if (!lock_profile_enable(true)) {
+			errormsg = "Lock profiling is not available";
+			goto error;
+		}
+		nfs_param.core_param.enable_lock_profiling = true;
+	}
 
 	gsh_dbus_status_reply(&iter, true, errormsg);
 	now(&timestamp);
@@ -2832,7 +2852,7 @@ static struct gsh_dbus_method mdcache_show = {
 	.name = "ShowMDCache",
 	.method = show_mdcache_stats,
 	.args = { STATUS_REPLY, TIMESTAMP_REPLY, TOTAL_OPS_REPLY,
-		  LRU_UTILIZATION_REPLY, END_ARG_LIST }
+		  LRU_UTILIZATION_REPLY, MDCACHE_EXPORTS_REPLY, END_ARG_LIST }
 };
 
 static struct gsh_dbus_method fd_usage_summary = {
@@ -2842,6 +2862,40 @@ static struct gsh_dbus_method fd_usage_summary = {
 		  END_ARG_LIST }
 };
 
+static struct gsh_dbus_method slow_requests = {
+	.name = "ShowSlowRequests",
+	.method = show_slow_requests,
+	.args = { STATUS_REPLY, TIMESTAMP_REPLY, SLOW_REQUESTS_REPLY,
+		  END_ARG_LIST }
+};
+
+static struct gsh_dbus_method recent_requests = {
+	.name = "ShowRecentRequests",
+	.method = show_recent_requests,
+	.args = { STATUS_REPLY, TIMESTAMP_REPLY, RECENT_REQUESTS_REPLY,
+		  END_ARG_LIST }
+};
+
+static struct gsh_dbus_method request_phases = {
+	.name = "ShowRequestPhases",
+	.method = show_request_phases,
+	.args = { STATUS_REPLY, TIMESTAMP_REPLY, REQUEST_PHASES_REPLY,
+		  END_ARG_LIST }
+};
+
+static struct gsh_dbus_method lock_contention = {
+	.name = "ShowLockContention",
+	.method = show_lock_contention,
+	.args = { STATUS_REPLY, TIMESTAMP_REPLY, LOCK_CONTENTION_REPLY,
+		  END_ARG_LIST }
+};
+
+static struct gsh_dbus_method memory = {
+	.name = "ShowMemory",
+	.method = show_memory,
+	.args = { STATUS_REPLY, TIMESTAMP_REPLY, MEMORY_REPLY, END_ARG_LIST }
+};
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -2926,6 +2980,11 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #endif /* _HAVE_GSSAPI */
 	&export_details,
 	&fd_usage_summary,
+	&slow_requests,
+	&recent_requests,
+	&request_phases,
+	&lock_contention,
+	&memory,
 	NULL
 };
 
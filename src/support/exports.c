@@ -494,6 +494,9 @@ static int client_commit(void *node, void *link_mem, void *self_struct,
 		}
 
 		glist_splice_tail(&export->clients, &cli->cle_list);
+
+		if (expcli->by_name)
+			export->clients_by_name = true;
 	}
 	if (errcnt == 0)
 		client_init(link_mem, self_struct);
@@ -820,14 +823,38 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint64_t(&export->PrefReaddir, src->PrefReaddir);
 	atomic_store_uint64_t(&export->MaxOffsetWrite, src->MaxOffsetWrite);
 	atomic_store_uint64_t(&export->MaxOffsetRead, src->MaxOffsetRead);
+	atomic_store_uint32_t(&export->cache_entries_soft,
+			      src->cache_entries_soft);
+	atomic_store_uint32_t(&export->cache_entries_hard,
+			      src->cache_entries_hard);
+	atomic_store_uint32_t(&export->cache_chunks_soft,
+			      src->cache_chunks_soft);
+	atomic_store_uint32_t(&export->cache_chunks_hard,
+			      src->cache_chunks_hard);
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 }
 
+/**
+ * @brief Whether a path of an export is still the configured one
+ *
+ * @param old [IN] the path the export had, may be NULL
+ * @param path [IN] the configured path, may be NULL
+ */
+
+static inline bool export_path_equal(struct gsh_refstr *old, const char *path)
+{
+	if (old == NULL || path == NULL)
+		return old == NULL && path == NULL;
+
+	return strcmp(old->gr_val, path) == 0;
+}
+
 static inline void copy_gsh_export(struct gsh_export *dest,
 				   struct gsh_export *src)
 {
 	struct gsh_refstr *old_fullpath = NULL, *old_pseudopath = NULL;
+	bool fullpath_changed, pseudopath_changed;
 
 	/* Update atomic fields */
 	update_atomic_fields(dest, src);
@@ -866,14 +893,6 @@ static inline void copy_gsh_export(struct gsh_export *dest,
 		rcu_set_pointer(&(dest->pseudopath), NULL);
 	}
 
-	synchronize_rcu();
-
-	if (old_fullpath)
-		gsh_refstr_put(old_fullpath);
-
-	if (old_pseudopath)
-		gsh_refstr_put(old_pseudopath);
-
 	/* Copy the export perms into the existing export. */
 	dest->export_perms = src->export_perms;
 
@@ -887,8 +906,27 @@ static inline void copy_gsh_export(struct gsh_export *dest,
 		     src->clients.prev);
 
 	glist_swap_lists(&dest->clients, &src->clients);
+	dest->clients_by_name = src->clients_by_name;
+
+	fullpath_changed = !export_path_equal(old_fullpath, dest->cfg_fullpath);
+	pseudopath_changed = !export_path_equal(old_pseudopath,
+						dest->cfg_pseudopath);
 
 	PTHREAD_RWLOCK_unlock(&dest->exp_lock);
+
+	reindex_gsh_export_paths(dest, fullpath_changed, pseudopath_changed);
+
+	/* Wait for RCU readers of the old paths outside of exp_lock so that
+	 * requests checking export permissions are not held up for a whole
+	 * grace period.
+	 */
+	synchronize_rcu();
+
+	if (old_fullpath)
+		gsh_refstr_put(old_fullpath);
+
+	if (old_pseudopath)
+		gsh_refstr_put(old_pseudopath);
 }
 
 uint32_t export_check_options(struct gsh_export *exp)
@@ -968,6 +1006,33 @@ enum export_commit_type {
 	update_export,
 };
 
+/**
+ * @brief Digest of the EXPORT_DEFAULTS blocks of the current config
+ *
+ * Folded into the digest of every EXPORT block so that a change of
+ * defaults makes every export look changed to reread_exports().
+ */
+static uint64_t export_defaults_digest;
+
+/**
+ * @brief Digest of the EXPORT block of an export
+ *
+ * Host names are resolved, and netgroups looked up, when the block is
+ * processed, so an export with such clients gets no digest and its block
+ * is processed again on every update to pick up DNS or netgroup changes.
+ *
+ * @param node [IN] the EXPORT block
+ * @param export [IN] the export parsed from it
+ */
+
+static uint64_t export_config_digest(void *node, struct gsh_export *export)
+{
+	if (export->clients_by_name)
+		return 0;
+
+	return config_node_digest(node, export_defaults_digest);
+}
+
 static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				struct config_error_type *err_type,
 				enum export_commit_type commit_type)
@@ -1229,8 +1294,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			probe_exp->update_prune_unmount = true;
 		}
 
-		/* Grab config_generation for this config */
+		/* Grab config_generation and digest for this config */
 		probe_exp->config_gen = get_parse_root_generation(node);
+		probe_exp->config_digest = export_config_digest(node, export);
 
 		copy_gsh_export(probe_exp, export);
 
@@ -1385,8 +1451,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 	LogMidDebug_ExportClients(export);
 
-	/* Copy the generation */
+	/* Copy the generation and digest */
 	export->config_gen = get_parse_root_generation(node);
+	export->config_digest = export_config_digest(node, export);
 
 success:
 
@@ -1900,6 +1967,9 @@ static int client_adder(const char *token, enum term_type type_hint,
 
 	LogMidDebug(COMPONENT_EXPORT, "Adding client %s", token);
 
+	if (type_hint == TERM_TOKEN || type_hint == TERM_NETGROUP)
+		proto_cli->by_name = true;
+
 	rc = add_client(COMPONENT_EXPORT, &client->cle_list, token, type_hint,
 			cnode, err_type, export_client_allocator,
 			export_client_filler, &proto_cli->client_perms);
@@ -1996,6 +2066,14 @@ static struct config_item fsal_params[] = {
 			       _struct_, MaxOffsetWrite),                      \
 		CONF_ITEM_UI64("MaxOffsetRead", 512, UINT64_MAX, INT64_MAX,    \
 			       _struct_, MaxOffsetRead),                       \
+		CONF_ITEM_UI32("Cache_Entries_Soft_Limit", 0, UINT32_MAX, 0,   \
+			       _struct_, cache_entries_soft),                  \
+		CONF_ITEM_UI32("Cache_Entries_Hard_Limit", 0, UINT32_MAX, 0,   \
+			       _struct_, cache_entries_hard),                  \
+		CONF_ITEM_UI32("Cache_Chunks_Soft_Limit", 0, UINT32_MAX, 0,    \
+			       _struct_, cache_chunks_soft),                   \
+		CONF_ITEM_UI32("Cache_Chunks_Hard_Limit", 0, UINT32_MAX, 0,    \
+			       _struct_, cache_chunks_hard),                   \
 		CONF_ITEM_BOOLBIT_SET("UseCookieVerifier", false,              \
 				      EXPORT_OPTION_USE_COOKIE_VERIFIER,       \
 				      _struct_, options, options_set),         \
@@ -2432,6 +2510,170 @@ void log_all_exports(log_levels_t level, int line, const char *func)
 	foreach_gsh_export(log_an_export, false, &lep);
 }
 
+/**
+ * @brief Compute the digest of the EXPORT_DEFAULTS blocks
+ *
+ * @param[in]  in_config The parsed configuration
+ * @param[out] err_type  Config error reporting
+ */
+
+static void set_export_defaults_digest(config_file_t in_config,
+				       struct config_error_type *err_type)
+{
+	struct config_node_list *config_list = NULL, *lp, *lp_next;
+	uint64_t digest = 0;
+
+	if (find_config_nodes(in_config, "EXPORT_DEFAULTS", &config_list,
+			      err_type) == 0) {
+		for (lp = config_list; lp != NULL; lp = lp_next) {
+			lp_next = lp->next;
+			digest = config_node_digest(lp->tree_node, digest);
+			gsh_free(lp);
+		}
+	}
+
+	export_defaults_digest = digest;
+}
+
+/**
+ * @brief An export and the digest of the EXPORT block it came from
+ */
+
+struct export_digest {
+	uint64_t digest;
+	struct gsh_export *export;
+	bool matched;
+};
+
+struct export_digest_table {
+	struct export_digest *entries;
+	size_t count;
+	size_t size;
+};
+
+static bool collect_export_digest(struct gsh_export *export, void *state)
+{
+	struct export_digest_table *table = state;
+
+	if (export->config_digest == 0)
+		return true;
+
+	if (table->count == table->size) {
+		table->size = table->size == 0 ? 64 : table->size * 2;
+		table->entries = gsh_realloc(
+			table->entries,
+			table->size * sizeof(struct export_digest));
+	}
+
+	get_gsh_export_ref(export);
+	table->entries[table->count].digest = export->config_digest;
+	table->entries[table->count].export = export;
+	table->entries[table->count].matched = false;
+	table->count++;
+
+	return true;
+}
+
+static int export_digest_cmpf(const void *a, const void *b)
+{
+	const struct export_digest *lhs = a, *rhs = b;
+
+	if (lhs->digest < rhs->digest)
+		return -1;
+
+	return lhs->digest > rhs->digest;
+}
+
+/**
+ * @brief Update the exports from only the EXPORT blocks that changed
+ *
+ * Each EXPORT block of the new configuration is digested and compared to
+ * the digest of the block each existing export was last updated from.
+ * Exports whose block did not change are simply marked as belonging to
+ * the new config generation so prune_defunct_exports() keeps them; all
+ * other blocks, and those of exports with clients named by host name or
+ * netgroup, go through the normal update_export processing.
+ *
+ * @param[in]  in_config  The parsed configuration
+ * @param[in]  generation Generation of in_config
+ * @param[out] unchanged  Number of exports left untouched
+ * @param[out] err_type   Config error reporting
+ *
+ * @return A negative value on error, the number of export entries else.
+ */
+
+static int update_changed_exports(config_file_t in_config, uint64_t generation,
+				  int *unchanged,
+				  struct config_error_type *err_type)
+{
+	struct config_node_list *config_list = NULL, *lp, *lp_next;
+	struct export_digest_table table = { NULL, 0, 0 };
+	struct export_digest key, *found;
+	int rc, num_exp = 0;
+	size_t i;
+
+	*unchanged = 0;
+
+	rc = find_config_nodes(in_config, "EXPORT", &config_list, err_type);
+
+	if (rc == ENOENT)
+		return 0;
+
+	if (rc != 0)
+		return -1;
+
+	(void)foreach_gsh_export(collect_export_digest, false, &table);
+
+	if (table.count > 0)
+		qsort(table.entries, table.count, sizeof(struct export_digest),
+		      export_digest_cmpf);
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+
+		key.digest = config_node_digest(lp->tree_node,
+						export_defaults_digest);
+		found = table.count == 0 ?
+				NULL :
+				bsearch(&key, table.entries, table.count,
+					sizeof(struct export_digest),
+					export_digest_cmpf);
+
+		if (found != NULL && !found->matched) {
+			/* Nothing changed for this export, just claim it for
+			 * the new generation.
+			 */
+			LogFullDebug(COMPONENT_EXPORT,
+				     "Export %d unchanged",
+				     found->export->export_id);
+			found->matched = true;
+			found->export->config_gen = generation;
+			(*unchanged)++;
+			num_exp++;
+		} else {
+			/* Same as load_config_from_parse() */
+			err_type->cur_exp_create_err = false;
+
+			if (load_config_from_node(lp->tree_node,
+						  &update_export_param, NULL,
+						  false, err_type) == 0)
+				num_exp++;
+
+			if (err_type->cur_exp_create_err)
+				err_type->all_exp_create_err = true;
+		}
+
+		gsh_free(lp);
+	}
+
+	for (i = 0; i < table.count; i++)
+		put_gsh_export(table.entries[i].export);
+
+	gsh_free(table.entries);
+
+	return num_exp;
+}
+
 /**
  * @brief Read the export entries from the parsed configuration file.
  *
@@ -2468,6 +2710,8 @@ int ReadExports(config_file_t in_config, struct config_error_type *err_type)
 		return -1;
 	}
 
+	set_export_defaults_digest(in_config, err_type);
+
 	if (isMidDebug(COMPONENT_EXPORT)) {
 		char perms[1024] = "\0";
 		struct display_buffer dspbuf = { sizeof(perms), perms, perms };
@@ -2517,11 +2761,14 @@ int ReadExports(config_file_t in_config, struct config_error_type *err_type)
 
 int reread_exports(config_file_t in_config, struct config_error_type *err_type)
 {
-	int rc, num_exp;
+	int rc, num_exp, unchanged = 0, pruned = 0;
 	uint64_t generation;
+	struct timespec start, end;
 
 	EXPORT_ADMIN_LOCK();
 
+	now(&start);
+
 	LogInfo(COMPONENT_CONFIG, "Reread exports starting");
 
 	LogDebug(COMPONENT_EXPORT, "Exports before update");
@@ -2536,6 +2783,8 @@ int reread_exports(config_file_t in_config, struct config_error_type *err_type)
 		goto out;
 	}
 
+	set_export_defaults_digest(in_config, err_type);
+
 	LogDebug(COMPONENT_EXPORT, "About to update pseudofs block");
 
 	rc = load_config_from_parse(in_config, &update_pseudofs_param, NULL,
@@ -2547,8 +2796,10 @@ int reread_exports(config_file_t in_config, struct config_error_type *err_type)
 		goto out;
 	}
 
-	num_exp = load_config_from_parse(in_config, &update_export_param, NULL,
-					 false, err_type);
+	generation = get_config_generation(in_config);
+
+	num_exp = update_changed_exports(in_config, generation, &unchanged,
+					 err_type);
 
 	if (num_exp < 0) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
@@ -2556,18 +2807,22 @@ int reread_exports(config_file_t in_config, struct config_error_type *err_type)
 		goto out;
 	}
 
-	generation = get_config_generation(in_config);
-
 	/* Prune the pseudofs of all exports that will be unexported (defunct)
 	 * as well as any descendant exports. Then unexport all defunct exports.
 	 * Finally remount all the exports that were unmounted. If that fails,
 	 * create_pseudofs() will LogFatal and abort.
 	 */
 	prune_pseudofs_subtree(NULL, generation, false);
-	prune_defunct_exports(generation);
+	pruned = prune_defunct_exports(generation);
 	create_pseudofs();
 
-	LogEvent(COMPONENT_CONFIG, "Reread exports complete");
+	now(&end);
+
+	LogEvent(COMPONENT_CONFIG,
+		 "Reread exports complete in %" PRIu64
+		 " ms: %d exports, %d added or updated, %d unchanged, %d removed",
+		 timespec_diff(&start, &end) / NS_PER_MSEC, num_exp,
+		 num_exp - unchanged, unchanged, pruned);
 	LogInfo(COMPONENT_EXPORT, "Exports after update");
 	log_all_exports(NIV_INFO, __LINE__, __func__);
 
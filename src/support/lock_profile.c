@@ -0,0 +1,571 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file support/lock_profile.c
+ * @brief Contention profiling of the PTHREAD_* lock wrappers
+ *
+ * When lock_profiling is set, PTHREAD_MUTEX_lock, PTHREAD_RWLOCK_rdlock and
+ * PTHREAD_RWLOCK_wrlock first try to take the lock.  Only if it is busy is
+ * the lock waited for, timed, and the wait accounted to the static
+ * lock_site of the macro use.  Uncontended locks thus only cost a try-lock.
+ *
+ * Waits are accounted in a table owned by the thread, only allocated once
+ * it waits for a lock, so threads never share a cache line while
+ * profiling.  The tables of threads that exit are folded into a table of
+ * retired threads.  lock_profile_collect() merges all of them by site, for
+ * the DBus report of the sites that waited the longest and for the load
+ * generator.
+ *
+ * The locks of the profiler itself are plain pthread locks, so they are not
+ * profiled.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#include "lock_profile.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/**
+ * @brief Sites per thread table, a power of 2
+ */
+#define LOCK_PROFILE_SLOTS 512
+
+/**
+ * @brief Slots probed before giving up on a site
+ */
+#define LOCK_PROFILE_PROBES 16
+
+/**
+ * @brief Most contended sites returned over DBus
+ */
+#define LOCK_PROFILE_REPORT 64
+
+/**
+ * @brief Waits of one thread at one site
+ *
+ * Only the owner of the table updates the counters, readers fetch them
+ * atomically.
+ */
+struct lock_profile_slot {
+	struct lock_site *site; /*< Site, NULL while the slot is free */
+	uint64_t contended; /*< Number of times the lock was busy */
+	uint64_t wait_ns; /*< Total time waited for the lock */
+	uint64_t max_ns; /*< Longest wait */
+};
+
+struct lock_profile_table {
+	struct glist_head tables; /*< Entry in lock_profile_tables */
+	uint64_t dropped; /*< Waits not accounted, the table being full */
+	struct lock_profile_slot slots[LOCK_PROFILE_SLOTS];
+};
+
+bool lock_profiling;
+
+/* Protects lock_profile_tables and lock_profile_retired */
+static pthread_mutex_t lock_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head lock_profile_tables =
+	GLIST_HEAD_INIT(lock_profile_tables);
+static struct lock_profile_table lock_profile_retired;
+static pthread_key_t lock_profile_key;
+static bool lock_profile_ready;
+static __thread struct lock_profile_table *my_table;
+
+/**
+ * @brief Find or claim the slot of a site in a table
+ *
+ * Only the owner of the table claims slots, or anyone holding
+ * lock_profile_lock for the retired table.
+ *
+ * @return The slot, or NULL if the table is full around the site.
+ */
+static struct lock_profile_slot *
+lock_profile_slot_get(struct lock_profile_table *table,
+		      struct lock_site *site)
+{
+	uint64_t hash = ((uintptr_t)site >> 3) * 0x9E3779B97F4A7C15ULL;
+	struct lock_profile_slot *slot;
+	struct lock_site *cur;
+	int i;
+
+	for (i = 0; i < LOCK_PROFILE_PROBES; i++) {
+		slot = &table->slots[(hash + i) & (LOCK_PROFILE_SLOTS - 1)];
+		cur = atomic_fetch_voidptr((void **)&slot->site);
+
+		if (cur == site)
+			return slot;
+
+		if (cur == NULL) {
+			atomic_store_voidptr((void **)&slot->site, site);
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+static void lock_profile_slot_add(struct lock_profile_slot *slot,
+				  uint64_t contended, uint64_t wait_ns,
+				  uint64_t max_ns)
+{
+	(void)atomic_add_uint64_t(&slot->contended, contended);
+	(void)atomic_add_uint64_t(&slot->wait_ns, wait_ns);
+
+	if (max_ns > atomic_fetch_uint64_t(&slot->max_ns))
+		atomic_store_uint64_t(&slot->max_ns, max_ns);
+}
+
+/**
+ * @brief Fold the table of an exiting thread into the retired table
+ */
+static void lock_profile_release(void *arg)
+{
+	struct lock_profile_table *table = arg;
+	struct lock_profile_slot *slot, *retired;
+	int i;
+
+	pthread_mutex_lock(&lock_profile_lock);
+
+	glist_del(&table->tables);
+
+	for (i = 0; i < LOCK_PROFILE_SLOTS; i++) {
+		slot = &table->slots[i];
+		if (slot->site == NULL)
+			continue;
+
+		retired = lock_profile_slot_get(&lock_profile_retired,
+						slot->site);
+		if (retired == NULL) {
+			lock_profile_retired.dropped += slot->contended;
+			continue;
+		}
+
+		lock_profile_slot_add(retired, slot->contended, slot->wait_ns,
+				      slot->max_ns);
+	}
+
+	lock_profile_retired.dropped += table->dropped;
+
+	pthread_mutex_unlock(&lock_profile_lock);
+
+	/* Locks taken by later destructors get a new table */
+	my_table = NULL;
+	gsh_free(table);
+}
+
+static struct lock_profile_table *lock_profile_table_get(void)
+{
+	if (likely(my_table != NULL))
+		return my_table;
+
+	my_table = gsh_calloc(1, sizeof(*my_table));
+
+	pthread_mutex_lock(&lock_profile_lock);
+	glist_add_tail(&lock_profile_tables, &my_table->tables);
+	pthread_mutex_unlock(&lock_profile_lock);
+
+	(void)pthread_setspecific(lock_profile_key, my_table);
+
+	return my_table;
+}
+
+/**
+ * @brief Account a wait for a busy lock
+ *
+ * @param[in] site	Site that waited
+ * @param[in] start	When the lock was found busy
+ */
+static void lock_profile_wait(struct lock_site *site,
+			      const struct timespec *start)
+{
+	struct lock_profile_table *table = lock_profile_table_get();
+	struct lock_profile_slot *slot;
+	struct timespec end;
+	nsecs_elapsed_t wait;
+
+	now_mono(&end);
+	wait = timespec_diff(start, &end);
+
+	slot = lock_profile_slot_get(table, site);
+	if (slot == NULL) {
+		(void)atomic_inc_uint64_t(&table->dropped);
+		return;
+	}
+
+	lock_profile_slot_add(slot, 1, wait, wait);
+}
+
+/**
+ * @brief Take a mutex, accounting the wait if it is busy
+ *
+ * @param[in] mtx	The mutex
+ * @param[in] site	Site taking it
+ *
+ * @return The result of pthread_mutex_lock.
+ */
+int lock_profile_mutex_lock(pthread_mutex_t *mtx, struct lock_site *site)
+{
+	struct timespec start;
+	int rc;
+
+	rc = pthread_mutex_trylock(mtx);
+	if (likely(rc == 0))
+		return 0;
+
+	/* Let pthread_mutex_lock report anything but a busy mutex */
+	if (rc != EBUSY)
+		return pthread_mutex_lock(mtx);
+
+	now_mono(&start);
+	rc = pthread_mutex_lock(mtx);
+	if (rc == 0)
+		lock_profile_wait(site, &start);
+
+	return rc;
+}
+
+/**
+ * @brief Take a read lock, accounting the wait if it is busy
+ *
+ * @param[in] lock	The read-write lock
+ * @param[in] site	Site taking it
+ *
+ * @return The result of pthread_rwlock_rdlock.
+ */
+int lock_profile_rwlock_rdlock(pthread_rwlock_t *lock,
+			       struct lock_site *site)
+{
+	struct timespec start;
+	int rc;
+
+	rc = pthread_rwlock_tryrdlock(lock);
+	if (likely(rc == 0))
+		return 0;
+
+	if (rc != EBUSY)
+		return pthread_rwlock_rdlock(lock);
+
+	now_mono(&start);
+	rc = pthread_rwlock_rdlock(lock);
+	if (rc == 0)
+		lock_profile_wait(site, &start);
+
+	return rc;
+}
+
+/**
+ * @brief Take a write lock, accounting the wait if it is busy
+ *
+ * @param[in] lock	The read-write lock
+ * @param[in] site	Site taking it
+ *
+ * @return The result of pthread_rwlock_wrlock.
+ */
+int lock_profile_rwlock_wrlock(pthread_rwlock_t *lock,
+			       struct lock_site *site)
+{
+	struct timespec start;
+	int rc;
+
+	rc = pthread_rwlock_trywrlock(lock);
+	if (likely(rc == 0))
+		return 0;
+
+	if (rc != EBUSY)
+		return pthread_rwlock_wrlock(lock);
+
+	now_mono(&start);
+	rc = pthread_rwlock_wrlock(lock);
+	if (rc == 0)
+		lock_profile_wait(site, &start);
+
+	return rc;
+}
+
+/**
+ * @brief Initialize the lock profiler
+ *
+ * Profiling starts right away if Enable_Lock_Profiling is set, it may
+ * also be turned on and off with the EnableStats and DisableStats DBus
+ * methods.
+ */
+void lock_profile_init(void)
+{
+	if (pthread_key_create(&lock_profile_key, lock_profile_release) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not create key, lock profiling disabled");
+		return;
+	}
+
+	lock_profile_ready = true;
+	lock_profile_enable(nfs_param.core_param.enable_lock_profiling);
+}
+
+/**
+ * @brief Turn lock profiling on or off
+ *
+ * Sites already accounted are kept until lock_profile_reset().
+ *
+ * @param[in] enable	Whether to profile
+ *
+ * @return false if the profiler could not be initialized.
+ */
+bool lock_profile_enable(bool enable)
+{
+	if (enable && !lock_profile_ready)
+		return false;
+
+	if (enable != lock_profiling)
+		LogEvent(COMPONENT_CONFIG, "%s lock contention profiling",
+			 enable ? "Enabling" : "Disabling");
+
+	lock_profiling = enable;
+
+	return true;
+}
+
+static void lock_profile_table_reset(struct lock_profile_table *table)
+{
+	struct lock_profile_slot *slot;
+	int i;
+
+	for (i = 0; i < LOCK_PROFILE_SLOTS; i++) {
+		slot = &table->slots[i];
+		atomic_store_uint64_t(&slot->contended, 0);
+		atomic_store_uint64_t(&slot->wait_ns, 0);
+		atomic_store_uint64_t(&slot->max_ns, 0);
+	}
+
+	atomic_store_uint64_t(&table->dropped, 0);
+}
+
+/**
+ * @brief Forget the waits accounted so far
+ *
+ * Sites keep their slots, so a thread racing with the reset may keep a
+ * wait it was accounting.
+ */
+void lock_profile_reset(void)
+{
+	struct glist_head *glist;
+
+	pthread_mutex_lock(&lock_profile_lock);
+
+	glist_for_each(glist, &lock_profile_tables)
+	{
+		lock_profile_table_reset(glist_entry(
+			glist, struct lock_profile_table, tables));
+	}
+
+	lock_profile_table_reset(&lock_profile_retired);
+
+	pthread_mutex_unlock(&lock_profile_lock);
+}
+
+/**
+ * @brief Order sums by site, the same site may have several lock_sites
+ *
+ * The macros used in static inline functions have one lock_site per
+ * compilation unit.
+ */
+static int lock_profile_site_cmp(const void *a, const void *b)
+{
+	const struct lock_profile_sum *sa = a, *sb = b;
+	int rc;
+
+	rc = strcmp(sa->site->file, sb->site->file);
+	if (rc != 0)
+		return rc;
+
+	if (sa->site->line != sb->site->line)
+		return sa->site->line < sb->site->line ? -1 : 1;
+
+	return strcmp(sa->site->name, sb->site->name);
+}
+
+static int lock_profile_wait_cmp(const void *a, const void *b)
+{
+	const struct lock_profile_sum *sa = a, *sb = b;
+
+	if (sa->wait_ns != sb->wait_ns)
+		return sa->wait_ns > sb->wait_ns ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * @brief Add the slots of a table to the sums
+ *
+ * @return The number of sums.
+ */
+static size_t lock_profile_sum_table(struct lock_profile_table *table,
+				     struct lock_profile_sum *sums,
+				     size_t count)
+{
+	struct lock_profile_slot *slot;
+	struct lock_profile_sum *sum;
+	int i;
+
+	for (i = 0; i < LOCK_PROFILE_SLOTS; i++) {
+		slot = &table->slots[i];
+		sum = &sums[count];
+		sum->site = atomic_fetch_voidptr((void **)&slot->site);
+		if (sum->site == NULL)
+			continue;
+
+		sum->contended = atomic_fetch_uint64_t(&slot->contended);
+		if (sum->contended == 0)
+			continue;
+
+		sum->wait_ns = atomic_fetch_uint64_t(&slot->wait_ns);
+		sum->max_ns = atomic_fetch_uint64_t(&slot->max_ns);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Sum the waits of all the threads by site
+ *
+ * @param[out] sums	Sums, most waited for first, to be freed with
+ *			gsh_free()
+ * @param[out] dropped	Waits not accounted, a table being full
+ *
+ * @return The number of sums.
+ */
+size_t lock_profile_collect(struct lock_profile_sum **sums,
+			    uint64_t *dropped)
+{
+	struct lock_profile_sum *sum;
+	struct glist_head *glist;
+	size_t tables = 1, count = 0, merged, i;
+
+	pthread_mutex_lock(&lock_profile_lock);
+
+	glist_for_each(glist, &lock_profile_tables)
+	{
+		tables++;
+	}
+
+	*sums = gsh_malloc(tables * LOCK_PROFILE_SLOTS * sizeof(**sums));
+
+	*dropped = atomic_fetch_uint64_t(&lock_profile_retired.dropped);
+	count = lock_profile_sum_table(&lock_profile_retired, *sums, count);
+
+	glist_for_each(glist, &lock_profile_tables)
+	{
+		struct lock_profile_table *table = glist_entry(
+			glist, struct lock_profile_table, tables);
+
+		*dropped += atomic_fetch_uint64_t(&table->dropped);
+		count = lock_profile_sum_table(table, *sums, count);
+	}
+
+	pthread_mutex_unlock(&lock_profile_lock);
+
+	/* Merge the sums of the same site */
+	qsort(*sums, count, sizeof(**sums), lock_profile_site_cmp);
+
+	for (i = 0, merged = 0; i < count; i++) {
+		sum = &(*sums)[i];
+
+		if (merged > 0 &&
+		    lock_profile_site_cmp(&(*sums)[merged - 1], sum) == 0) {
+			(*sums)[merged - 1].contended += sum->contended;
+			(*sums)[merged - 1].wait_ns += sum->wait_ns;
+			(*sums)[merged - 1].max_ns =
+				MAX((*sums)[merged - 1].max_ns, sum->max_ns);
+			continue;
+		}
+
+		(*sums)[merged++] = *sum;
+	}
+
+	qsort(*sums, merged, sizeof(**sums), lock_profile_wait_cmp);
+
+	return merged;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the most contended lock sites over DBus
+ *
+ * @param[in,out] iter	Reply being built
+ */
+void lock_profile_dbus_report(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct lock_profile_sum *sums, *sum;
+	size_t count, i;
+	uint64_t dropped;
+	dbus_bool_t enabled = lock_profiling;
+	uint32_t line;
+
+	count = lock_profile_collect(&sums, &dropped);
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN, &enabled);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64, &dropped);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 LOCK_PROFILE_DBUS_TYPE, &array_iter);
+
+	for (i = 0; i < MIN(count, LOCK_PROFILE_REPORT); i++) {
+		sum = &sums[i];
+		line = sum->site->line;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &sum->site->name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &sum->site->kind);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &sum->site->file);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &line);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum->contended);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum->wait_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum->max_ns);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(sums);
+}
+#endif /* USE_DBUS */
@@ -0,0 +1,639 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file support/mem_accounting.c
+ * @brief Memory accounting per log component
+ *
+ * Only built with USE_MEM_ACCOUNTING, see abstract_mem.h.  Allocations and
+ * frees are counted in a table owned by the thread, so the allocator
+ * shims never share a cache line.  A block freed by another thread than
+ * the one that allocated it leaves a negative count in the freeing
+ * thread, only the sum over all threads is meaningful.
+ *
+ * The reaper calls gsh_mem_check() to sum the tables, track the high
+ * water mark of each component and ask components over their limit to
+ * release memory.  The sums are also exported over DBus and to
+ * Prometheus.
+ *
+ * Blocks of libraries handed over with gsh_foreign() are kept in a hash
+ * table until released, so gsh_free never has to guess whether a block
+ * has a header.  The table is only searched while it is not empty.
+ *
+ * The tables are allocated with calloc and the locks here are plain
+ * pthread locks, so that accounting never recurses into itself.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "mem_accounting.h"
+#include "monitoring.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+#define GSH_MEM_MAGIC 0x67736d6dU
+
+/**
+ * @brief Header preceding every accounted block
+ *
+ * Its size keeps the blocks returned by malloc aligned for any type.
+ */
+struct gsh_mem_header {
+	uint64_t size; /*< Bytes requested */
+	uint32_t magic; /*< GSH_MEM_MAGIC while allocated, for assertions */
+	uint16_t component; /*< Component charged with the block */
+	uint16_t shift; /*< log2 of the offset of the block in the allocation */
+};
+
+#define GSH_MEM_HEADER_SHIFT 4
+
+/**
+ * @brief Allocations of one thread, or of all the exited threads
+ */
+struct gsh_mem_counters {
+	struct glist_head threads; /*< Entry in gsh_mem_threads */
+	int64_t bytes[COMPONENT_COUNT]; /*< Bytes allocated less freed */
+	int64_t blocks[COMPONENT_COUNT]; /*< Blocks allocated less freed */
+};
+
+/**
+ * @brief Sums and limit of a component
+ *
+ * Updated by gsh_mem_check() under gsh_mem_lock.
+ */
+struct gsh_mem_component {
+	int64_t bytes; /*< Bytes in use at the last check */
+	int64_t blocks; /*< Blocks in use at the last check */
+	int64_t high_water; /*< Most bytes in use seen by a check */
+	uint64_t limit; /*< Reclaim above this many bytes, 0 for none */
+	uint64_t reclaims; /*< Times the component was asked to reclaim */
+	gsh_mem_reclaim_t reclaim; /*< Releases memory of the component */
+};
+
+#define GSH_MEM_FOREIGN_BUCKETS 64
+
+/**
+ * @brief A block of a library handed over by gsh_foreign()
+ */
+struct gsh_mem_foreign_block {
+	struct gsh_mem_foreign_block *next; /*< Next block of the bucket */
+	void *p; /*< The block */
+};
+
+struct gsh_mem_site gsh_mem_tirpc_site = {
+	.file = "ntirpc", .component = COMPONENT_TIRPC
+};
+
+/* Protects gsh_mem_threads, gsh_mem_retired and gsh_mem_components */
+static pthread_mutex_t gsh_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head gsh_mem_threads = GLIST_HEAD_INIT(gsh_mem_threads);
+static struct gsh_mem_counters gsh_mem_retired;
+static struct gsh_mem_component gsh_mem_components[COMPONENT_COUNT];
+static pthread_once_t gsh_mem_once = PTHREAD_ONCE_INIT;
+static pthread_key_t gsh_mem_key;
+static __thread struct gsh_mem_counters *my_counters;
+
+/* Protects gsh_mem_foreign_blocks */
+static pthread_mutex_t gsh_mem_foreign_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct gsh_mem_foreign_block
+	*gsh_mem_foreign_blocks[GSH_MEM_FOREIGN_BUCKETS];
+static uint64_t gsh_mem_foreign_count;
+
+/**
+ * @brief Source paths charged to each component, first match wins
+ *
+ * Anything else, such as the helpers of abstract_mem.h itself, is charged
+ * to MEM_ALLOC.
+ */
+static const struct {
+	const char *path;
+	log_components_t component;
+} gsh_mem_paths[] = {
+	{ "FSAL_MDCACHE/", COMPONENT_MDCACHE },
+	{ "nfs_dupreq", COMPONENT_DUPREQ },
+	{ "idmapper/", COMPONENT_IDMAPPER },
+	{ "uid2grp", COMPONENT_IDMAPPER },
+	{ "nfs41_session", COMPONENT_SESSIONS },
+	{ "nfs4_clientid", COMPONENT_CLIENTID },
+	{ "SAL/nlm_", COMPONENT_NLM },
+	{ "Protocols/NLM/", COMPONENT_NLM },
+	{ "SAL/", COMPONENT_STATE },
+	{ "nfs_readdir_cache", COMPONENT_NFS_READDIR },
+	{ "Protocols/9P/", COMPONENT_9P },
+	{ "Protocols/NFS/nfs4_", COMPONENT_NFS_V4 },
+	{ "Protocols/", COMPONENT_NFSPROTO },
+	{ "hashtable/", COMPONENT_HASHTABLE },
+	{ "FSAL_UP/", COMPONENT_FSAL_UP },
+	{ "FSAL/", COMPONENT_FSAL },
+	{ "RPCAL/", COMPONENT_DISPATCH },
+	{ "export", COMPONENT_EXPORT },
+	{ "config_parsing/", COMPONENT_CONFIG },
+	{ "log/", COMPONENT_LOG },
+	{ "dbus/", COMPONENT_DBUS },
+	{ "MainNFSD/", COMPONENT_MAIN },
+};
+
+static log_components_t gsh_mem_site_component(struct gsh_mem_site *site)
+{
+	int32_t component = atomic_fetch_int32_t(&site->component);
+	int i;
+
+	if (likely(component >= 0))
+		return component;
+
+	component = COMPONENT_MEM_ALLOC;
+
+	for (i = 0; i < ARRAY_SIZE(gsh_mem_paths); i++) {
+		if (strstr(site->file, gsh_mem_paths[i].path) != NULL) {
+			component = gsh_mem_paths[i].component;
+			break;
+		}
+	}
+
+	atomic_store_int32_t(&site->component, component);
+
+	return component;
+}
+
+static void gsh_mem_counters_add(struct gsh_mem_counters *to,
+				 struct gsh_mem_counters *from)
+{
+	int i;
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		to->bytes[i] += atomic_fetch_int64_t(&from->bytes[i]);
+		to->blocks[i] += atomic_fetch_int64_t(&from->blocks[i]);
+	}
+}
+
+/**
+ * @brief Fold the counters of an exiting thread into the retired ones
+ */
+static void gsh_mem_release(void *arg)
+{
+	struct gsh_mem_counters *counters = arg;
+
+	pthread_mutex_lock(&gsh_mem_lock);
+	glist_del(&counters->threads);
+	gsh_mem_counters_add(&gsh_mem_retired, counters);
+	pthread_mutex_unlock(&gsh_mem_lock);
+
+	/* Frees done by later destructors get new counters */
+	my_counters = NULL;
+	free(counters);
+}
+
+static void gsh_mem_key_create(void)
+{
+	if (pthread_key_create(&gsh_mem_key, gsh_mem_release) != 0)
+		abort();
+}
+
+static struct gsh_mem_counters *gsh_mem_counters_get(void)
+{
+	struct gsh_mem_counters *counters = my_counters;
+
+	if (likely(counters != NULL))
+		return counters;
+
+	(void)pthread_once(&gsh_mem_once, gsh_mem_key_create);
+
+	counters = calloc(1, sizeof(*counters));
+	if (counters == NULL)
+		abort();
+
+	pthread_mutex_lock(&gsh_mem_lock);
+	glist_add_tail(&gsh_mem_threads, &counters->threads);
+	pthread_mutex_unlock(&gsh_mem_lock);
+
+	(void)pthread_setspecific(gsh_mem_key, counters);
+	my_counters = counters;
+
+	return counters;
+}
+
+static inline void gsh_mem_account(uint16_t component, int64_t bytes,
+				   int64_t blocks)
+{
+	struct gsh_mem_counters *counters = gsh_mem_counters_get();
+
+	(void)atomic_add_int64_t(&counters->bytes[component], bytes);
+	(void)atomic_add_int64_t(&counters->blocks[component], blocks);
+}
+
+static inline struct gsh_mem_header *gsh_mem_header(void *p)
+{
+	return (struct gsh_mem_header *)p - 1;
+}
+
+static inline void *gsh_mem_base(struct gsh_mem_header *hdr)
+{
+	return (char *)(hdr + 1) - (1UL << hdr->shift);
+}
+
+static inline struct gsh_mem_foreign_block **gsh_mem_foreign_bucket(void *p)
+{
+	return &gsh_mem_foreign_blocks[((uintptr_t)p >> 4) %
+				       GSH_MEM_FOREIGN_BUCKETS];
+}
+
+/**
+ * @brief Let gsh_mem_free release a block allocated by a library
+ *
+ * @param[in] p	Block from a library's malloc
+ */
+void gsh_mem_foreign(void *p)
+{
+	struct gsh_mem_foreign_block **bucket = gsh_mem_foreign_bucket(p);
+	struct gsh_mem_foreign_block *block = malloc(sizeof(*block));
+
+	if (block == NULL) {
+		LogMallocFailure(__FILE__, __LINE__, __func__, "gsh_foreign");
+		abort();
+	}
+
+	block->p = p;
+
+	pthread_mutex_lock(&gsh_mem_foreign_lock);
+	block->next = *bucket;
+	*bucket = block;
+	(void)atomic_inc_uint64_t(&gsh_mem_foreign_count);
+	pthread_mutex_unlock(&gsh_mem_foreign_lock);
+}
+
+/**
+ * @brief Forget a block handed over by gsh_mem_foreign
+ *
+ * @param[in] p	The block
+ *
+ * @return Whether the block came from a library.
+ */
+static bool gsh_mem_foreign_take(void *p)
+{
+	struct gsh_mem_foreign_block **next, *block = NULL;
+
+	if (likely(atomic_fetch_uint64_t(&gsh_mem_foreign_count) == 0))
+		return false;
+
+	pthread_mutex_lock(&gsh_mem_foreign_lock);
+
+	for (next = gsh_mem_foreign_bucket(p); *next != NULL;
+	     next = &(*next)->next) {
+		if ((*next)->p == p) {
+			block = *next;
+			*next = block->next;
+			(void)atomic_dec_uint64_t(&gsh_mem_foreign_count);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&gsh_mem_foreign_lock);
+
+	free(block);
+
+	return block != NULL;
+}
+
+/**
+ * @brief Allocate an accounted block
+ *
+ * @param[in] site	Site allocating the block
+ * @param[in] align	Alignment of the block, 0 for malloc's
+ * @param[in] n		Size of the block
+ * @param[in] zero	Whether to zero the block
+ *
+ * @return The block, NULL if out of memory.
+ */
+void *gsh_mem_alloc(struct gsh_mem_site *site, size_t align, size_t n,
+		    bool zero)
+{
+	struct gsh_mem_header *hdr;
+	unsigned int shift = GSH_MEM_HEADER_SHIFT;
+	void *base;
+
+	if (align <= sizeof(*hdr)) {
+		if (n > SIZE_MAX - sizeof(*hdr))
+			return NULL;
+
+		base = zero ? calloc(1, n + sizeof(*hdr))
+			    : malloc(n + sizeof(*hdr));
+		if (base == NULL)
+			return NULL;
+	} else {
+		/* The header goes at the end of a first aligned chunk */
+		shift = __builtin_ctzl(align);
+		if (n > SIZE_MAX - align ||
+		    posix_memalign(&base, align, n + align) != 0)
+			return NULL;
+
+		if (zero)
+			memset(base, 0, n + align);
+	}
+
+	hdr = (struct gsh_mem_header *)((char *)base + (1UL << shift)) - 1;
+	hdr->size = n;
+	hdr->magic = GSH_MEM_MAGIC;
+	hdr->component = gsh_mem_site_component(site);
+	hdr->shift = shift;
+
+	gsh_mem_account(hdr->component, n, 1);
+
+	return hdr + 1;
+}
+
+/**
+ * @brief Free a block, accounted or handed over by gsh_mem_foreign
+ *
+ * @param[in] p	The block
+ */
+void gsh_mem_free(void *p)
+{
+	struct gsh_mem_header *hdr;
+
+	if (p == NULL)
+		return;
+
+	if (gsh_mem_foreign_take(p)) {
+		free(p);
+		return;
+	}
+
+	hdr = gsh_mem_header(p);
+	assert(hdr->magic == GSH_MEM_MAGIC);
+
+	gsh_mem_account(hdr->component, -(int64_t)hdr->size, -1);
+	hdr->magic = 0;
+
+	free(gsh_mem_base(hdr));
+}
+
+/**
+ * @brief Resize an accounted block
+ *
+ * The block is charged to the component of the resizing site.
+ *
+ * @param[in] site	Site resizing the block
+ * @param[in] p		The block, may be NULL
+ * @param[in] n		New size, 0 to free the block
+ *
+ * @return The block, NULL if freed or out of memory.
+ */
+void *gsh_mem_realloc(struct gsh_mem_site *site, void *p, size_t n)
+{
+	struct gsh_mem_header *hdr, old;
+	void *p2;
+
+	if (p == NULL)
+		return gsh_mem_alloc(site, 0, n, false);
+
+	if (n == 0) {
+		gsh_mem_free(p);
+		return NULL;
+	}
+
+	if (gsh_mem_foreign_take(p)) {
+		/* Still the library's, a failed realloc keeps the block */
+		p2 = realloc(p, n);
+		gsh_mem_foreign(p2 != NULL ? p2 : p);
+		return p2;
+	}
+
+	hdr = gsh_mem_header(p);
+	assert(hdr->magic == GSH_MEM_MAGIC);
+
+	if (hdr->shift != GSH_MEM_HEADER_SHIFT) {
+		/* Aligned blocks are moved to a block of malloc's alignment */
+		p2 = gsh_mem_alloc(site, 0, n, false);
+		if (p2 != NULL) {
+			memcpy(p2, p, n < hdr->size ? n : hdr->size);
+			gsh_mem_free(p);
+		}
+		return p2;
+	}
+
+	if (n > SIZE_MAX - sizeof(*hdr))
+		return NULL;
+
+	old = *hdr;
+	hdr = realloc(hdr, n + sizeof(*hdr));
+	if (hdr == NULL)
+		return NULL;
+
+	gsh_mem_account(old.component, -(int64_t)old.size, -1);
+
+	hdr->size = n;
+	hdr->component = gsh_mem_site_component(site);
+	gsh_mem_account(hdr->component, n, 1);
+
+	return hdr + 1;
+}
+
+/**
+ * @brief Set the limit of a component
+ *
+ * @param[in] component	The component
+ * @param[in] limit	Bytes above which to reclaim, 0 for no limit
+ * @param[in] reclaim	Called by gsh_mem_check() while above the limit
+ */
+void gsh_mem_set_limit(log_components_t component, uint64_t limit,
+		       gsh_mem_reclaim_t reclaim)
+{
+	pthread_mutex_lock(&gsh_mem_lock);
+	gsh_mem_components[component].limit = limit;
+	gsh_mem_components[component].reclaim = reclaim;
+	pthread_mutex_unlock(&gsh_mem_lock);
+
+	if (limit != 0)
+		LogInfo(COMPONENT_MEMLEAKS,
+			"Reclaiming %s memory above %" PRIu64 " bytes",
+			LogComponents[component].comp_str, limit);
+}
+
+/**
+ * @brief Sum the counters of all threads
+ *
+ * Must be called with gsh_mem_lock held.
+ */
+static void gsh_mem_sum(struct gsh_mem_counters *sum)
+{
+	struct glist_head *glist;
+
+	memset(sum, 0, sizeof(*sum));
+	gsh_mem_counters_add(sum, &gsh_mem_retired);
+
+	glist_for_each(glist, &gsh_mem_threads)
+	{
+		gsh_mem_counters_add(sum, glist_entry(glist,
+						      struct gsh_mem_counters,
+						      threads));
+	}
+}
+
+/**
+ * @brief Update the sums of the components
+ *
+ * Must be called with gsh_mem_lock held.
+ */
+static void gsh_mem_update(void)
+{
+	struct gsh_mem_counters sum;
+	struct gsh_mem_component *comp;
+	int i;
+
+	gsh_mem_sum(&sum);
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		comp = &gsh_mem_components[i];
+		comp->bytes = sum.bytes[i];
+		comp->blocks = sum.blocks[i];
+		if (comp->bytes > comp->high_water)
+			comp->high_water = comp->bytes;
+	}
+}
+
+/**
+ * @brief Check the memory of every component against its limit
+ *
+ * Called periodically by the reaper.  The reclaim functions are called
+ * without gsh_mem_lock, as they free memory.
+ */
+void gsh_mem_check(void)
+{
+	gsh_mem_reclaim_t reclaim[COMPONENT_COUNT];
+	uint64_t excess[COMPONENT_COUNT];
+	struct gsh_mem_component *comp;
+	int i;
+
+	pthread_mutex_lock(&gsh_mem_lock);
+
+	gsh_mem_update();
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		comp = &gsh_mem_components[i];
+		reclaim[i] = NULL;
+
+		if (comp->bytes > 0)
+			monitoring__dynamic_memory_usage(
+				LogComponents[i].comp_str, comp->bytes,
+				comp->high_water);
+
+		if (comp->limit == 0 || comp->reclaim == NULL ||
+		    comp->bytes <= (int64_t)comp->limit)
+			continue;
+
+		reclaim[i] = comp->reclaim;
+		excess[i] = comp->bytes - comp->limit;
+		comp->reclaims++;
+	}
+
+	pthread_mutex_unlock(&gsh_mem_lock);
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		if (reclaim[i] == NULL)
+			continue;
+
+		LogDebug(COMPONENT_MEMLEAKS,
+			 "%s is %" PRIu64 " bytes over its memory limit",
+			 LogComponents[i].comp_str, excess[i]);
+
+		reclaim[i](excess[i]);
+	}
+}
+
+/**
+ * @brief Restart the high water marks from the current usage
+ */
+void gsh_mem_reset(void)
+{
+	int i;
+
+	pthread_mutex_lock(&gsh_mem_lock);
+
+	gsh_mem_update();
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		gsh_mem_components[i].high_water = gsh_mem_components[i].bytes;
+		gsh_mem_components[i].reclaims = 0;
+	}
+
+	pthread_mutex_unlock(&gsh_mem_lock);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the memory of every component over DBus
+ *
+ * @param[in,out] iter	Reply being built
+ */
+void gsh_mem_dbus_report(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct gsh_mem_component comps[COMPONENT_COUNT];
+	struct gsh_mem_component *comp;
+	const char *name;
+	int i;
+
+	pthread_mutex_lock(&gsh_mem_lock);
+	gsh_mem_update();
+	memcpy(comps, gsh_mem_components, sizeof(comps));
+	pthread_mutex_unlock(&gsh_mem_lock);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 MEM_ACCOUNTING_DBUS_TYPE, &array_iter);
+
+	for (i = 0; i < COMPONENT_COUNT; i++) {
+		comp = &comps[i];
+		if (comp->blocks == 0 && comp->high_water == 0)
+			continue;
+
+		name = LogComponents[i].comp_str;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT64,
+					       &comp->bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT64,
+					       &comp->blocks);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT64,
+					       &comp->high_water);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &comp->limit);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &comp->reclaims);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
@@ -31,6 +31,7 @@
 #include "netdb.h"
 #include "abstract_mem.h"
 #include "netgroup_cache.h"
+#include "idmapper.h"
 
 /* Netgroup cache information */
 struct ng_cache_info {
@@ -101,14 +102,16 @@ static int ng_comparator(const struct avltree_node *node1,
 	return rc;
 }
 
+/* Hardcoded to 30 minutes for now */
+#define NG_TIME_VALIDITY (30 * 60)
+
 static bool ng_expired(struct avltree_node *node)
 {
 	struct ng_cache_info *info;
 
 	info = avltree_container_of(node, struct ng_cache_info, ng_node);
 
-	/* Hardcoded to 30 minutes for now */
-	if (time(NULL) - info->ng_epoch > 30 * 60)
+	if (time(NULL) - info->ng_epoch > NG_TIME_VALIDITY)
 		return true;
 
 	return false;
@@ -155,7 +158,8 @@ static void ng_remove(struct ng_cache_info *info, bool negative)
 }
 
 /* The caller must hold ng_lock for write */
-static void ng_add(const char *group, const char *host, bool negative)
+static void ng_add(const char *group, const char *host, bool negative,
+		   time_t epoch)
 {
 	struct ng_cache_info *info;
 	struct avltree_node *found_node;
@@ -169,7 +173,7 @@ static void ng_add(const char *group, const char *host, bool negative)
 	info->ng_group.len = strlen(group) + 1;
 	info->ng_host.addr = gsh_strdup(host);
 	info->ng_host.len = strlen(host) + 1;
-	info->ng_epoch = time(NULL);
+	info->ng_epoch = epoch;
 
 	if (negative) {
 		/* @todo check positive cache first? */
@@ -301,14 +305,64 @@ bool ng_innetgr(const char *group, const char *host)
 	PTHREAD_RWLOCK_wrlock(&ng_lock);
 	rc = innetgr(group, host, NULL, NULL);
 	if (rc)
-		ng_add(group, host, false); /* positive lookup */
+		ng_add(group, host, false, time(NULL)); /* positive lookup */
 	else
-		ng_add(group, host, true); /* negative lookup */
+		ng_add(group, host, true, time(NULL)); /* negative lookup */
 	PTHREAD_RWLOCK_unlock(&ng_lock);
 
 	return rc;
 }
 
+static void ng_save_tree(struct idmapper_snapshot *snapshot,
+			 struct avltree *tree, bool negative)
+{
+	struct avltree_node *node;
+	struct ng_cache_info *info;
+
+	for (node = avltree_first(tree); node != NULL;
+	     node = avltree_next(node)) {
+		if (ng_expired(node))
+			continue;
+		info = avltree_container_of(node, struct ng_cache_info,
+					    ng_node);
+		idmapper_snapshot_add(snapshot,
+				      negative ?
+					      IDMAPPER_SNAPSHOT_NEGATIVE_NETGROUP :
+					      IDMAPPER_SNAPSHOT_NETGROUP,
+				      &info->ng_group, &info->ng_host, 0, NULL,
+				      NULL, 0, info->ng_epoch);
+	}
+}
+
+/**
+ * @brief Add the valid entries of the cache to a warm-restart snapshot
+ */
+void ng_cache_save(struct idmapper_snapshot *snapshot)
+{
+	PTHREAD_RWLOCK_rdlock(&ng_lock);
+	ng_save_tree(snapshot, &pos_ng_tree, false);
+	ng_save_tree(snapshot, &neg_ng_tree, true);
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+}
+
+/**
+ * @brief Restore an entry from a warm-restart snapshot
+ *
+ * @return false if the entry has expired since it was cached.
+ */
+bool ng_cache_restore(const char *group, const char *host, bool negative,
+		      time_t epoch)
+{
+	if (time(NULL) - epoch > NG_TIME_VALIDITY)
+		return false;
+
+	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	ng_add(group, host, negative, epoch);
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	return true;
+}
+
 /**
  * @brief Wipe out the netgroup cache
  */
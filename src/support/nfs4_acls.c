@@ -53,6 +53,12 @@ static hash_parameter_t fsal_acl_hash_config = {
 
 static hash_table_t *fsal_acl_hash;
 
+/* Id of the last ACL entry allocated */
+static uint64_t fsal_acl_next_id;
+
+/* Access decisions memoized by this thread, see nfs4_acl_decision_get() */
+static __thread struct fsal_acl_decision acl_decisions[FSAL_ACL_DECISIONS];
+
 /* hash table functions */
 
 static int fsal_acl_hash_both(hash_parameter_t *hparam,
@@ -87,6 +93,7 @@ fsal_acl_t *nfs4_acl_alloc(void)
 	fsal_acl_t *acl = pool_alloc(fsal_acl_pool);
 
 	PTHREAD_RWLOCK_init(&acl->acl_lock, NULL);
+	acl->id = atomic_inc_uint64_t(&fsal_acl_next_id);
 
 	return acl;
 }
@@ -260,6 +267,78 @@ void nfs4_acl_release_entry(fsal_acl_t *acl)
 	nfs4_acl_free(acl);
 }
 
+/* d1 is a slot, d2 the key being looked up */
+static bool nfs4_acl_decision_match(const struct fsal_acl_decision *d1,
+				    const struct fsal_acl_decision *d2)
+{
+	return d1->acl_id == d2->acl_id && d1->caller_uid == d2->caller_uid &&
+	       d1->caller_gid == d2->caller_gid &&
+	       d1->caller_glen == d2->caller_glen && d1->owner == d2->owner &&
+	       d1->group == d2->group && d1->v4mask == d2->v4mask &&
+	       d1->flags == (d2->flags | FSAL_ACL_DECISION_VALID) &&
+	       memcmp(d1->caller_garray, d2->caller_garray,
+		      d2->caller_glen * sizeof(gid_t)) == 0;
+}
+
+static struct fsal_acl_decision *
+nfs4_acl_decision_slot(const struct fsal_acl_decision *decision)
+{
+	uint64_t hash = (decision->acl_id * 0x9e3779b97f4a7c15ULL) ^
+			((uint64_t)decision->caller_uid << 32) ^
+			((uint64_t)decision->caller_gid << 8) ^
+			decision->caller_glen ^ decision->v4mask ^
+			((uint64_t)decision->owner << 16);
+
+	hash ^= hash >> 29;
+
+	return &acl_decisions[hash & (FSAL_ACL_DECISIONS - 1)];
+}
+
+/**
+ * @brief Look up a memoized access decision
+ *
+ * Decisions are memoized per thread, so this takes no lock.  The caller's
+ * groups are compared, so only callers with up to FSAL_ACL_DECISION_GROUPS
+ * of them may be looked up.
+ *
+ * @param[in,out] decision Key of the decision, filled with the result
+ *                         if found
+ *
+ * @retval true if the decision was found.
+ */
+
+bool nfs4_acl_decision_get(struct fsal_acl_decision *decision)
+{
+	struct fsal_acl_decision *slot = nfs4_acl_decision_slot(decision);
+
+	if (!nfs4_acl_decision_match(slot, decision))
+		return false;
+
+	decision->major = slot->major;
+	decision->allowed = slot->allowed;
+	decision->denied = slot->denied;
+
+	return true;
+}
+
+/**
+ * @brief Memoize an access decision
+ *
+ * The decision replaces whatever this thread had memoized in its slot.
+ * Decisions about ACL entries that were freed are never matched again,
+ * as ACL ids are not reused.
+ *
+ * @param[in] decision Key and result of the decision
+ */
+
+void nfs4_acl_decision_set(const struct fsal_acl_decision *decision)
+{
+	struct fsal_acl_decision *slot = nfs4_acl_decision_slot(decision);
+
+	*slot = *decision;
+	slot->flags |= FSAL_ACL_DECISION_VALID;
+}
+
 int nfs4_acls_init(void)
 {
 	LogDebug(COMPONENT_NFS_V4_ACL, "Initialize NFSv4 ACLs");
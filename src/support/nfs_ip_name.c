@@ -28,6 +28,12 @@
 /**
  * @file    nfs_ip_name.c
  * @brief   The management of the IP/name cache.
+ *
+ * Reverse DNS resolutions are done on a small pool of resolver threads, so
+ * that a slow or unreachable DNS server does not hold worker threads.  A
+ * single resolution is in progress at any time for a given address, and
+ * entries about to expire are resolved again in the background while the
+ * cached name keeps being used.
  */
 
 #include "config.h"
@@ -37,6 +43,8 @@
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "fridgethr.h"
+#include "gsh_list.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -47,6 +55,27 @@
 hash_table_t *ht_ip_name;
 unsigned int expiration_time;
 
+/**
+ * @brief A reverse resolution in progress
+ */
+
+struct ip_name_pending {
+	struct glist_head node; /*< Node in ip_name_pending_list */
+	sockaddr_t addr; /*< Address being resolved */
+	uint32_t refcount; /*< Resolver plus waiters */
+	bool done; /*< Resolution is over */
+	pthread_cond_t cond; /*< Signalled when done */
+};
+
+/* Resolutions in progress, protected by ip_name_pending_lock.  There are
+ * at most as many of them as resolver threads, a list will do.
+ */
+static struct glist_head ip_name_pending_list;
+static pthread_mutex_t ip_name_pending_lock;
+
+/* Pool of resolver threads, NULL if resolutions are synchronous */
+static struct fridgethr *ip_name_fridge;
+
 /**
  * @name Compute the hash value for the entry in IP/name cache
  *
@@ -125,11 +154,132 @@ int display_ip_name_val(struct display_buffer *dspbuf,
 	return display_cat(dspbuf, nfs_ip_name->hostname);
 }
 
+/**
+ * @defgroup config_ipnamemap Structure and defaults for NFS_IP_Name
+ *
+ * @{
+ */
+
+/**
+ * @brief Default index size for IP-Name hash
+ */
+#define PRIME_IP_NAME 17
+
+/**
+ * @brief Default value for ip_name_param.expiration-time
+ */
+#define IP_NAME_EXPIRATION 3600
+
+/**
+ * @brief Default value for ip_name_param.negative_expiration_time
+ */
+#define IP_NAME_NEGATIVE_EXPIRATION 60
+
+/** @} */
+
+/**
+ * @brief NFS_IP_Name configuration stanza
+ */
+
+struct ip_name_cache {
+	/** Configuration for hash table for NFS Name/IP map.
+	    Default index size is PRIME_IP_NAME, settable with
+	    Index_Size. */
+	hash_parameter_t hash_param;
+	/** Expiration time for ip-name mappings.  Defaults to
+	    IP_NAME_Expiration, and settable with Expiration_Time. */
+	uint32_t expiration_time;
+	/** Expiration time for addresses that could not be resolved,
+	    settable with Negative_Expiration_Time. */
+	uint32_t negative_expiration_time;
+	/** Resolve names again this many seconds before they expire,
+	    settable with Refresh_Ahead_Time. */
+	uint32_t refresh_ahead_time;
+	/** Number of resolver threads, 0 to resolve in the requesting
+	    thread.  Settable with Resolver_Threads. */
+	uint32_t resolver_threads;
+	/** What to do with a client that is not resolved yet, settable
+	    with Unresolved_Policy. */
+	uint32_t unresolved_policy;
+	/** Milliseconds to wait for a resolution with the wait policy,
+	    settable with Resolve_Wait_Time. */
+	uint32_t resolve_wait_time;
+};
+
+static struct ip_name_cache ip_name_cache = {
+	.hash_param.hash_func_key = ip_name_value_hash_func,
+	.hash_param.hash_func_rbt = ip_name_rbt_hash_func,
+	.hash_param.compare_key = compare_ip_name,
+	.hash_param.display_key = display_ip_name_key,
+	.hash_param.display_val = display_ip_name_val,
+	.hash_param.flags = HT_FLAG_NONE,
+};
+
+/**
+ * @brief Insert or replace an entry of the IP/name cache
+ *
+ * @param[in] ipaddr   Address to be used as key
+ * @param[in] hostname Hostname of the address
+ * @param[in] resolved false if hostname is the address itself
+ */
+
+static void ip_name_set(sockaddr_t *ipaddr, const char *hostname,
+			bool resolved)
+{
+	struct gsh_buffdesc buffkey;
+	struct gsh_buffdesc buffdata;
+	struct gsh_buffdesc old_key;
+	struct gsh_buffdesc old_data;
+	struct hash_latch latch;
+	nfs_ip_name_t *nfs_ip_name;
+	size_t len = strlen(hostname);
+	hash_error_t hash_rc;
+
+	buffkey.len = sizeof(sockaddr_t);
+	buffkey.addr = gsh_memdup(ipaddr, buffkey.len);
+
+	buffdata.len = sizeof(nfs_ip_name_t) + len + 1;
+	nfs_ip_name = gsh_malloc(buffdata.len);
+	nfs_ip_name->timestamp = time(NULL);
+	nfs_ip_name->resolved = resolved;
+	memcpy(nfs_ip_name->hostname, hostname, len + 1);
+	buffdata.addr = nfs_ip_name;
+
+	hash_rc = hashtable_getlatch(ht_ip_name, &buffkey, NULL, true, &latch);
+
+	if (hash_rc == HASHTABLE_SUCCESS ||
+	    hash_rc == HASHTABLE_ERROR_NO_SUCH_KEY) {
+		/* A refresh replaces the expiring entry */
+		hash_rc = hashtable_setlatched(ht_ip_name, &buffkey, &buffdata,
+					       &latch, true, &old_key,
+					       &old_data);
+	}
+
+	switch (hash_rc) {
+	case HASHTABLE_SUCCESS:
+		break;
+
+	case HASHTABLE_OVERWRITTEN:
+		gsh_free(old_key.addr);
+		gsh_free(old_data.addr);
+		break;
+
+	default:
+		/* This should not happen */
+		LogEvent(COMPONENT_DISPATCH,
+			 "Error %s while adding host %s to cache",
+			 hash_table_err_to_str(hash_rc), hostname);
+		gsh_free(nfs_ip_name);
+		gsh_free(buffkey.addr);
+	}
+}
+
 /**
  *
  * nfs_ip_name_add: adds an entry into IP/name cache.
  *
- * Adds an entry in the duplicate requests cache.
+ * Resolves the address synchronously and adds the result to the IP/name
+ * cache, replacing any previous entry.
  *
  * @param ipaddr[IN]       the ipaddr to be used as key
  * @param hostname[OUT]    the hostname added (found by using getnameinfo)
@@ -142,14 +292,10 @@ int display_ip_name_val(struct display_buffer *dspbuf,
 
 int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t maxsize)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffdata;
-	nfs_ip_name_t *nfs_ip_name = NULL;
 	struct timeval tv0, tv1, dur;
-	int rc, len, size;
+	int rc;
 	char ipstring[SOCK_NAME_MAX];
 	char *hn = hostname;
-	hash_error_t hash_rc;
 
 	gettimeofday(&tv0, NULL);
 
@@ -197,52 +343,93 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t maxsize)
 	 * with the hostname we would cache.
 	 */
 
-	/* I have to keep an integer as key, I will use the pointer
-	 * buffkey->addr for this, this also means that buffkey->len will be 0
+	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
+		 hn);
+
+	/* No matter if we were able to cache or not, we either have a hostname
+	 * or it didn't work, so we will return the hostname from above which is
+	 * already in the caller's buffer.
 	 */
-	buffkey.len = sizeof(sockaddr_t);
-	buffkey.addr = gsh_memdup(ipaddr, buffkey.len);
+	ip_name_set(ipaddr, hn, rc == 0);
 
-	/* Now setup the cached hostname */
-	len = strlen(hn);
-	size = sizeof(nfs_ip_name_t) + len + 1;
+	return IP_NAME_SUCCESS;
+} /* nfs_ip_name_add */
 
-	nfs_ip_name = gsh_malloc(size);
+/**
+ * @brief Look an address up in the IP/name cache
+ *
+ * @param[in]  ipaddr   The ip address requested
+ * @param[out] hostname The hostname
+ * @param[in]  size     Size of hostname
+ * @param[out] refresh  Whether the entry should be resolved again
+ *
+ * @return IP_NAME_SUCCESS, IP_NAME_NOT_FOUND if missing or expired, or
+ *         IP_NAME_INSERT_MALLOC_ERROR if hostname is too small.
+ */
 
-	nfs_ip_name->timestamp = time(NULL);
-	memcpy(nfs_ip_name->hostname, hn, len + 1);
+static int ip_name_cache_get(sockaddr_t *ipaddr, char *hostname, size_t size,
+			     bool *refresh)
+{
+	struct gsh_buffdesc buffkey;
+	struct gsh_buffdesc buffval;
+	struct hash_latch latch;
+	nfs_ip_name_t *nfs_ip_name;
+	char ipstring[SOCK_NAME_MAX];
+	time_t age, validity, ahead;
+	hash_error_t hash_rc;
+	int rc = IP_NAME_SUCCESS;
 
-	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
-		 hn);
+	*refresh = false;
 
-	buffdata.addr = nfs_ip_name;
-	buffdata.len = size;
+	if (!sprint_sockip(ipaddr, ipstring, sizeof(ipstring))) {
+		/* Error in converting socket address into string. */
+		return IP_NAME_NOT_FOUND;
+	}
 
-	/* Multiple threads may try to add the same IP/name to cache. Need to
-	 * return success if we get HASHTABLE_ERROR_KEY_ALREADY_EXISTS
-	 * as return status
-	 */
-	hash_rc = HashTable_Set(ht_ip_name, &buffkey, &buffdata);
+	buffkey.addr = ipaddr;
+	buffkey.len = sizeof(sockaddr_t);
+
+	/* Copy the name out under the latch, a refresh may replace it */
+	hash_rc = hashtable_getlatch(ht_ip_name, &buffkey, &buffval, false,
+				     &latch);
 
-	/* No matter if we were able to cache or not, we either have a hostname
-	 * or it didn't work, so we will return the hostname from above which is
-	 * already in the caller's buffer.
-	 */
 	if (hash_rc != HASHTABLE_SUCCESS) {
-		if (hash_rc != HASHTABLE_ERROR_KEY_ALREADY_EXISTS) {
-			/* This should not happen */
-			LogEvent(COMPONENT_DISPATCH,
-				 "Error %s while adding host %s to cache",
-				 hash_table_err_to_str(hash_rc), hn);
-		}
+		if (hash_rc == HASHTABLE_ERROR_NO_SUCH_KEY)
+			hashtable_releaselatched(ht_ip_name, &latch);
+		LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s",
+			     ipstring);
+		return IP_NAME_NOT_FOUND;
+	}
 
-		/* Release not required allocations */
-		gsh_free(nfs_ip_name);
-		gsh_free(buffkey.addr);
+	nfs_ip_name = buffval.addr;
+	age = time(NULL) - nfs_ip_name->timestamp;
+	validity = nfs_ip_name->resolved ? expiration_time
+					 : ip_name_cache.negative_expiration_time;
+
+	/* Never refresh ahead more than half way through validity */
+	ahead = ip_name_cache.refresh_ahead_time;
+	if (ahead > validity / 2)
+		ahead = validity / 2;
+
+	if (age > validity) {
+		LogFullDebug(COMPONENT_DISPATCH, "Found an expired host %s entry",
+			     nfs_ip_name->hostname);
+		rc = IP_NAME_NOT_FOUND;
+	} else if (strlcpy(hostname, nfs_ip_name->hostname, size) >= size) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Could not return host %s to caller, too big",
+			nfs_ip_name->hostname);
+		rc = IP_NAME_INSERT_MALLOC_ERROR;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
+			     ipstring, nfs_ip_name->hostname);
+		*refresh = ahead > 0 && age >= validity - ahead;
 	}
 
-	return IP_NAME_SUCCESS;
-} /* nfs_ip_name_add */
+	hashtable_releaselatched(ht_ip_name, &latch);
+
+	return rc;
+}
 
 /**
  *
@@ -258,57 +445,204 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t maxsize)
  */
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	nfs_ip_name_t *nfs_ip_name;
-	char ipstring[SOCK_NAME_MAX];
+	bool refresh;
 
-	if (!sprint_sockip(ipaddr, ipstring, sizeof(ipstring))) {
-		/* Error in converting socket address into string. */
-		return IP_NAME_NOT_FOUND;
+	return ip_name_cache_get(ipaddr, hostname, size, &refresh);
+} /* nfs_ip_name_get */
+
+/**
+ * @brief Drop a reference on a pending resolution
+ *
+ * @note The caller must hold ip_name_pending_lock.
+ */
+
+static void ip_name_pending_put(struct ip_name_pending *pending)
+{
+	if (--pending->refcount == 0) {
+		PTHREAD_COND_destroy(&pending->cond);
+		gsh_free(pending);
 	}
+}
 
-	buffkey.addr = ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+/**
+ * @brief Complete a resolution and wake up any waiters
+ */
 
-	if (HashTable_Get(ht_ip_name, &buffkey, &buffval) ==
-	    HASHTABLE_SUCCESS) {
-		nfs_ip_name = buffval.addr;
+static void ip_name_pending_done(struct ip_name_pending *pending)
+{
+	PTHREAD_MUTEX_lock(&ip_name_pending_lock);
+	glist_del(&pending->node);
+	pending->done = true;
+	PTHREAD_COND_broadcast(&pending->cond);
+	ip_name_pending_put(pending);
+	PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+}
 
-		if ((time(NULL) - nfs_ip_name->timestamp) > expiration_time) {
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "Found an expired host %s entry, removing",
-				     nfs_ip_name->hostname);
-			if (HashTable_Del(ht_ip_name, &buffkey, NULL,
-					  &buffval) == HASHTABLE_SUCCESS) {
-				nfs_ip_name = (nfs_ip_name_t *)buffval.addr;
+static void ip_name_resolve_run(struct fridgethr_context *ctx)
+{
+	struct ip_name_pending *pending = ctx->arg;
+	char hostname[NI_MAXHOST];
 
-				LogFullDebug(COMPONENT_DISPATCH,
-					     "Removing cache entry %s->%s",
-					     ipstring, nfs_ip_name->hostname);
+	(void)nfs_ip_name_add(&pending->addr, hostname, sizeof(hostname));
 
-				gsh_free(nfs_ip_name);
+	ip_name_pending_done(pending);
+}
+
+/**
+ * @brief Start resolving an address in the background
+ *
+ * Nothing is started if the address is already being resolved.
+ *
+ * @param[in] ipaddr Address to resolve
+ * @param[in] hold   Return the pending resolution with a reference
+ *
+ * @return The pending resolution if hold, NULL otherwise.
+ */
+
+static struct ip_name_pending *ip_name_resolve_async(sockaddr_t *ipaddr,
+						     bool hold)
+{
+	struct glist_head *glist;
+	struct ip_name_pending *pending;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&ip_name_pending_lock);
+
+	glist_for_each(glist, &ip_name_pending_list) {
+		pending = glist_entry(glist, struct ip_name_pending, node);
+
+		if (cmp_sockaddr(&pending->addr, ipaddr, true)) {
+			if (!hold) {
+				PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+				return NULL;
 			}
-			return IP_NAME_NOT_FOUND;
-		}
 
-		if (strlcpy(hostname, nfs_ip_name->hostname, size) >= size) {
-			LogWarn(COMPONENT_DISPATCH,
-				"Could not return host %s to caller, too big",
-				nfs_ip_name->hostname);
-			return IP_NAME_INSERT_MALLOC_ERROR;
+			pending->refcount++;
+			PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+			return pending;
 		}
+	}
 
-		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
+	pending = gsh_calloc(1, sizeof(struct ip_name_pending));
+	memcpy(&pending->addr, ipaddr, sizeof(sockaddr_t));
+	pending->refcount = hold ? 2 : 1;
+	PTHREAD_COND_init(&pending->cond, NULL);
+	glist_add_tail(&ip_name_pending_list, &pending->node);
+
+	PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+
+	rc = fridgethr_submit(ip_name_fridge, ip_name_resolve_run, pending);
+
+	if (rc != 0) {
+		/* All resolvers are busy, a later request will retry */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Could not schedule address resolution, error %d",
+			 rc);
+		ip_name_pending_done(pending);
+	}
+
+	return hold ? pending : NULL;
+}
+
+/**
+ * @brief Wait for a pending resolution, for at most Resolve_Wait_Time
+ *
+ * @param[in] pending Resolution to wait for, its reference is dropped
+ */
+
+static void ip_name_pending_wait(struct ip_name_pending *pending)
+{
+	struct timespec deadline;
+
+	now(&deadline);
+	timespec_add_nsecs(ip_name_cache.resolve_wait_time * NS_PER_MSEC,
+			   &deadline);
+
+	PTHREAD_MUTEX_lock(&ip_name_pending_lock);
+
+	while (!pending->done) {
+		if (pthread_cond_timedwait(&pending->cond,
+					   &ip_name_pending_lock,
+					   &deadline) == ETIMEDOUT)
+			break;
+	}
+
+	ip_name_pending_put(pending);
+
+	PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+}
+
+/**
+ * @brief Get the hostname of an address without blocking on DNS
+ *
+ * Cached names are returned right away, and resolved again in the
+ * background when they are about to expire.  On a miss the address is
+ * resolved by the resolver threads, and the caller is handled according to
+ * Unresolved_Policy meanwhile.
+ *
+ * @param[in]  ipaddr   The ip address requested
+ * @param[out] hostname The hostname
+ * @param[in]  size     Size of hostname
+ *
+ * @return IP_NAME_SUCCESS if hostname was filled, IP_NAME_PENDING if the
+ *         address is not resolved yet, or an error.
+ */
+
+int nfs_ip_name_lookup(sockaddr_t *ipaddr, char *hostname, size_t size)
+{
+	struct ip_name_pending *pending;
+	bool refresh;
+	int rc;
+
+	rc = ip_name_cache_get(ipaddr, hostname, size, &refresh);
+
+	if (rc == IP_NAME_SUCCESS) {
+		if (refresh && ip_name_fridge != NULL)
+			(void)ip_name_resolve_async(ipaddr, false);
+		return rc;
+	}
+
+	if (rc != IP_NAME_NOT_FOUND)
+		return rc;
 
+	if (ip_name_fridge == NULL) {
+		/* Synchronous resolution */
+		return nfs_ip_name_add(ipaddr, hostname, size);
+	}
+
+	switch (ip_name_cache.unresolved_policy) {
+	case IP_NAME_UNRESOLVED_WAIT:
+		pending = ip_name_resolve_async(ipaddr, true);
+		ip_name_pending_wait(pending);
+
+		rc = ip_name_cache_get(ipaddr, hostname, size, &refresh);
+		if (rc != IP_NAME_NOT_FOUND)
+			return rc;
+		break;
+
+	case IP_NAME_UNRESOLVED_ADDRESS:
+		(void)ip_name_resolve_async(ipaddr, false);
+
+		if (!sprint_sockip(ipaddr, hostname, size))
+			return IP_NAME_INSERT_MALLOC_ERROR;
 		return IP_NAME_SUCCESS;
+
+	case IP_NAME_UNRESOLVED_DENY:
+		(void)ip_name_resolve_async(ipaddr, false);
+		break;
 	}
 
-	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s", ipstring);
+	if (isFullDebug(COMPONENT_DISPATCH)) {
+		char ipstring[SOCK_NAME_MAX];
 
-	return IP_NAME_NOT_FOUND;
-} /* nfs_ip_name_get */
+		if (sprint_sockip(ipaddr, ipstring, sizeof(ipstring)))
+			LogFullDebug(COMPONENT_DISPATCH,
+				     "Address %s is not resolved yet",
+				     ipstring);
+	}
+
+	return IP_NAME_PENDING;
+}
 
 /**
  *
@@ -352,44 +686,14 @@ int nfs_ip_name_remove(sockaddr_t *ipaddr)
 } /* nfs_ip_name_remove */
 
 /**
- * @defgroup config_ipnamemap Structure and defaults for NFS_IP_Name
- *
- * @{
- */
-
-/**
- * @brief Default index size for IP-Name hash
+ * @brief Policies for clients that are not resolved yet
  */
-#define PRIME_IP_NAME 17
-
-/**
- * @brief Default value for ip_name_param.expiration-time
- */
-#define IP_NAME_EXPIRATION 3600
 
-/** @} */
-
-/**
- * @brief NFS_IP_Name configuration stanza
- */
-
-struct ip_name_cache {
-	/** Configuration for hash table for NFS Name/IP map.
-	    Default index size is PRIME_IP_NAME, settable with
-	    Index_Size. */
-	hash_parameter_t hash_param;
-	/** Expiration time for ip-name mappings.  Defaults to
-	    IP_NAME_Expiration, and settable with Expiration_Time. */
-	uint32_t expiration_time;
-};
-
-static struct ip_name_cache ip_name_cache = {
-	.hash_param.hash_func_key = ip_name_value_hash_func,
-	.hash_param.hash_func_rbt = ip_name_rbt_hash_func,
-	.hash_param.compare_key = compare_ip_name,
-	.hash_param.display_key = display_ip_name_key,
-	.hash_param.display_val = display_ip_name_val,
-	.hash_param.flags = HT_FLAG_NONE,
+static struct config_item_list unresolved_policies[] = {
+	CONFIG_LIST_TOK("deny", IP_NAME_UNRESOLVED_DENY),
+	CONFIG_LIST_TOK("wait", IP_NAME_UNRESOLVED_WAIT),
+	CONFIG_LIST_TOK("address", IP_NAME_UNRESOLVED_ADDRESS),
+	CONFIG_LIST_EOL
 };
 
 /**
@@ -401,6 +705,18 @@ static struct config_item ip_name_params[] = {
 		       hash_param.index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60 * 60 * 24, IP_NAME_EXPIRATION,
 		       ip_name_cache, expiration_time),
+	CONF_ITEM_UI32("Negative_Expiration_Time", 1, 60 * 60 * 24,
+		       IP_NAME_NEGATIVE_EXPIRATION, ip_name_cache,
+		       negative_expiration_time),
+	CONF_ITEM_UI32("Refresh_Ahead_Time", 0, 60 * 60 * 24, 300,
+		       ip_name_cache, refresh_ahead_time),
+	CONF_ITEM_UI32("Resolver_Threads", 0, 64, 4, ip_name_cache,
+		       resolver_threads),
+	CONF_ITEM_TOKEN("Unresolved_Policy", IP_NAME_UNRESOLVED_WAIT,
+			unresolved_policies, ip_name_cache,
+			unresolved_policy),
+	CONF_ITEM_UI32("Resolve_Wait_Time", 0, 60 * 1000, 2000,
+		       ip_name_cache, resolve_wait_time),
 	CONFIG_EOL
 };
 
@@ -444,8 +760,30 @@ struct config_block nfs_ip_name = {
  * @return 0 if successful, -1 otherwise
  *
  */
+static void ip_name_cleanup(void)
+{
+	if (ip_name_fridge != NULL) {
+		int rc = fridgethr_sync_command(ip_name_fridge,
+						fridgethr_comm_stop, 120);
+
+		if (rc != 0)
+			LogMajor(COMPONENT_DISPATCH,
+				 "Failed shutting down resolver threads: %d",
+				 rc);
+		fridgethr_destroy(ip_name_fridge);
+		ip_name_fridge = NULL;
+	}
+}
+
+static struct cleanup_list_element ip_name_cleanup_element = {
+	.clean = ip_name_cleanup,
+};
+
 int nfs_Init_ip_name(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 	ht_ip_name = hashtable_init(&ip_name_cache.hash_param);
 
 	if (ht_ip_name == NULL) {
@@ -457,5 +795,31 @@ int nfs_Init_ip_name(void)
 	/* Set the expiration time */
 	expiration_time = ip_name_cache.expiration_time;
 
+	PTHREAD_MUTEX_init(&ip_name_pending_lock, NULL);
+	glist_init(&ip_name_pending_list);
+
+	if (ip_name_cache.resolver_threads == 0)
+		return IP_NAME_SUCCESS;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = ip_name_cache.resolver_threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&ip_name_fridge, "ip_name_resolver", &frp);
+
+	if (rc != 0) {
+		/* Fall back to synchronous resolutions */
+		LogCrit(COMPONENT_INIT,
+			"NFS IP_NAME: Cannot start resolver threads, error %d",
+			rc);
+		ip_name_fridge = NULL;
+		return IP_NAME_SUCCESS;
+	}
+
+	RegisterCleanup(&ip_name_cleanup_element);
+
 	return IP_NAME_SUCCESS;
 } /* nfs_Init_ip_name */
@@ -322,6 +322,16 @@ static struct config_item core_params[] = {
 		       enable_AUTHSTATS),
 	CONF_ITEM_BOOL("Enable_CLNT_AllOps_Stats", false, nfs_core_param,
 		       enable_CLNTALLSTATS),
+	CONF_ITEM_UI32("Slow_Request_Threshold", 0, 3600 * 1000, 1000,
+		       nfs_core_param, slow_request_threshold),
+	CONF_ITEM_UI32("Slow_Request_Log_Size", 1, 65536, 64, nfs_core_param,
+		       slow_request_log_size),
+	CONF_ITEM_UI32("Request_Recorder_Size", 0, 1024, 16, nfs_core_param,
+		       request_recorder_size),
+	CONF_ITEM_BOOL("Enable_Request_Phase_Stats", true, nfs_core_param,
+		       enable_request_phase_stats),
+	CONF_ITEM_BOOL("Enable_Lock_Profiling", false, nfs_core_param,
+		       enable_lock_profiling),
 	CONF_ITEM_BOOL("Short_File_Handle", false, nfs_core_param,
 		       short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7 * 24 * 60 * 60, 30 * 60,
@@ -349,6 +359,8 @@ static struct config_item core_params[] = {
 		       nfs_core_param, readdir_res_size),
 	CONF_ITEM_UI32("Readdir_Max_Count", 32, 1024 * 1024, 1024 * 1024,
 		       nfs_core_param, readdir_max_count),
+	CONF_ITEM_UI32("Readdir_Cache_Size", 0, 1024 * 1024, 0, nfs_core_param,
+		       readdir_cache_size),
 	CONF_ITEM_BOOL("Getattrs_In_Complete_Read", true, nfs_core_param,
 		       getattrs_in_complete_read),
 	CONF_ITEM_BOOL("Enable_malloc_trim", false, nfs_core_param,
@@ -438,6 +450,18 @@ static struct config_item directory_services_params[] = {
 	CONF_ITEM_BOOL("Pwutils_Use_Fully_Qualified_Names", false,
 		       directory_services_param,
 		       pwutils_use_fully_qualified_names),
+	CONF_ITEM_I64("Cache_Refresh_Ahead_Time", 0, INT64_MAX, 60,
+		      directory_services_param, cache_refresh_ahead_time),
+	CONF_ITEM_I64("Cache_Stale_Serve_Time", 0, INT64_MAX, 0,
+		      directory_services_param, cache_stale_serve_time),
+	CONF_ITEM_UI32("Cache_Refresh_Threads", 0, 256, 4,
+		       directory_services_param, cache_refresh_threads),
+	CONF_ITEM_PATH("Cache_Snapshot_Path", 1, MAXPATHLEN, NULL,
+		       directory_services_param, cache_snapshot_path),
+	CONF_ITEM_I64("Cache_Snapshot_Interval", 0, INT64_MAX, 600,
+		      directory_services_param, cache_snapshot_interval),
+	CONF_ITEM_UI64("Cache_Memory_Limit", 0, UINT64_MAX, 0,
+		       directory_services_param, cache_memory_limit),
 	CONFIG_EOL
 };
 
@@ -473,6 +497,7 @@ static struct config_item_list recovery_backend_types[] = {
 	CONFIG_LIST_TOK("rados_kv", RECOVERY_BACKEND_RADOS_KV),
 	CONFIG_LIST_TOK("rados_ng", RECOVERY_BACKEND_RADOS_NG),
 	CONFIG_LIST_TOK("rados_cluster", RECOVERY_BACKEND_RADOS_CLUSTER),
+	CONFIG_LIST_TOK("fs_journal", RECOVERY_BACKEND_FS_JOURNAL),
 	CONFIG_LIST_EOL
 };
 
@@ -0,0 +1,1099 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file support/req_recorder.c
+ * @brief Flight recorder of NFS requests
+ *
+ * Each request carries a timeline in its nfs_request_t: when it was decoded
+ * and authenticated, dispatched to the protocol handler, back from it and
+ * replied to, the NFSv4 operations of the compound and the time spent in
+ * the FSAL.  Once replied to, the timeline is kept in a small ring owned by
+ * the worker thread, so the last few requests of every worker are always
+ * available, and requests slower than Slow_Request_Threshold are also kept
+ * in a global slow request log.
+ *
+ * The rings are only locked by their worker and by DBus readers, so
+ * recording a request costs a few clock reads and a copy of its timeline.
+ *
+ * The time between the marks of the timeline is also accounted to phase
+ * histograms, per NFSv3 procedure or main NFSv4 operation: waiting to be
+ * picked up, decoding, duplicate request cache, execution, of which FSAL
+ * and SAL time, and reply.  Marks are taken with the cycle counter and
+ * each thread only updates its own histograms, without atomics, so that
+ * this may always be on.  Readers add up the histograms of all threads,
+ * Prometheus gets what was accounted since its last scrape.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "fsal.h"
+#include "log.h"
+#include "gsh_list.h"
+#include "gsh_rpc.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#include "nfs_proto_data.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "nfs_convert.h"
+#include "req_recorder.h"
+#include "monitoring.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/**
+ * @brief A request once replied to
+ */
+struct req_record_entry {
+	uint32_t xid; /*< RPC xid */
+	uint32_t prog; /*< RPC program */
+	uint32_t vers; /*< RPC program version */
+	uint32_t proc; /*< RPC procedure */
+	const char *funcname; /*< Name of the procedure */
+	char client[SOCK_NAME_MAX]; /*< Address of the client */
+	int32_t export_id; /*< Export once done, -1 if none */
+	int32_t result; /*< enum nfs_req_result of the request */
+	struct timespec start; /*< Request decoded and authenticated */
+	nsecs_elapsed_t dispatch; /*< From start, to the protocol handler */
+	nsecs_elapsed_t service; /*< From start, back from the handler */
+	nsecs_elapsed_t reply; /*< From start, reply sent */
+	nsecs_elapsed_t fsal_time; /*< Time spent in FSAL calls */
+	uint32_t fsal_calls; /*< Number of FSAL calls */
+	uint32_t num_ops; /*< Operations of the compound */
+	struct req_record_op ops[REQ_RECORD_OPS];
+};
+
+/**
+ * @brief Recent requests of a worker thread
+ */
+struct req_ring {
+	struct glist_head rr_list; /*< Entry in req_rings */
+	pthread_mutex_t rr_lock; /*< Protects the entries */
+	bool rr_owned; /*< Owned by a thread, protected by req_rings_lock */
+	uint32_t rr_next; /*< Next entry to be written */
+	uint32_t rr_count; /*< Entries in use */
+	struct req_record_entry rr_entries[];
+};
+
+static bool recording;
+static nsecs_elapsed_t slow_threshold;
+static uint32_t ring_size;
+
+static pthread_mutex_t req_rings_lock;
+static struct glist_head req_rings;
+static pthread_key_t req_ring_key;
+static __thread struct req_ring *my_ring;
+
+static pthread_mutex_t slow_log_lock;
+static struct req_record_entry *slow_log;
+static uint32_t slow_log_size;
+static uint32_t slow_log_next;
+static uint32_t slow_log_count;
+static uint64_t slow_total;
+
+/**
+ * @brief Buckets of the phase histograms
+ *
+ * Bucket 0 counts durations under 1us, bucket i those under 2^i us and the
+ * last one everything above.
+ */
+#define REQ_PHASE_BUCKETS 24
+
+/**
+ * @brief Histogram of the duration of a phase
+ */
+struct req_phase_histo {
+	uint64_t count; /*< Requests that went through the phase */
+	uint64_t sum; /*< Total time in the phase, in nsecs */
+	uint64_t buckets[REQ_PHASE_BUCKETS];
+};
+
+/* Requests are accounted to their NFSv3 procedure, to the main operation of
+ * their NFSv4 compound, or else to other.
+ */
+#define REQ_PHASE_KEY_V3 0
+#define REQ_PHASE_KEY_V4 (REQ_PHASE_KEY_V3 + NFS_V3_NB_COMMAND)
+#define REQ_PHASE_KEY_OTHER (REQ_PHASE_KEY_V4 + NFS4_OP_LAST_ONE)
+#define REQ_PHASE_KEYS (REQ_PHASE_KEY_OTHER + 1)
+
+static const char *const req_phase_names[REQ_PHASE_COUNT] = {
+	[REQ_PHASE_QUEUE] = "queue",
+	[REQ_PHASE_DECODE] = "decode",
+	[REQ_PHASE_DUPREQ] = "dupreq",
+	[REQ_PHASE_EXECUTE] = "execute",
+	[REQ_PHASE_FSAL] = "fsal",
+	[REQ_PHASE_SAL] = "sal",
+	[REQ_PHASE_REPLY] = "reply",
+};
+
+#define REQ_PHASE_HISTOS (REQ_PHASE_KEYS * REQ_PHASE_COUNT)
+
+/**
+ * @brief Phase histograms of a thread
+ *
+ * Only the owning thread updates them.  A thread only allocates the rows
+ * of the operations it goes through.
+ */
+struct req_phases {
+	struct glist_head rp_list; /*< Entry in req_phases_list */
+	bool rp_owned; /*< Owned by a thread, protected by req_phases_lock */
+	/** REQ_PHASE_COUNT histograms per key, NULL until used */
+	struct req_phase_histo *rp_rows[REQ_PHASE_KEYS];
+};
+
+static bool phase_stats;
+
+static pthread_mutex_t req_phases_lock;
+static struct glist_head req_phases_list;
+static pthread_key_t req_phases_key;
+static __thread struct req_phases *my_phases;
+
+/* Sums at the last reset, and last published to the monitoring, both
+ * REQ_PHASE_HISTOS histograms protected by req_phases_lock.
+ */
+static struct req_phase_histo *phase_base;
+static struct req_phase_histo *phase_published;
+
+/** Conversion of req_cycles() to nsecs, calibrated at startup */
+double req_ns_per_cycle = 1.0;
+
+/**
+ * @brief Give the ring of an exiting thread to the next one
+ */
+static void req_ring_release(void *arg)
+{
+	struct req_ring *ring = arg;
+
+	PTHREAD_MUTEX_lock(&req_rings_lock);
+	ring->rr_owned = false;
+	PTHREAD_MUTEX_unlock(&req_rings_lock);
+}
+
+static struct req_ring *req_ring_get(void)
+{
+	struct glist_head *glist;
+	struct req_ring *ring = NULL;
+	size_t entry_size = sizeof(struct req_record_entry);
+
+	if (my_ring != NULL || ring_size == 0)
+		return my_ring;
+
+	PTHREAD_MUTEX_lock(&req_rings_lock);
+
+	glist_for_each(glist, &req_rings)
+	{
+		ring = glist_entry(glist, struct req_ring, rr_list);
+
+		if (!ring->rr_owned)
+			break;
+
+		ring = NULL;
+	}
+
+	if (ring == NULL) {
+		ring = gsh_calloc(1, sizeof(*ring) + ring_size * entry_size);
+		PTHREAD_MUTEX_init(&ring->rr_lock, NULL);
+		glist_add_tail(&req_rings, &ring->rr_list);
+	}
+
+	ring->rr_owned = true;
+
+	PTHREAD_MUTEX_unlock(&req_rings_lock);
+
+	(void)pthread_setspecific(req_ring_key, ring);
+	my_ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Give the phase histograms of an exiting thread to the next one
+ */
+static void req_phases_release(void *arg)
+{
+	struct req_phases *phases = arg;
+
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+	phases->rp_owned = false;
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+}
+
+static struct req_phases *req_phases_get(void)
+{
+	struct glist_head *glist;
+	struct req_phases *phases = NULL;
+
+	if (my_phases != NULL)
+		return my_phases;
+
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+
+	glist_for_each(glist, &req_phases_list)
+	{
+		phases = glist_entry(glist, struct req_phases, rp_list);
+
+		if (!phases->rp_owned)
+			break;
+
+		phases = NULL;
+	}
+
+	if (phases == NULL) {
+		phases = gsh_calloc(1, sizeof(*phases));
+		glist_add_tail(&req_phases_list, &phases->rp_list);
+	}
+
+	phases->rp_owned = true;
+
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+
+	(void)pthread_setspecific(req_phases_key, phases);
+	my_phases = phases;
+
+	return phases;
+}
+
+static void req_phases_publish(void);
+
+/**
+ * @brief Calibrate req_cycles() against CLOCK_MONOTONIC
+ */
+static void req_cycles_calibrate(void)
+{
+	struct timespec ts0, ts1, delay = { 0, 10 * NS_PER_MSEC };
+	uint64_t c0, c1;
+
+	now_mono(&ts0);
+	c0 = req_cycles();
+	(void)nanosleep(&delay, NULL);
+	now_mono(&ts1);
+	c1 = req_cycles();
+
+	if (c1 > c0)
+		req_ns_per_cycle =
+			(double)timespec_diff(&ts0, &ts1) / (c1 - c0);
+
+	LogInfo(COMPONENT_INIT, "Request phases timed at %.3f ns per cycle",
+		req_ns_per_cycle);
+}
+
+/**
+ * @brief Initialize the flight recorder
+ *
+ * Requests are not recorded at all if the recorder, the slow request log
+ * and the phase statistics are all disabled.
+ */
+void req_recorder_init(void)
+{
+	struct nfs_core_param *param = &nfs_param.core_param;
+
+	PTHREAD_MUTEX_init(&req_rings_lock, NULL);
+	PTHREAD_MUTEX_init(&slow_log_lock, NULL);
+	PTHREAD_MUTEX_init(&req_phases_lock, NULL);
+	glist_init(&req_rings);
+	glist_init(&req_phases_list);
+
+	if (pthread_key_create(&req_ring_key, req_ring_release) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not create key, request recorder disabled");
+		return;
+	}
+
+	ring_size = param->request_recorder_size;
+	slow_threshold = (nsecs_elapsed_t)param->slow_request_threshold *
+			 NS_PER_MSEC;
+
+	if (slow_threshold != 0) {
+		slow_log_size = param->slow_request_log_size;
+		slow_log = gsh_calloc(slow_log_size, sizeof(*slow_log));
+	}
+
+	phase_stats = param->enable_request_phase_stats;
+
+	if (phase_stats &&
+	    pthread_key_create(&req_phases_key, req_phases_release) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not create key, request phase stats disabled");
+		phase_stats = false;
+	}
+
+	if (phase_stats)
+		monitoring_register_collect_hook(req_phases_publish);
+
+	recording = ring_size != 0 || slow_threshold != 0 || phase_stats;
+
+	if (recording)
+		req_cycles_calibrate();
+
+	LogInfo(COMPONENT_INIT,
+		"Request recorder %s, %" PRIu32
+		" requests per worker, slow requests above %" PRIu32 " ms",
+		recording ? "enabled" : "disabled", ring_size,
+		param->slow_request_threshold);
+}
+
+/**
+ * @brief Note that a request reached a point of its processing
+ *
+ * @param[in] reqdata	The request
+ * @param[in] mark	The point reached
+ */
+void req_record_mark(struct nfs_request *reqdata, enum req_record_mark mark)
+{
+	if (recording)
+		reqdata->record.marks[mark] = req_cycles();
+}
+
+/**
+ * @brief Start the timeline of a request
+ *
+ * Called once the request is decoded and authenticated and its
+ * start_time is set.
+ *
+ * @param[in] reqdata	The request
+ */
+void req_record_start(struct nfs_request *reqdata)
+{
+	struct req_record *record = &reqdata->record;
+
+	if (!recording)
+		return;
+
+	record->start = op_ctx->start_time;
+	record->marks[REQ_MARK_START] = req_cycles();
+
+	op_ctx->req_record = record;
+}
+
+static inline struct req_record *req_record_cur(void)
+{
+	if (op_ctx == NULL)
+		return NULL;
+
+	return op_ctx->req_record;
+}
+
+/**
+ * @brief Whether an operation only sets up the ones after it
+ */
+static inline bool req_op_is_prefix(uint32_t opcode)
+{
+	return opcode == NFS4_OP_SEQUENCE || opcode == NFS4_OP_PUTFH ||
+	       opcode == NFS4_OP_PUTROOTFH || opcode == NFS4_OP_PUTPUBFH;
+}
+
+/**
+ * @brief An NFSv4 operation of the request is done
+ *
+ * Only the first REQ_RECORD_OPS operations are kept, the others are only
+ * counted.  The compound is accounted to its first operation past SEQUENCE
+ * and PUTFH.
+ *
+ * @param[in] opcode	The operation
+ * @param[in] name	Name of the operation
+ * @param[in] start	When the operation started
+ * @param[in] status	nfsstat4 of the operation
+ */
+void req_record_op(uint32_t opcode, const char *name,
+		   const struct timespec *start, int status)
+{
+	struct req_record *record = req_record_cur();
+	struct req_record_op *op;
+	struct timespec ts;
+
+	if (record == NULL)
+		return;
+
+	if (record->main_op == 0 || req_op_is_prefix(record->main_op))
+		record->main_op = opcode;
+
+	if (record->num_ops++ >= REQ_RECORD_OPS)
+		return;
+
+	now(&ts);
+
+	op = &record->ops[record->num_ops - 1];
+	op->name = name;
+	op->status = status;
+	op->export_id = op_ctx->ctx_export != NULL ?
+				op_ctx->ctx_export->export_id :
+				-1;
+	op->duration = timespec_diff(start, &ts);
+}
+
+/**
+ * @brief Time between two marks of a request, 0 if either was not reached
+ */
+static inline nsecs_elapsed_t req_record_between(struct req_record *record,
+						 enum req_record_mark from,
+						 enum req_record_mark to)
+{
+	if (record->marks[from] == 0 || record->marks[to] < record->marks[from])
+		return 0;
+
+	return req_cycles_to_ns(record->marks[to] - record->marks[from]);
+}
+
+static void req_record_fill(struct req_record_entry *entry,
+			    struct nfs_request *reqdata, int rc,
+			    nsecs_elapsed_t reply)
+{
+	struct req_record *record = &reqdata->record;
+	uint32_t num_ops = MIN(record->num_ops, REQ_RECORD_OPS);
+
+	entry->xid = reqdata->svc.rq_msg.rm_xid;
+	entry->prog = reqdata->svc.rq_msg.cb_prog;
+	entry->vers = reqdata->svc.rq_msg.cb_vers;
+	entry->proc = reqdata->svc.rq_msg.cb_proc;
+	entry->funcname = reqdata->funcdesc->funcname;
+
+	if (op_ctx->client != NULL)
+		strlcpy(entry->client, op_ctx->client->hostaddr_str,
+			sizeof(entry->client));
+	else
+		strlcpy(entry->client, "<unknown client>",
+			sizeof(entry->client));
+
+	entry->export_id = op_ctx->ctx_export != NULL ?
+				   op_ctx->ctx_export->export_id :
+				   -1;
+	entry->result = rc;
+	entry->start = record->start;
+	entry->dispatch = req_record_between(record, REQ_MARK_START,
+					     REQ_MARK_DISPATCH);
+	entry->service = req_record_between(record, REQ_MARK_START,
+					    REQ_MARK_SERVICE);
+	entry->reply = reply;
+	entry->fsal_time = req_cycles_to_ns(record->fsal_cycles);
+	entry->fsal_calls = record->fsal_calls;
+	entry->num_ops = record->num_ops;
+	memcpy(entry->ops, record->ops, num_ops * sizeof(entry->ops[0]));
+}
+
+/**
+ * @brief Find the histograms a request is accounted to
+ */
+static int req_phase_key(struct nfs_request *reqdata)
+{
+	uint32_t vers = reqdata->svc.rq_msg.cb_vers;
+	uint32_t proc = reqdata->svc.rq_msg.cb_proc;
+	uint32_t main_op = reqdata->record.main_op;
+
+	if (reqdata->svc.rq_msg.cb_prog != nfs_param.core_param.program[P_NFS])
+		return REQ_PHASE_KEY_OTHER;
+
+	if (vers == NFS_V3 && proc < NFS_V3_NB_COMMAND)
+		return REQ_PHASE_KEY_V3 + proc;
+
+	if (vers == NFS_V4 && main_op != 0 && main_op < NFS4_OP_LAST_ONE)
+		return REQ_PHASE_KEY_V4 + main_op;
+
+	return REQ_PHASE_KEY_OTHER;
+}
+
+static void req_phase_key_names(int key, const char **version,
+				const char **op)
+{
+	if (key >= REQ_PHASE_KEY_OTHER) {
+		*version = "other";
+		*op = "other";
+	} else if (key >= REQ_PHASE_KEY_V4) {
+		*version = "nfs4";
+		*op = nfsop4_to_str(key - REQ_PHASE_KEY_V4);
+	} else {
+		*version = "nfs3";
+#ifdef _USE_NFS3
+		*op = nfsproc3_to_str(key - REQ_PHASE_KEY_V3);
+#else
+		*op = "unknown";
+#endif
+	}
+}
+
+static inline void req_phase_observe(struct req_phase_histo *row,
+				     enum req_phase phase,
+				     nsecs_elapsed_t duration)
+{
+	struct req_phase_histo *histo = &row[phase];
+	uint64_t usecs = duration / NS_PER_USEC;
+	int bucket = usecs == 0 ? 0 : 64 - __builtin_clzll(usecs);
+
+	if (bucket >= REQ_PHASE_BUCKETS)
+		bucket = REQ_PHASE_BUCKETS - 1;
+
+	/* Only this thread writes its histograms */
+	histo->count++;
+	histo->sum += duration;
+	histo->buckets[bucket]++;
+}
+
+/**
+ * @brief Account the phases a request went through
+ *
+ * Phases whose marks were not both reached, such as the execution of a
+ * dropped duplicate, are not accounted.
+ */
+static void req_phase_account(struct nfs_request *reqdata)
+{
+	static const enum req_record_mark bounds[][2] = {
+		[REQ_PHASE_QUEUE] = { REQ_MARK_RECEIVED, REQ_MARK_PROCESS },
+		[REQ_PHASE_DECODE] = { REQ_MARK_PROCESS, REQ_MARK_DUPREQ },
+		[REQ_PHASE_DUPREQ] = { REQ_MARK_DUPREQ, REQ_MARK_EXECUTE },
+		[REQ_PHASE_EXECUTE] = { REQ_MARK_EXECUTE, REQ_MARK_SERVICE },
+		[REQ_PHASE_REPLY] = { REQ_MARK_SERVICE, REQ_MARK_REPLY },
+	};
+	struct req_record *record = &reqdata->record;
+	struct req_phases *phases = req_phases_get();
+	int key = req_phase_key(reqdata);
+	struct req_phase_histo *row = phases->rp_rows[key];
+	enum req_phase phase;
+
+	if (row == NULL) {
+		row = gsh_calloc(REQ_PHASE_COUNT, sizeof(*row));
+		atomic_store_voidptr((void **)&phases->rp_rows[key], row);
+	}
+
+	for (phase = 0; phase < REQ_PHASE_COUNT; phase++) {
+		if (phase == REQ_PHASE_FSAL || phase == REQ_PHASE_SAL)
+			continue;
+
+		if (record->marks[bounds[phase][0]] == 0 ||
+		    record->marks[bounds[phase][1]] == 0)
+			continue;
+
+		req_phase_observe(row, phase,
+				  req_record_between(record, bounds[phase][0],
+						     bounds[phase][1]));
+
+		if (phase != REQ_PHASE_EXECUTE)
+			continue;
+
+		req_phase_observe(row, REQ_PHASE_FSAL,
+				  req_cycles_to_ns(record->fsal_cycles));
+		req_phase_observe(row, REQ_PHASE_SAL,
+				  req_cycles_to_ns(record->sal_cycles));
+	}
+}
+
+/**
+ * @brief Add up the phase histograms of all the threads
+ *
+ * The histograms of running threads may be a few requests behind.
+ *
+ * @note req_phases_lock MUST be held
+ *
+ * @param[out] sums	REQ_PHASE_HISTOS histograms, zeroed by the caller
+ */
+static void req_phases_sum(struct req_phase_histo *sums)
+{
+	struct glist_head *glist;
+	struct req_phases *phases;
+	struct req_phase_histo *row, *histo, *sum;
+	int key, phase, i;
+
+	glist_for_each(glist, &req_phases_list)
+	{
+		phases = glist_entry(glist, struct req_phases, rp_list);
+
+		for (key = 0; key < REQ_PHASE_KEYS; key++) {
+			row = atomic_fetch_voidptr(
+				(void **)&phases->rp_rows[key]);
+			if (row == NULL)
+				continue;
+
+			for (phase = 0; phase < REQ_PHASE_COUNT; phase++) {
+				histo = &row[phase];
+				sum = &sums[key * REQ_PHASE_COUNT + phase];
+
+				sum->count += histo->count;
+				sum->sum += histo->sum;
+				for (i = 0; i < REQ_PHASE_BUCKETS; i++)
+					sum->buckets[i] += histo->buckets[i];
+			}
+		}
+	}
+}
+
+static inline uint64_t req_phase_sub(uint64_t val, uint64_t base)
+{
+	return val > base ? val - base : 0;
+}
+
+/**
+ * @brief Remove earlier sums from sums of the phase histograms
+ *
+ * @param[in,out] sums	REQ_PHASE_HISTOS histograms
+ * @param[in] base	REQ_PHASE_HISTOS histograms summed earlier
+ */
+static void req_phases_sub(struct req_phase_histo *sums,
+			   const struct req_phase_histo *base)
+{
+	int h, i;
+
+	for (h = 0; h < REQ_PHASE_HISTOS; h++) {
+		sums[h].count = req_phase_sub(sums[h].count, base[h].count);
+		sums[h].sum = req_phase_sub(sums[h].sum, base[h].sum);
+		for (i = 0; i < REQ_PHASE_BUCKETS; i++)
+			sums[h].buckets[i] = req_phase_sub(sums[h].buckets[i],
+							   base[h].buckets[i]);
+	}
+}
+
+/**
+ * @brief Publish the phase histograms to the monitoring
+ *
+ * Called before each scrape, only what was accounted since the previous
+ * one is added, so requests never look up the labels of the metrics.
+ */
+static void req_phases_publish(void)
+{
+	struct req_phase_histo *sums, *delta;
+	const char *version, *op;
+	int key, phase, h, i;
+
+	sums = gsh_calloc(REQ_PHASE_HISTOS, sizeof(*sums));
+
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+
+	req_phases_sum(sums);
+
+	if (phase_published == NULL)
+		phase_published =
+			gsh_calloc(REQ_PHASE_HISTOS, sizeof(*phase_published));
+
+	/* Keep the sums for the next scrape, publish what changed */
+	req_phases_sub(sums, phase_published);
+	for (h = 0; h < REQ_PHASE_HISTOS; h++) {
+		phase_published[h].count += sums[h].count;
+		phase_published[h].sum += sums[h].sum;
+		for (i = 0; i < REQ_PHASE_BUCKETS; i++)
+			phase_published[h].buckets[i] += sums[h].buckets[i];
+	}
+
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+
+	for (key = 0; key < REQ_PHASE_KEYS; key++) {
+		for (phase = 0; phase < REQ_PHASE_COUNT; phase++) {
+			delta = &sums[key * REQ_PHASE_COUNT + phase];
+			if (delta->count == 0)
+				continue;
+
+			req_phase_key_names(key, &version, &op);
+			monitoring__dynamic_request_phases(
+				version, op, req_phase_names[phase],
+				delta->buckets, REQ_PHASE_BUCKETS, delta->sum);
+		}
+	}
+
+	gsh_free(sums);
+}
+
+/**
+ * @brief The request is replied to, or dropped
+ *
+ * The timeline is copied to the ring of the worker, and to the slow request
+ * log if the request took too long.
+ *
+ * @param[in] reqdata	The request
+ * @param[in] rc	enum nfs_req_result of the request
+ */
+void req_record_done(struct nfs_request *reqdata, int rc)
+{
+	struct req_record *record = req_record_cur();
+	struct req_ring *ring;
+	struct req_record_entry *entry;
+	nsecs_elapsed_t reply;
+
+	if (record == NULL)
+		return;
+
+	op_ctx->req_record = NULL;
+	record->marks[REQ_MARK_REPLY] = req_cycles();
+	reply = req_record_between(record, REQ_MARK_START, REQ_MARK_REPLY);
+
+	if (phase_stats)
+		req_phase_account(reqdata);
+
+	ring = req_ring_get();
+
+	if (ring != NULL) {
+		PTHREAD_MUTEX_lock(&ring->rr_lock);
+
+		entry = &ring->rr_entries[ring->rr_next];
+		req_record_fill(entry, reqdata, rc, reply);
+
+		ring->rr_next = (ring->rr_next + 1) % ring_size;
+		if (ring->rr_count < ring_size)
+			ring->rr_count++;
+
+		PTHREAD_MUTEX_unlock(&ring->rr_lock);
+	}
+
+	if (slow_threshold == 0 || reply < slow_threshold)
+		return;
+
+	PTHREAD_MUTEX_lock(&slow_log_lock);
+
+	entry = &slow_log[slow_log_next];
+	req_record_fill(entry, reqdata, rc, reply);
+
+	slow_log_next = (slow_log_next + 1) % slow_log_size;
+	if (slow_log_count < slow_log_size)
+		slow_log_count++;
+
+	slow_total++;
+
+	PTHREAD_MUTEX_unlock(&slow_log_lock);
+
+	LogEventLimited(COMPONENT_DISPATCH,
+			"Slow request xid=%" PRIu32 " %s from %s took %" PRIu64
+			" ms, dispatch %" PRIu64 " us, service %" PRIu64
+			" us, %" PRIu32 " FSAL calls in %" PRIu64 " us",
+			reqdata->svc.rq_msg.rm_xid,
+			reqdata->funcdesc->funcname,
+			op_ctx->client != NULL ? op_ctx->client->hostaddr_str :
+						 "<unknown client>",
+			reply / NS_PER_MSEC,
+			req_record_between(record, REQ_MARK_START,
+					   REQ_MARK_DISPATCH) /
+				NS_PER_USEC,
+			req_record_between(record, REQ_MARK_START,
+					   REQ_MARK_SERVICE) /
+				NS_PER_USEC,
+			record->fsal_calls,
+			req_cycles_to_ns(record->fsal_cycles) / NS_PER_USEC);
+}
+
+/**
+ * @brief Forget all the recorded requests
+ */
+void req_recorder_reset(void)
+{
+	struct glist_head *glist;
+	struct req_ring *ring;
+
+	PTHREAD_MUTEX_lock(&req_rings_lock);
+
+	glist_for_each(glist, &req_rings)
+	{
+		ring = glist_entry(glist, struct req_ring, rr_list);
+
+		PTHREAD_MUTEX_lock(&ring->rr_lock);
+		ring->rr_next = 0;
+		ring->rr_count = 0;
+		PTHREAD_MUTEX_unlock(&ring->rr_lock);
+	}
+
+	PTHREAD_MUTEX_unlock(&req_rings_lock);
+
+	PTHREAD_MUTEX_lock(&slow_log_lock);
+	slow_log_next = 0;
+	slow_log_count = 0;
+	slow_total = 0;
+	PTHREAD_MUTEX_unlock(&slow_log_lock);
+
+	/* Prometheus histograms are never reset, readers of the phases start
+	 * from the sums as they are now.
+	 */
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+
+	if (phase_base == NULL)
+		phase_base = gsh_calloc(REQ_PHASE_HISTOS, sizeof(*phase_base));
+	else
+		memset(phase_base, 0, REQ_PHASE_HISTOS * sizeof(*phase_base));
+
+	req_phases_sum(phase_base);
+
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+}
+
+/**
+ * @brief Total of a phase over all operations since the last reset
+ *
+ * @param[in]  phase	The phase
+ * @param[out] count	Requests that went through the phase
+ * @param[out] sum	Total time in the phase, in nsecs
+ */
+void req_recorder_phase_total(enum req_phase phase, uint64_t *count,
+			      uint64_t *sum)
+{
+	struct req_phase_histo *sums, *histo;
+	int key;
+
+	sums = gsh_calloc(REQ_PHASE_HISTOS, sizeof(*sums));
+
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+
+	req_phases_sum(sums);
+
+	if (phase_base != NULL)
+		req_phases_sub(sums, phase_base);
+
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+
+	*count = 0;
+	*sum = 0;
+
+	for (key = 0; key < REQ_PHASE_KEYS; key++) {
+		histo = &sums[key * REQ_PHASE_COUNT + phase];
+		*count += histo->count;
+		*sum += histo->sum;
+	}
+
+	gsh_free(sums);
+}
+
+#ifdef USE_DBUS
+
+static void req_record_dbus_entry(DBusMessageIter *iter,
+				  const struct req_record_entry *entry)
+{
+	DBusMessageIter struct_iter, ops_iter, op_iter;
+	const char *str;
+	uint64_t val;
+	uint32_t i, num_ops = MIN(entry->num_ops, REQ_RECORD_OPS);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->xid);
+	str = entry->client;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &str);
+	str = entry->funcname;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &str);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->prog);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->vers);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->proc);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32,
+				       &entry->export_id);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32,
+				       &entry->result);
+	val = entry->start.tv_sec;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = entry->start.tv_nsec;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->dispatch);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->service);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->reply);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->fsal_time);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->fsal_calls);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &entry->num_ops);
+
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(suit)", &ops_iter);
+
+	for (i = 0; i < num_ops; i++) {
+		const struct req_record_op *op = &entry->ops[i];
+
+		dbus_message_iter_open_container(&ops_iter, DBUS_TYPE_STRUCT,
+						 NULL, &op_iter);
+		str = op->name;
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_STRING,
+					       &str);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_UINT32,
+					       &op->status);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_INT32,
+					       &op->export_id);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_UINT64,
+					       &op->duration);
+		dbus_message_iter_close_container(&ops_iter, &op_iter);
+	}
+
+	dbus_message_iter_close_container(&struct_iter, &ops_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the slow request log, oldest first
+ *
+ * @param[in] iter	DBus reply
+ */
+void req_recorder_dbus_slow(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&slow_log_lock);
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64, &slow_total);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 REQ_RECORD_DBUS_TYPE, &array_iter);
+
+	for (i = 0; i < slow_log_count; i++) {
+		uint32_t idx = (slow_log_next + slow_log_size - slow_log_count +
+				i) % slow_log_size;
+
+		req_record_dbus_entry(&array_iter, &slow_log[idx]);
+	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	PTHREAD_MUTEX_unlock(&slow_log_lock);
+}
+
+/**
+ * @brief Report the recent requests of every worker, oldest first
+ *
+ * Entries are copied out of the rings so that workers are not held up
+ * while the reply is built.
+ *
+ * @param[in] iter	DBus reply
+ */
+void req_recorder_dbus_recent(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct glist_head *glist;
+	struct req_ring *ring;
+	struct req_record_entry entry;
+	uint32_t i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 REQ_RECORD_DBUS_TYPE, &array_iter);
+
+	PTHREAD_MUTEX_lock(&req_rings_lock);
+
+	glist_for_each(glist, &req_rings)
+	{
+		ring = glist_entry(glist, struct req_ring, rr_list);
+
+		for (i = 0;; i++) {
+			PTHREAD_MUTEX_lock(&ring->rr_lock);
+
+			if (i >= ring->rr_count) {
+				PTHREAD_MUTEX_unlock(&ring->rr_lock);
+				break;
+			}
+
+			entry = ring->rr_entries[(ring->rr_next + ring_size -
+						  ring->rr_count + i) %
+						 ring_size];
+
+			PTHREAD_MUTEX_unlock(&ring->rr_lock);
+
+			req_record_dbus_entry(&array_iter, &entry);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&req_rings_lock);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the phase histograms
+ *
+ * The upper bounds of the buckets, in usecs, are followed by the histograms
+ * of every phase requests went through.
+ *
+ * @param[in] iter	DBus reply
+ */
+void req_recorder_dbus_phases(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter, bucket_iter;
+	struct req_phase_histo *sums, *histo;
+	const char *version, *op, *phase_name;
+	uint64_t bound;
+	int key, phase, i;
+
+	sums = gsh_calloc(REQ_PHASE_HISTOS, sizeof(*sums));
+
+	PTHREAD_MUTEX_lock(&req_phases_lock);
+
+	req_phases_sum(sums);
+
+	if (phase_base != NULL)
+		req_phases_sub(sums, phase_base);
+
+	PTHREAD_MUTEX_unlock(&req_phases_lock);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "t",
+					 &bucket_iter);
+
+	for (i = 0; i < REQ_PHASE_BUCKETS - 1; i++) {
+		bound = 1ULL << i;
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &bound);
+	}
+
+	dbus_message_iter_close_container(iter, &bucket_iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sssttat)",
+					 &array_iter);
+
+	for (key = 0; key < REQ_PHASE_KEYS; key++) {
+		for (phase = 0; phase < REQ_PHASE_COUNT; phase++) {
+			histo = &sums[key * REQ_PHASE_COUNT + phase];
+			if (histo->count == 0)
+				continue;
+
+			req_phase_key_names(key, &version, &op);
+			phase_name = req_phase_names[phase];
+
+			dbus_message_iter_open_container(
+				&array_iter, DBUS_TYPE_STRUCT, NULL,
+				&struct_iter);
+			dbus_message_iter_append_basic(
+				&struct_iter, DBUS_TYPE_STRING, &version);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_STRING, &op);
+			dbus_message_iter_append_basic(
+				&struct_iter, DBUS_TYPE_STRING, &phase_name);
+			dbus_message_iter_append_basic(
+				&struct_iter, DBUS_TYPE_UINT64, &histo->count);
+			dbus_message_iter_append_basic(
+				&struct_iter, DBUS_TYPE_UINT64, &histo->sum);
+
+			dbus_message_iter_open_container(&struct_iter,
+							 DBUS_TYPE_ARRAY, "t",
+							 &bucket_iter);
+			for (i = 0; i < REQ_PHASE_BUCKETS; i++)
+				dbus_message_iter_append_basic(
+					&bucket_iter, DBUS_TYPE_UINT64,
+					&histo->buckets[i]);
+			dbus_message_iter_close_container(&struct_iter,
+							  &bucket_iter);
+
+			dbus_message_iter_close_container(&array_iter,
+							  &struct_iter);
+		}
+	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(sums);
+}
+#endif /* USE_DBUS */
@@ -467,6 +467,9 @@ static struct group_data *uid2grp_allocate_by_principal(char *principal,
 /**
  * @brief Add a user entry to the cache
  *
+ * On return the caller holds a reference on the entry, whether or not it
+ * was actually added to the cache.
+ *
  * @param[in] group_data user entry with allocated supplementary groups
  */
 static void add_user_groups_to_cache(struct group_data **gdata)
@@ -475,6 +478,7 @@ static void add_user_groups_to_cache(struct group_data **gdata)
 	if (!idmapping_enabled) {
 		LogWarn(COMPONENT_IDMAPPER,
 			"Idmapping is disabled, add-to-cache skipped");
+		uid2grp_hold_group_data(*gdata);
 		return;
 	}
 
@@ -489,6 +493,7 @@ static void add_user_groups_to_cache(struct group_data **gdata)
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 		LogWarn(COMPONENT_IDMAPPER,
 			"Idmapping is disabled, add-to-cache skipped");
+		uid2grp_hold_group_data(*gdata);
 		return;
 	}
 	uid2grp_add_user(*gdata);
@@ -497,57 +502,216 @@ static void add_user_groups_to_cache(struct group_data **gdata)
 }
 
 /**
- * @brief Get supplementary groups given uname
+ * @brief What a user-groups lookup is keyed on
+ */
+struct uid2grp_key {
+	enum idmapper_flight_type type;
+	uid_t uid; /*< For uid lookups, and principal lookups */
+	gid_t gid; /*< For principal lookups */
+	struct gsh_buffdesc name; /*< For name and principal lookups */
+};
+
+static inline const void *uid2grp_key_addr(const struct uid2grp_key *key)
+{
+	return key->type == IDMAPPER_FLIGHT_UID_TO_GROUPS ? (void *)&key->uid
+							  : key->name.addr;
+}
+
+static inline size_t uid2grp_key_len(const struct uid2grp_key *key)
+{
+	return key->type == IDMAPPER_FLIGHT_UID_TO_GROUPS ? sizeof(key->uid)
+							  : key->name.len;
+}
+
+/**
+ * @brief Look a user up in the cache
  *
- * @param[in]  name       The name of the user
- * @param[out] group_data The group data of the user
+ * @param[in]  key     What to look up
+ * @param[out] gdata   Held group data, if usable
+ * @param[out] present Whether an entry, usable or not, is cached
+ * @param[out] refresh Whether the entry should be refreshed
  *
- * @return true if successful, false otherwise
+ * @return true if a usable entry was found.
  */
-bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+static bool uid2grp_cache_get(struct uid2grp_key *key,
+			      struct group_data **gdata, bool *present,
+			      bool *refresh)
 {
-	bool success = false;
-	uid_t uid = -1;
+	uid_t unused_cached_uid = -1;
+	bool usable = false;
 
-	if (!idmapping_enabled) {
-		LogWarn(COMPONENT_IDMAPPER,
-			"Idmapping is disabled, name-to-group skipped");
-		return false;
-	}
+	*refresh = false;
 
 	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
 
-	/* Return success if we find non-expired group-data in cache */
-	if (success && !uid2grp_is_group_data_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	if (key->type == IDMAPPER_FLIGHT_UID_TO_GROUPS)
+		*present = uid2grp_lookup_by_uid(key->uid, gdata);
+	else
+		*present = uid2grp_lookup_by_uname(&key->name,
+						   &unused_cached_uid, gdata);
+
+	if (*present) {
+		usable = idmapper_flight_usable(
+			(*gdata)->epoch,
+			nfs_param.core_param.manage_gids_expiration, refresh);
+		if (usable)
+			uid2grp_hold_group_data(*gdata);
 	}
+
 	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 
-	/* We could not find non-expired group-data in cache, fetch it afresh */
-	*gdata = uid2grp_allocate_by_name(name);
+	return usable;
+}
+
+/**
+ * @brief Fetch the group data of a user from the directory
+ *
+ * @param[in] key What to look up
+ *
+ * @return group_data with fetched groups, or NULL.
+ */
+static struct group_data *uid2grp_allocate(const struct uid2grp_key *key)
+{
+	char *principal;
+
+	switch (key->type) {
+	case IDMAPPER_FLIGHT_UID_TO_GROUPS:
+		return uid2grp_allocate_by_uid(key->uid);
+	case IDMAPPER_FLIGHT_NAME_TO_GROUPS:
+		return uid2grp_allocate_by_name(&key->name);
+	case IDMAPPER_FLIGHT_PRINCIPAL_TO_GROUPS:
+		principal = alloca(key->name.len + 1);
+		memcpy(principal, key->name.addr, key->name.len);
+		principal[key->name.len] = '\0';
+		return uid2grp_allocate_by_principal(principal, key->uid,
+						     key->gid);
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * @brief Refresh a cached user in the background
+ *
+ * Called from the idmapper refresh threads with the key the flight was
+ * started for.
+ */
+static void uid2grp_refresh(enum idmapper_flight_type type, const void *addr,
+			    size_t len)
+{
+	struct uid2grp_key key = { .type = type };
+	struct group_data *gdata;
+	uid_t cached_uid;
+
+	if (type == IDMAPPER_FLIGHT_UID_TO_GROUPS) {
+		memcpy(&key.uid, addr, sizeof(key.uid));
+	} else {
+		key.name.addr = (void *)addr;
+		key.name.len = len;
+	}
+
+	if (type == IDMAPPER_FLIGHT_PRINCIPAL_TO_GROUPS) {
+		/* The ids the principal maps to come from the cached entry */
+		PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
+		if (!uid2grp_lookup_by_uname(&key.name, &cached_uid, &gdata)) {
+			PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+			return;
+		}
+		key.uid = gdata->uid;
+		key.gid = gdata->gid;
+		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	}
+
+	gdata = uid2grp_allocate(&key);
+	if (gdata == NULL)
+		return;
+
+	/* This will also replace the existing cache entry */
+	add_user_groups_to_cache(&gdata);
+	uid2grp_unref(gdata);
+}
+
+/**
+ * @brief Get supplementary groups, from the cache or the directory
+ *
+ * Concurrent misses for the same key are folded into a single directory
+ * lookup, and entries close to or past expiry are refreshed in the
+ * background while they keep being served.
+ *
+ * @param[in]  key   What to look up
+ * @param[out] gdata The group data of the user
+ *
+ * @return true if successful, false otherwise
+ */
+static bool uid2grp_get(struct uid2grp_key *key, struct group_data **gdata)
+{
+	struct idmapper_flight *flight = NULL;
+	bool present, refresh;
+
+	if (uid2grp_cache_get(key, gdata, &present, &refresh)) {
+		if (refresh)
+			idmapper_flight_refresh(key->type,
+						uid2grp_key_addr(key),
+						uid2grp_key_len(key),
+						uid2grp_refresh);
+		return true;
+	}
+
+	if (!idmapper_flight_join(key->type, uid2grp_key_addr(key),
+				  uid2grp_key_len(key), &flight)) {
+		/* Someone else just looked it up, use what they found */
+		return uid2grp_cache_get(key, gdata, &present, &refresh);
+	}
+
+	/* We could not find usable group-data in cache, fetch it afresh */
+	*gdata = uid2grp_allocate(key);
 	if (*gdata) {
 		/* This will also remove existing expired cache entry */
 		add_user_groups_to_cache(gdata);
+		idmapper_flight_land(flight);
 		return true;
 	}
 
 	/*
-	 * At this point, we could not find non-expired group-data in cache,
+	 * At this point, we could not find usable group-data in cache,
 	 * and we also weren't able to fetch fresh group-data.
-	 * If the group-data in cache is expired, we stll want to remove it.
+	 * If the group-data in cache is expired, we still want to remove it.
 	 */
-	if (success) {
+	if (present) {
 		/* Remove expired cache entry */
 		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_expired_by_uname(name);
+		if (key->type == IDMAPPER_FLIGHT_UID_TO_GROUPS)
+			uid2grp_remove_expired_by_uid(key->uid);
+		else
+			uid2grp_remove_expired_by_uname(&key->name);
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 	}
+	idmapper_flight_land(flight);
 	return false;
 }
 
+/**
+ * @brief Get supplementary groups given uname
+ *
+ * @param[in]  name       The name of the user
+ * @param[out] group_data The group data of the user
+ *
+ * @return true if successful, false otherwise
+ */
+bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+{
+	struct uid2grp_key key = { .type = IDMAPPER_FLIGHT_NAME_TO_GROUPS,
+				   .name = *name };
+
+	if (!idmapping_enabled) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Idmapping is disabled, name-to-group skipped");
+		return false;
+	}
+
+	return uid2grp_get(&key, gdata);
+}
+
 /**
  * @brief Get supplementary groups given uid
  *
@@ -558,7 +722,8 @@ bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
  */
 bool uid2grp(uid_t uid, struct group_data **gdata)
 {
-	bool success = false;
+	struct uid2grp_key key = { .type = IDMAPPER_FLIGHT_UID_TO_GROUPS,
+				   .uid = uid };
 
 	if (!idmapping_enabled) {
 		LogWarn(COMPONENT_IDMAPPER,
@@ -566,37 +731,7 @@ bool uid2grp(uid_t uid, struct group_data **gdata)
 		return false;
 	}
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-
-	/* Return success if we find non-expired group-data in cache */
-	if (success && !uid2grp_is_group_data_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
-	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-
-	/* We could not find non-expired group-data in cache, fetch it afresh */
-	*gdata = uid2grp_allocate_by_uid(uid);
-	if (*gdata) {
-		/* This will also remove existing expired cache entry */
-		add_user_groups_to_cache(gdata);
-		return true;
-	}
-
-	/*
-	 * At this point, we could not find non-expired group-data in cache,
-	 * and we also weren't able to fetch fresh group-data.
-	 * If the group-data in cache is expired, we still want to remove it.
-	 */
-	if (success) {
-		/* Remove expired cache entry */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_expired_by_uid(uid);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-	}
-	return false;
+	return uid2grp_get(&key, gdata);
 }
 
 /**
@@ -614,10 +749,12 @@ bool uid2grp(uid_t uid, struct group_data **gdata)
 bool principal2grp(char *principal, struct group_data **gdata, const uid_t uid,
 		   const gid_t gid)
 {
-	bool success = false;
-	uid_t unused_cached_uid = -1;
-	struct gsh_buffdesc princbuff = { .addr = principal,
-					  .len = strlen(principal) };
+	struct uid2grp_key key = { .type = IDMAPPER_FLIGHT_PRINCIPAL_TO_GROUPS,
+				   .uid = uid,
+				   .gid = gid,
+				   .name = { .addr = principal,
+					     .len = strlen(principal) } };
+
 	LogDebug(COMPONENT_IDMAPPER, "Resolve principal %s to groups",
 		 principal);
 
@@ -627,38 +764,7 @@ bool principal2grp(char *principal, struct group_data **gdata, const uid_t uid,
 		return false;
 	}
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success =
-		uid2grp_lookup_by_uname(&princbuff, &unused_cached_uid, gdata);
-
-	/* Return success if we find non-expired group-data in cache */
-	if (success && !uid2grp_is_group_data_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return true;
-	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-
-	/* We could not find non-expired group-data in cache, fetch it afresh */
-	*gdata = uid2grp_allocate_by_principal(principal, uid, gid);
-	if (*gdata) {
-		/* This will also remove existing expired cache entry */
-		add_user_groups_to_cache(gdata);
-		return true;
-	}
-
-	/*
-	 * At this point, we could not find non-expired group-data in cache,
-	 * and we also weren't able to fetch fresh group-data.
-	 * If the group-data in cache is expired, we still want to remove it.
-	 */
-	if (success) {
-		/* Remove expired cache entry */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_expired_by_uname(&princbuff);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-	}
-	return false;
+	return uid2grp_get(&key, gdata);
 }
 
 /*
@@ -44,6 +44,7 @@
 #include "common_utils.h"
 #include "avltree.h"
 #include "uid2grp.h"
+#include "idmapper.h"
 #include "abstract_atomic.h"
 #include "nfs_core.h"
 #include <misc/queue.h>
@@ -500,6 +501,83 @@ void uid2grp_remove_expired_by_uname(const struct gsh_buffdesc *name)
 		uid2grp_remove_user(info);
 }
 
+/**
+ * @brief Add the valid entries of the cache to a warm-restart snapshot
+ *
+ * Entries are saved oldest first, so that restoring them in order keeps
+ * the fifo queue sorted by time validity.
+ *
+ * @param[in] snapshot Snapshot being built
+ */
+
+void uid2grp_cache_save(struct idmapper_snapshot *snapshot)
+{
+	struct cache_info *info;
+	struct group_data *gdata;
+
+	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
+
+	TAILQ_FOREACH(info, &groups_fifo_queue, queue_entry) {
+		gdata = info->gdata;
+		if (uid2grp_is_group_data_expired(gdata))
+			continue;
+		idmapper_snapshot_add(snapshot, IDMAPPER_SNAPSHOT_USER_GROUPS,
+				      &gdata->uname, NULL, gdata->uid,
+				      &gdata->gid, gdata->groups,
+				      gdata->nbgroups, gdata->epoch);
+	}
+
+	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+}
+
+/**
+ * @brief Restore a user entry from a warm-restart snapshot
+ *
+ * @param[in] uname   User name or principal
+ * @param[in] uid     The uid of the user
+ * @param[in] gid     The gid of the user
+ * @param[in] groups  Supplementary groups
+ * @param[in] ngroups Number of supplementary groups
+ * @param[in] epoch   When the entry was cached
+ *
+ * @retval true if the entry was restored.
+ * @retval false if it has expired since.
+ */
+
+bool uid2grp_cache_restore(const struct gsh_buffdesc *uname, uid_t uid,
+			   gid_t gid, const gid_t *groups, int ngroups,
+			   time_t epoch)
+{
+	struct group_data *gdata;
+
+	if (time(NULL) - epoch > nfs_param.core_param.manage_gids_expiration)
+		return false;
+
+	gdata = gsh_malloc(sizeof(struct group_data) + uname->len + 1);
+	gdata->uname.len = uname->len;
+	gdata->uname.addr = (char *)gdata + sizeof(struct group_data);
+	memcpy(gdata->uname.addr, uname->addr, uname->len);
+	((char *)gdata->uname.addr)[uname->len] = '\0';
+	gdata->uid = uid;
+	gdata->gid = gid;
+	gdata->nbgroups = ngroups;
+	if (ngroups > 0) {
+		gdata->groups = gsh_malloc(ngroups * sizeof(gid_t));
+		memcpy(gdata->groups, groups, ngroups * sizeof(gid_t));
+	} else {
+		gdata->groups = NULL;
+	}
+	PTHREAD_MUTEX_init(&gdata->gd_lock, NULL);
+	gdata->epoch = epoch;
+	gdata->refcount = 0;
+
+	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
+	uid2grp_add_user(gdata);
+	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+
+	return true;
+}
+
 /**
  * @brief Wipe out the uid2grp cache
  */